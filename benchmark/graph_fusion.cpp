@@ -0,0 +1,260 @@
+#include "server/graph_fusion.hpp"
+#include "server/graph_type.hpp"
+#include <boost/program_options.hpp>
+#include <boost/optional.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+namespace
+{
+	std::atomic<std::uint64_t> allocations(0);
+}
+
+// counts every allocation of the process so that the stages can be compared by how often they allocate
+void *operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *const allocated = std::malloc(size ? size : 1))
+	{
+		return allocated;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *allocated) noexcept
+{
+	std::free(allocated);
+}
+
+void operator delete(void *allocated, std::size_t) noexcept
+{
+	std::free(allocated);
+}
+
+namespace
+{
+	struct options
+	{
+		unsigned iterations;
+	};
+
+	namespace keys
+	{
+		graph::symbol const first("first");
+		graph::symbol const second("second");
+		graph::symbol const source("source");
+		graph::symbol const build("build");
+		graph::symbol const parallelism("parallelism");
+		graph::symbol const log("log");
+	}
+
+	// the transformations that test/graph.cpp chains by nesting the calls
+	graph::value uint32_add(graph::value v)
+	{
+		graph::listing const &arguments = **Si::try_get_ptr<std::shared_ptr<graph::listing>>(v);
+		return static_cast<std::uint32_t>(*graph::find_entry_of_type<std::uint32_t const>(arguments, keys::first) +
+		                                  *graph::find_entry_of_type<std::uint32_t const>(arguments, keys::second));
+	}
+
+	graph::value uint32_to_le(graph::value v)
+	{
+		std::uint32_t const i32 = *Si::try_get_ptr<std::uint32_t>(v);
+		std::vector<char> le(4);
+		le[0] = static_cast<char>(i32);
+		le[1] = static_cast<char>(i32 >> 8);
+		le[2] = static_cast<char>(i32 >> 16);
+		le[3] = static_cast<char>(i32 >> 24);
+		return graph::blob{std::move(le)};
+	}
+
+	graph::value identity(graph::value v)
+	{
+		return v;
+	}
+
+	// how the examples derive the input of a step from the output of the previous one
+	graph::value copy_and_add(graph::value v, graph::symbol key, graph::value entry)
+	{
+		auto derived = std::make_shared<graph::listing>(**Si::try_get_ptr<std::shared_ptr<graph::listing>>(v));
+		derived->entries.insert(std::make_pair(key, std::move(entry)));
+		return graph::value{std::move(derived)};
+	}
+
+	graph::pipeline_stage add_in_place(graph::type input, graph::type output, graph::symbol key, graph::value entry)
+	{
+		return graph::make_in_place_stage(std::move(input), std::move(output), [key, entry](graph::value &v)
+		                                  {
+			                                  graph::mutable_listing(v).entries.insert(std::make_pair(key, entry));
+			                              });
+	}
+
+	struct measurement
+	{
+		double ns;
+		double allocations;
+	};
+
+	template <class Run>
+	measurement measure(unsigned iterations, Run &&run, std::uint64_t &checksum)
+	{
+		std::uint64_t const allocated_before = allocations.load();
+		auto const started = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			checksum += run(i);
+		}
+		auto const finished = std::chrono::steady_clock::now();
+		return measurement{
+		    static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count()) /
+		        iterations,
+		    static_cast<double>(allocations.load() - allocated_before) / iterations};
+	}
+
+	boost::optional<options> parse_options(int argc, char **argv)
+	{
+		options result;
+		result.iterations = 200000;
+
+		boost::program_options::options_description desc("Allowed options");
+		desc.add_options()("help", "produce help message")(
+		    "iterations,n", boost::program_options::value(&result.iterations), "number of values passed through");
+
+		boost::program_options::variables_map vm;
+		try
+		{
+			boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+			                              vm);
+		}
+		catch (boost::program_options::error const &ex)
+		{
+			std::cerr << ex.what() << '\n' << desc << "\n";
+			return boost::none;
+		}
+
+		boost::program_options::notify(vm);
+
+		if (vm.count("help"))
+		{
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
+		if (result.iterations == 0)
+		{
+			std::cerr << "At least one iteration is required\n";
+			return boost::none;
+		}
+
+		return result;
+	}
+
+	void print(char const *name, measurement const &result)
+	{
+		std::cout << std::left << std::setw(30) << name << std::right << std::setw(14) << result.ns << std::setw(14)
+		          << result.allocations << '\n';
+	}
+}
+
+int main(int argc, char **argv)
+{
+	boost::optional<options> parsed_options = parse_options(argc, argv);
+	if (!parsed_options)
+	{
+		return 1;
+	}
+	std::uint64_t checksum = 0;
+
+	graph::type const pair_type =
+	    graph::make_listing_type({{"first", graph::atomic_type::uint32}, {"second", graph::atomic_type::uint32}});
+	graph::typed_transformation const tf_uint32_add{pair_type, graph::atomic_type::uint32, &uint32_add};
+	graph::typed_transformation const tf_uint32_to_le{graph::atomic_type::uint32, graph::atomic_type::blob,
+	                                                  &uint32_to_le};
+	graph::typed_transformation const tf_id_blob{graph::atomic_type::blob, graph::atomic_type::blob, &identity};
+	auto const make_arguments = [](unsigned i) -> graph::value
+	{
+		auto arguments = std::make_shared<graph::listing>();
+		arguments->entries.reserve(2);
+		arguments->entries.insert(std::make_pair(keys::first, static_cast<std::uint32_t>(i)));
+		arguments->entries.insert(std::make_pair(keys::second, std::uint32_t(500)));
+		return graph::value{std::move(arguments)};
+	};
+	auto const checksum_of_blob = [](graph::value const &result) -> std::uint64_t
+	{
+		return static_cast<unsigned char>(Si::try_get_ptr<graph::blob>(result)->begin()[0]);
+	};
+
+	measurement const nested_arithmetic = measure(
+	    parsed_options->iterations, [&](unsigned i)
+	    {
+		    return checksum_of_blob(
+		        tf_id_blob.transform(tf_uint32_to_le.transform(tf_uint32_add.transform(make_arguments(i)))));
+		},
+	    checksum);
+	graph::typed_transformation const fused_arithmetic =
+	    graph::fuse({graph::make_stage(tf_uint32_add), graph::make_stage(tf_uint32_to_le),
+	                 graph::make_identity_stage(graph::atomic_type::blob)});
+	measurement const fused_arithmetic_result = measure(
+	    parsed_options->iterations, [&](unsigned i)
+	    {
+		    return checksum_of_blob(fused_arithmetic.transform(make_arguments(i)));
+		},
+	    checksum);
+
+	// an environment with a few entries that every step extends by one
+	graph::type const environment_type = graph::make_listing_type({{"first", graph::atomic_type::uint32}});
+	graph::type const with_source =
+	    graph::make_listing_type({{"first", graph::atomic_type::uint32}, {"source", graph::atomic_type::uri}});
+	graph::type const with_build = graph::make_listing_type({{"first", graph::atomic_type::uint32},
+	                                                         {"source", graph::atomic_type::uri},
+	                                                         {"build", graph::atomic_type::uri}});
+	graph::type const with_parallelism = graph::make_listing_type({{"first", graph::atomic_type::uint32},
+	                                                               {"source", graph::atomic_type::uri},
+	                                                               {"build", graph::atomic_type::uri},
+	                                                               {"parallelism", graph::atomic_type::uint32}});
+	graph::value const source = graph::uri{"/tmp/workspace/source.git"};
+	graph::value const build = graph::uri{"/tmp/workspace/build"};
+	graph::value const parallelism = std::uint32_t(4);
+	auto const make_environment = [](unsigned i) -> graph::value
+	{
+		auto environment = std::make_shared<graph::listing>();
+		environment->entries.insert(std::make_pair(keys::first, static_cast<std::uint32_t>(i)));
+		return graph::value{std::move(environment)};
+	};
+	auto const checksum_of_listing = [](graph::value const &result) -> std::uint64_t
+	{
+		return (*Si::try_get_ptr<std::shared_ptr<graph::listing>>(result))->entries.size();
+	};
+
+	measurement const nested_listing = measure(
+	    parsed_options->iterations, [&](unsigned i)
+	    {
+		    return checksum_of_listing(copy_and_add(
+		        copy_and_add(copy_and_add(make_environment(i), keys::source, source), keys::build, build),
+		        keys::parallelism, parallelism));
+		},
+	    checksum);
+	graph::typed_transformation const fused_listing =
+	    graph::fuse({add_in_place(environment_type, with_source, keys::source, source),
+	                 add_in_place(with_source, with_build, keys::build, build),
+	                 add_in_place(with_build, with_parallelism, keys::parallelism, parallelism)});
+	measurement const fused_listing_result = measure(
+	    parsed_options->iterations, [&](unsigned i)
+	    {
+		    return checksum_of_listing(fused_listing.transform(make_environment(i)));
+		},
+	    checksum);
+
+	std::cout << std::left << std::setw(30) << "chain" << std::right << std::setw(14) << "ns" << std::setw(14)
+	          << "allocations" << '\n';
+	std::cout << std::fixed << std::setprecision(1);
+	print("add, to_le, id: nested", nested_arithmetic);
+	print("add, to_le, id: fused", fused_arithmetic_result);
+	print("extend listing: nested", nested_listing);
+	print("extend listing: fused", fused_listing_result);
+	std::cerr << "checksum " << checksum << '\n';
+}
@@ -0,0 +1,261 @@
+#include "server/graph.hpp"
+#include <boost/program_options.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+namespace
+{
+	struct options
+	{
+		unsigned iterations;
+	};
+
+	// the layout graph::listing had before the keys were interned
+	struct map_listing
+	{
+		std::map<Si::noexcept_string, graph::value> entries;
+	};
+
+	// the layout graph::listing had before copies shared their entries
+	struct flat_listing
+	{
+		graph::symbol_map<graph::value> entries;
+	};
+
+	template <class T>
+	T *find_in_map(map_listing &list, Si::noexcept_string const &key)
+	{
+		auto i = list.entries.find(key);
+		if (i == list.entries.end())
+		{
+			return nullptr;
+		}
+		return Si::try_get_ptr<T>(i->second);
+	}
+
+	struct inputs
+	{
+		graph::uri repository;
+		ventura::absolute_path git;
+		ventura::absolute_path cmake;
+		ventura::absolute_path source;
+		ventura::absolute_path build;
+	};
+
+	namespace keys
+	{
+		graph::symbol const repository("repository");
+		graph::symbol const destination("destination");
+		graph::symbol const git("git");
+		graph::symbol const cmake("cmake");
+		graph::symbol const build("build");
+		graph::symbol const parallelism("parallelism");
+	}
+
+	template <class Listing>
+	struct listing_pair
+	{
+		Listing clone;
+		Listing cmake_build;
+	};
+
+	template <class Listing>
+	std::size_t count_entries(listing_pair<Listing> const &listings)
+	{
+		return listings.clone.entries.size() + listings.cmake_build.entries.size();
+	}
+
+	// Copies a large environment and adds the two entries a step needs, like building the input of a step from the
+	// output of the previous one. Returns nanoseconds per derived listing.
+	template <class Listing>
+	double measure_derive(unsigned iterations, std::size_t environment_size, std::uint64_t &checksum)
+	{
+		Listing environment;
+		for (std::size_t i = 0; i < environment_size; ++i)
+		{
+			environment.entries.insert(
+			    std::make_pair(Si::to_noexcept_string("variable" + std::to_string(i)), static_cast<std::uint32_t>(i)));
+		}
+		auto const started = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			Listing derived = environment;
+			derived.entries.insert(std::make_pair(keys::build, std::uint32_t(i)));
+			derived.entries.insert(std::make_pair(keys::parallelism, std::uint32_t(4)));
+			checksum += derived.entries.size();
+		}
+		auto const finished = std::chrono::steady_clock::now();
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count()) /
+		       iterations;
+	}
+
+	struct measurement
+	{
+		double build_ns;
+		double lookup_ns;
+	};
+
+	// Builds the inputs of example_graph::clone and example_graph::cmake_build and reads all of their entries like
+	// the transformations do. The checksum keeps the compiler from removing the lookups.
+	template <class Build, class Lookup>
+	measurement measure(unsigned iterations, Build &&build, Lookup &&lookup, std::uint64_t &checksum)
+	{
+		auto const started = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			checksum += count_entries(build());
+		}
+		auto const built = std::chrono::steady_clock::now();
+		auto listings = build();
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			checksum += lookup(listings);
+		}
+		auto const looked_up = std::chrono::steady_clock::now();
+		double const lookups_per_iteration = 6;
+		return measurement{
+		    static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(built - started).count()) /
+		        iterations,
+		    static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(looked_up - built).count()) /
+		        (iterations * lookups_per_iteration)};
+	}
+
+	boost::optional<options> parse_options(int argc, char **argv)
+	{
+		options result;
+		result.iterations = 200000;
+
+		boost::program_options::options_description desc("Allowed options");
+		desc.add_options()("help", "produce help message")(
+		    "iterations,n", boost::program_options::value(&result.iterations), "number of listings built and queried");
+
+		boost::program_options::variables_map vm;
+		try
+		{
+			boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+			                              vm);
+		}
+		catch (boost::program_options::error const &ex)
+		{
+			std::cerr << ex.what() << '\n' << desc << "\n";
+			return boost::none;
+		}
+
+		boost::program_options::notify(vm);
+
+		if (vm.count("help"))
+		{
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
+		if (result.iterations == 0)
+		{
+			std::cerr << "At least one iteration is required\n";
+			return boost::none;
+		}
+
+		return result;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	boost::optional<options> parsed_options = parse_options(argc, argv);
+	if (!parsed_options)
+	{
+		return 1;
+	}
+
+	inputs const values{graph::uri{"https://github.com/TyRoXx/buildserver.git"},
+	                    *ventura::absolute_path::create("/usr/bin/git"),
+	                    *ventura::absolute_path::create("/usr/bin/cmake"),
+	                    *ventura::absolute_path::create("/tmp/workspace/source.git"),
+	                    *ventura::absolute_path::create("/tmp/workspace/build")};
+	std::uint64_t checksum = 0;
+
+	auto const build_map = [&values]()
+	{
+		listing_pair<map_listing> result;
+		result.clone.entries.insert(std::make_pair("repository", values.repository));
+		result.clone.entries.insert(std::make_pair("git", values.git));
+		result.clone.entries.insert(std::make_pair("destination", values.source));
+		result.cmake_build.entries.insert(std::make_pair("cmake", values.cmake));
+		result.cmake_build.entries.insert(std::make_pair("parallelism", std::uint32_t(4)));
+		result.cmake_build.entries.insert(std::make_pair("build", values.build));
+		return result;
+	};
+
+	measurement const map_result = measure(
+	    parsed_options->iterations, build_map, [](listing_pair<map_listing> &listings) -> std::uint64_t
+	    {
+		    return (find_in_map<graph::uri>(listings.clone, "repository") != nullptr) +
+		           (find_in_map<ventura::absolute_path>(listings.clone, "git") != nullptr) +
+		           (find_in_map<ventura::absolute_path>(listings.clone, "destination") != nullptr) +
+		           (find_in_map<ventura::absolute_path>(listings.cmake_build, "cmake") != nullptr) +
+		           *find_in_map<std::uint32_t>(listings.cmake_build, "parallelism") +
+		           (find_in_map<ventura::absolute_path>(listings.cmake_build, "build") != nullptr);
+		},
+	    checksum);
+
+	auto const build_flat = [&values]()
+	{
+		listing_pair<graph::listing> result;
+		result.clone.entries.insert(std::make_pair(keys::repository, values.repository));
+		result.clone.entries.insert(std::make_pair(keys::git, values.git));
+		result.clone.entries.insert(std::make_pair(keys::destination, values.source));
+		result.cmake_build.entries.insert(std::make_pair(keys::cmake, values.cmake));
+		result.cmake_build.entries.insert(std::make_pair(keys::parallelism, std::uint32_t(4)));
+		result.cmake_build.entries.insert(std::make_pair(keys::build, values.build));
+		return result;
+	};
+
+	measurement const strings_result = measure(
+	    parsed_options->iterations, build_flat, [](listing_pair<graph::listing> &listings) -> std::uint64_t
+	    {
+		    return (graph::find_entry_of_type<graph::uri>(listings.clone, "repository") != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.clone, "git") != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.clone, "destination") != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.cmake_build, "cmake") != nullptr) +
+		           *graph::find_entry_of_type<std::uint32_t>(listings.cmake_build, "parallelism") +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.cmake_build, "build") != nullptr);
+		},
+	    checksum);
+
+	measurement const symbols_result = measure(
+	    parsed_options->iterations, build_flat, [](listing_pair<graph::listing> &listings) -> std::uint64_t
+	    {
+		    return (graph::find_entry_of_type<graph::uri>(listings.clone, keys::repository) != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.clone, keys::git) != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.clone, keys::destination) != nullptr) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.cmake_build, keys::cmake) != nullptr) +
+		           *graph::find_entry_of_type<std::uint32_t>(listings.cmake_build, keys::parallelism) +
+		           (graph::find_entry_of_type<ventura::absolute_path>(listings.cmake_build, keys::build) != nullptr);
+		},
+	    checksum);
+
+	std::cout << std::left << std::setw(24) << "layout" << std::right << std::setw(14) << "build ns" << std::setw(14)
+	          << "lookup ns" << '\n';
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << std::left << std::setw(24) << "std::map" << std::right << std::setw(14) << map_result.build_ns
+	          << std::setw(14) << map_result.lookup_ns << '\n';
+	std::cout << std::left << std::setw(24) << "flat, string keys" << std::right << std::setw(14)
+	          << strings_result.build_ns << std::setw(14) << strings_result.lookup_ns << '\n';
+	std::cout << std::left << std::setw(24) << "flat, interned symbols" << std::right << std::setw(14)
+	          << symbols_result.build_ns << std::setw(14) << symbols_result.lookup_ns << '\n';
+
+	std::size_t const environment_size = 100;
+	double const flat_derive = measure_derive<flat_listing>(parsed_options->iterations, environment_size, checksum);
+	double const shared_derive =
+	    measure_derive<graph::listing>(parsed_options->iterations, environment_size, checksum);
+	std::cout << '\n'
+	          << std::left << std::setw(24) << "layout" << std::right << std::setw(14) << "derive ns"
+	          << "    (copy " << environment_size << " entries, add 2)\n";
+	std::cout << std::left << std::setw(24) << "flat, copied" << std::right << std::setw(14) << flat_derive << '\n';
+	std::cout << std::left << std::setw(24) << "shared entries" << std::right << std::setw(14) << shared_derive << '\n';
+	std::cerr << "checksum " << checksum << '\n';
+}
@@ -0,0 +1,296 @@
+#include "tyroxx-ci/request_handler.hpp"
+#include "nanoweb/admission.hpp"
+#include <silicium/asio/tcp_acceptor.hpp>
+#include <silicium/observable/spawn_observable.hpp>
+#include <silicium/observable/transform.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	struct options
+	{
+		unsigned connections;
+		unsigned requests;
+		unsigned rows;
+		std::size_t max_connections;
+	};
+
+	struct scenario
+	{
+		char const *name;
+		std::string path;
+		std::string headers;
+		char const *expected_status;
+	};
+
+	struct scenario_result
+	{
+		std::vector<std::uint64_t> latencies_ns;
+		std::size_t errors = 0;
+		double seconds = 0;
+	};
+
+	// a registry like that of a tyroxx-ci that has built every branch once, so that there are logs to serve
+	void fill_registry(tyroxx::step_history_registry &registry, unsigned branches)
+	{
+		for (unsigned i = 0; i < branches; ++i)
+		{
+			tyroxx::step_history &step = registry.changed("branch-" + boost::lexical_cast<Si::noexcept_string>(i));
+			step.last_result = (i % 5 == 0) ? tyroxx::build_result::failure : tyroxx::build_result::success;
+			std::vector<char> log;
+			for (unsigned line = 0; line < 200; ++line)
+			{
+				std::string const text = "[" + boost::lexical_cast<std::string>(line) + "/200] Building CXX object\n";
+				log.insert(log.end(), text.begin(), text.end());
+			}
+			step.last_log = nanoweb::precompress("text/plain; charset=utf-8", std::move(log), Z_BEST_COMPRESSION);
+		}
+	}
+
+	bool send_one_request(boost::asio::io_service &io, boost::asio::ip::tcp::endpoint const &server,
+	                      std::string const &request, char const *expected_status, std::vector<char> &response)
+	{
+		boost::asio::ip::tcp::socket socket(io);
+		boost::system::error_code ec;
+		socket.connect(server, ec);
+		if (!!ec)
+		{
+			return false;
+		}
+		boost::asio::write(socket, boost::asio::buffer(request), ec);
+		if (!!ec)
+		{
+			return false;
+		}
+		// nanoweb answers with HTTP/1.0 and closes the connection after the response
+		response.clear();
+		char buffer[4096];
+		for (;;)
+		{
+			std::size_t const received = socket.read_some(boost::asio::buffer(buffer), ec);
+			response.insert(response.end(), buffer, buffer + received);
+			if (!!ec)
+			{
+				break;
+			}
+		}
+		if (ec != boost::asio::error::eof)
+		{
+			return false;
+		}
+		std::string const expected_status_line = std::string("HTTP/1.0 ") + expected_status;
+		return (response.size() >= expected_status_line.size()) &&
+		       std::equal(expected_status_line.begin(), expected_status_line.end(), response.begin());
+	}
+
+	scenario_result run_scenario(boost::asio::ip::tcp::endpoint const &server, scenario const &what,
+	                             options const &options)
+	{
+		std::string const request = "GET " + what.path + " HTTP/1.0\r\nHost: localhost\r\n" + what.headers + "\r\n";
+		std::atomic<unsigned> remaining(options.requests);
+		std::vector<scenario_result> per_client(options.connections);
+		std::vector<std::thread> clients;
+		auto const started = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < options.connections; ++i)
+		{
+			scenario_result &result = per_client[i];
+			clients.emplace_back([&result, &remaining, &server, &request, &what]()
+			                     {
+				                     boost::asio::io_service io;
+				                     std::vector<char> response;
+				                     for (;;)
+				                     {
+					                     unsigned left = remaining.load();
+					                     do
+					                     {
+						                     if (left == 0)
+						                     {
+							                     return;
+						                     }
+					                     } while (!remaining.compare_exchange_weak(left, left - 1));
+					                     auto const request_started = std::chrono::steady_clock::now();
+					                     bool const success =
+					                         send_one_request(io, server, request, what.expected_status, response);
+					                     auto const request_finished = std::chrono::steady_clock::now();
+					                     if (!success)
+					                     {
+						                     ++result.errors;
+						                     continue;
+					                     }
+					                     result.latencies_ns.emplace_back(static_cast<std::uint64_t>(
+					                         std::chrono::duration_cast<std::chrono::nanoseconds>(request_finished -
+					                                                                              request_started)
+					                             .count()));
+				                     }
+				                 });
+		}
+		for (std::thread &client : clients)
+		{
+			client.join();
+		}
+		scenario_result total;
+		total.seconds =
+		    std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - started)
+		        .count();
+		for (scenario_result &client : per_client)
+		{
+			total.latencies_ns.insert(total.latencies_ns.end(), client.latencies_ns.begin(),
+			                          client.latencies_ns.end());
+			total.errors += client.errors;
+		}
+		std::sort(total.latencies_ns.begin(), total.latencies_ns.end());
+		return total;
+	}
+
+	double percentile_us(std::vector<std::uint64_t> const &sorted_ns, double fraction)
+	{
+		if (sorted_ns.empty())
+		{
+			return 0;
+		}
+		std::size_t const index = (std::min)(sorted_ns.size() - 1,
+		                                     static_cast<std::size_t>(static_cast<double>(sorted_ns.size()) * fraction));
+		return static_cast<double>(sorted_ns[index]) / 1000.0;
+	}
+
+	boost::optional<options> parse_options(int argc, char **argv)
+	{
+		options result;
+		result.connections = 64;
+		result.requests = 20000;
+		result.rows = 50;
+		result.max_connections = 256;
+
+		boost::program_options::options_description desc("Allowed options");
+		desc.add_options()("help", "produce help message")(
+		    "connections,c", boost::program_options::value(&result.connections),
+		    "number of clients sending requests at the same time")(
+		    "requests,n", boost::program_options::value(&result.requests), "number of requests per scenario")(
+		    "rows", boost::program_options::value(&result.rows), "number of branches known to the server")(
+		    "max-connections", boost::program_options::value(&result.max_connections),
+		    "clients beyond this number are shed by the server with 503, as in tyroxx-ci");
+
+		boost::program_options::variables_map vm;
+		try
+		{
+			boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).run(),
+			                              vm);
+		}
+		catch (boost::program_options::error const &ex)
+		{
+			std::cerr << ex.what() << '\n' << desc << "\n";
+			return boost::none;
+		}
+
+		boost::program_options::notify(vm);
+
+		if (vm.count("help"))
+		{
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
+		if (result.connections == 0)
+		{
+			std::cerr << "At least one connection is required\n";
+			return boost::none;
+		}
+
+		if (result.max_connections == 0)
+		{
+			std::cerr << "The server has to admit at least one connection\n";
+			return boost::none;
+		}
+
+		return result;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	boost::optional<options> parsed_options = parse_options(argc, argv);
+	if (!parsed_options)
+	{
+		return 1;
+	}
+
+	boost::asio::io_service io;
+	tyroxx::step_history_registry registry;
+	fill_registry(registry, parsed_options->rows);
+	std::size_t notifications = 0;
+	Si::noexcept_string const secret = "secret";
+	nanoweb::request_handler const root_request_handler =
+	    tyroxx::make_root_request_handler(secret,
+	                                      [&notifications](tyroxx::push_notification)
+	                                      {
+		                                      // the build queue is not part of what is measured
+		                                      ++notifications;
+		                                      return true;
+		                                  },
+	                                      registry);
+	nanoweb::admission_control admission(
+	    nanoweb::admission_limits{parsed_options->max_connections, std::chrono::seconds(10), std::chrono::seconds(10)});
+
+	boost::asio::ip::tcp::acceptor acceptor(
+	    io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+	boost::asio::ip::tcp::endpoint const server = acceptor.local_endpoint();
+	Si::spawn_observable(Si::transform(
+	    Si::asio::make_tcp_acceptor(std::move(acceptor)),
+	    [&root_request_handler, &admission](Si::asio::tcp_acceptor_result maybe_client) -> Si::nothing
+	    {
+		    std::shared_ptr<boost::asio::ip::tcp::socket> client = maybe_client.get();
+		    admission.admit(std::move(client), root_request_handler,
+		                    [](boost::asio::ip::tcp::socket &, boost::system::error_code)
+		                    {
+			                });
+		    return {};
+		}));
+
+	std::thread server_thread([&io]()
+	                          {
+		                          io.run();
+		                      });
+
+	std::string const gzip = "Accept-Encoding: gzip, deflate\r\n";
+	scenario const scenarios[] = {{"overview", "/", "", "200"},
+	                              {"overview gz", "/", gzip, "200"},
+	                              {"status", "/status.json", gzip, "200"},
+	                              {"log gz", "/log/branch-1", gzip, "200"},
+	                              {"metrics", "/metrics", "", "200"},
+	                              {"not found", "/does/not/exist", "", "404"},
+	                              {"notify", "/notify?secret&branch=feature%2Fx&commit=abcdef0", "", "200"},
+	                              {"bad notify", "/notify?secret&branch=-x", "", "400"}};
+
+	std::cout << std::left << std::setw(12) << "scenario" << std::right << std::setw(10) << "requests"
+	          << std::setw(8) << "errors" << std::setw(12) << "req/s" << std::setw(12) << "p50 us" << std::setw(12)
+	          << "p99 us" << std::setw(12) << "p999 us" << '\n';
+	for (scenario const &what : scenarios)
+	{
+		scenario_result const result = run_scenario(server, what, *parsed_options);
+		std::cout << std::left << std::setw(12) << what.name << std::right << std::setw(10)
+		          << result.latencies_ns.size() << std::setw(8) << result.errors << std::setw(12) << std::fixed
+		          << std::setprecision(0) << (static_cast<double>(result.latencies_ns.size()) / result.seconds)
+		          << std::setw(12) << std::setprecision(1) << percentile_us(result.latencies_ns, 0.5)
+		          << std::setw(12) << percentile_us(result.latencies_ns, 0.99) << std::setw(12)
+		          << percentile_us(result.latencies_ns, 0.999) << '\n';
+	}
+
+	io.stop();
+	server_thread.join();
+	nanoweb::admission_counters const &counters = admission.counters();
+	std::cout << "connections accepted " << counters.accepted << ", shed " << counters.shed << ", timed out "
+	          << counters.timed_out << ", notifications " << notifications << '\n';
+}
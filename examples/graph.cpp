@@ -1,9 +1,12 @@
-#include "server/graph.hpp"
+#include "server/graph_executor.hpp"
 #include "nanoweb/nanoweb.hpp"
 #include "server/find_cmake.hpp"
 #include "server/find_executable.hpp"
 #include "server/find_git.hpp"
 #include "server/cmake.hpp"
+#include "server/action_cache.hpp"
+#include "server/graph_remote.hpp"
+#include "server/trace.hpp"
 #include <silicium/asio/tcp_acceptor.hpp>
 #include <silicium/asio/writing_observable.hpp>
 #include <silicium/asio/posting_observable.hpp>
@@ -26,10 +29,16 @@
 #include <boost/program_options.hpp>
 #include <boost/optional.hpp>
 #include <boost/range/algorithm/equal.hpp>
+#include <boost/system/system_error.hpp>
 #include <boost/thread.hpp>
 #include <unordered_map>
+#include <initializer_list>
+#include <algorithm>
+#include <cstdlib>
 #include <functional>
+#include <fstream>
 #include <iostream>
+#include <memory>
 
 namespace
 {
@@ -213,12 +222,18 @@ namespace
 		boost::uint16_t port;
 		Si::noexcept_string secret;
 		ventura::absolute_path workspace;
+		ventura::absolute_path action_cache;
+		boost::uint16_t worker_port;
+		std::string worker_address;
+		Si::noexcept_string worker_secret;
 	};
 
 	boost::optional<options> parse_options(int argc, char **argv)
 	{
 		options result;
 		result.port = 8080;
+		result.worker_port = 0;
+		result.worker_address = "127.0.0.1";
 
 		boost::program_options::options_description desc("Allowed options");
 		desc.add_options()("help", "produce help message")(
@@ -226,7 +241,16 @@ namespace
 		    "port,p", boost::program_options::value(&result.port), "port to listen on for POSTed push notifications")(
 		    "secret,s", boost::program_options::value(&result.secret),
 		    "a string that needs to be in the query for the notification to be accepted")(
-		    "workspace,w", boost::program_options::value(&result.workspace), "");
+		    "workspace,w", boost::program_options::value(&result.workspace), "")(
+		    "action-cache,c", boost::program_options::value(&result.action_cache),
+		    "a directory in which the outputs of CMake are kept to skip steps whose inputs did not change")(
+		    "listen-workers", boost::program_options::value(&result.worker_port),
+		    "port for build machines running server-cli --worker that take over the builds; they have to see the "
+		    "workspace under the same path")(
+		    "listen-workers-address", boost::program_options::value(&result.worker_address),
+		    "the address on which the port for workers is opened, only this machine can connect by default")(
+		    "worker-secret", boost::program_options::value(&result.worker_secret),
+		    "a string that workers have to send to be given builds, required with --listen-workers");
 
 		boost::program_options::positional_options_description positional;
 		positional.add("repository", 1);
@@ -267,6 +291,13 @@ namespace
 			return boost::none;
 		}
 
+		if ((result.worker_port != 0) && result.worker_secret.empty())
+		{
+			std::cerr << "Missing option value --worker-secret\n";
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
 		return std::move(result);
 	}
 
@@ -314,6 +345,38 @@ namespace
 
 namespace example_graph
 {
+	namespace keys
+	{
+		// interned once so that building and reading the listings only compares pointers
+		graph::symbol const repository("repository");
+		graph::symbol const destination("destination");
+		graph::symbol const git("git");
+		graph::symbol const cmake("cmake");
+		graph::symbol const source("source");
+		graph::symbol const build("build");
+		graph::symbol const parallelism("parallelism");
+		graph::symbol const output("output");
+		graph::symbol const log("log");
+		graph::symbol const action("action");
+	}
+
+	Si::noexcept_string to_key_string(Si::os_string const &value)
+	{
+		return Si::noexcept_string(value.begin(), value.end());
+	}
+
+	// CMake finds the compilers through these variables and the PATH, so a change of the toolchain changes the key of
+	// every cached step.
+	void describe_toolchain(buildserver::action_description &action, ventura::absolute_path const &cmake_exe)
+	{
+		action.inputs["cmake"] = buildserver::format_hex(buildserver::hash_file(cmake_exe.to_boost_path())).c_str();
+		for (char const *variable : {"PATH", "CC", "CXX", "CFLAGS", "CXXFLAGS", "LDFLAGS"})
+		{
+			char const *const value = std::getenv(variable);
+			action.inputs[Si::noexcept_string("environment:") + variable] = value ? value : "";
+		}
+	}
+
 	Si::variant<graph::input_type_mismatch, graph::value> clone(graph::value input)
 	{
 		auto *const input_listing = Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
@@ -321,19 +384,19 @@ namespace example_graph
 		{
 			return graph::input_type_mismatch{};
 		}
-		auto *const repository = graph::find_entry_of_type<graph::uri>(**input_listing, "repository");
+		auto *const repository = graph::find_entry_of_type<graph::uri>(**input_listing, keys::repository);
 		if (!repository)
 		{
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const destination =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "destination");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::destination);
 		if (!destination)
 		{
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const git_exe =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "git");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::git);
 		if (!git_exe)
 		{
 			return graph::input_type_mismatch{};
@@ -344,12 +407,13 @@ namespace example_graph
 		          *git_exe, output_sink);
 
 		graph::listing results;
-		results.entries.insert(std::make_pair("output", graph::blob{std::move(output)}));
-		results.entries.insert(std::make_pair("destination", *destination));
+		results.entries.insert(std::make_pair(keys::output, graph::blob{std::move(output)}));
+		results.entries.insert(std::make_pair(keys::destination, *destination));
 		return graph::value{Si::to_shared(std::move(results))};
 	}
 
-	Si::variant<graph::input_type_mismatch, graph::value> cmake_generate(graph::value input)
+	Si::variant<graph::input_type_mismatch, graph::value> cmake_generate(graph::value input,
+	                                                                     buildserver::action_cache *cache)
 	{
 		auto *const input_listing = Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
 		if (!input_listing)
@@ -357,38 +421,102 @@ namespace example_graph
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const cmake_exe =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "cmake");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::cmake);
 		if (!cmake_exe)
 		{
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const source =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "source");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::source);
 		if (!source)
 		{
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const build =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "build");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::build);
 		if (!build)
 		{
 			return graph::input_type_mismatch{};
 		}
 
-		buildserver::cmake_exe cmake(*cmake_exe);
-		std::vector<char> output;
-		auto output_sink = Si::virtualize_sink(Si::make_container_sink(output));
 		boost::unordered_map<Si::os_string, Si::os_string> definitions; // TODO
-		boost::system::error_code error = cmake.generate(*source, *build, definitions, output_sink);
-		assert(!error); // TODO
+		std::vector<char> output;
+
+		// The key is passed on to the build so that a change of the sources invalidates the build, too. The paths are
+		// part of it because CMake writes them into the build directory.
+		Si::optional<buildserver::sha256_digest> action;
+		if (cache)
+		{
+			buildserver::action_description description;
+			description.tool = "cmake_generate";
+			describe_toolchain(description, *cmake_exe);
+			description.inputs["source_tree"] =
+			    buildserver::format_hex(buildserver::hash_directory_tree(source->to_boost_path(), {".git"})).c_str();
+			description.inputs["source"] = to_key_string(to_os_string(*source));
+			description.inputs["build"] = to_key_string(to_os_string(*build));
+			for (auto const &definition : definitions)
+			{
+				description.inputs["definition:" + to_key_string(definition.first)] = to_key_string(definition.second);
+			}
+			action = buildserver::hash_action(description);
+		}
+
+		Si::optional<std::vector<char>> restored_output;
+		if (action)
+		{
+			restored_output = cache->restore(*action, build->to_boost_path());
+		}
+		if (restored_output)
+		{
+			output = std::move(*restored_output);
+		}
+		else
+		{
+			buildserver::cmake_exe cmake(*cmake_exe);
+			auto output_sink = Si::virtualize_sink(Si::make_container_sink(output));
+			boost::system::error_code const error = cmake.generate(*source, *build, definitions, output_sink);
+			if (error)
+			{
+				boost::throw_exception(boost::system::system_error(error));
+			}
+			if (action)
+			{
+				cache->store(*action, build->to_boost_path(), Si::make_memory_range(output));
+			}
+		}
+
+		std::vector<char> action_key;
+		if (action)
+		{
+			std::string const hex = buildserver::format_hex(*action);
+			action_key.assign(hex.begin(), hex.end());
+		}
 
 		graph::listing results;
-		results.entries.insert(std::make_pair("output", graph::blob{std::move(output)}));
-		results.entries.insert(std::make_pair("build", *build));
+		results.entries.insert(std::make_pair(keys::output, graph::blob{std::move(output)}));
+		results.entries.insert(std::make_pair(keys::build, *build));
+		results.entries.insert(std::make_pair(keys::action, graph::blob{std::move(action_key)}));
 		return graph::value{Si::to_shared(std::move(results))};
 	}
 
-	Si::variant<graph::input_type_mismatch, graph::value> cmake_build(graph::value input)
+	// passes the log on while keeping a copy for the action cache
+	struct recording_sink
+	{
+		typedef char element_type;
+		typedef Si::success error_type;
+
+		graph::byte_stream_sink *destination;
+		std::vector<char> *recorded;
+
+		error_type append(Si::iterator_range<char const *> data)
+		{
+			recorded->insert(recorded->end(), data.begin(), data.end());
+			return destination->append(data);
+		}
+	};
+
+	Si::variant<graph::input_type_mismatch, graph::value> cmake_build(graph::value input,
+	                                                                  buildserver::action_cache *cache)
 	{
 		auto *const input_listing = Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
 		if (!input_listing)
@@ -396,35 +524,200 @@ namespace example_graph
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const cmake_exe =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "cmake");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::cmake);
 		if (!cmake_exe)
 		{
 			return graph::input_type_mismatch{};
 		}
 		ventura::absolute_path const *const build =
-		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, "build");
+		    graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::build);
 		if (!build)
 		{
 			return graph::input_type_mismatch{};
 		}
 		std::uint32_t const *const parallelism =
-		    graph::find_entry_of_type<std::uint32_t>(**input_listing, "parallelism");
+		    graph::find_entry_of_type<std::uint32_t>(**input_listing, keys::parallelism);
 		if (!parallelism)
 		{
 			return graph::input_type_mismatch{};
 		}
+		std::shared_ptr<graph::byte_stream> const *const log =
+		    graph::find_entry_of_type<std::shared_ptr<graph::byte_stream>>(**input_listing, keys::log);
+		if (!log)
+		{
+			return graph::input_type_mismatch{};
+		}
+		graph::blob const *const configuration = graph::find_entry_of_type<graph::blob>(**input_listing, keys::action);
+		if (!configuration)
+		{
+			return graph::input_type_mismatch{};
+		}
 
-		buildserver::cmake_exe cmake(*cmake_exe);
-		std::vector<char> output;
-		auto output_sink = Si::virtualize_sink(Si::make_container_sink(output));
-		boost::system::error_code error = cmake.build(*build, *parallelism, output_sink);
-		assert(!error); // TODO
+		// The generate step leaves the key empty when it did not compute one. The parallelism does not change the
+		// result, so it is not part of the key and builds with different numbers of jobs share their outputs.
+		Si::optional<buildserver::sha256_digest> action;
+		if (cache && (configuration->size() != 0))
+		{
+			buildserver::action_description description;
+			description.tool = "cmake_build";
+			describe_toolchain(description, *cmake_exe);
+			description.inputs["configuration"] = Si::noexcept_string(configuration->begin(), configuration->end());
+			action = buildserver::hash_action(description);
+		}
+
+		// the compiler output is passed on while the build is still running instead of being collected first
+		graph::byte_stream_sink log_sink(*log, 64 * 1024);
+		try
+		{
+			Si::optional<std::vector<char>> restored_log;
+			if (action)
+			{
+				restored_log = cache->restore(*action, build->to_boost_path());
+			}
+			if (restored_log)
+			{
+				// replayed, so that a hit cannot be told apart from a build by the readers of the log
+				log_sink.append(
+				    Si::make_iterator_range(restored_log->data(), restored_log->data() + restored_log->size()));
+			}
+			else
+			{
+				std::vector<char> recorded;
+				auto output_sink = Si::virtualize_sink(recording_sink{&log_sink, &recorded});
+				buildserver::cmake_exe cmake(*cmake_exe);
+				boost::system::error_code const error = cmake.build(*build, *parallelism, output_sink);
+				if (error)
+				{
+					boost::throw_exception(boost::system::system_error(error));
+				}
+				if (action)
+				{
+					cache->store(*action, build->to_boost_path(), Si::make_memory_range(recorded));
+				}
+			}
+			log_sink.flush();
+		}
+		catch (...)
+		{
+			(*log)->fail(std::current_exception());
+			throw;
+		}
+		(*log)->close();
 
 		graph::listing results;
-		results.entries.insert(std::make_pair("output", graph::blob{std::move(output)}));
-		results.entries.insert(std::make_pair("build", *build));
+		results.entries.insert(std::make_pair(keys::build, *build));
 		return graph::value{Si::to_shared(std::move(results))};
 	}
+
+	// Consumes a build log while it is being written. The build directory is only requested so that this node starts
+	// after the same step as the build: a reader of a stream that is never written to would wait forever.
+	Si::variant<graph::input_type_mismatch, graph::value> count_warnings(graph::value input)
+	{
+		auto *const input_listing = Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
+		if (!input_listing)
+		{
+			return graph::input_type_mismatch{};
+		}
+		std::shared_ptr<graph::byte_stream> const *const log =
+		    graph::find_entry_of_type<std::shared_ptr<graph::byte_stream>>(**input_listing, keys::log);
+		if (!log || !graph::find_entry_of_type<ventura::absolute_path>(**input_listing, keys::build))
+		{
+			return graph::input_type_mismatch{};
+		}
+		static char const needle[] = "warning:";
+		std::size_t const needle_size = sizeof(needle) - 1;
+		graph::byte_stream::reader reader = graph::byte_stream::open_reader(*log);
+		std::uint32_t warnings = 0;
+
+		// the end of the previous chunk in case a match is split between two chunks
+		std::string carry;
+		for (;;)
+		{
+			Si::optional<graph::blob> const chunk = reader.read();
+			if (!chunk)
+			{
+				break;
+			}
+			carry.append(chunk->begin(), chunk->end());
+			for (std::size_t found = carry.find(needle); found != std::string::npos;
+			     found = carry.find(needle, found + needle_size))
+			{
+				++warnings;
+			}
+			if (carry.size() >= needle_size)
+			{
+				carry.erase(0, carry.size() - (needle_size - 1));
+			}
+		}
+		return graph::value{warnings};
+	}
+
+	graph::typed_transformation clone_transformation()
+	{
+		return graph::typed_transformation{
+		    graph::make_listing_type({{"repository", graph::atomic_type::uri},
+		                              {"git", graph::atomic_type::absolute_path},
+		                              {"destination", graph::atomic_type::absolute_path}}),
+		    graph::make_listing_type(
+		        {{"output", graph::atomic_type::blob}, {"destination", graph::atomic_type::absolute_path}}),
+		    [](graph::value input)
+		    {
+			    return graph::expect_value(clone(std::move(input)));
+			}};
+	}
+
+	// the steps are run every time if cache is null
+	graph::typed_transformation cmake_generate_transformation(buildserver::action_cache *cache)
+	{
+		return graph::typed_transformation{
+		    graph::make_listing_type({{"cmake", graph::atomic_type::absolute_path},
+		                              {"source", graph::atomic_type::absolute_path},
+		                              {"build", graph::atomic_type::absolute_path}}),
+		    graph::make_listing_type({{"output", graph::atomic_type::blob},
+		                              {"build", graph::atomic_type::absolute_path},
+		                              {"action", graph::atomic_type::blob}}),
+		    [cache](graph::value input)
+		    {
+			    return graph::expect_value(cmake_generate(std::move(input), cache));
+			}};
+	}
+
+	graph::typed_transformation cmake_build_transformation(buildserver::action_cache *cache)
+	{
+		return graph::typed_transformation{
+		    graph::make_listing_type({{"cmake", graph::atomic_type::absolute_path},
+		                              {"parallelism", graph::atomic_type::uint32},
+		                              {"build", graph::atomic_type::absolute_path},
+		                              {"log", graph::atomic_type::stream},
+		                              {"action", graph::atomic_type::blob}}),
+		    graph::make_listing_type({{"build", graph::atomic_type::absolute_path}}),
+		    [cache](graph::value input)
+		    {
+			    return graph::expect_value(cmake_build(std::move(input), cache));
+			}};
+	}
+
+	// The build step that server-cli --worker offers. It neither streams the log nor uses the action cache of the
+	// coordinator.
+	graph::typed_transformation remote_cmake_build_transformation(graph::remote_executor &workers)
+	{
+		return graph::remote_transformation(workers, "cmake_build",
+		                                    graph::make_listing_type({{"cmake", graph::atomic_type::absolute_path},
+		                                                              {"build", graph::atomic_type::absolute_path},
+		                                                              {"parallelism", graph::atomic_type::uint32}}),
+		                                    graph::atomic_type::absolute_path);
+	}
+
+	graph::typed_transformation count_warnings_transformation()
+	{
+		return graph::typed_transformation{
+		    graph::make_listing_type(
+		        {{"log", graph::atomic_type::stream}, {"build", graph::atomic_type::absolute_path}}),
+		    graph::atomic_type::uint32, [](graph::value input)
+		    {
+			    return graph::expect_value(count_warnings(std::move(input)));
+			}};
+	}
 }
 
 int main(int argc, char **argv)
@@ -450,6 +743,35 @@ int main(int argc, char **argv)
 	}
 
 	boost::asio::io_service io;
+	// the warning counter blocks a thread while it waits for the build log, so there have to be at least two
+	graph::work_stealing_pool pool((std::max)(2u, boost::thread::hardware_concurrency()));
+
+	// kept between builds so that the executor knows which steps are slow
+	graph::duration_history durations(std::chrono::seconds(1));
+
+	// the workspace is deleted before every build, so the cache has to be somewhere else
+	std::unique_ptr<buildserver::action_cache> cache;
+	if (!parsed_options->action_cache.empty())
+	{
+		cache.reset(new buildserver::action_cache(parsed_options->action_cache.to_boost_path()));
+	}
+
+	// builds run on a connected worker if there is one and on this machine otherwise
+	std::unique_ptr<graph::remote_executor> workers;
+	if (parsed_options->worker_port != 0)
+	{
+		boost::system::error_code error;
+		boost::asio::ip::address const address =
+		    boost::asio::ip::address::from_string(parsed_options->worker_address, error);
+		if (error)
+		{
+			std::cerr << "Invalid option value --listen-workers-address: " << parsed_options->worker_address << '\n';
+			return 1;
+		}
+		workers.reset(new graph::remote_executor(boost::asio::ip::tcp::endpoint(address, parsed_options->worker_port),
+		                                         parsed_options->worker_secret));
+		std::cerr << "Listening for workers on " << workers->local_endpoint() << '\n';
+	}
 
 	saturating_notifier<Si::erased_observer<notification>> notifier;
 	step_history_registry registry;
@@ -479,7 +801,8 @@ int main(int argc, char **argv)
 	{
 		step_history &history = step.second;
 		Si::spawn_coroutine(
-		    [&history, &notifier, &io, &parsed_options, &maybe_git, &maybe_cmake](Si::spawn_context yield)
+		    [&history, &notifier, &io, &pool, &durations, &cache, &workers, &parsed_options, &maybe_git,
+		     &maybe_cmake](Si::spawn_context yield)
 		    {
 			    for (;;)
 			    {
@@ -502,31 +825,77 @@ int main(int argc, char **argv)
 						                        workspace / *ventura::path_segment::create("source.git");
 						                    ventura::absolute_path const build_dir =
 						                        workspace / *ventura::path_segment::create("build");
-
-						                    graph::listing clone_input;
-						                    clone_input.entries.insert(
-						                        std::make_pair("repository", graph::uri{parsed_options->repository}));
-						                    clone_input.entries.insert(std::make_pair("git", *maybe_git));
-						                    clone_input.entries.insert(std::make_pair("destination", source_dir));
-						                    graph::value clone_output = expect_value(
-						                        example_graph::clone(Si::to_shared(std::move(clone_input))));
-
 						                    boost::filesystem::create_directories(build_dir.to_boost_path());
 
-						                    graph::listing generate_input;
-						                    generate_input.entries.insert(std::make_pair("cmake", *maybe_cmake));
-						                    generate_input.entries.insert(std::make_pair("source", source_dir));
-						                    generate_input.entries.insert(std::make_pair("build", build_dir));
-						                    graph::value generate_output = expect_value(example_graph::cmake_generate(
-						                        Si::to_shared(std::move(generate_input))));
-
-						                    graph::listing build_input;
-						                    build_input.entries.insert(std::make_pair("cmake", *maybe_cmake));
-						                    build_input.entries.insert(
-						                        std::make_pair("parallelism", static_cast<std::uint32_t>(4)));
-						                    build_input.entries.insert(std::make_pair("build", build_dir));
-						                    graph::value build_output = expect_value(
-						                        example_graph::cmake_build(Si::to_shared(std::move(build_input))));
+						                    // the nodes only wait for the entries they actually consume, so
+						                    // independent steps added here later will overlap on the pool
+						                    graph::dag build_graph;
+						                    graph::node_id const cloned = build_graph.add_node(
+						                        example_graph::clone_transformation(),
+						                        {{"repository",
+						                          graph::constant{graph::uri{parsed_options->repository}}},
+						                         {"git", graph::constant{*maybe_git}},
+						                         {"destination", graph::constant{source_dir}}},
+						                        "git_clone");
+						                    graph::node_id const generated = build_graph.add_node(
+						                        example_graph::cmake_generate_transformation(cache.get()),
+						                        {{"cmake", graph::constant{*maybe_cmake}},
+						                         {"source", graph::dependency{cloned, "destination"}},
+						                         {"build", graph::constant{build_dir}}},
+						                        "cmake_generate");
+						                    std::vector<graph::node_id> wanted;
+						                    if (workers && (workers->worker_count() > 0))
+						                    {
+							                    wanted.emplace_back(build_graph.add_node(
+							                        example_graph::remote_cmake_build_transformation(*workers),
+							                        {{"cmake", graph::constant{*maybe_cmake}},
+							                         {"parallelism", graph::constant{static_cast<std::uint32_t>(4)}},
+							                         {"build", graph::dependency{generated, "build"}}},
+							                        "cmake_build"));
+						                    }
+						                    else
+						                    {
+							                    // count_warnings is the one reader of the log, and it has to
+							                    // see the start of the build even if it opens late
+							                    auto const build_log =
+							                        std::make_shared<graph::byte_stream>(1024 * 1024, 1);
+							                    graph::node_id const built = build_graph.add_node(
+							                        example_graph::cmake_build_transformation(cache.get()),
+							                        {{"cmake", graph::constant{*maybe_cmake}},
+							                         {"parallelism", graph::constant{static_cast<std::uint32_t>(4)}},
+							                         {"build", graph::dependency{generated, "build"}},
+							                         {"log", graph::constant{build_log}},
+							                         {"action", graph::dependency{generated, "action"}}},
+							                        "cmake_build");
+							                    graph::node_id const warnings = build_graph.add_node(
+							                        example_graph::count_warnings_transformation(),
+							                        {{"log", graph::constant{build_log}},
+							                         {"build", graph::dependency{generated, "build"}}},
+							                        "count_warnings");
+							                    // only these outputs and what they depend on are computed; the
+							                    // build writes the log that the warnings are counted in
+							                    wanted.emplace_back(built);
+							                    wanted.emplace_back(warnings);
+						                    }
+						                    buildserver::trace_recorder trace(16 * 1024);
+						                    std::vector<graph::value> results;
+						                    {
+							                    buildserver::trace_scope const tracing(&trace);
+							                    results = graph::evaluate(build_graph, wanted, pool, &durations);
+						                    }
+						                    std::vector<char> trace_json;
+						                    trace.write_chrome_trace(trace_json);
+						                    ventura::absolute_path const trace_file =
+						                        workspace / *ventura::path_segment::create("trace.json");
+						                    std::ofstream(trace_file.to_boost_path().string(), std::ios::binary)
+						                        .write(trace_json.data(),
+						                               static_cast<std::streamsize>(trace_json.size()));
+						                    std::cerr << "Trace for chrome://tracing: " << trace_file << '\n';
+						                    if (results.size() > 1)
+						                    {
+							                    std::cerr << "Compiler warnings: "
+							                              << *Si::try_get_ptr<std::uint32_t>(results[1]) << '\n';
+						                    }
 
 						                    return build_result::success;
 						                })));
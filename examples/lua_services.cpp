@@ -1,108 +1,240 @@
+#include "server/dag_runner.hpp"
+#include "server/file_io.hpp"
+#include "server/history_journal.hpp"
+#include "server/lua_pipeline.hpp"
+#include "server/timer_wheel.hpp"
 #include <boost/asio/io_service.hpp>
-#include <luacpp/register_any_function.hpp>
 #include <luacpp/load.hpp>
-#include <boost/range/algorithm/equal.hpp>
-#include <boost/asio/steady_timer.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdlib>
+#include <vector>
 
 namespace buildserver
 {
-	struct scoped_temporary_directory : private boost::noncopyable
+	// Many delays share the ticks of one timer_wheel, so restarting a delay for every input of a timeout only relinks
+	// an entry of the wheel.
+	struct delay : process
 	{
-		boost::filesystem::path where;
-		std::function<void(boost::filesystem::path const &)> on_obsoletion;
+		explicit delay(steady_timer_wheel &timers, steady_timer_wheel::clock::duration amount, shared_result output)
+		    : m_timers(timers)
+		    , m_amount(amount)
+		    , m_output(std::move(output))
+		    , m_armed(0)
+		{
+		}
 
-		scoped_temporary_directory(boost::filesystem::path where,
-		                           std::function<void(boost::filesystem::path const &)> on_obsoletion)
-		    : where(std::move(where))
-		    , on_obsoletion(std::move(on_obsoletion))
+		~delay()
 		{
+			m_timers.cancel(m_armed);
 		}
 
-		~scoped_temporary_directory() BOOST_NOEXCEPT
+		// reuses the delay for the next input
+		void restart(shared_result output)
 		{
-			if (on_obsoletion)
-			{
-				return;
-			}
-			on_obsoletion(where);
+			m_output = std::move(output);
 		}
-	};
 
-	struct memory_blob
-	{
-		std::vector<char> content;
+		virtual void async_get_result(std::function<void(shared_result)> result_handler) SILICIUM_OVERRIDE
+		{
+			shared_result output = m_output;
+			m_armed = m_timers.expires_from_now(m_amount, [result_handler, output]()
+			                                    {
+				                                    std::cerr << "timer elapsed\n";
+				                                    result_handler(output);
+				                                });
+			std::cerr << "timer started\n";
+		}
+
+	private:
+		steady_timer_wheel &m_timers;
+		steady_timer_wheel::clock::duration m_amount;
+		shared_result m_output;
+		timer_wheel::handle m_armed;
 	};
 
-	struct failure_description
+	// Calls a step that the scripts of the workers have exported with the input and produces its return value. The
+	// result handler is called on the thread of io.
+	struct lua_map : process
 	{
-		Si::noexcept_string message;
-	};
+		explicit lua_map(boost::asio::io_service &io, lua_worker_pool &workers, std::string function,
+		                 shared_result input)
+		    : m_io(io)
+		    , m_workers(workers)
+		    , m_function(std::move(function))
+		    , m_input(std::move(input))
+		{
+		}
 
-	typedef Si::fast_variant<failure_description, std::shared_ptr<scoped_temporary_directory>, memory_blob>
-	    process_result;
+		virtual void async_get_result(std::function<void(shared_result)> result_handler) SILICIUM_OVERRIDE
+		{
+			boost::asio::io_service &io = m_io;
+			std::string const function = m_function;
+			shared_result const input = m_input;
 
-	struct process
+			// io.run() must not return while the result is being computed on another thread
+			auto const pending = std::make_shared<boost::asio::io_service::work>(io);
+
+			m_workers.post([&io, function, input, result_handler, pending](lua_pipeline_host &host)
+			               {
+				               lua_State &state = host.state();
+				               int const stack_size = lua_gettop(&state);
+				               shared_result output;
+				               if (!host.push_step(function))
+				               {
+					               output = std::make_shared<process_result const>(
+					                   failure_description{"the Lua step has not been exported"});
+				               }
+				               else
+				               {
+					               push_result(state, *input);
+					               if (lua_pcall(&state, 1, 1, 0) == 0)
+					               {
+						               output = pop_result(state);
+					               }
+					               else
+					               {
+						               char const *const message = lua_tostring(&state, -1);
+						               output = std::make_shared<process_result const>(
+						                   failure_description{message ? message : "unknown Lua error"});
+					               }
+				               }
+				               lua_settop(&state, stack_size);
+				               io.post([result_handler, output, pending]()
+				                       {
+					                       result_handler(output);
+					                   });
+				           });
+		}
+
+	private:
+		boost::asio::io_service &m_io;
+		lua_worker_pool &m_workers;
+		std::string m_function;
+		shared_result m_input;
+	};
+
+	// produces a result that is known already
+	struct ready : process
 	{
-		virtual ~process()
+		explicit ready(boost::asio::io_service &io, shared_result output)
+		    : m_io(io)
+		    , m_output(std::move(output))
 		{
 		}
-		virtual void async_get_result(std::function<void(process_result)> result_handler) = 0;
-	};
 
-	typedef std::function<std::unique_ptr<process>(process_result const &)> step;
+		virtual void async_get_result(std::function<void(shared_result)> result_handler) SILICIUM_OVERRIDE
+		{
+			shared_result output = m_output;
+			m_io.post([result_handler, output]()
+			          {
+				          result_handler(output);
+				      });
+		}
+
+	private:
+		boost::asio::io_service &m_io;
+		shared_result m_output;
+	};
 
-	struct dag_node
+	// Passes a blob on only if it differs from the last one that the step with this ID has passed on, including in
+	// earlier runs of the server. The journal is read and written on the thread of history_io, so the disk does not
+	// stall the other steps on the thread of io. That thread also orders the lookup and the append of each input.
+	struct persistent_filter : process
 	{
-		step value;
-		std::vector<std::unique_ptr<dag_node>> edges;
-
-		dag_node()
+		explicit persistent_filter(boost::asio::io_service &io, boost::asio::io_service &history_io,
+		                           history_journal &history, std::string id, shared_result input)
+		    : m_io(io)
+		    , m_history_io(history_io)
+		    , m_history(history)
+		    , m_id(std::move(id))
+		    , m_input(std::move(input))
 		{
 		}
 
-		explicit dag_node(step value)
-		    : value(std::move(value))
+		virtual void async_get_result(std::function<void(shared_result)> result_handler) SILICIUM_OVERRIDE
 		{
+			boost::asio::io_service &io = m_io;
+			history_journal &history = m_history;
+			std::string const id = m_id;
+			shared_result const input = m_input;
+
+			// io.run() must not return while the journal is being accessed on another thread
+			auto const pending = std::make_shared<boost::asio::io_service::work>(io);
+
+			m_history_io.post([&io, &history, id, input, result_handler, pending]()
+			                  {
+				                  // the step only creates filters for blobs
+				                  memory_blob const &current = *Si::try_get_ptr<memory_blob>(*input);
+				                  shared_result output;
+				                  try
+				                  {
+					                  Si::memory_range const step(id.data(), id.data() + id.size());
+					                  Si::optional<std::vector<char>> const last = history.latest(step);
+					                  if (!last || (*last != current.content))
+					                  {
+						                  history.append(step, Si::make_memory_range(current.content));
+						                  output = input;
+					                  }
+				                  }
+				                  catch (std::exception const &ex)
+				                  {
+					                  output = std::make_shared<process_result const>(failure_description{ex.what()});
+				                  }
+				                  io.post([result_handler, output, pending]()
+				                          {
+					                          result_handler(output);
+					                      });
+				              });
 		}
+
+	private:
+		boost::asio::io_service &m_io;
+		boost::asio::io_service &m_history_io;
+		history_journal &m_history;
+		std::string m_id;
+		shared_result m_input;
 	};
 
-	struct delay : process
+	// the step of history.persistent_filter
+	inline step make_persistent_filter(boost::asio::io_service &io, boost::asio::io_service &history_io,
+	                                   history_journal &history, std::string id)
 	{
-		explicit delay(boost::asio::io_service &io, boost::asio::steady_timer::duration amount, process_result output)
-		    : m_timer(io)
-		    , m_amount(amount)
-		    , m_output(std::move(output))
+		return [&io, &history_io, &history, id](shared_result const &input,
+		                                        std::unique_ptr<process>) -> std::unique_ptr<process>
+		{
+			if (!Si::try_get_ptr<memory_blob>(*input))
+			{
+				return nullptr;
+			}
+			return Si::make_unique<persistent_filter>(io, history_io, history, id, input);
+		};
+	}
+
+	// Runs the handlers that are posted to jobs on a thread of its own until it is destroyed.
+	struct background_thread : private boost::noncopyable
+	{
+		boost::asio::io_service jobs;
+
+		background_thread()
+		    : m_keep_running(new boost::asio::io_service::work(jobs))
+		    , m_thread([this]()
+		               {
+			               jobs.run();
+			           })
 		{
 		}
 
-		virtual void async_get_result(std::function<void(process_result)> result_handler) SILICIUM_OVERRIDE
-		{
-			m_timer.expires_from_now(m_amount);
-			auto &output = m_output;
-			m_timer.async_wait([
-				result_handler,
-				output
-#if SILICIUM_COMPILER_HAS_EXTENDED_CAPTURE
-				= std::move(output)
-#endif
-			](boost::system::error_code ec) mutable
-			                   {
-				                   if (!ec)
-				                   {
-					                   result_handler(failure_description{"A timer failed on the system level: " +
-					                                                      Si::to_noexcept_string(ec.message())});
-					                   return;
-				                   }
-				                   std::cerr << "timer elapsed\n";
-				                   result_handler(std::move(output));
-				               });
-			std::cerr << "timer started\n";
+		// finishes the jobs that were posted already
+		~background_thread()
+		{
+			m_keep_running.reset();
+			m_thread.join();
 		}
 
 	private:
-		boost::asio::steady_timer m_timer;
-		boost::asio::steady_timer::duration m_amount;
-		process_result m_output;
+		std::unique_ptr<boost::asio::io_service::work> m_keep_running;
+		boost::thread m_thread;
 	};
 }
 
@@ -110,109 +242,127 @@ namespace
 {
 	struct step_a : buildserver::process
 	{
-		explicit step_a(boost::asio::io_service &io, buildserver::process_result input)
+		explicit step_a(boost::asio::io_service &io, buildserver::shared_result input)
 		    : m_io(&io)
 		    , m_input(std::move(input))
 		{
 		}
 
-		virtual void async_get_result(std::function<void(buildserver::process_result)> result_handler) SILICIUM_OVERRIDE
+		virtual void async_get_result(std::function<void(buildserver::shared_result)> result_handler) SILICIUM_OVERRIDE
 		{
 			std::cerr << "Step A\n";
 			m_io->post([result_handler]()
 			           {
-				           result_handler(buildserver::memory_blob{});
+				           result_handler(
+				               std::make_shared<buildserver::process_result const>(buildserver::memory_blob{}));
 				       });
 		}
 
 	private:
 		boost::asio::io_service *m_io;
-		buildserver::process_result m_input;
+		buildserver::shared_result m_input;
 	};
 
-	void run_experiment()
+	// The cache of the current user. Bytecode must not be loaded from a directory that other users can write to.
+	boost::filesystem::path user_cache_directory()
 	{
-		auto lua_state = lua::create_lua();
-		lua::stack_value script =
-		    lua::load_file(*lua_state, boost::filesystem::path(__FILE__).parent_path() / "lua_services.lua").value();
-		script.release();
-		lua::stack_array script_main = lua::pcall(*lua_state, 0, 1);
-		if (script_main.size() != 1)
-		{
-			return;
-		}
-		lua::stack s(*lua_state);
-		lua::stack_value require = lua::register_any_function(
-		    s, [](Si::memory_range name, Si::memory_range version, lua_State &stack) -> lua::stack_value
-		    {
-			    if (boost::range::equal(name, Si::make_c_str_range("steps")) &&
-			        boost::range::equal(version, Si::make_c_str_range("1.0")))
-			    {
-				    lua::stack_value module = lua::create_table(stack);
-				    lua::stack s(stack);
-				    module.set("map", lua::register_any_function(s, [](lua::any_local start)
-				                                                 {
-					                                             }));
-				    module.set("sequence", lua::register_any_function(s, [](lua::any_local elements)
-				                                                      {
-					                                                  }));
-				    return module;
-			    }
-			    return lua::push_nil(stack);
-			});
-		script_main.release();
-		require.release();
-		lua::stack_array main_results = lua::pcall(*lua_state, 1, 1);
+		char const *const cache_home = std::getenv("XDG_CACHE_HOME");
+		if (cache_home && *cache_home)
+		{
+			return boost::filesystem::path(cache_home) / "buildserver";
+		}
+		char const *const home = std::getenv("HOME");
+		if (!home || !*home)
+		{
+			throw std::runtime_error("neither XDG_CACHE_HOME nor HOME is set");
+		}
+		return boost::filesystem::path(home) / ".cache" / "buildserver";
 	}
-}
 
-void handle_input(buildserver::dag_node const &start, buildserver::process_result const &input)
-{
-	std::unique_ptr<buildserver::process> started = start.value(input);
-	if (!started)
+	boost::filesystem::path example_script(char const *name)
 	{
-		std::cerr << "input ignored\n";
-		return;
+		return boost::filesystem::path(__FILE__).parent_path() / name;
+	}
+
+	void run_experiment(buildserver::lua_bytecode_cache &cache, buildserver::lua_pipeline_host &host,
+	                    lua_State &compiler)
+	{
+		boost::filesystem::path const script = example_script("lua_services.lua");
+		host.run(cache.get(compiler, script), script.string());
 	}
-	std::shared_ptr<buildserver::process> started_copyable(std::move(started));
-	started_copyable->async_get_result([&start, started_copyable](buildserver::process_result result)
-	                                   {
-		                                   std::cerr << "got result\n";
-		                                   for (auto const &next : start.edges)
-		                                   {
-			                                   handle_input(*next, result);
-		                                   }
-		                               });
 }
 
 int main()
 {
-	boost::asio::io_service io;
-	buildserver::dag_node root;
-	root.value = [&io](buildserver::process_result const &input) -> std::unique_ptr<buildserver::process>
+	try
 	{
-		return Si::make_unique<step_a>(io, input);
-	};
-	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(root.value));
-	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>([&io](buildserver::process_result const &input)
-	                                                               {
-		                                                               return Si::make_unique<buildserver::delay>(
-		                                                                   io, std::chrono::milliseconds(30), input);
-		                                                           }));
-	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(root.value));
-	handle_input(root, {});
+		boost::filesystem::path const cache_directory = user_cache_directory();
+		auto compiler = lua::create_lua();
+		buildserver::lua_bytecode_cache cache(cache_directory / "lua-bytecode");
 
-	io.run();
+		// compiled once here, every worker only loads the bytecode
+		boost::filesystem::path const steps_script = example_script("lua_steps.lua");
+		std::vector<char> const &steps = cache.get(*compiler, steps_script);
 
-	try
-	{
-		run_experiment();
+		boost::asio::io_service io;
+		buildserver::lua_worker_pool workers((std::max)(1u, boost::thread::hardware_concurrency()),
+		                                     [&steps, &steps_script](buildserver::lua_pipeline_host &host)
+		                                     {
+			                                     try
+			                                     {
+				                                     host.run(steps, steps_script.string());
+			                                     }
+			                                     catch (std::exception const &ex)
+			                                     {
+				                                     std::cerr << ex.what() << '\n';
+			                                     }
+			                                 });
+		buildserver::steady_timer_wheel timers(io, std::chrono::milliseconds(10));
+		buildserver::dag_node root;
+		root.value = [&io](buildserver::shared_result const &input,
+		                   std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+		{
+			return Si::make_unique<step_a>(io, input);
+		};
+		root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(root.value));
+		root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(
+		    [&timers](buildserver::shared_result const &input,
+		              std::unique_ptr<buildserver::process> finished) -> std::unique_ptr<buildserver::process>
+		    {
+			    if (finished)
+			    {
+				    // this step only ever creates delays
+				    static_cast<buildserver::delay &>(*finished).restart(input);
+				    return finished;
+			    }
+			    return Si::make_unique<buildserver::delay>(timers, std::chrono::milliseconds(30), input);
+			}));
+		root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(root.value));
+		root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(
+		    [&io, &workers](buildserver::shared_result const &input,
+		                    std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+		    {
+			    return Si::make_unique<buildserver::lua_map>(io, workers, "map_blob", input);
+			}));
+		// private like the bytecode, so that other users cannot change what the filters let through
+		boost::filesystem::path const history_directory = cache_directory / "history";
+		buildserver::create_private_directory(history_directory);
+		buildserver::history_journal history(history_directory);
+		buildserver::background_thread history_thread;
+		root.edges.back()->edges.emplace_back(Si::make_unique<buildserver::dag_node>(
+		    buildserver::make_persistent_filter(io, history_thread.jobs, history, "400")));
+		buildserver::dag_runner runner(root);
+		runner.start(std::make_shared<buildserver::process_result const>(buildserver::memory_blob{}));
+		runner.start(std::make_shared<buildserver::process_result const>(buildserver::memory_blob{}));
+
+		io.run();
+
+		buildserver::lua_pipeline_host host(*compiler);
+		run_experiment(cache, host, *compiler);
 	}
 	catch (std::exception const &ex)
 	{
 		std::cerr << ex.what() << '\n';
 		return 1;
 	}
-
-	io.run();
 }
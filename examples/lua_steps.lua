@@ -0,0 +1,9 @@
+-- The steps that the Lua workers of lua_services run. Every worker loads
+-- the bytecode of this script into its own state.
+return function(require)
+	local steps = require("steps", "1.0")
+
+	steps.export("map_blob", function(content)
+		return content .. content
+	end)
+end
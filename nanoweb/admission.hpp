@@ -0,0 +1,205 @@
+#ifndef BUILDSERVER_NANOWEB_ADMISSION_HPP
+#define BUILDSERVER_NANOWEB_ADMISSION_HPP
+
+#include "nanoweb/nanoweb.hpp"
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace nanoweb
+{
+	struct admission_limits
+	{
+		// connections beyond this number are answered with 503 without spawning a coroutine for them
+		std::size_t max_connections;
+
+		// a client has to send its complete request header within this time
+		std::chrono::steady_clock::duration read_timeout;
+
+		// the response has to be written within this time after the request has been received
+		std::chrono::steady_clock::duration write_timeout;
+	};
+
+	struct admission_counters
+	{
+		std::uint64_t accepted = 0;
+		std::uint64_t shed = 0;
+		std::uint64_t timed_out = 0;
+	};
+
+	namespace metrics
+	{
+		inline buildserver::metrics::counter &connections_accepted()
+		{
+			static buildserver::metrics::counter instance("nanoweb_connections_accepted_total",
+			                                              "HTTP connections that were served");
+			return instance;
+		}
+
+		inline buildserver::metrics::counter &connections_shed()
+		{
+			static buildserver::metrics::counter instance("nanoweb_connections_shed_total",
+			                                              "HTTP connections answered with 503 because of saturation");
+			return instance;
+		}
+
+		inline buildserver::metrics::counter &connections_timed_out()
+		{
+			static buildserver::metrics::counter instance("nanoweb_connections_timed_out_total",
+			                                              "HTTP connections closed by the read or write deadline");
+			return instance;
+		}
+
+		inline buildserver::metrics::gauge &active_connections()
+		{
+			static buildserver::metrics::gauge instance("nanoweb_active_connections",
+			                                            "HTTP connections currently being served");
+			return instance;
+		}
+	}
+
+	// Decides for every accepted socket whether it is served or shed. Has to be used from the thread that runs the
+	// io_service of the sockets.
+	struct admission_control : private boost::noncopyable
+	{
+		explicit admission_control(admission_limits limits)
+		    : m_limits(limits)
+		    , m_active(0)
+		{
+			if (m_limits.max_connections == 0)
+			{
+				throw std::invalid_argument("an HTTP server has to admit at least one connection");
+			}
+		}
+
+		template <class ErrorHandler>
+		void admit(std::shared_ptr<boost::asio::ip::tcp::socket> client, request_handler const &root_request_handler,
+		           ErrorHandler &&on_error)
+		{
+			if (m_active >= m_limits.max_connections)
+			{
+				++m_counters.shed;
+				metrics::connections_shed().add();
+				reject(std::move(client));
+				return;
+			}
+
+			++m_counters.accepted;
+			metrics::connections_accepted().add();
+			++m_active;
+			metrics::active_connections().set(static_cast<std::int64_t>(m_active));
+			auto deadline = std::make_shared<connection_deadline>(client->get_io_service());
+			arm(deadline, client, m_limits.read_timeout);
+			Si::spawn_coroutine([this, client, deadline, &root_request_handler, on_error](Si::spawn_context yield)
+			                    {
+				                    active_connection const counted(m_active);
+				                    boost::system::error_code const error =
+				                        serve_client(*client, yield, root_request_handler, [this, &client, &deadline]
+				                                     {
+					                                     arm(deadline, client, m_limits.write_timeout);
+					                                 });
+				                    deadline->disarm();
+				                    if (!!error)
+				                    {
+					                    on_error(*client, error);
+				                    }
+				                });
+		}
+
+		admission_counters const &counters() const
+		{
+			return m_counters;
+		}
+
+		std::size_t active_connections() const
+		{
+			return m_active;
+		}
+
+	private:
+		admission_limits m_limits;
+		admission_counters m_counters;
+		std::size_t m_active;
+
+		struct connection_deadline : private boost::noncopyable
+		{
+			boost::asio::steady_timer timer;
+
+			// Incremented whenever the deadline moves or goes away. Cancelling the timer is not enough, because its
+			// handler may have been queued already and would close the socket in the middle of the response.
+			std::uint64_t phase;
+
+			explicit connection_deadline(boost::asio::io_service &io)
+			    : timer(io)
+			    , phase(0)
+			{
+			}
+
+			void disarm()
+			{
+				++phase;
+				boost::system::error_code ignored;
+				timer.cancel(ignored);
+			}
+		};
+
+		void arm(std::shared_ptr<connection_deadline> const &deadline,
+		         std::shared_ptr<boost::asio::ip::tcp::socket> const &client,
+		         std::chrono::steady_clock::duration timeout)
+		{
+			deadline->disarm();
+			std::uint64_t const phase = deadline->phase;
+			deadline->timer.expires_from_now(timeout);
+			deadline->timer.async_wait([this, deadline, client, phase](boost::system::error_code ec)
+			                           {
+				                           if (!!ec || (deadline->phase != phase))
+				                           {
+					                           return;
+				                           }
+				                           ++m_counters.timed_out;
+				                           metrics::connections_timed_out().add();
+				                           // makes the pending receive or send in the coroutine fail
+				                           client->close(ec);
+				                       });
+		}
+
+		struct active_connection : private boost::noncopyable
+		{
+			explicit active_connection(std::size_t &active)
+			    : m_active(active)
+			{
+			}
+
+			~active_connection()
+			{
+				--m_active;
+				metrics::active_connections().set(static_cast<std::int64_t>(m_active));
+			}
+
+		private:
+			std::size_t &m_active;
+		};
+
+		static void reject(std::shared_ptr<boost::asio::ip::tcp::socket> client)
+		{
+			static char const response[] = "HTTP/1.0 503 Service Unavailable\r\n"
+			                               "Retry-After: 1\r\n"
+			                               "Content-Length: 25\r\n"
+			                               "\r\n"
+			                               "503 - Service Unavailable";
+			// the request is not even read because that is what a saturated server cannot afford
+			boost::asio::async_write(*client, boost::asio::buffer(response, sizeof(response) - 1),
+			                         [client](boost::system::error_code ec, std::size_t)
+			                         {
+				                         client->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+				                         client->close(ec);
+				                     });
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef BUILDSERVER_NANOWEB_COMPRESSION_HPP
+#define BUILDSERVER_NANOWEB_COMPRESSION_HPP
+
+#include "nanoweb/nanoweb.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace nanoweb
+{
+	enum class content_encoding
+	{
+		identity,
+		gzip,
+		deflate
+	};
+
+	inline char const *get_content_encoding_name(content_encoding encoding)
+	{
+		switch (encoding)
+		{
+		case content_encoding::gzip:
+			return "gzip";
+		case content_encoding::deflate:
+			return "deflate";
+		case content_encoding::identity:
+			break;
+		}
+		return "identity";
+	}
+
+	// "deflate" in HTTP means the zlib format (RFC 1950), not raw deflate
+	inline std::vector<char> compress(Si::memory_range content, content_encoding encoding,
+	                                  int level = Z_DEFAULT_COMPRESSION)
+	{
+		assert(encoding != content_encoding::identity);
+		z_stream stream = {};
+		int const window_bits = (encoding == content_encoding::gzip) ? (15 + 16) : 15;
+		if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			throw std::bad_alloc();
+		}
+		std::vector<char> compressed(deflateBound(&stream, static_cast<uLong>(content.size())));
+		std::size_t const max_chunk = (std::numeric_limits<uInt>::max)();
+		std::size_t written = 0;
+		char const *next_input = content.begin();
+		std::size_t remaining = static_cast<std::size_t>(content.size());
+		int flush = Z_NO_FLUSH;
+		int status = Z_OK;
+		do
+		{
+			uInt const input_chunk = static_cast<uInt>((std::min)(remaining, max_chunk));
+			stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(next_input));
+			stream.avail_in = input_chunk;
+			next_input += input_chunk;
+			remaining -= input_chunk;
+			flush = (remaining == 0) ? Z_FINISH : Z_NO_FLUSH;
+			do
+			{
+				if (written == compressed.size())
+				{
+					compressed.resize(compressed.size() * 2 + 64);
+				}
+				uInt const output_space = static_cast<uInt>((std::min)(compressed.size() - written, max_chunk));
+				stream.next_out = reinterpret_cast<Bytef *>(compressed.data() + written);
+				stream.avail_out = output_space;
+				status = deflate(&stream, flush);
+				written += output_space - stream.avail_out;
+			} while (stream.avail_out == 0 && status != Z_STREAM_END);
+		} while (flush != Z_FINISH);
+		deflateEnd(&stream);
+		if (status != Z_STREAM_END)
+		{
+			throw std::runtime_error("zlib could not compress a response body");
+		}
+		compressed.resize(written);
+		return compressed;
+	}
+
+	// All the representations of a response body are computed once so that requests only have to pick one.
+	struct precompressed_content
+	{
+		Si::noexcept_string content_type;
+		std::vector<char> identity;
+
+		// empty if compression would not make the body smaller
+		Si::optional<std::vector<char>> gzip;
+		Si::optional<std::vector<char>> deflate;
+	};
+
+	inline std::shared_ptr<precompressed_content const> precompress(Si::noexcept_string content_type,
+	                                                                std::vector<char> content,
+	                                                                int level = Z_DEFAULT_COMPRESSION)
+	{
+		auto result = std::make_shared<precompressed_content>();
+		result->content_type = std::move(content_type);
+		result->identity = std::move(content);
+		Si::memory_range const original = Si::make_memory_range(result->identity);
+		std::vector<char> gzip = compress(original, content_encoding::gzip, level);
+		if (gzip.size() < result->identity.size())
+		{
+			result->gzip = std::move(gzip);
+		}
+		std::vector<char> deflate = compress(original, content_encoding::deflate, level);
+		if (deflate.size() < result->identity.size())
+		{
+			result->deflate = std::move(deflate);
+		}
+		return std::move(result);
+	}
+
+	template <class Request>
+	Si::noexcept_string const *find_header(Request const &request, char const *name)
+	{
+		for (auto const &header : request.arguments)
+		{
+			if (boost::algorithm::iequals(header.first, name))
+			{
+				return &header.second;
+			}
+		}
+		return nullptr;
+	}
+
+	// Picks the encoding with the highest q-value from an Accept-Encoding header, preferring gzip over deflate
+	// over identity when the client likes them equally. Identity is acceptable unless the header excludes it with
+	// identity;q=0 or with *;q=0 without mentioning it. Returns none if none of the available encodings is acceptable.
+	inline Si::optional<content_encoding> choose_content_encoding(Si::memory_range accept_encoding,
+	                                                              bool gzip_available, bool deflate_available)
+	{
+		double gzip_quality = 0;
+		double deflate_quality = 0;
+		double identity_quality = 1;
+		double any_quality = 0;
+		bool gzip_mentioned = false;
+		bool deflate_mentioned = false;
+		bool identity_mentioned = false;
+		bool any_mentioned = false;
+		char const *token_begin = accept_encoding.begin();
+		while (token_begin < accept_encoding.end())
+		{
+			char const *const token_end = std::find(token_begin, accept_encoding.end(), ',');
+			char const *const parameters = std::find(token_begin, token_end, ';');
+			std::string coding(token_begin, parameters);
+			boost::algorithm::trim(coding);
+			double quality = 1;
+			std::string parameter(parameters, token_end);
+			std::size_t const q = parameter.find("q=");
+			if (q != std::string::npos)
+			{
+				try
+				{
+					quality = std::stod(parameter.substr(q + 2));
+				}
+				catch (std::exception const &)
+				{
+					quality = 0;
+				}
+			}
+			if (boost::algorithm::iequals(coding, "gzip") || boost::algorithm::iequals(coding, "x-gzip"))
+			{
+				gzip_quality = quality;
+				gzip_mentioned = true;
+			}
+			else if (boost::algorithm::iequals(coding, "deflate"))
+			{
+				deflate_quality = quality;
+				deflate_mentioned = true;
+			}
+			else if (boost::algorithm::iequals(coding, "identity"))
+			{
+				identity_quality = quality;
+				identity_mentioned = true;
+			}
+			else if (coding == "*")
+			{
+				any_quality = quality;
+				any_mentioned = true;
+			}
+			token_begin = token_end + 1;
+		}
+		if (!gzip_mentioned)
+		{
+			gzip_quality = any_quality;
+		}
+		if (!deflate_mentioned)
+		{
+			deflate_quality = any_quality;
+		}
+		if (!identity_mentioned && any_mentioned && (any_quality <= 0))
+		{
+			identity_quality = 0;
+		}
+		if (!gzip_available)
+		{
+			gzip_quality = 0;
+		}
+		if (!deflate_available)
+		{
+			deflate_quality = 0;
+		}
+		if (gzip_quality > 0 && gzip_quality >= deflate_quality)
+		{
+			return content_encoding::gzip;
+		}
+		if (deflate_quality > 0)
+		{
+			return content_encoding::deflate;
+		}
+		if (identity_quality > 0)
+		{
+			return content_encoding::identity;
+		}
+		return Si::none;
+	}
+
+	template <class Socket, class YieldContext, class Status, class StatusText>
+	void quick_final_response(Socket &client, YieldContext &&yield, Status &&status, StatusText &&status_text,
+	                          Si::http::request const &request, precompressed_content const &content)
+	{
+		content_encoding encoding = content_encoding::identity;
+		if (Si::noexcept_string const *const accept_encoding = find_header(request, "Accept-Encoding"))
+		{
+			Si::optional<content_encoding> const acceptable = choose_content_encoding(
+			    Si::make_memory_range(*accept_encoding), !!content.gzip, !!content.deflate);
+			if (!acceptable)
+			{
+				quick_final_response(client, yield, "406", "Not Acceptable",
+				                     Si::make_c_str_range("none of the accepted content codings is available"));
+				return;
+			}
+			encoding = *acceptable;
+		}
+		std::vector<char> const *body = &content.identity;
+		switch (encoding)
+		{
+		case content_encoding::identity:
+			break;
+		case content_encoding::gzip:
+			body = &*content.gzip;
+			break;
+		case content_encoding::deflate:
+			body = &*content.deflate;
+			break;
+		}
+
+		std::vector<char> response;
+		{
+			auto response_writer = Si::make_container_sink(response);
+			Si::http::generate_status_line(response_writer, "HTTP/1.0", std::forward<Status>(status),
+			                               std::forward<StatusText>(status_text));
+			if (!content.content_type.empty())
+			{
+				Si::http::generate_header(response_writer, "Content-Type", content.content_type);
+			}
+			if (encoding != content_encoding::identity)
+			{
+				Si::http::generate_header(response_writer, "Content-Encoding", get_content_encoding_name(encoding));
+			}
+			Si::http::generate_header(response_writer, "Vary", "Accept-Encoding");
+			Si::http::generate_header(response_writer, "Content-Length",
+			                          boost::lexical_cast<Si::noexcept_string>(body->size()));
+			Si::append(response_writer, "\r\n");
+		}
+
+		// the body is not copied into the response buffer because it can be large and is shared by all clients
+		boost::system::error_code error = Si::asio::write(client, Si::make_memory_range(response), yield);
+		if (!error)
+		{
+			error = Si::asio::write(client, Si::make_memory_range(*body), yield);
+		}
+
+		// ignore shutdown failures, they do not matter here
+		client.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+	}
+
+	// Keeps the precompressed representations of a generated page until the state it was rendered from changes.
+	struct versioned_representation
+	{
+		template <class Render>
+		std::shared_ptr<precompressed_content const> get(std::uint64_t current_version, Render &&render)
+		{
+			if (!m_content || (m_version != current_version))
+			{
+				m_content = std::forward<Render>(render)();
+				m_version = current_version;
+			}
+			return m_content;
+		}
+
+	private:
+		std::uint64_t m_version = 0;
+		std::shared_ptr<precompressed_content const> m_content;
+	};
+}
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef BUILDSERVER_NANOWEB_HPP
 #define BUILDSERVER_NANOWEB_HPP
 
+#include "server/metrics.hpp"
 #include <silicium/asio/writing_observable.hpp>
 #include <silicium/http/generate_response.hpp>
 #include <silicium/http/receive_request.hpp>
@@ -11,7 +12,9 @@
 #include <silicium/sink/append.hpp>
 #include <unordered_map>
 #include <functional>
+#include <algorithm>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/range/algorithm/equal.hpp>
 
 namespace nanoweb
 {
@@ -25,6 +28,28 @@ namespace nanoweb
 	                                             Si::iterator_range<Si::memory_range const *>, Si::spawn_context)>
 	    request_handler;
 
+	namespace metrics
+	{
+		inline buildserver::metrics::counter &requests()
+		{
+			static buildserver::metrics::counter instance("nanoweb_requests_total", "HTTP requests received");
+			return instance;
+		}
+
+		inline buildserver::metrics::counter &not_found()
+		{
+			static buildserver::metrics::counter instance("nanoweb_not_found_total", "HTTP requests answered with 404");
+			return instance;
+		}
+
+		inline buildserver::metrics::histogram &request_duration()
+		{
+			static buildserver::metrics::histogram instance(
+			    "nanoweb_request_duration_seconds", "Time from receiving an HTTP request until the response is sent");
+			return instance;
+		}
+	}
+
 	inline request_handler
 	make_directory(std::unordered_map<Si::range_value<Si::memory_range>, request_handler> entries)
 	{
@@ -51,15 +76,89 @@ namespace nanoweb
 		};
 	}
 
+	// finds the value of name=value in the query part of a request path like /notify?branch=master&commit=abc
+	inline Si::optional<Si::memory_range> find_query_parameter(Si::memory_range path, Si::memory_range name)
+	{
+		char const *const query = std::find(path.begin(), path.end(), '?');
+		if (query == path.end())
+		{
+			return Si::none;
+		}
+		char const *parameter_begin = query + 1;
+		while (parameter_begin < path.end())
+		{
+			char const *const parameter_end = std::find(parameter_begin, path.end(), '&');
+			char const *const equals = std::find(parameter_begin, parameter_end, '=');
+			if (boost::range::equal(Si::memory_range(parameter_begin, equals), name))
+			{
+				return Si::memory_range((equals == parameter_end) ? parameter_end : (equals + 1), parameter_end);
+			}
+			parameter_begin = parameter_end + 1;
+		}
+		return Si::none;
+	}
+
+	// decodes the %XX escapes and the + of a query value, or returns none if an escape is truncated or not hexadecimal
+	inline Si::optional<Si::noexcept_string> decode_query_value(Si::memory_range encoded)
+	{
+		auto const hex_digit = [](char c) -> int
+		{
+			if ((c >= '0') && (c <= '9'))
+			{
+				return c - '0';
+			}
+			if ((c >= 'a') && (c <= 'f'))
+			{
+				return c - 'a' + 10;
+			}
+			if ((c >= 'A') && (c <= 'F'))
+			{
+				return c - 'A' + 10;
+			}
+			return -1;
+		};
+		Si::noexcept_string decoded;
+		for (char const *i = encoded.begin(); i != encoded.end(); ++i)
+		{
+			if (*i == '+')
+			{
+				decoded += ' ';
+				continue;
+			}
+			if (*i != '%')
+			{
+				decoded += *i;
+				continue;
+			}
+			if ((encoded.end() - i) < 3)
+			{
+				return Si::none;
+			}
+			int const high = hex_digit(i[1]);
+			int const low = hex_digit(i[2]);
+			if ((high < 0) || (low < 0))
+			{
+				return Si::none;
+			}
+			decoded += static_cast<char>((high << 4) | low);
+			i += 2;
+		}
+		return decoded;
+	}
+
 	template <class Socket, class YieldContext, class Status, class StatusText>
 	void quick_final_response(Socket &client, YieldContext &&yield, Status &&status, StatusText &&status_text,
-	                          Si::memory_range const &content)
+	                          Si::memory_range const &content_type, Si::memory_range const &content)
 	{
 		std::vector<char> response;
 		{
 			auto response_writer = Si::make_container_sink(response);
 			Si::http::generate_status_line(response_writer, "HTTP/1.0", std::forward<Status>(status),
 			                               std::forward<StatusText>(status_text));
+			if (!content_type.empty())
+			{
+				Si::http::generate_header(response_writer, "Content-Type", content_type);
+			}
 			Si::http::generate_header(response_writer, "Content-Length",
 			                          boost::lexical_cast<Si::noexcept_string>(content.size()));
 			Si::append(response_writer, "\r\n");
@@ -73,9 +172,18 @@ namespace nanoweb
 		client.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
 	}
 
-	template <class Socket, class YieldContext>
+	template <class Socket, class YieldContext, class Status, class StatusText>
+	void quick_final_response(Socket &client, YieldContext &&yield, Status &&status, StatusText &&status_text,
+	                          Si::memory_range const &content)
+	{
+		quick_final_response(client, std::forward<YieldContext>(yield), std::forward<Status>(status),
+		                     std::forward<StatusText>(status_text), Si::make_c_str_range(""), content);
+	}
+
+	template <class Socket, class YieldContext, class RequestReceived>
 	boost::system::error_code serve_client(Socket &client, YieldContext &&yield,
-	                                       request_handler const &root_request_handler)
+	                                       request_handler const &root_request_handler,
+	                                       RequestReceived &&on_request_received)
 	{
 		Si::error_or<Si::optional<Si::http::request>> maybe_request = Si::http::receive_request(client, yield);
 		if (maybe_request.is_error())
@@ -88,6 +196,10 @@ namespace nanoweb
 			return {}; // TODO
 		}
 
+		std::forward<RequestReceived>(on_request_received)();
+		metrics::requests().add();
+		buildserver::metrics::scoped_duration const timing(metrics::request_duration());
+
 		Si::http::request const &request = *maybe_request.get();
 
 		Si::optional<Si::http::uri> relative_uri = Si::http::parse_uri(Si::make_memory_range(request.path));
@@ -102,12 +214,22 @@ namespace nanoweb
 			break;
 
 		case request_handler_result::not_found:
+			metrics::not_found().add();
 			quick_final_response(client, yield, "404", "Not Found", Si::make_c_str_range("404 - Not Found"));
 			break;
 		}
 
 		return {};
 	}
+
+	template <class Socket, class YieldContext>
+	boost::system::error_code serve_client(Socket &client, YieldContext &&yield,
+	                                       request_handler const &root_request_handler)
+	{
+		return serve_client(client, std::forward<YieldContext>(yield), root_request_handler, []
+		                    {
+			                });
+	}
 }
 
 #endif
@@ -1,10 +1,121 @@
+#include "server/cmake.hpp"
+#include "server/graph_remote.hpp"
+#include <silicium/sink/virtualized_sink.hpp>
+#include <silicium/sink/ostream_sink.hpp>
+#include <boost/asio/io_service.hpp>
 #include <boost/program_options.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
 #include <iostream>
 
+namespace
+{
+	// The steps of a build that a build machine can do for a coordinator. The paths refer to the file system of the
+	// worker.
+	graph::transformation_registry make_worker_transformations()
+	{
+		graph::transformation_registry offered;
+		offered.add("cmake_generate",
+		            graph::typed_transformation{
+		                graph::make_listing_type({{"cmake", graph::atomic_type::absolute_path},
+		                                          {"source", graph::atomic_type::absolute_path},
+		                                          {"build", graph::atomic_type::absolute_path}}),
+		                graph::atomic_type::absolute_path,
+		                [](graph::value input) -> graph::value
+		                {
+			                // run_worker has checked the input against the type above
+			                graph::listing const &arguments = **Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
+			                ventura::absolute_path const &build =
+			                    *graph::find_entry_of_type<ventura::absolute_path>(arguments, "build");
+			                buildserver::cmake_exe const cmake(
+			                    *graph::find_entry_of_type<ventura::absolute_path>(arguments, "cmake"));
+			                auto output = Si::virtualize_sink(Si::ostream_ref_sink(std::cerr));
+			                ventura::absolute_path const &source =
+			                    *graph::find_entry_of_type<ventura::absolute_path>(arguments, "source");
+			                boost::system::error_code const error = cmake.generate(
+			                    source, build, boost::unordered_map<Si::os_string, Si::os_string>(), output);
+			                if (error)
+			                {
+				                boost::throw_exception(boost::system::system_error(error));
+			                }
+			                return build;
+			            }});
+		offered.add("cmake_build",
+		            graph::typed_transformation{
+		                graph::make_listing_type({{"cmake", graph::atomic_type::absolute_path},
+		                                          {"build", graph::atomic_type::absolute_path},
+		                                          {"parallelism", graph::atomic_type::uint32}}),
+		                graph::atomic_type::absolute_path,
+		                [](graph::value input) -> graph::value
+		                {
+			                graph::listing const &arguments = **Si::try_get_ptr<std::shared_ptr<graph::listing>>(input);
+			                ventura::absolute_path const &build =
+			                    *graph::find_entry_of_type<ventura::absolute_path>(arguments, "build");
+			                buildserver::cmake_exe const cmake(
+			                    *graph::find_entry_of_type<ventura::absolute_path>(arguments, "cmake"));
+			                auto output = Si::virtualize_sink(Si::ostream_ref_sink(std::cerr));
+			                std::uint32_t const parallelism =
+			                    *graph::find_entry_of_type<std::uint32_t>(arguments, "parallelism");
+			                boost::system::error_code const error = cmake.build(build, parallelism, output);
+			                if (error)
+			                {
+				                boost::throw_exception(boost::system::system_error(error));
+			                }
+			                return build;
+			            }});
+		return offered;
+	}
+
+	// a worker without slots would never run anything
+	void require_slots(unsigned capacity)
+	{
+		if (capacity == 0)
+		{
+			throw boost::program_options::validation_error(
+			    boost::program_options::validation_error::invalid_option_value, "capacity", "0");
+		}
+	}
+
+	int run_worker_mode(std::string const &coordinator, std::string const &port, Si::noexcept_string const &secret,
+	                    unsigned capacity)
+	{
+		boost::asio::io_service io;
+		boost::asio::ip::tcp::resolver resolver(io);
+		graph::transformation_registry const offered = make_worker_transformations();
+		try
+		{
+			boost::asio::ip::tcp::endpoint const endpoint =
+			    *resolver.resolve(boost::asio::ip::tcp::resolver::query(coordinator, port));
+			std::cerr << "Offering " << capacity << " slots to " << endpoint << '\n';
+			graph::run_worker(endpoint, secret, offered, capacity);
+		}
+		catch (std::exception const &ex)
+		{
+			std::cerr << "Could not work for the coordinator " << coordinator << ':' << port << ": " << ex.what()
+			          << '\n';
+			return 1;
+		}
+		std::cerr << "The coordinator closed the connection\n";
+		return 0;
+	}
+}
+
 int main(int argc, char **argv)
 {
+	std::string coordinator;
+	std::string port = "8090";
+	Si::noexcept_string secret;
+	unsigned capacity = (std::max)(1u, boost::thread::hardware_concurrency());
+
 	boost::program_options::options_description desc("Allowed options");
-	desc.add_options()("help", "produce help message");
+	desc.add_options()("help", "produce help message")(
+	    "worker", boost::program_options::value(&coordinator),
+	    "run build steps for the coordinator at this host")("port", boost::program_options::value(&port),
+	                                                         "port of the coordinator")(
+	    "capacity", boost::program_options::value(&capacity)->notifier(&require_slots),
+	    "number of build steps to run at the same time, at least one")(
+	    "secret", boost::program_options::value(&secret), "the --worker-secret of the coordinator");
 
 	boost::program_options::positional_options_description positional;
 	boost::program_options::variables_map vm;
@@ -12,6 +123,8 @@ int main(int argc, char **argv)
 	{
 		boost::program_options::store(
 		    boost::program_options::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+		// the notifiers reject invalid values
+		boost::program_options::notify(vm);
 	}
 	catch (boost::program_options::error const &ex)
 	{
@@ -19,11 +132,19 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	boost::program_options::notify(vm);
-
 	if (vm.count("help"))
 	{
 		std::cerr << desc << "\n";
 		return 1;
 	}
+
+	if (!coordinator.empty())
+	{
+		if (secret.empty())
+		{
+			std::cerr << "A worker needs the --secret of the coordinator\n";
+			return 1;
+		}
+		return run_worker_mode(coordinator, port, secret, capacity);
+	}
 }
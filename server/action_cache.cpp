@@ -0,0 +1,466 @@
+#include "action_cache.hpp"
+#include "file_io.hpp"
+#include "metrics.hpp"
+#include <silicium/optional.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace buildserver
+{
+	namespace
+	{
+		metrics::counter cache_hits("buildserver_action_cache_hits_total", "Actions restored from the action cache");
+		metrics::counter cache_misses("buildserver_action_cache_misses_total",
+		                              "Actions that were not found in the action cache");
+
+		void append_integer(std::vector<char> &out, std::uint64_t integer, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				out.push_back(static_cast<char>(integer >> (8 * i)));
+			}
+		}
+
+		void append_string(std::vector<char> &out, Si::memory_range content)
+		{
+			append_integer(out, content.size(), 8);
+			out.insert(out.end(), content.begin(), content.end());
+		}
+
+		enum class entry_kind : char
+		{
+			directory = 'd',
+			file = 'f',
+			symlink = 'l'
+		};
+
+		struct tree_entry
+		{
+			entry_kind kind;
+
+			// relative to the root of the tree, separated by slashes on every platform
+			std::string path;
+
+			bool executable;
+			sha256_digest content;
+			std::string symlink_target;
+		};
+
+		bool is_executable(boost::filesystem::path const &file)
+		{
+			return (boost::filesystem::status(file).permissions() & boost::filesystem::owner_exe) != 0;
+		}
+
+		// Parents come before their children and siblings are sorted by name. The content of files is not hashed
+		// here because the callers read the files anyway.
+		void collect_entries(boost::filesystem::path const &directory, std::string const &prefix,
+		                     std::vector<Si::noexcept_string> const &excluded_names, std::vector<tree_entry> &entries)
+		{
+			std::vector<boost::filesystem::path> children{boost::filesystem::directory_iterator(directory),
+			                                              boost::filesystem::directory_iterator()};
+			std::sort(children.begin(), children.end(),
+			          [](boost::filesystem::path const &left, boost::filesystem::path const &right)
+			          {
+				          return left.filename().generic_string() < right.filename().generic_string();
+				      });
+			for (boost::filesystem::path const &child : children)
+			{
+				std::string const name = child.filename().generic_string();
+				if (std::find(excluded_names.begin(), excluded_names.end(), Si::noexcept_string(name.c_str())) !=
+				    excluded_names.end())
+				{
+					continue;
+				}
+				tree_entry entry;
+				entry.path = prefix + name;
+				entry.executable = false;
+				entry.content = sha256_digest();
+				boost::filesystem::file_status const status = boost::filesystem::symlink_status(child);
+				if (boost::filesystem::is_symlink(status))
+				{
+					entry.kind = entry_kind::symlink;
+					entry.symlink_target = boost::filesystem::read_symlink(child).generic_string();
+					entries.emplace_back(std::move(entry));
+				}
+				else if (boost::filesystem::is_directory(status))
+				{
+					entry.kind = entry_kind::directory;
+					entries.emplace_back(entry);
+					collect_entries(child, entry.path + '/', excluded_names, entries);
+				}
+				else if (boost::filesystem::is_regular_file(status))
+				{
+					entry.kind = entry_kind::file;
+					entry.executable = is_executable(child);
+					entries.emplace_back(std::move(entry));
+				}
+				// sockets, pipes and devices are not part of a build output
+			}
+		}
+
+		std::vector<char> encode_tree(std::vector<tree_entry> const &entries)
+		{
+			std::vector<char> encoded;
+			for (tree_entry const &entry : entries)
+			{
+				encoded.push_back(static_cast<char>(entry.kind));
+				encoded.push_back(entry.executable ? 1 : 0);
+				append_string(encoded, Si::make_memory_range(entry.path));
+				switch (entry.kind)
+				{
+				case entry_kind::directory:
+					break;
+
+				case entry_kind::file:
+					encoded.insert(encoded.end(), entry.content.begin(), entry.content.end());
+					break;
+
+				case entry_kind::symlink:
+					append_string(encoded, Si::make_memory_range(entry.symlink_target));
+					break;
+				}
+			}
+			return encoded;
+		}
+
+		struct tree_decoder
+		{
+			char const *position;
+			char const *end;
+
+			Si::memory_range take(std::uint64_t size)
+			{
+				if (static_cast<std::uint64_t>(end - position) < size)
+				{
+					throw std::invalid_argument("truncated tree manifest");
+				}
+				Si::memory_range const taken(position, position + size);
+				position += size;
+				return taken;
+			}
+
+			std::string string()
+			{
+				Si::memory_range const size = take(8);
+				std::uint64_t length = 0;
+				for (std::size_t i = 0; i < 8; ++i)
+				{
+					length |= std::uint64_t(static_cast<unsigned char>(size.begin()[i])) << (8 * i);
+				}
+				Si::memory_range const content = take(length);
+				return std::string(content.begin(), content.end());
+			}
+		};
+
+		// only plain relative paths, so a damaged manifest cannot write outside of the output directory
+		bool is_safe_relative_path(std::string const &path)
+		{
+			boost::filesystem::path const parsed(path);
+			if (path.empty() || parsed.has_root_path())
+			{
+				return false;
+			}
+			for (boost::filesystem::path const &segment : parsed)
+			{
+				if ((segment == "..") || (segment == "."))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// A symlink can point anywhere, so an entry below one would be written to wherever it points. Checked for
+		// every pair because a damaged manifest does not have to list the parents first.
+		void reject_paths_through_symlinks(std::vector<tree_entry> const &entries)
+		{
+			std::set<std::string> symlinks;
+			for (tree_entry const &entry : entries)
+			{
+				if (entry.kind == entry_kind::symlink)
+				{
+					symlinks.insert(entry.path);
+				}
+			}
+			if (symlinks.empty())
+			{
+				return;
+			}
+			for (tree_entry const &entry : entries)
+			{
+				for (std::size_t slash = entry.path.find('/'); slash != std::string::npos;
+				     slash = entry.path.find('/', slash + 1))
+				{
+					if (symlinks.count(entry.path.substr(0, slash)))
+					{
+						throw std::invalid_argument("a path in a tree manifest goes through a symlink");
+					}
+				}
+			}
+		}
+
+		std::vector<tree_entry> decode_tree(std::vector<char> const &encoded)
+		{
+			std::vector<tree_entry> entries;
+			tree_decoder decoder{encoded.data(), encoded.data() + encoded.size()};
+			while (decoder.position != decoder.end)
+			{
+				Si::memory_range const header = decoder.take(2);
+				tree_entry entry;
+				entry.kind = static_cast<entry_kind>(header.begin()[0]);
+				entry.executable = (header.begin()[1] != 0);
+				entry.path = decoder.string();
+				entry.content = sha256_digest();
+				if (!is_safe_relative_path(entry.path))
+				{
+					throw std::invalid_argument("unsafe path in a tree manifest");
+				}
+				switch (entry.kind)
+				{
+				case entry_kind::directory:
+					break;
+
+				case entry_kind::file:
+				{
+					Si::memory_range const digest = decoder.take(entry.content.size());
+					std::copy(digest.begin(), digest.end(), entry.content.begin());
+					break;
+				}
+
+				case entry_kind::symlink:
+					entry.symlink_target = decoder.string();
+					break;
+
+				default:
+					throw std::invalid_argument("unknown entry kind in a tree manifest");
+				}
+				entries.emplace_back(std::move(entry));
+			}
+			reject_paths_through_symlinks(entries);
+			return entries;
+		}
+
+		Si::optional<sha256_digest> parse_hex(Si::memory_range text)
+		{
+			sha256_digest digest;
+			if (static_cast<std::size_t>(text.size()) != (digest.size() * 2))
+			{
+				return Si::none;
+			}
+			for (std::size_t i = 0; i < digest.size() * 2; ++i)
+			{
+				char const c = text.begin()[i];
+				int nibble = 0;
+				if ((c >= '0') && (c <= '9'))
+				{
+					nibble = c - '0';
+				}
+				else if ((c >= 'a') && (c <= 'f'))
+				{
+					nibble = c - 'a' + 10;
+				}
+				else
+				{
+					return Si::none;
+				}
+				if ((i % 2) == 0)
+				{
+					digest[i / 2] = static_cast<std::uint8_t>(nibble << 4);
+				}
+				else
+				{
+					digest[i / 2] = static_cast<std::uint8_t>(digest[i / 2] | nibble);
+				}
+			}
+			return digest;
+		}
+	}
+
+	sha256_digest hash_file(boost::filesystem::path const &file)
+	{
+		std::ifstream in(file.string(), std::ios::binary);
+		if (!in)
+		{
+			throw std::runtime_error("could not open " + file.string());
+		}
+		sha256 hasher;
+		std::array<char, 64 * 1024> buffer;
+		while (in)
+		{
+			in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			hasher.update(Si::memory_range(buffer.data(), buffer.data() + in.gcount()));
+		}
+		return hasher.finish();
+	}
+
+	sha256_digest hash_directory_tree(boost::filesystem::path const &root,
+	                                  std::vector<Si::noexcept_string> const &excluded_names)
+	{
+		std::vector<tree_entry> entries;
+		collect_entries(root, "", excluded_names, entries);
+		for (tree_entry &entry : entries)
+		{
+			if (entry.kind == entry_kind::file)
+			{
+				entry.content = hash_file(root / entry.path);
+			}
+		}
+		return hash_sha256(Si::make_memory_range(encode_tree(entries)));
+	}
+
+	sha256_digest hash_action(action_description const &action)
+	{
+		std::vector<char> encoded;
+		append_string(encoded, Si::make_memory_range(action.tool));
+		for (auto const &input : action.inputs)
+		{
+			append_string(encoded, Si::make_memory_range(input.first));
+			append_string(encoded, Si::make_memory_range(input.second));
+		}
+		return hash_sha256(Si::make_memory_range(encoded));
+	}
+
+	action_cache::action_cache(boost::filesystem::path root)
+	    : m_root(std::move(root))
+	    , m_hits(0)
+	    , m_misses(0)
+	{
+		boost::filesystem::create_directories(m_root / "objects");
+		boost::filesystem::create_directories(m_root / "actions");
+		boost::filesystem::create_directories(m_root / "tmp");
+	}
+
+	void action_cache::store(sha256_digest const &action, boost::filesystem::path const &output_directory,
+	                         Si::memory_range log)
+	{
+		std::vector<tree_entry> entries;
+		collect_entries(output_directory, "", std::vector<Si::noexcept_string>(), entries);
+		for (tree_entry &entry : entries)
+		{
+			if (entry.kind == entry_kind::file)
+			{
+				entry.content = put_object(output_directory / entry.path);
+			}
+		}
+		std::string const record = format_hex(put_object(encode_tree(entries))) +
+		                           format_hex(put_object(std::vector<char>(log.begin(), log.end())));
+		boost::filesystem::path const temporary = make_temporary_path();
+		write_file(temporary, Si::make_memory_range(record));
+		publish_file(temporary, action_path(action));
+	}
+
+	Si::optional<std::vector<char>> action_cache::restore(sha256_digest const &action,
+	                                                      boost::filesystem::path const &output_directory)
+	{
+		boost::filesystem::path const recorded = action_path(action);
+		Si::optional<sha256_digest> manifest;
+		Si::optional<sha256_digest> log;
+		if (boost::filesystem::exists(recorded))
+		{
+			std::vector<char> const record = read_file(recorded);
+			std::size_t const digest_size = sha256_digest().size() * 2;
+			if (record.size() == (2 * digest_size))
+			{
+				manifest = parse_hex(Si::memory_range(record.data(), record.data() + digest_size));
+				log = parse_hex(Si::memory_range(record.data() + digest_size, record.data() + record.size()));
+			}
+		}
+		std::vector<tree_entry> entries;
+		bool complete = manifest && log && boost::filesystem::exists(object_path(*manifest)) &&
+		                boost::filesystem::exists(object_path(*log));
+		if (complete)
+		{
+			entries = decode_tree(read_file(object_path(*manifest)));
+			complete = std::all_of(entries.begin(), entries.end(), [this](tree_entry const &entry)
+			                       {
+				                       return (entry.kind != entry_kind::file) ||
+				                              boost::filesystem::exists(object_path(entry.content));
+				                   });
+		}
+		if (!complete)
+		{
+			++m_misses;
+			cache_misses.add();
+			return Si::none;
+		}
+		std::vector<char> restored_log = read_file(object_path(*log));
+
+		boost::filesystem::remove_all(output_directory);
+		boost::filesystem::create_directories(output_directory);
+		for (tree_entry const &entry : entries)
+		{
+			boost::filesystem::path const destination = output_directory / entry.path;
+			switch (entry.kind)
+			{
+			case entry_kind::directory:
+				boost::filesystem::create_directory(destination);
+				break;
+
+			case entry_kind::file:
+				// copied instead of linked so that a build changing its outputs cannot damage the store
+				boost::filesystem::copy_file(object_path(entry.content), destination);
+				if (entry.executable)
+				{
+					boost::filesystem::permissions(destination, boost::filesystem::add_perms |
+					                                                boost::filesystem::owner_exe |
+					                                                boost::filesystem::group_exe |
+					                                                boost::filesystem::others_exe);
+				}
+				break;
+
+			case entry_kind::symlink:
+				boost::filesystem::create_symlink(entry.symlink_target, destination);
+				break;
+			}
+		}
+		++m_hits;
+		cache_hits.add();
+		return std::move(restored_log);
+	}
+
+	boost::filesystem::path action_cache::object_path(sha256_digest const &digest) const
+	{
+		std::string const name = format_hex(digest);
+		return m_root / "objects" / name.substr(0, 2) / name.substr(2);
+	}
+
+	boost::filesystem::path action_cache::action_path(sha256_digest const &action) const
+	{
+		return m_root / "actions" / format_hex(action);
+	}
+
+	sha256_digest action_cache::put_object(boost::filesystem::path const &file)
+	{
+		sha256_digest const digest = hash_file(file);
+		boost::filesystem::path const destination = object_path(digest);
+		if (!boost::filesystem::exists(destination))
+		{
+			boost::filesystem::path const temporary = make_temporary_path();
+			boost::filesystem::copy_file(file, temporary);
+			publish_file(temporary, destination);
+		}
+		return digest;
+	}
+
+	sha256_digest action_cache::put_object(std::vector<char> const &content)
+	{
+		sha256_digest const digest = hash_sha256(Si::make_memory_range(content));
+		boost::filesystem::path const destination = object_path(digest);
+		if (!boost::filesystem::exists(destination))
+		{
+			boost::filesystem::path const temporary = make_temporary_path();
+			write_file(temporary, Si::make_memory_range(content));
+			publish_file(temporary, destination);
+		}
+		return digest;
+	}
+
+	boost::filesystem::path action_cache::make_temporary_path() const
+	{
+		return m_root / "tmp" / boost::filesystem::unique_path();
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef BUILDSERVER_ACTION_CACHE_HPP
+#define BUILDSERVER_ACTION_CACHE_HPP
+
+#include "sha256.hpp"
+#include <silicium/memory_range.hpp>
+#include <silicium/noexcept_string.hpp>
+#include <silicium/optional.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <map>
+#include <vector>
+
+namespace buildserver
+{
+	sha256_digest hash_file(boost::filesystem::path const &file);
+
+	// Hashes the relative paths, the kinds, the executable bits and the contents of everything below root in a fixed
+	// order, so equal trees have equal hashes no matter when or where they were created. Entries with one of the
+	// excluded names are skipped at any depth, for example ".git" whose content differs between equal checkouts.
+	sha256_digest hash_directory_tree(boost::filesystem::path const &root,
+	                                  std::vector<Si::noexcept_string> const &excluded_names);
+
+	// Everything that can influence the output of one run of a tool. Inputs that cannot change the output, like the
+	// number of parallel jobs, should be left out so that they do not prevent hits.
+	struct action_description
+	{
+		Si::noexcept_string tool;
+
+		// sorted by name, so the order in which the inputs are added does not matter
+		std::map<Si::noexcept_string, Si::noexcept_string> inputs;
+	};
+
+	sha256_digest hash_action(action_description const &action);
+
+	// Remembers the output directories and the logs of actions in a content addressed store:
+	//
+	//   root/objects/ab/cdef...   the content of a file, named after its SHA-256
+	//   root/actions/<action>     the digest of the manifest object that lists the output directory, followed by the
+	//                             digest of the log object
+	//
+	// Files are written under a temporary name and renamed, so several processes can share one store.
+	struct action_cache : private boost::noncopyable
+	{
+		explicit action_cache(boost::filesystem::path root);
+
+		// Copies the directory and the log into the store and records them as the output of the action. Only the
+		// outputs of successful actions should be stored because a restore cannot tell them apart.
+		void store(sha256_digest const &action, boost::filesystem::path const &output_directory,
+		           Si::memory_range log);
+
+		// Replaces the content of the directory with the recorded output of the action and returns the recorded log,
+		// so that a hit looks like a run of the tool. Returns none and leaves the directory alone if the action is
+		// unknown or its output is incomplete. Throws std::invalid_argument if the manifest would write outside of
+		// the directory.
+		Si::optional<std::vector<char>> restore(sha256_digest const &action,
+		                                        boost::filesystem::path const &output_directory);
+
+		std::uint64_t hits() const
+		{
+			return m_hits.load();
+		}
+
+		std::uint64_t misses() const
+		{
+			return m_misses.load();
+		}
+
+	private:
+		boost::filesystem::path m_root;
+		std::atomic<std::uint64_t> m_hits;
+		std::atomic<std::uint64_t> m_misses;
+
+		boost::filesystem::path object_path(sha256_digest const &digest) const;
+		boost::filesystem::path action_path(sha256_digest const &action) const;
+		sha256_digest put_object(boost::filesystem::path const &file);
+		sha256_digest put_object(std::vector<char> const &content);
+		boost::filesystem::path make_temporary_path() const;
+	};
+}
+
+#endif
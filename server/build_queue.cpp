@@ -0,0 +1,106 @@
+#include "build_queue.hpp"
+#include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+#include <tuple>
+
+namespace buildserver
+{
+	bool operator==(build_key const &left, build_key const &right)
+	{
+		return std::tie(left.repository, left.branch) == std::tie(right.repository, right.branch);
+	}
+
+	bool operator<(build_key const &left, build_key const &right)
+	{
+		return std::tie(left.repository, left.branch) < std::tie(right.repository, right.branch);
+	}
+
+	bool is_valid_branch_name(Si::memory_range name)
+	{
+		if (name.empty() || (name.size() > 255) || (name.front() == '-') || (name.back() == '/') ||
+		    (name.back() == '.') || boost::algorithm::ends_with(name, Si::make_c_str_range(".lock")))
+		{
+			return false;
+		}
+		// a slash in front of the name, so that a leading slash and a leading dot are caught like empty components
+		// and hidden components
+		char previous = '/';
+		for (char const c : name)
+		{
+			unsigned char const byte = static_cast<unsigned char>(c);
+			if ((byte <= 0x20) || (byte == 0x7f) || (std::strchr("~^:?*[\\", c) != nullptr))
+			{
+				return false;
+			}
+			if (((previous == '.') && (c == '.')) || ((previous == '@') && (c == '{')) ||
+			    ((previous == '/') && ((c == '/') || (c == '.'))))
+			{
+				return false;
+			}
+			previous = c;
+		}
+		return true;
+	}
+
+	bool is_valid_commit(Si::memory_range commit)
+	{
+		if ((commit.size() < 4) || (commit.size() > 64))
+		{
+			return false;
+		}
+		return std::all_of(commit.begin(), commit.end(), [](char c)
+		                   {
+			                   return std::isxdigit(static_cast<unsigned char>(c)) != 0;
+			               });
+	}
+
+	bool pending_builds::push(build_key key, Si::noexcept_string commit)
+	{
+		auto const existing = m_latest_commit.find(key);
+		if (existing != m_latest_commit.end())
+		{
+			existing->second = std::move(commit);
+			return false;
+		}
+		m_latest_commit.insert(std::make_pair(key, std::move(commit)));
+		m_order.emplace_back(std::move(key));
+		return true;
+	}
+
+	Si::optional<build_request> pending_builds::pop()
+	{
+		auto const ready = std::find_if(m_order.begin(), m_order.end(), [this](build_key const &key)
+		                                {
+			                                return m_in_flight.count(key) == 0;
+			                            });
+		if (ready == m_order.end())
+		{
+			return Si::none;
+		}
+		auto const commit = m_latest_commit.find(*ready);
+		assert(commit != m_latest_commit.end());
+		build_request result{std::move(*ready), std::move(commit->second)};
+		m_latest_commit.erase(commit);
+		m_order.erase(ready);
+		m_in_flight.insert(result.key);
+		return std::move(result);
+	}
+
+	void pending_builds::finish(build_key const &key)
+	{
+		m_in_flight.erase(key);
+	}
+
+	std::size_t pending_builds::size() const
+	{
+		return m_order.size();
+	}
+
+	std::size_t pending_builds::in_flight() const
+	{
+		return m_in_flight.size();
+	}
+}
@@ -0,0 +1,116 @@
+#ifndef BUILDSERVER_BUILD_QUEUE_HPP
+#define BUILDSERVER_BUILD_QUEUE_HPP
+
+#include <silicium/memory_range.hpp>
+#include <silicium/noexcept_string.hpp>
+#include <silicium/optional.hpp>
+#include <silicium/os_string.hpp>
+#include <deque>
+#include <map>
+#include <set>
+
+namespace buildserver
+{
+	struct build_key
+	{
+		Si::os_string repository;
+		Si::noexcept_string branch;
+	};
+
+	bool operator==(build_key const &left, build_key const &right);
+	bool operator<(build_key const &left, build_key const &right);
+
+	// Branches and commits arrive in the query of a push notification and end up on the command line of git, so they
+	// are checked before anything is queued. A valid branch name is accepted by git check-ref-format and cannot be
+	// mistaken for an option. A valid commit is an abbreviated or full hexadecimal object name.
+	bool is_valid_branch_name(Si::memory_range name);
+	bool is_valid_commit(Si::memory_range commit);
+
+	struct build_request
+	{
+		build_key key;
+
+		// empty means "whatever the branch points to when the build starts"
+		Si::noexcept_string commit;
+	};
+
+	// Remembers only the latest commit per (repository, branch). A key that is currently being built is not handed
+	// out again until finish() has been called for it, so a branch is never built twice at the same time.
+	struct pending_builds
+	{
+		// returns true if a new build was scheduled, false if the commit of an already pending build was replaced
+		bool push(build_key key, Si::noexcept_string commit);
+
+		// returns the oldest pending build whose key is not in flight and marks that key as in flight
+		Si::optional<build_request> pop();
+
+		void finish(build_key const &key);
+
+		std::size_t size() const;
+		std::size_t in_flight() const;
+
+	private:
+		std::deque<build_key> m_order;
+		std::map<build_key, Si::noexcept_string> m_latest_commit;
+		std::set<build_key> m_in_flight;
+	};
+
+	// An observable of build_request that can be consumed by any number of build workers at the same time.
+	template <class Observer>
+	struct build_queue
+	{
+		typedef build_request element_type;
+
+		template <class ActualObserver>
+		void async_get_one(ActualObserver &&observer)
+		{
+			Si::optional<build_request> next = m_pending.pop();
+			if (next)
+			{
+				std::forward<ActualObserver>(observer).got_element(std::move(*next));
+				return;
+			}
+			m_waiting.emplace_back(Observer(observer));
+		}
+
+		bool push(build_key key, Si::noexcept_string commit)
+		{
+			bool const is_new = m_pending.push(std::move(key), std::move(commit));
+			dispatch();
+			return is_new;
+		}
+
+		void finish(build_key const &key)
+		{
+			m_pending.finish(key);
+			dispatch();
+		}
+
+		pending_builds const &pending() const
+		{
+			return m_pending;
+		}
+
+	private:
+		pending_builds m_pending;
+		std::deque<Observer> m_waiting;
+
+		void dispatch()
+		{
+			while (!m_waiting.empty())
+			{
+				Si::optional<build_request> next = m_pending.pop();
+				if (!next)
+				{
+					return;
+				}
+				// the observer may call async_get_one again before got_element returns
+				Observer receiver = std::move(m_waiting.front());
+				m_waiting.pop_front();
+				std::move(receiver).got_element(std::move(*next));
+			}
+		}
+	};
+}
+
+#endif
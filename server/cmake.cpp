@@ -1,4 +1,6 @@
 #include "cmake.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include <ventura/run_process.hpp>
 #include <silicium/sink/iterator_sink.hpp>
 #include <silicium/sink/virtualized_sink.hpp>
@@ -6,6 +8,13 @@
 
 namespace buildserver
 {
+	namespace
+	{
+		metrics::histogram generate_duration("buildserver_cmake_generate_duration_seconds",
+		                                     "Duration of CMake generate steps");
+		metrics::histogram build_duration("buildserver_cmake_build_duration_seconds", "Duration of CMake builds");
+	}
+
 	cmake::~cmake()
 	{
 	}
@@ -20,6 +29,8 @@ namespace buildserver
 	                                              boost::unordered_map<Si::os_string, Si::os_string> const &definitions,
 	                                              Si::Sink<char, Si::success>::interface &output) const
 	{
+		metrics::scoped_duration const timing(generate_duration);
+		trace_span const span("cmake_exe::generate", "step");
 		std::vector<Si::os_string> arguments;
 		arguments.emplace_back(to_os_string(source));
 		for (auto const &definition : definitions)
@@ -34,6 +45,7 @@ namespace buildserver
 		parameters.arguments = std::move(arguments);
 		parameters.out = &output;
 		parameters.err = &output;
+		metrics::processes_spawned().add();
 		int const rc = ventura::run_process(parameters).get();
 		if (rc != 0)
 		{
@@ -45,6 +57,8 @@ namespace buildserver
 	boost::system::error_code cmake_exe::build(ventura::absolute_path const &build, unsigned cpu_parallelism,
 	                                           Si::Sink<char, Si::success>::interface &output) const
 	{
+		metrics::scoped_duration const timing(build_duration);
+		trace_span const span("cmake_exe::build", "step");
 		std::vector<Si::os_string> arguments{SILICIUM_OS_STR("--build"), SILICIUM_OS_STR(".")
 #ifndef _WIN32
 		                                     // assuming make..
@@ -61,6 +75,7 @@ namespace buildserver
 		parameters.arguments = std::move(arguments);
 		parameters.out = &output;
 		parameters.err = &output;
+		metrics::processes_spawned().add();
 		int const rc = ventura::run_process(parameters).get();
 		if (rc != 0)
 		{
@@ -0,0 +1,96 @@
+#include "dag_runner.hpp"
+
+namespace buildserver
+{
+	dag_node::~dag_node()
+	{
+		std::vector<std::unique_ptr<dag_node>> pending = std::move(edges);
+		while (!pending.empty())
+		{
+			std::unique_ptr<dag_node> next = std::move(pending.back());
+			pending.pop_back();
+			for (std::unique_ptr<dag_node> &edge : next->edges)
+			{
+				pending.emplace_back(std::move(edge));
+			}
+			next->edges.clear();
+		}
+	}
+
+	dag_runner::dag_runner(dag_node const &root)
+	    : m_root(root)
+	    , m_draining(false)
+	{
+	}
+
+	void dag_runner::start(shared_result input)
+	{
+		m_ready.emplace_back(ready_node{&m_root, std::move(input)});
+		drain();
+	}
+
+	void dag_runner::drain()
+	{
+		// a process that completes during async_get_result only adds its successors to the queue
+		if (m_draining)
+		{
+			return;
+		}
+		m_draining = true;
+		while (!m_ready.empty())
+		{
+			ready_node next = std::move(m_ready.back());
+			m_ready.pop_back();
+			std::unique_ptr<process> recycled;
+			std::vector<std::unique_ptr<process>> &finished = m_finished[next.node];
+			if (!finished.empty())
+			{
+				recycled = std::move(finished.back());
+				finished.pop_back();
+			}
+			std::unique_ptr<process> started = next.node->value(next.input, std::move(recycled));
+			if (!started)
+			{
+				continue;
+			}
+			std::size_t const index = allocate_slot();
+			m_slots[index] = slot{next.node, std::move(started)};
+			m_slots[index].running->async_get_result([this, index](shared_result result)
+			                                         {
+				                                         on_result(index, std::move(result));
+				                                     });
+		}
+		m_draining = false;
+	}
+
+	std::size_t dag_runner::allocate_slot()
+	{
+		if (m_free_slots.empty())
+		{
+			m_slots.emplace_back();
+			return m_slots.size() - 1;
+		}
+		std::size_t const index = m_free_slots.back();
+		m_free_slots.pop_back();
+		return index;
+	}
+
+	void dag_runner::on_result(std::size_t index, shared_result result)
+	{
+		slot &finished = m_slots[index];
+		dag_node const &node = *finished.node;
+		m_finished[&node].emplace_back(std::move(finished.running));
+		finished.node = nullptr;
+		m_free_slots.emplace_back(index);
+		if (!result)
+		{
+			return;
+		}
+		// reversed because the queue is a stack, so the first edge starts first
+		for (auto i = node.edges.rbegin(); i != node.edges.rend(); ++i)
+		{
+			m_ready.emplace_back(ready_node{i->get(), result});
+		}
+		drain();
+	}
+}
@@ -0,0 +1,130 @@
+#ifndef BUILDSERVER_DAG_RUNNER_HPP
+#define BUILDSERVER_DAG_RUNNER_HPP
+
+#include <silicium/noexcept_string.hpp>
+#include <silicium/variant.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace buildserver
+{
+	struct scoped_temporary_directory : private boost::noncopyable
+	{
+		boost::filesystem::path where;
+		std::function<void(boost::filesystem::path const &)> on_obsoletion;
+
+		scoped_temporary_directory(boost::filesystem::path where,
+		                           std::function<void(boost::filesystem::path const &)> on_obsoletion)
+		    : where(std::move(where))
+		    , on_obsoletion(std::move(on_obsoletion))
+		{
+		}
+
+		~scoped_temporary_directory() BOOST_NOEXCEPT
+		{
+			if (!on_obsoletion)
+			{
+				return;
+			}
+			on_obsoletion(where);
+		}
+	};
+
+	struct memory_blob
+	{
+		std::vector<char> content;
+	};
+
+	struct failure_description
+	{
+		Si::noexcept_string message;
+	};
+
+	typedef Si::fast_variant<failure_description, std::shared_ptr<scoped_temporary_directory>, memory_blob>
+	    process_result;
+
+	// A result is never changed after it has been produced, so all the successors of a step share one instance
+	// instead of getting a copy each.
+	typedef std::shared_ptr<process_result const> shared_result;
+
+	struct process
+	{
+		virtual ~process()
+		{
+		}
+
+		// A null result means that the process has nothing to pass on, so the successors do not run for this input.
+		virtual void async_get_result(std::function<void(shared_result)> result_handler) = 0;
+	};
+
+	// Creates the process that handles one input of a node. finished is a process that this step created earlier and
+	// that has delivered its result, or null. The step may prepare it for the new input and return it instead of
+	// allocating a new one. Returning null ignores the input.
+	typedef std::function<std::unique_ptr<process>(shared_result const &input, std::unique_ptr<process> finished)>
+	    step;
+
+	struct dag_node
+	{
+		step value;
+		std::vector<std::unique_ptr<dag_node>> edges;
+
+		dag_node()
+		{
+		}
+
+		explicit dag_node(step value)
+		    : value(std::move(value))
+		{
+		}
+
+		// destroys the successors without recursion, so that a deep tree cannot overflow the stack
+		~dag_node();
+	};
+
+	// Runs the steps of a tree of dag_nodes for every input that is given to the root. The nodes that are ready to
+	// start are kept in an explicit queue instead of on the call stack, so neither deep nor wide trees nor processes
+	// that complete synchronously can overflow the stack. Each result is shared by all successors, the running
+	// processes are kept in reused slots, and the finished processes of a node are offered to its step for reuse.
+	// All members have to be used on the thread that runs the handlers of the processes.
+	struct dag_runner : private boost::noncopyable
+	{
+		explicit dag_runner(dag_node const &root);
+
+		void start(shared_result input);
+
+		std::size_t running() const
+		{
+			return m_slots.size() - m_free_slots.size();
+		}
+
+	private:
+		struct ready_node
+		{
+			dag_node const *node;
+			shared_result input;
+		};
+
+		struct slot
+		{
+			dag_node const *node;
+			std::unique_ptr<process> running;
+		};
+
+		dag_node const &m_root;
+		std::vector<ready_node> m_ready;
+		std::vector<slot> m_slots;
+		std::vector<std::size_t> m_free_slots;
+		std::unordered_map<dag_node const *, std::vector<std::unique_ptr<process>>> m_finished;
+		bool m_draining;
+
+		void drain();
+		std::size_t allocate_slot();
+		void on_result(std::size_t index, shared_result result);
+	};
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include "file_io.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace buildserver
+{
+	std::vector<char> read_file(boost::filesystem::path const &file)
+	{
+		std::ifstream in(file.string(), std::ios::binary);
+		if (!in)
+		{
+			throw std::runtime_error("could not open " + file.string());
+		}
+		return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	void write_file(boost::filesystem::path const &file, Si::memory_range content)
+	{
+		std::ofstream out(file.string(), std::ios::binary);
+		out.write(content.begin(), static_cast<std::streamsize>(content.size()));
+		if (!out)
+		{
+			throw std::runtime_error("could not write " + file.string());
+		}
+	}
+
+	void publish_file(boost::filesystem::path const &temporary, boost::filesystem::path const &destination)
+	{
+		boost::filesystem::create_directories(destination.parent_path());
+		boost::filesystem::rename(temporary, destination);
+	}
+
+	void write_file_atomically(boost::filesystem::path const &destination, Si::memory_range content)
+	{
+		boost::filesystem::path const temporary =
+		    destination.parent_path() /
+		    (destination.filename().string() + "." + boost::filesystem::unique_path().string());
+		try
+		{
+			write_file(temporary, content);
+			publish_file(temporary, destination);
+		}
+		catch (...)
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(temporary, ignored);
+			throw;
+		}
+	}
+
+	void create_private_directory(boost::filesystem::path const &directory)
+	{
+		if (boost::filesystem::create_directories(directory))
+		{
+			boost::filesystem::permissions(directory, boost::filesystem::owner_all);
+		}
+#ifndef _WIN32
+		// lstat so that a symlink to a directory of someone else is rejected, too
+		struct stat status;
+		if (::lstat(directory.c_str(), &status) != 0)
+		{
+			throw std::runtime_error("could not inspect " + directory.string());
+		}
+		if (!S_ISDIR(status.st_mode))
+		{
+			throw std::runtime_error(directory.string() + " is not a directory");
+		}
+		if (status.st_uid != ::geteuid())
+		{
+			throw std::runtime_error(directory.string() + " belongs to another user");
+		}
+		if ((status.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+		{
+			throw std::runtime_error(directory.string() + " can be written by other users");
+		}
+#endif
+	}
+}
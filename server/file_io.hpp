@@ -0,0 +1,29 @@
+#ifndef BUILDSERVER_FILE_IO_HPP
+#define BUILDSERVER_FILE_IO_HPP
+
+#include <silicium/memory_range.hpp>
+#include <boost/filesystem/path.hpp>
+#include <vector>
+
+namespace buildserver
+{
+	// Throws std::runtime_error if the file cannot be read.
+	std::vector<char> read_file(boost::filesystem::path const &file);
+
+	// Replaces the file. Throws std::runtime_error if it cannot be written.
+	void write_file(boost::filesystem::path const &file, Si::memory_range content);
+
+	// Renames a completely written file to its destination and creates the parent directories of the destination. Both
+	// have to be on the same file system, so that a concurrent reader sees either no file or the whole file.
+	void publish_file(boost::filesystem::path const &temporary, boost::filesystem::path const &destination);
+
+	// Writes the content under a unique name next to the destination and publishes it.
+	void write_file_atomically(boost::filesystem::path const &destination, Si::memory_range content);
+
+	// Creates the directory so that only the current user can access it. Throws std::runtime_error if the directory
+	// exists already and belongs to another user or can be written by other users, because anyone who can write there
+	// could replace the files that are loaded from it. The parent directories are not checked.
+	void create_private_directory(boost::filesystem::path const &directory);
+}
+
+#endif
@@ -1,23 +1,20 @@
 #ifndef BUILDSERVER_GRAPH_HPP
 #define BUILDSERVER_GRAPH_HPP
 
+#include "graph_blob.hpp"
+#include "graph_stream.hpp"
+#include "graph_symbol.hpp"
 #include <silicium/variant.hpp>
 #include <ventura/absolute_path.hpp>
 #include <ventura/path_segment.hpp>
 #include <silicium/function.hpp>
 #include <vector>
-#include <map>
 #include <cstdint>
 
 namespace graph
 {
 	struct listing;
 
-	struct blob
-	{
-		std::vector<char> content;
-	};
-
 	struct uri
 	{
 		Si::noexcept_string value;
@@ -29,7 +26,7 @@ namespace graph
 	};
 
 	typedef Si::variant<blob, std::shared_ptr<listing>, uri, filesystem_directory_ownership, ventura::absolute_path,
-	                    ventura::path_segment, std::uint32_t> value;
+	                    ventura::path_segment, std::uint32_t, std::shared_ptr<byte_stream>> value;
 
 	enum class atomic_type
 	{
@@ -38,7 +35,8 @@ namespace graph
 		filesystem_directory_ownership,
 		absolute_path,
 		path_segment,
-		uint32
+		uint32,
+		stream
 	};
 
 	struct listing_type;
@@ -47,30 +45,35 @@ namespace graph
 
 	struct listing_type
 	{
-		std::map<Si::noexcept_string, type> entries;
+		symbol_map<type> entries;
 	};
 
+	// Copies share their entries, so a listing can be derived from a large one in O(number of inserted entries):
+	//
+	//   listing derived = *parent;
+	//   derived.entries.insert(std::make_pair("build", build_directory));
 	struct listing
 	{
-		std::map<Si::noexcept_string, value> entries;
+		persistent_symbol_map<value> entries;
 	};
 
-	template <class T, class Listing>
-	T *find_entry_of_type(Listing &list, Si::noexcept_string const &key)
+	// the key can be a symbol or anything that persistent_symbol_map::find_value accepts
+	template <class T, class Listing, class Key>
+	T const *find_entry_of_type(Listing const &list, Key const &key)
 	{
-		auto i = list.entries.find(key);
-		if (i == list.entries.end())
+		value const *const found = list.entries.find_value(key);
+		if (!found)
 		{
 			return nullptr;
 		}
-		return Si::try_get_ptr<T>(i->second);
+		return Si::try_get_ptr<T>(*found);
 	}
 
 	struct input_type_mismatch
 	{
 	};
 
-	value expect_value(Si::variant<input_type_mismatch, value> maybe)
+	inline value expect_value(Si::variant<input_type_mismatch, value> maybe)
 	{
 		return Si::visit<value>(maybe,
 		                        [](input_type_mismatch) -> value
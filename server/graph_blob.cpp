@@ -0,0 +1,61 @@
+#include "graph_blob.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <stdexcept>
+
+namespace graph
+{
+	namespace
+	{
+		struct mapped_file
+		{
+			boost::interprocess::file_mapping file;
+			boost::interprocess::mapped_region region;
+
+			explicit mapped_file(boost::filesystem::path const &path)
+			    : file(path.string().c_str(), boost::interprocess::read_only)
+			    , region(file, boost::interprocess::read_only)
+			{
+			}
+		};
+	}
+
+	blob::blob()
+	{
+	}
+
+	blob::blob(std::vector<char> content)
+	{
+		auto const owner = std::make_shared<std::vector<char> const>(std::move(content));
+		m_content = Si::memory_range(owner->data(), owner->data() + owner->size());
+		m_owner = owner;
+	}
+
+	blob::blob(std::shared_ptr<void const> owner, Si::memory_range content)
+	    : m_owner(std::move(owner))
+	    , m_content(content)
+	{
+	}
+
+	blob blob::map_file(boost::filesystem::path const &file)
+	{
+		// an empty file cannot be mapped
+		if (boost::filesystem::file_size(file) == 0)
+		{
+			return blob();
+		}
+		auto const mapped = std::make_shared<mapped_file const>(file);
+		char const *const begin = static_cast<char const *>(mapped->region.get_address());
+		return blob(mapped, Si::memory_range(begin, begin + mapped->region.get_size()));
+	}
+
+	blob blob::slice(std::size_t offset, std::size_t length) const
+	{
+		if ((offset > size()) || (length > (size() - offset)))
+		{
+			throw std::out_of_range("blob slice out of range");
+		}
+		return blob(m_owner, Si::memory_range(begin() + offset, begin() + offset + length));
+	}
+}
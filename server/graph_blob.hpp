@@ -0,0 +1,67 @@
+#ifndef BUILDSERVER_GRAPH_BLOB_HPP
+#define BUILDSERVER_GRAPH_BLOB_HPP
+
+#include <silicium/memory_range.hpp>
+#include <boost/filesystem/path.hpp>
+#include <memory>
+#include <vector>
+
+namespace graph
+{
+	// An immutable sequence of bytes. Copies and slices share the storage, so passing a blob from node to node costs
+	// a reference count increment regardless of its size.
+	struct blob
+	{
+		blob();
+
+		// takes the bytes over without copying them
+		blob(std::vector<char> content);
+
+		// The content has to stay valid and unchanged as long as the owner exists.
+		blob(std::shared_ptr<void const> owner, Si::memory_range content);
+
+		// Maps the file into memory read-only. Pages are only loaded when they are read, so a huge file is never
+		// resident as a whole. The file must not be modified while a blob refers to it. Throws
+		// boost::interprocess::interprocess_exception if the file cannot be mapped.
+		static blob map_file(boost::filesystem::path const &file);
+
+		Si::memory_range content() const
+		{
+			return m_content;
+		}
+
+		char const *begin() const
+		{
+			return m_content.begin();
+		}
+
+		char const *end() const
+		{
+			return m_content.end();
+		}
+
+		std::size_t size() const
+		{
+			return static_cast<std::size_t>(m_content.size());
+		}
+
+		bool empty() const
+		{
+			return m_content.empty();
+		}
+
+		// shares the storage, throws std::out_of_range if the slice does not fit
+		blob slice(std::size_t offset, std::size_t length) const;
+
+		std::shared_ptr<void const> const &owner() const
+		{
+			return m_owner;
+		}
+
+	private:
+		std::shared_ptr<void const> m_owner;
+		Si::memory_range m_content;
+	};
+}
+
+#endif
@@ -0,0 +1,555 @@
+#include "graph_executor.hpp"
+#include "thread_local.hpp"
+#include "trace.hpp"
+#include <boost/thread/lock_guard.hpp>
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <stdexcept>
+
+namespace graph
+{
+	namespace
+	{
+		// set in the worker threads so that submit() knows which queue is the local one
+		BUILDSERVER_THREAD_LOCAL work_stealing_pool *current_pool = nullptr;
+		BUILDSERVER_THREAD_LOCAL std::size_t current_worker = 0;
+	}
+
+	work_stealing_pool::work_stealing_pool(std::size_t thread_count)
+	    : m_queued(0)
+	    , m_next_queue(0)
+	    , m_stopping(false)
+	{
+		if (thread_count == 0)
+		{
+			throw std::invalid_argument("a work_stealing_pool needs at least one thread");
+		}
+		for (std::size_t i = 0; i < thread_count; ++i)
+		{
+			m_queues.emplace_back(new worker_queue);
+		}
+		for (std::size_t i = 0; i < thread_count; ++i)
+		{
+			m_threads.emplace_back([this, i]()
+			                       {
+				                       work(i);
+				                   });
+		}
+	}
+
+	work_stealing_pool::~work_stealing_pool()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_sleeping);
+			m_stopping = true;
+		}
+		m_wake_up.notify_all();
+		for (boost::thread &thread : m_threads)
+		{
+			thread.join();
+		}
+	}
+
+	void work_stealing_pool::submit(std::function<void()> task)
+	{
+		std::size_t const queue_index = (current_pool == this)
+		                                    ? current_worker
+		                                    : (m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size());
+		worker_queue &queue = *m_queues[queue_index];
+		{
+			boost::lock_guard<boost::mutex> lock(queue.access);
+			queue.tasks.emplace_back(std::move(task));
+		}
+		m_queued.fetch_add(1);
+		{
+			// a worker checks m_queued while holding this mutex before it waits, so taking the mutex here makes sure
+			// that the notification cannot get lost between the check and the wait
+			boost::lock_guard<boost::mutex> lock(m_sleeping);
+		}
+		m_wake_up.notify_one();
+	}
+
+	bool work_stealing_pool::run_pending_task()
+	{
+		std::function<void()> task;
+		if (!try_take((current_pool == this) ? current_worker : 0, task))
+		{
+			return false;
+		}
+		m_queued.fetch_sub(1);
+		task();
+		return true;
+	}
+
+	bool work_stealing_pool::is_worker_thread() const
+	{
+		return current_pool == this;
+	}
+
+	void work_stealing_pool::work(std::size_t index)
+	{
+		current_pool = this;
+		current_worker = index;
+		std::function<void()> task;
+		for (;;)
+		{
+			if (try_take(index, task))
+			{
+				m_queued.fetch_sub(1);
+				task();
+				task = nullptr;
+				continue;
+			}
+			boost::unique_lock<boost::mutex> lock(m_sleeping);
+			while ((m_queued.load() == 0) && !m_stopping)
+			{
+				m_wake_up.wait(lock);
+			}
+			if ((m_queued.load() == 0) && m_stopping)
+			{
+				return;
+			}
+		}
+	}
+
+	bool work_stealing_pool::try_take(std::size_t index, std::function<void()> &task)
+	{
+		{
+			worker_queue &own = *m_queues[index];
+			boost::lock_guard<boost::mutex> lock(own.access);
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (std::size_t i = 1; i < m_queues.size(); ++i)
+		{
+			worker_queue &victim = *m_queues[(index + i) % m_queues.size()];
+			boost::lock_guard<boost::mutex> lock(victim.access);
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	node_id dag::add_node(typed_transformation transformation, argument input, symbol name)
+	{
+		check_input(check_argument(input), transformation);
+		interned_type const output_type(transformation.output);
+		dag_node added{std::move(transformation), output_type, name, false, {}};
+		added.arguments.emplace_back(symbol(""), std::move(input));
+		m_nodes.emplace_back(std::move(added));
+		return node_id{m_nodes.size() - 1};
+	}
+
+	node_id dag::add_node(typed_transformation transformation, std::map<Si::noexcept_string, argument> inputs,
+	                      symbol name)
+	{
+		symbol_map<interned_type> assembled;
+		assembled.reserve(inputs.size());
+		for (auto const &input : inputs)
+		{
+			assembled.insert(std::make_pair(input.first, check_argument(input.second)));
+		}
+		check_input(interned_type(assembled), transformation);
+		interned_type const output_type(transformation.output);
+		dag_node added{std::move(transformation), output_type, name, true, {}};
+		for (auto &input : inputs)
+		{
+			added.arguments.emplace_back(input.first, std::move(input.second));
+		}
+		m_nodes.emplace_back(std::move(added));
+		return node_id{m_nodes.size() - 1};
+	}
+
+	interned_type dag::check_argument(argument const &checked) const
+	{
+		return Si::visit<interned_type>(
+		    checked,
+		    [](constant const &constant_)
+		    {
+			    return type_of(constant_.content);
+			},
+		    [this](dependency const &dependency_) -> interned_type
+		    {
+			    if (dependency_.from.index >= m_nodes.size())
+			    {
+				    throw std::invalid_argument("a node can only depend on nodes that have been added before");
+			    }
+			    interned_type const output_type = m_nodes[dependency_.from.index].output_type;
+			    if (dependency_.entry.empty())
+			    {
+				    return output_type;
+			    }
+			    if (!output_type.is_listing())
+			    {
+				    throw std::invalid_argument("an entry of a value was requested that is not a listing");
+			    }
+			    Si::optional<interned_type> const entry = output_type.find_entry(dependency_.entry);
+			    if (!entry)
+			    {
+				    throw std::invalid_argument("a requested listing entry does not exist");
+			    }
+			    return *entry;
+			});
+	}
+
+	void dag::check_input(interned_type arguments, typed_transformation const &transformation)
+	{
+		if (!is_compatible(arguments, interned_type(transformation.input)))
+		{
+			throw std::invalid_argument("the arguments of a node do not match the input type of its transformation");
+		}
+	}
+
+	duration_history::duration_history(std::chrono::nanoseconds unknown)
+	    : m_unknown(unknown)
+	{
+	}
+
+	void duration_history::record(symbol name, std::chrono::nanoseconds elapsed)
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		auto const existing = m_estimates.find(name);
+		if (existing == m_estimates.end())
+		{
+			m_estimates.insert(std::make_pair(name, elapsed));
+			return;
+		}
+		// a moving average so that one unusually slow run does not dominate the estimate
+		existing->second = (existing->second * 3 + elapsed) / 4;
+	}
+
+	std::chrono::nanoseconds duration_history::estimate(symbol name) const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		auto const existing = m_estimates.find(name);
+		if (existing == m_estimates.end())
+		{
+			return m_unknown;
+		}
+		return existing->second;
+	}
+
+	namespace
+	{
+		struct execution
+		{
+			dag const &graph;
+			work_stealing_pool &pool;
+			buildserver::trace_recorder *trace;
+			duration_history *durations;
+			std::vector<std::vector<std::size_t>> dependents;
+			std::unique_ptr<std::atomic<std::size_t>[]> missing_dependencies;
+
+			// the estimated time from the start of a node to the end of the longest chain of nodes that depend on it
+			std::vector<std::uint64_t> remaining_path;
+
+			// every element is written by exactly one task before its dependents are scheduled
+			std::vector<Si::optional<value>> results;
+
+			boost::mutex access;
+			boost::condition_variable finished;
+			std::size_t running;
+
+			// incremented whenever a node finishes, so that a waiting worker can tell whether it missed a notification
+			// while it was looking for a task to help with
+			std::size_t finished_nodes;
+			std::exception_ptr failure;
+
+			// a heap of the nodes whose dependencies are done, the node with the longest remaining path on top
+			std::vector<std::size_t> ready;
+
+			execution(dag const &graph, work_stealing_pool &pool, duration_history *durations)
+			    : graph(graph)
+			    , pool(pool)
+			    , trace(buildserver::current_trace())
+			    , durations(durations)
+			    , dependents(graph.nodes().size())
+			    , missing_dependencies(new std::atomic<std::size_t>[graph.nodes().size()])
+			    , remaining_path(graph.nodes().size())
+			    , results(graph.nodes().size())
+			    , running(0)
+			    , finished_nodes(0)
+			{
+			}
+		};
+
+		struct shorter_remaining_path
+		{
+			std::vector<std::uint64_t> const *remaining_path;
+
+			bool operator()(std::size_t left, std::size_t right) const
+			{
+				std::uint64_t const left_path = (*remaining_path)[left];
+				std::uint64_t const right_path = (*remaining_path)[right];
+				// among equally long paths the node that was added first is preferred
+				return (left_path < right_path) || ((left_path == right_path) && (left > right));
+			}
+		};
+
+		value resolve(execution const &state, argument const &resolved)
+		{
+			return Si::visit<value>(
+			    resolved,
+			    [](constant const &constant_) -> value
+			    {
+				    return constant_.content;
+				},
+			    [&state](dependency const &dependency_) -> value
+			    {
+				    value const &output = *state.results[dependency_.from.index];
+				    if (dependency_.entry.empty())
+				    {
+					    return output;
+				    }
+				    // dag::add_node has checked the types and run_node has checked the output against them
+				    auto const *const output_listing = Si::try_get_ptr<std::shared_ptr<listing>>(output);
+				    assert(output_listing);
+				    auto const found = (*output_listing)->entries.find(dependency_.entry);
+				    assert(found != (*output_listing)->entries.end());
+				    return found->second;
+				});
+		}
+
+		value transform_arguments(execution const &state, dag_node const &node)
+		{
+			if (!node.assembles_listing)
+			{
+				return node.transformation.transform(resolve(state, node.arguments.front().second));
+			}
+			auto input = std::make_shared<listing>();
+			input->entries.reserve(node.arguments.size());
+			for (auto const &argument_ : node.arguments)
+			{
+				input->entries.insert(std::make_pair(argument_.first, resolve(state, argument_.second)));
+			}
+			return node.transformation.transform(std::move(input));
+		}
+
+		value run_node(execution const &state, dag_node const &node)
+		{
+			value output = transform_arguments(state, node);
+			if (!has_type(output, node.output_type))
+			{
+				throw std::runtime_error("the node " + std::string(node.name.name().c_str()) +
+				                         " returned a value that does not have the output type of its transformation");
+			}
+			return output;
+		}
+
+		void schedule(std::shared_ptr<execution> const &state, std::size_t node);
+
+		void finish_node(std::shared_ptr<execution> const &state, std::size_t node, std::exception_ptr error)
+		{
+			bool may_continue = false;
+			{
+				boost::lock_guard<boost::mutex> lock(state->access);
+				if (error && !state->failure)
+				{
+					state->failure = error;
+				}
+				may_continue = !state->failure;
+				if (may_continue)
+				{
+					// the counter is incremented before this task stops counting as running so that the caller of
+					// execute() cannot observe zero in between
+					for (std::size_t dependent : state->dependents[node])
+					{
+						if (state->missing_dependencies[dependent].fetch_sub(1) == 1)
+						{
+							++state->running;
+							schedule(state, dependent);
+						}
+					}
+				}
+				--state->running;
+				++state->finished_nodes;
+			}
+			state->finished.notify_all();
+		}
+
+		// Has to be called with the access mutex locked. Every submitted task runs the most urgent node that is ready
+		// when the task starts, not necessarily the one that was passed here.
+		void schedule(std::shared_ptr<execution> const &state, std::size_t node)
+		{
+			state->ready.emplace_back(node);
+			std::push_heap(state->ready.begin(), state->ready.end(), shorter_remaining_path{&state->remaining_path});
+			state->pool.submit([state]()
+			                   {
+				                   std::size_t node = 0;
+				                   {
+					                   boost::lock_guard<boost::mutex> lock(state->access);
+					                   std::pop_heap(state->ready.begin(), state->ready.end(),
+					                                 shorter_remaining_path{&state->remaining_path});
+					                   node = state->ready.back();
+					                   state->ready.pop_back();
+				                   }
+				                   dag_node const &running = state->graph.nodes()[node];
+				                   std::exception_ptr error;
+				                   try
+				                   {
+					                   buildserver::trace_scope const tracing(state->trace);
+					                   buildserver::trace_span const span(running.name.name().c_str(), "graph");
+					                   auto const started = std::chrono::steady_clock::now();
+					                   state->results[node] = run_node(*state, running);
+					                   if (state->durations)
+					                   {
+						                   state->durations->record(running.name,
+						                                            std::chrono::steady_clock::now() - started);
+					                   }
+				                   }
+				                   catch (...)
+				                   {
+					                   error = std::current_exception();
+				                   }
+				                   finish_node(state, node, error);
+				               });
+		}
+
+		void for_each_dependency(dag_node const &node, std::function<void(std::size_t)> const &visit)
+		{
+			for (auto const &argument_ : node.arguments)
+			{
+				if (dependency const *const from_node = Si::try_get_ptr<dependency>(argument_.second))
+				{
+					visit(from_node->from.index);
+				}
+			}
+		}
+
+		// runs the nodes marked as needed, which have to include all of their dependencies
+		std::vector<Si::optional<value>> run_needed(dag const &graph, work_stealing_pool &pool,
+		                                            duration_history *durations, std::vector<bool> const &needed)
+		{
+			std::vector<dag_node> const &nodes = graph.nodes();
+			auto const state = std::make_shared<execution>(graph, pool, durations);
+			for (std::size_t i = 0; i < nodes.size(); ++i)
+			{
+				if (!needed[i])
+				{
+					continue;
+				}
+				std::vector<std::size_t> dependencies;
+				for_each_dependency(nodes[i], [&dependencies](std::size_t from)
+				                    {
+					                    dependencies.emplace_back(from);
+					                });
+				std::sort(dependencies.begin(), dependencies.end());
+				dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+				state->missing_dependencies[i].store(dependencies.size());
+				for (std::size_t dependency_ : dependencies)
+				{
+					state->dependents[dependency_].emplace_back(i);
+				}
+			}
+			// dependents always come after their dependencies, so walking backwards visits them first
+			for (std::size_t i = nodes.size(); i > 0; --i)
+			{
+				std::size_t const node = i - 1;
+				if (!needed[node])
+				{
+					continue;
+				}
+				std::uint64_t longest_dependent = 0;
+				for (std::size_t dependent : state->dependents[node])
+				{
+					longest_dependent = (std::max)(longest_dependent, state->remaining_path[dependent]);
+				}
+				std::uint64_t const cost =
+				    durations ? static_cast<std::uint64_t>(durations->estimate(nodes[node].name).count()) : 1;
+				state->remaining_path[node] = cost + longest_dependent;
+			}
+			{
+				boost::unique_lock<boost::mutex> lock(state->access);
+				for (std::size_t i = 0; i < nodes.size(); ++i)
+				{
+					if (needed[i] && (state->missing_dependencies[i].load() == 0))
+					{
+						++state->running;
+						schedule(state, i);
+					}
+				}
+				buildserver::trace_span const waiting("wait for graph nodes", "wait");
+				bool const can_help = pool.is_worker_thread();
+				while (state->running > 0)
+				{
+					if (can_help)
+					{
+						// Blocking here would take a thread away from the pool, and with every worker blocked the
+						// nodes of this graph would never run. The task may belong to another graph.
+						std::size_t const seen = state->finished_nodes;
+						lock.unlock();
+						bool const helped = pool.run_pending_task();
+						lock.lock();
+						if (helped || (state->finished_nodes != seen))
+						{
+							continue;
+						}
+					}
+					state->finished.wait(lock);
+				}
+				if (state->failure)
+				{
+					std::rethrow_exception(state->failure);
+				}
+			}
+			return std::move(state->results);
+		}
+	}
+
+	std::vector<value> execute(dag const &graph, work_stealing_pool &pool, duration_history *durations)
+	{
+		std::vector<Si::optional<value>> results =
+		    run_needed(graph, pool, durations, std::vector<bool>(graph.nodes().size(), true));
+		std::vector<value> outputs;
+		outputs.reserve(results.size());
+		for (Si::optional<value> &result : results)
+		{
+			outputs.emplace_back(std::move(*result));
+		}
+		return outputs;
+	}
+
+	std::vector<value> evaluate(dag const &graph, std::vector<node_id> const &wanted, work_stealing_pool &pool,
+	                            duration_history *durations)
+	{
+		std::vector<dag_node> const &nodes = graph.nodes();
+		std::vector<bool> needed(nodes.size(), false);
+		for (node_id const &requested : wanted)
+		{
+			if (requested.index >= nodes.size())
+			{
+				throw std::invalid_argument("the requested node is not part of the graph");
+			}
+			needed[requested.index] = true;
+		}
+		// dependencies always have a lower index than their dependents, so a single pass from the back finds all of
+		// the transitive dependencies
+		for (std::size_t i = nodes.size(); i > 0; --i)
+		{
+			if (needed[i - 1])
+			{
+				for_each_dependency(nodes[i - 1], [&needed](std::size_t from)
+				                    {
+					                    needed[from] = true;
+					                });
+			}
+		}
+		std::vector<Si::optional<value>> results = run_needed(graph, pool, durations, needed);
+		std::vector<value> outputs;
+		outputs.reserve(wanted.size());
+		for (node_id const &requested : wanted)
+		{
+			outputs.emplace_back(*results[requested.index]);
+		}
+		return outputs;
+	}
+}
@@ -0,0 +1,159 @@
+#ifndef BUILDSERVER_GRAPH_EXECUTOR_HPP
+#define BUILDSERVER_GRAPH_EXECUTOR_HPP
+
+#include "graph_type.hpp"
+#include <silicium/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace graph
+{
+	// A fixed set of threads with one task queue each. A worker takes its own newest task first, which keeps the
+	// output of a node hot in the cache for the node that consumes it, and steals the oldest task of another worker
+	// when its own queue is empty.
+	struct work_stealing_pool : private boost::noncopyable
+	{
+		explicit work_stealing_pool(std::size_t thread_count);
+		~work_stealing_pool();
+
+		// Tasks submitted from a worker of this pool go to the queue of that worker. Tasks must not throw.
+		void submit(std::function<void()> task);
+
+		// Runs one queued task on the calling thread, preferring the newest task of the own queue when called from a
+		// worker. Returns false if every queue was empty.
+		bool run_pending_task();
+
+		// true if the calling thread is one of the workers of this pool
+		bool is_worker_thread() const;
+
+		std::size_t thread_count() const
+		{
+			return m_queues.size();
+		}
+
+	private:
+		struct worker_queue
+		{
+			boost::mutex access;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::unique_ptr<worker_queue>> m_queues;
+		std::atomic<std::size_t> m_queued;
+		std::atomic<std::size_t> m_next_queue;
+		boost::mutex m_sleeping;
+		boost::condition_variable m_wake_up;
+		bool m_stopping;
+		std::vector<boost::thread> m_threads;
+
+		void work(std::size_t index);
+		bool try_take(std::size_t index, std::function<void()> &task);
+	};
+
+	struct node_id
+	{
+		std::size_t index;
+	};
+
+	struct constant
+	{
+		value content;
+	};
+
+	// the output of another node, or one entry of it if the other node returns a listing
+	struct dependency
+	{
+		node_id from;
+		Si::noexcept_string entry;
+	};
+
+	typedef Si::variant<constant, dependency> argument;
+
+	struct dag_node
+	{
+		typed_transformation transformation;
+		interned_type output_type;
+
+		// the name of the span that is recorded for this node when a trace is installed
+		symbol name;
+
+		// true if the input is a listing assembled from the arguments, false if there is exactly one argument that
+		// is passed as it is
+		bool assembles_listing;
+
+		std::vector<std::pair<symbol, argument>> arguments;
+	};
+
+	// A node can only depend on nodes that were added before it, so every dag is acyclic by construction. add_node
+	// also checks that the types of the arguments are compatible with the input of the transformation and throws
+	// std::invalid_argument otherwise. Returning a value of the output type is up to the transformation: the executor
+	// checks every output with has_type and fails the evaluation with std::runtime_error if it does not match, so a
+	// transformation only ever sees values of its input type, even when a buggy or remote step produced the values.
+	struct dag
+	{
+		node_id add_node(typed_transformation transformation, argument input, symbol name = symbol("node"));
+		node_id add_node(typed_transformation transformation, std::map<Si::noexcept_string, argument> inputs,
+		                 symbol name = symbol("node"));
+
+		std::vector<dag_node> const &nodes() const
+		{
+			return m_nodes;
+		}
+
+	private:
+		std::vector<dag_node> m_nodes;
+
+		interned_type check_argument(argument const &checked) const;
+		static void check_input(interned_type arguments, typed_transformation const &transformation);
+	};
+
+	// How long the nodes of a name took in earlier runs. The executor uses the estimates to start the nodes at the
+	// beginning of the longest remaining chain first when more nodes are ready than the pool has threads.
+	struct duration_history : private boost::noncopyable
+	{
+		// the estimate for names that have not been recorded yet
+		explicit duration_history(std::chrono::nanoseconds unknown);
+
+		void record(symbol name, std::chrono::nanoseconds elapsed);
+		std::chrono::nanoseconds estimate(symbol name) const;
+
+	private:
+		mutable boost::mutex m_access;
+		symbol_map<std::chrono::nanoseconds> m_estimates;
+		std::chrono::nanoseconds m_unknown;
+	};
+
+	// Runs every node of the graph as soon as all of its dependencies are available and blocks until all nodes are
+	// done. The result contains the output of every node, indexed like dag::nodes(). If a transformation throws, no
+	// further nodes are started and the first exception is rethrown once the running ones have finished.
+	//
+	// If the calling thread has a buildserver::trace_scope, every node is recorded as a span on the thread that runs
+	// it, and the spans of the transformations go into the same trace.
+	//
+	// A transformation may call execute() or evaluate() with the pool it runs on. A worker that waits for a graph
+	// runs queued tasks of the pool in the meantime instead of blocking, so nested graphs cannot starve the pool even
+	// if every worker is waiting.
+	//
+	// Ready nodes are started in the order of the estimated time from their start to the end of the graph, so that
+	// the critical path is not delayed by work that could run later. With durations, the estimates come from earlier
+	// runs and the durations of this run are recorded under the names of the nodes. Without, every node counts the
+	// same.
+	std::vector<value> execute(dag const &graph, work_stealing_pool &pool, duration_history *durations = nullptr);
+
+	// Like execute(), but only runs the wanted nodes and the nodes they transitively depend on. The result contains
+	// the outputs of the wanted nodes in the requested order. Together with memoize(), asking again for an output
+	// whose inputs have not changed does not repeat any of the work. A node that reads a stream has to be requested
+	// together with the node that writes it.
+	std::vector<value> evaluate(dag const &graph, std::vector<node_id> const &wanted, work_stealing_pool &pool,
+	                            duration_history *durations = nullptr);
+}
+
+#endif
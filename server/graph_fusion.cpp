@@ -0,0 +1,86 @@
+#include "graph_fusion.hpp"
+#include "graph_type.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace graph
+{
+	pipeline_stage make_stage(typed_transformation transformation)
+	{
+		untyped_transformation transform = std::move(transformation.transform);
+		return pipeline_stage{std::move(transformation.input), std::move(transformation.output),
+		                      [transform](value &changed)
+		                      {
+			                      changed = transform(std::move(changed));
+			                  }};
+	}
+
+	pipeline_stage make_in_place_stage(type input, type output, in_place_function apply)
+	{
+		return pipeline_stage{std::move(input), std::move(output), std::move(apply)};
+	}
+
+	pipeline_stage make_identity_stage(type passed)
+	{
+		return pipeline_stage{passed, passed, in_place_function()};
+	}
+
+	listing &mutable_listing(value &changed)
+	{
+		auto *const shared = Si::try_get_ptr<std::shared_ptr<listing>>(changed);
+		if (!shared || !*shared)
+		{
+			throw std::invalid_argument("expected a listing");
+		}
+		// nobody else can obtain a new reference while this one is the only one, so the count cannot grow in between
+		if (shared->use_count() != 1)
+		{
+			*shared = std::make_shared<listing>(**shared);
+		}
+		return **shared;
+	}
+
+	typed_transformation fuse(std::vector<pipeline_stage> stages)
+	{
+		if (stages.empty())
+		{
+			throw std::invalid_argument("a pipeline needs at least one stage");
+		}
+		for (std::size_t i = 1; i < stages.size(); ++i)
+		{
+			if (!is_compatible(interned_type(stages[i - 1].output), interned_type(stages[i].input)))
+			{
+				throw std::invalid_argument("the output of a pipeline stage does not fit the input of the next one");
+			}
+		}
+		type input = stages.front().input;
+		type output = stages.back().output;
+		stages.erase(std::remove_if(stages.begin(), stages.end(),
+		                            [](pipeline_stage const &stage)
+		                            {
+			                            return !stage.apply;
+			                        }),
+		             stages.end());
+		if (stages.empty())
+		{
+			return typed_transformation{std::move(input), std::move(output), [](value passed)
+			                            {
+				                            return passed;
+				                        }};
+		}
+		auto const applied = std::make_shared<std::vector<in_place_function>>();
+		applied->reserve(stages.size());
+		for (pipeline_stage &stage : stages)
+		{
+			applied->emplace_back(std::move(stage.apply));
+		}
+		return typed_transformation{std::move(input), std::move(output), [applied](value passed)
+		                            {
+			                            for (in_place_function const &apply : *applied)
+			                            {
+				                            apply(passed);
+			                            }
+			                            return passed;
+			                        }};
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef BUILDSERVER_GRAPH_FUSION_HPP
+#define BUILDSERVER_GRAPH_FUSION_HPP
+
+#include "graph.hpp"
+#include <vector>
+
+namespace graph
+{
+	// A step of a fused pipeline. It replaces the value it is given, which the pipeline owns exclusively, so the step
+	// can update the value in place instead of building a new one.
+	typedef Si::function<void(value &)> in_place_function;
+
+	struct pipeline_stage
+	{
+		type input;
+		type output;
+
+		// empty for a stage that passes the value on unchanged
+		in_place_function apply;
+	};
+
+	// The transformation receives the value of the previous stage by move, so it can use mutable_listing() on its
+	// argument as well.
+	pipeline_stage make_stage(typed_transformation transformation);
+
+	pipeline_stage make_in_place_stage(type input, type output, in_place_function apply);
+	pipeline_stage make_identity_stage(type passed);
+
+	// The listing in the value, which is copied first if another value refers to it, too. A value that is passed
+	// through a pipeline or moved into a transformation is usually the only reference, so extending or changing the
+	// listing of the previous step does not allocate a new one. Throws std::invalid_argument if the value is not a
+	// listing.
+	listing &mutable_listing(value &changed);
+
+	// Combines a linear chain of pure stages into one transformation that passes a single value through all of them.
+	// Identity stages are dropped. Throws std::invalid_argument if the chain is empty or an output is not compatible
+	// with the input of the next stage, so the types are checked once here instead of between the stages.
+	typed_transformation fuse(std::vector<pipeline_stage> stages);
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "graph_hash.hpp"
+#include <boost/thread/lock_guard.hpp>
+#include <stdexcept>
+
+namespace graph
+{
+	namespace
+	{
+		enum class value_tag : std::uint8_t
+		{
+			blob,
+			listing,
+			uri,
+			filesystem_directory_ownership,
+			absolute_path,
+			path_segment,
+			uint32
+		};
+
+		void hash_tag(buildserver::sha256 &hasher, value_tag tag)
+		{
+			char const encoded = static_cast<char>(tag);
+			hasher.update(Si::memory_range(&encoded, &encoded + 1));
+		}
+
+		void hash_integer(buildserver::sha256 &hasher, std::uint64_t integer, std::size_t size)
+		{
+			char encoded[8];
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				encoded[i] = static_cast<char>(integer >> (8 * i));
+			}
+			hasher.update(Si::memory_range(encoded, encoded + size));
+		}
+
+		void hash_bytes(buildserver::sha256 &hasher, char const *begin, std::size_t size)
+		{
+			hash_integer(hasher, size, 8);
+			hasher.update(Si::memory_range(begin, begin + size));
+		}
+
+		template <class String>
+		void hash_string(buildserver::sha256 &hasher, String const &hashed)
+		{
+			hash_bytes(hasher, hashed.data(), hashed.size());
+		}
+
+		void hash_path(buildserver::sha256 &hasher, boost::filesystem::path const &hashed)
+		{
+			hash_string(hasher, hashed.string());
+		}
+	}
+
+	void hash_value(buildserver::sha256 &hasher, value const &hashed)
+	{
+		return Si::visit<void>(hashed,
+		                       [&hasher](blob const &content)
+		                       {
+			                       hash_tag(hasher, value_tag::blob);
+			                       hash_bytes(hasher, content.begin(), content.size());
+			                   },
+		                       [&hasher](std::shared_ptr<listing> const &content)
+		                       {
+			                       if (!content)
+			                       {
+				                       throw std::invalid_argument("cannot hash a null listing");
+			                       }
+			                       hash_tag(hasher, value_tag::listing);
+			                       hash_integer(hasher, content->entries.size(), 8);
+			                       // the entries are sorted by key, so equal listings are hashed in the same order
+			                       for (auto const &entry : content->entries)
+			                       {
+				                       hash_string(hasher, entry.first.name());
+				                       hash_value(hasher, entry.second);
+			                       }
+			                   },
+		                       [&hasher](uri const &content)
+		                       {
+			                       hash_tag(hasher, value_tag::uri);
+			                       hash_string(hasher, content.value);
+			                   },
+		                       [&hasher](filesystem_directory_ownership const &content)
+		                       {
+			                       hash_tag(hasher, value_tag::filesystem_directory_ownership);
+			                       hash_path(hasher, content.owned.to_boost_path());
+			                   },
+		                       [&hasher](ventura::absolute_path const &content)
+		                       {
+			                       hash_tag(hasher, value_tag::absolute_path);
+			                       hash_path(hasher, content.to_boost_path());
+			                   },
+		                       [&hasher](ventura::path_segment const &content)
+		                       {
+			                       hash_tag(hasher, value_tag::path_segment);
+			                       hash_path(hasher, content.to_boost_path());
+			                   },
+		                       [&hasher](std::uint32_t content)
+		                       {
+			                       hash_tag(hasher, value_tag::uint32);
+			                       hash_integer(hasher, content, 4);
+			                   },
+		                       [](std::shared_ptr<byte_stream> const &)
+		                       {
+			                       // the content is not known yet, so a node with a stream input cannot be memoized
+			                       throw std::invalid_argument("cannot hash a stream");
+			                   });
+	}
+
+	value_digest hash_value(value const &hashed)
+	{
+		buildserver::sha256 hasher;
+		hash_value(hasher, hashed);
+		return hasher.finish();
+	}
+
+	memo_cache::memo_cache(std::size_t capacity)
+	    : m_capacity(capacity)
+	    , m_hits(0)
+	    , m_misses(0)
+	{
+	}
+
+	Si::optional<value> memo_cache::find(value_digest const &key) const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		auto const found = m_results.find(key);
+		if (found == m_results.end())
+		{
+			++m_misses;
+			return Si::none;
+		}
+		++m_hits;
+		return found->second;
+	}
+
+	void memo_cache::insert(value_digest const &key, value result)
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		if (m_capacity == 0)
+		{
+			return;
+		}
+		// two threads may have computed the same result concurrently, the first one wins
+		if (!m_results.insert(std::make_pair(key, std::move(result))).second)
+		{
+			return;
+		}
+		m_insertion_order.emplace_back(key);
+		if (m_insertion_order.size() > m_capacity)
+		{
+			m_results.erase(m_insertion_order.front());
+			m_insertion_order.pop_front();
+		}
+	}
+
+	std::size_t memo_cache::size() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		return m_results.size();
+	}
+
+	std::uint64_t memo_cache::hits() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		return m_hits;
+	}
+
+	std::uint64_t memo_cache::misses() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		return m_misses;
+	}
+
+	typed_transformation memoize(Si::noexcept_string name, typed_transformation original, memo_cache &cache)
+	{
+		untyped_transformation transform = std::move(original.transform);
+		original.transform = [name, transform, &cache](value input) -> value
+		{
+			buildserver::sha256 hasher;
+			hash_string(hasher, name);
+			hash_value(hasher, input);
+			value_digest const key = hasher.finish();
+			Si::optional<value> cached = cache.find(key);
+			if (cached)
+			{
+				return std::move(*cached);
+			}
+			value result = transform(std::move(input));
+			cache.insert(key, result);
+			return result;
+		};
+		return original;
+	}
+}
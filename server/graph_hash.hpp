@@ -0,0 +1,50 @@
+#ifndef BUILDSERVER_GRAPH_HASH_HPP
+#define BUILDSERVER_GRAPH_HASH_HPP
+
+#include "graph.hpp"
+#include "sha256.hpp"
+#include <silicium/optional.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+
+namespace graph
+{
+	typedef buildserver::sha256_digest value_digest;
+
+	// Feeds an unambiguous encoding of the value into the hasher: every alternative is tagged and every variable-length
+	// part is prefixed with its length, so different values cannot produce the same byte stream.
+	void hash_value(buildserver::sha256 &hasher, value const &hashed);
+
+	value_digest hash_value(value const &hashed);
+
+	// Results of transformations keyed by the name of the transformation and the digest of the input. When the
+	// capacity is reached, the oldest result is forgotten.
+	struct memo_cache : private boost::noncopyable
+	{
+		explicit memo_cache(std::size_t capacity);
+
+		Si::optional<value> find(value_digest const &key) const;
+		void insert(value_digest const &key, value result);
+
+		std::size_t size() const;
+		std::uint64_t hits() const;
+		std::uint64_t misses() const;
+
+	private:
+		mutable boost::mutex m_access;
+		std::map<value_digest, value> m_results;
+		std::deque<value_digest> m_insertion_order;
+		std::size_t m_capacity;
+		mutable std::uint64_t m_hits;
+		mutable std::uint64_t m_misses;
+	};
+
+	// Only for pure transformations: the wrapped transformation is skipped whenever the same name has already been
+	// applied successfully to an equal input. The name has to identify what the transformation does, including its
+	// version if the behaviour may change.
+	typed_transformation memoize(Si::noexcept_string name, typed_transformation original, memo_cache &cache);
+}
+
+#endif
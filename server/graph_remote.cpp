@@ -0,0 +1,687 @@
+#include "graph_remote.hpp"
+#include "graph_executor.hpp"
+#include "graph_serialization.hpp"
+#include "graph_type.hpp"
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <future>
+#include <set>
+#include <stdexcept>
+
+namespace graph
+{
+	void transformation_registry::add(Si::noexcept_string name, typed_transformation transformation)
+	{
+		if (!m_entries.insert(std::make_pair(std::move(name), std::move(transformation))).second)
+		{
+			throw std::invalid_argument("a transformation of this name has already been registered");
+		}
+	}
+
+	typed_transformation const *transformation_registry::find(Si::noexcept_string const &name) const
+	{
+		auto const found = m_entries.find(name);
+		if (found == m_entries.end())
+		{
+			return nullptr;
+		}
+		return &found->second;
+	}
+
+	namespace
+	{
+		enum class message_type : std::uint32_t
+		{
+			hello = 1,
+			invoke = 2,
+			result = 3,
+			failure = 4
+		};
+
+		// a peer that has introduced itself cannot make the other side allocate more than this for one message
+		std::uint32_t const max_frame_size = std::uint32_t(1) << 30;
+
+		std::size_t const frame_size_size = 4;
+
+		void append_integer(std::vector<char> &out, std::uint64_t integer, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				out.push_back(static_cast<char>(integer >> (8 * i)));
+			}
+		}
+
+		void store_integer(char *destination, std::uint64_t integer, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				destination[i] = static_cast<char>(integer >> (8 * i));
+			}
+		}
+
+		std::uint64_t load_integer(char const *source, std::size_t size)
+		{
+			std::uint64_t result = 0;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				result |= std::uint64_t(static_cast<unsigned char>(source[i])) << (8 * i);
+			}
+			return result;
+		}
+
+		std::vector<char> begin_frame(message_type type)
+		{
+			std::vector<char> frame;
+			append_integer(frame, 0, frame_size_size);
+			append_integer(frame, static_cast<std::uint32_t>(type), 4);
+			return frame;
+		}
+
+		void append_string(std::vector<char> &frame, Si::memory_range content)
+		{
+			append_integer(frame, content.size(), 4);
+			frame.insert(frame.end(), content.begin(), content.end());
+		}
+
+		// The padding is relative to the start of the message type, which is where a received frame begins.
+		void pad(std::vector<char> &frame)
+		{
+			while (((frame.size() - frame_size_size) % 8) != 0)
+			{
+				frame.push_back('\0');
+			}
+		}
+
+		std::vector<char> finish_frame(std::vector<char> frame)
+		{
+			std::size_t const size = frame.size() - frame_size_size;
+			if (size > max_frame_size)
+			{
+				throw std::invalid_argument("a message is too large for the remote protocol");
+			}
+			store_integer(frame.data(), size, frame_size_size);
+			return frame;
+		}
+
+		// parses a received frame without the size
+		struct frame_reader
+		{
+			blob frame;
+			std::size_t position;
+
+			explicit frame_reader(blob frame)
+			    : frame(std::move(frame))
+			    , position(0)
+			{
+			}
+
+			Si::memory_range take(std::size_t size)
+			{
+				if ((frame.size() - position) < size)
+				{
+					throw std::invalid_argument("a message of the remote protocol is truncated");
+				}
+				Si::memory_range const taken(frame.begin() + position, frame.begin() + position + size);
+				position += size;
+				return taken;
+			}
+
+			std::uint64_t integer(std::size_t size)
+			{
+				return load_integer(take(size).begin(), size);
+			}
+
+			Si::noexcept_string string()
+			{
+				Si::memory_range const content = take(static_cast<std::size_t>(integer(4)));
+				return Si::noexcept_string(content.begin(), content.end());
+			}
+
+			void skip_padding()
+			{
+				take((8 - (position % 8)) % 8);
+			}
+
+			blob rest() const
+			{
+				return frame.slice(position, frame.size() - position);
+			}
+		};
+
+		// takes as long for every content of the same size, so the time of a rejection tells nothing about the secret
+		bool equal_secrets(Si::memory_range received, Si::memory_range expected)
+		{
+			if (received.size() != expected.size())
+			{
+				return false;
+			}
+			unsigned char difference = 0;
+			for (std::size_t i = 0; i < static_cast<std::size_t>(received.size()); ++i)
+			{
+				difference |= static_cast<unsigned char>(received.begin()[i] ^ expected.begin()[i]);
+			}
+			return difference == 0;
+		}
+
+		// the peer decides which keys a document contains, so they are not interned
+		value read_document(blob const &document)
+		{
+			return materialize_known_keys(open_serialized(document.content()), document);
+		}
+
+		// Owns a socket and exchanges frames over it. All of the functions have to be called on the thread that runs
+		// the io_service, so the other threads post to it.
+		struct connection : std::enable_shared_from_this<connection>, private boost::noncopyable
+		{
+			boost::asio::ip::tcp::socket socket;
+
+			// called with every received frame, starting with the message type; throwing closes the connection
+			std::function<void(blob)> on_frame;
+
+			// called once when the connection fails or is closed
+			std::function<void()> on_closed;
+
+			// larger frames close the connection
+			std::uint32_t max_incoming;
+
+			explicit connection(boost::asio::io_service &io)
+			    : socket(io)
+			    , max_incoming(max_frame_size)
+			    , m_closed(false)
+			{
+			}
+
+			void start_reading()
+			{
+				auto const self = shared_from_this();
+				boost::asio::async_read(socket, boost::asio::buffer(m_size),
+				                        [self](boost::system::error_code error, std::size_t)
+				                        {
+					                        if (error)
+					                        {
+						                        self->close();
+						                        return;
+					                        }
+					                        self->read_frame();
+					                    });
+			}
+
+			void send(std::vector<char> frame)
+			{
+				if (m_closed)
+				{
+					return;
+				}
+				m_outgoing.emplace_back(std::move(frame));
+				if (m_outgoing.size() == 1)
+				{
+					write_next();
+				}
+			}
+
+			void close()
+			{
+				if (m_closed)
+				{
+					return;
+				}
+				m_closed = true;
+				boost::system::error_code ignored;
+				socket.close(ignored);
+				// the callbacks usually keep this connection alive, so they are released to break the cycle
+				std::function<void()> const closed = std::move(on_closed);
+				on_frame = nullptr;
+				on_closed = nullptr;
+				if (closed)
+				{
+					closed();
+				}
+			}
+
+		private:
+			std::array<char, frame_size_size> m_size;
+			std::vector<char> m_incoming;
+			std::deque<std::vector<char>> m_outgoing;
+			bool m_closed;
+
+			void read_frame()
+			{
+				std::uint64_t const size = load_integer(m_size.data(), m_size.size());
+				if ((size < 4) || (size > max_incoming))
+				{
+					close();
+					return;
+				}
+				m_incoming.resize(static_cast<std::size_t>(size));
+				auto const self = shared_from_this();
+				boost::asio::async_read(socket, boost::asio::buffer(m_incoming),
+				                        [self](boost::system::error_code error, std::size_t)
+				                        {
+					                        if (error || self->m_closed)
+					                        {
+						                        self->close();
+						                        return;
+					                        }
+					                        try
+					                        {
+						                        self->on_frame(blob(std::move(self->m_incoming)));
+					                        }
+					                        catch (std::exception const &)
+					                        {
+						                        self->close();
+						                        return;
+					                        }
+					                        if (!self->m_closed)
+					                        {
+						                        self->start_reading();
+					                        }
+					                    });
+			}
+
+			void write_next()
+			{
+				auto const self = shared_from_this();
+				boost::asio::async_write(socket, boost::asio::buffer(m_outgoing.front()),
+				                         [self](boost::system::error_code error, std::size_t)
+				                         {
+					                         if (error)
+					                         {
+						                         self->close();
+						                         return;
+					                         }
+					                         if (self->m_closed)
+					                         {
+						                         return;
+					                         }
+					                         self->m_outgoing.pop_front();
+					                         if (!self->m_outgoing.empty())
+					                         {
+						                         self->write_next();
+					                         }
+					                     });
+			}
+		};
+
+		void post_frame(boost::asio::io_service &io, std::shared_ptr<connection> link, std::vector<char> frame)
+		{
+			auto const moved = std::make_shared<std::vector<char>>(std::move(frame));
+			io.post([link, moved]()
+			        {
+				        link->send(std::move(*moved));
+				    });
+		}
+
+		struct remote_worker
+		{
+			std::shared_ptr<connection> link;
+			bool greeted = false;
+			std::set<Si::noexcept_string> offered;
+			std::size_t capacity = 0;
+			std::size_t busy = 0;
+			std::map<std::uint64_t, std::shared_ptr<std::promise<blob>>> pending;
+		};
+	}
+
+	struct remote_executor::state : private boost::noncopyable
+	{
+		boost::asio::io_service io;
+		boost::asio::ip::tcp::acceptor acceptor;
+		boost::asio::ip::tcp::endpoint endpoint;
+		Si::noexcept_string secret;
+
+		// only used on the io thread, includes the connections that have not introduced themselves yet
+		std::vector<std::weak_ptr<connection>> links;
+
+		mutable boost::mutex access;
+		boost::condition_variable changed;
+		std::vector<std::shared_ptr<remote_worker>> workers;
+		std::uint64_t next_request;
+
+		boost::thread io_thread;
+
+		explicit state(boost::asio::ip::tcp::endpoint const &listen_on, Si::noexcept_string secret)
+		    : acceptor(io, listen_on)
+		    , endpoint(acceptor.local_endpoint())
+		    , secret(std::move(secret))
+		    , next_request(0)
+		{
+		}
+
+		void accept_next()
+		{
+			auto const link = std::make_shared<connection>(io);
+			acceptor.async_accept(link->socket, [this, link](boost::system::error_code error)
+			                      {
+				                      if (error)
+				                      {
+					                      // the acceptor was closed
+					                      return;
+				                      }
+				                      links.emplace_back(link);
+				                      auto const worker = std::make_shared<remote_worker>();
+				                      worker->link = link;
+				                      link->on_frame = [this, worker](blob frame)
+				                      {
+					                      receive(worker, std::move(frame));
+					                  };
+				                      link->on_closed = [this, worker]()
+				                      {
+					                      disconnected(worker);
+					                  };
+				                      // nobody knows who is connecting before the hello
+				                      link->max_incoming = max_hello_size;
+				                      link->start_reading();
+				                      accept_next();
+				                  });
+		}
+
+		void receive(std::shared_ptr<remote_worker> const &worker, blob frame)
+		{
+			frame_reader reader(std::move(frame));
+			auto const type = static_cast<message_type>(reader.integer(4));
+			if (!worker->greeted)
+			{
+				if ((type != message_type::hello) || (reader.integer(4) != remote_protocol_version))
+				{
+					throw std::invalid_argument("a worker has to introduce itself with a compatible hello");
+				}
+				Si::memory_range const received_secret = reader.take(static_cast<std::size_t>(reader.integer(4)));
+				if (!equal_secrets(received_secret, Si::make_memory_range(secret)))
+				{
+					throw std::invalid_argument("a worker does not know the secret");
+				}
+				std::size_t const capacity = static_cast<std::size_t>(reader.integer(4));
+				if (capacity == 0)
+				{
+					// invocations would wait for a free slot of this worker forever
+					throw std::invalid_argument("a worker has to offer at least one slot");
+				}
+				std::size_t const name_count = static_cast<std::size_t>(reader.integer(4));
+				std::set<Si::noexcept_string> offered;
+				for (std::size_t i = 0; i < name_count; ++i)
+				{
+					offered.insert(reader.string());
+				}
+				{
+					boost::lock_guard<boost::mutex> lock(access);
+					worker->greeted = true;
+					worker->capacity = capacity;
+					worker->offered = std::move(offered);
+					workers.emplace_back(worker);
+				}
+				worker->link->max_incoming = max_frame_size;
+				changed.notify_all();
+				return;
+			}
+			if ((type != message_type::result) && (type != message_type::failure))
+			{
+				throw std::invalid_argument("unexpected message from a worker");
+			}
+			std::uint64_t const request = reader.integer(8);
+			std::shared_ptr<std::promise<blob>> answered;
+			{
+				boost::lock_guard<boost::mutex> lock(access);
+				auto const found = worker->pending.find(request);
+				if (found == worker->pending.end())
+				{
+					throw std::invalid_argument("a worker answered an unknown request");
+				}
+				answered = std::move(found->second);
+				worker->pending.erase(found);
+				--worker->busy;
+			}
+			changed.notify_all();
+			if (type == message_type::result)
+			{
+				reader.take(4);
+				reader.skip_padding();
+				answered->set_value(reader.rest());
+			}
+			else
+			{
+				answered->set_exception(std::make_exception_ptr(std::runtime_error(reader.string().c_str())));
+			}
+		}
+
+		void disconnected(std::shared_ptr<remote_worker> const &worker)
+		{
+			std::map<std::uint64_t, std::shared_ptr<std::promise<blob>>> abandoned;
+			{
+				boost::lock_guard<boost::mutex> lock(access);
+				workers.erase(std::remove(workers.begin(), workers.end(), worker), workers.end());
+				abandoned.swap(worker->pending);
+				worker->busy = 0;
+			}
+			changed.notify_all();
+			for (auto const &request : abandoned)
+			{
+				request.second->set_exception(
+				    std::make_exception_ptr(std::runtime_error("the worker disconnected before it answered")));
+			}
+		}
+
+		void shut_down()
+		{
+			boost::system::error_code ignored;
+			acceptor.close(ignored);
+			for (auto const &link : links)
+			{
+				if (auto const alive = link.lock())
+				{
+					alive->close();
+				}
+			}
+			links.clear();
+		}
+	};
+
+	remote_executor::remote_executor(boost::asio::ip::tcp::endpoint listen_on, Si::noexcept_string secret)
+	{
+		if (secret.empty())
+		{
+			throw std::invalid_argument("a coordinator needs a secret for its workers");
+		}
+		m_state.reset(new state(listen_on, std::move(secret)));
+		state &state_ = *m_state;
+		state_.accept_next();
+		state_.io_thread = boost::thread([&state_]()
+		                                 {
+			                                 state_.io.run();
+			                             });
+	}
+
+	remote_executor::~remote_executor()
+	{
+		state &state_ = *m_state;
+		state_.io.post([&state_]()
+		               {
+			               state_.shut_down();
+			           });
+		state_.io_thread.join();
+	}
+
+	boost::asio::ip::tcp::endpoint remote_executor::local_endpoint() const
+	{
+		return m_state->endpoint;
+	}
+
+	std::size_t remote_executor::worker_count() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_state->access);
+		return m_state->workers.size();
+	}
+
+	void remote_executor::wait_for_workers(std::size_t count)
+	{
+		boost::unique_lock<boost::mutex> lock(m_state->access);
+		while (m_state->workers.size() < count)
+		{
+			m_state->changed.wait(lock);
+		}
+	}
+
+	value remote_executor::invoke(Si::noexcept_string const &name, value const &input)
+	{
+		std::vector<char> frame = begin_frame(message_type::invoke);
+		std::size_t const request_position = frame.size();
+		append_integer(frame, 0, 8);
+		append_string(frame, Si::make_memory_range(name));
+		pad(frame);
+		serialize(input, frame);
+		frame = finish_frame(std::move(frame));
+
+		state &state_ = *m_state;
+		std::future<blob> answer;
+		std::shared_ptr<connection> link;
+		{
+			boost::unique_lock<boost::mutex> lock(state_.access);
+			std::shared_ptr<remote_worker> chosen;
+			for (;;)
+			{
+				bool offered = false;
+				for (auto const &worker : state_.workers)
+				{
+					if (!worker->offered.count(name))
+					{
+						continue;
+					}
+					offered = true;
+					// the worker with the most free slots spreads the load evenly
+					if ((worker->busy < worker->capacity) &&
+					    (!chosen || ((worker->capacity - worker->busy) > (chosen->capacity - chosen->busy))))
+					{
+						chosen = worker;
+					}
+				}
+				if (chosen)
+				{
+					break;
+				}
+				if (!offered)
+				{
+					throw std::invalid_argument("no connected worker offers the transformation " +
+					                            std::string(name.begin(), name.end()));
+				}
+				state_.changed.wait(lock);
+			}
+			std::uint64_t const request = state_.next_request++;
+			store_integer(frame.data() + request_position, request, 8);
+			auto promise = std::make_shared<std::promise<blob>>();
+			answer = promise->get_future();
+			chosen->pending.insert(std::make_pair(request, std::move(promise)));
+			++chosen->busy;
+			link = chosen->link;
+		}
+		post_frame(state_.io, std::move(link), std::move(frame));
+		return read_document(answer.get());
+	}
+
+	typed_transformation remote_transformation(remote_executor &executor, Si::noexcept_string name, type input,
+	                                           type output)
+	{
+		// The worker is not trusted to return what the dag was built for, so the result is checked before a
+		// transformation of this process sees it. Interned once here because interning takes a lock.
+		interned_type const expected(output);
+		return typed_transformation{std::move(input), std::move(output), [&executor, name, expected](value argument)
+		                            {
+			                            value result = executor.invoke(name, argument);
+			                            if (!has_type(result, expected))
+			                            {
+				                            throw std::runtime_error(
+				                                "the worker returned a value of an unexpected type for the "
+				                                "transformation " +
+				                                std::string(name.begin(), name.end()));
+			                            }
+			                            return result;
+			                        }};
+	}
+
+	void run_worker(boost::asio::ip::tcp::endpoint const &coordinator, Si::noexcept_string const &secret,
+	                transformation_registry const &offered, std::size_t capacity)
+	{
+		if (capacity == 0)
+		{
+			throw std::invalid_argument("a worker has to offer at least one slot");
+		}
+		boost::asio::io_service io;
+		auto const link = std::make_shared<connection>(io);
+		link->socket.connect(coordinator);
+
+		std::vector<char> hello = begin_frame(message_type::hello);
+		append_integer(hello, remote_protocol_version, 4);
+		append_string(hello, Si::make_memory_range(secret));
+		append_integer(hello, capacity, 4);
+		append_integer(hello, offered.entries().size(), 4);
+		for (auto const &entry : offered.entries())
+		{
+			append_string(hello, Si::make_memory_range(entry.first));
+		}
+		if ((hello.size() - frame_size_size) > max_hello_size)
+		{
+			throw std::invalid_argument("the secret and the names of the transformations do not fit into a hello");
+		}
+		link->send(finish_frame(std::move(hello)));
+
+		// destroyed before the io_service, so the tasks can still post their answers
+		work_stealing_pool pool(capacity);
+		link->on_frame = [&io, &offered, &pool, link](blob frame)
+		{
+			frame_reader reader(std::move(frame));
+			if (static_cast<message_type>(reader.integer(4)) != message_type::invoke)
+			{
+				throw std::invalid_argument("unexpected message from the coordinator");
+			}
+			std::uint64_t const request = reader.integer(8);
+			Si::noexcept_string name = reader.string();
+			reader.skip_padding();
+			blob document = reader.rest();
+			std::weak_ptr<connection> const weak_link = link;
+			pool.submit([&io, &offered, weak_link, request, name, document]()
+			            {
+				            std::vector<char> answer;
+				            try
+				            {
+					            typed_transformation const *const found = offered.find(name);
+					            if (!found)
+					            {
+						            throw std::invalid_argument("this worker does not offer the transformation");
+					            }
+					            value input = read_document(document);
+					            // the coordinator is not trusted to send what the transformation expects
+					            if (!has_type(input, interned_type(found->input)))
+					            {
+						            throw std::invalid_argument("the input does not match the transformation");
+					            }
+					            value const output = found->transform(std::move(input));
+					            answer = begin_frame(message_type::result);
+					            append_integer(answer, request, 8);
+					            append_integer(answer, 0, 4);
+					            pad(answer);
+					            serialize(output, answer);
+					            answer = finish_frame(std::move(answer));
+				            }
+				            catch (std::exception const &ex)
+				            {
+					            answer = begin_frame(message_type::failure);
+					            append_integer(answer, request, 8);
+					            append_string(answer, Si::make_c_str_range(ex.what()));
+					            answer = finish_frame(std::move(answer));
+				            }
+				            if (auto const alive = weak_link.lock())
+				            {
+					            post_frame(io, alive, std::move(answer));
+				            }
+				        });
+		};
+		link->start_reading();
+		io.run();
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef BUILDSERVER_GRAPH_REMOTE_HPP
+#define BUILDSERVER_GRAPH_REMOTE_HPP
+
+#include "graph.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <memory>
+
+namespace graph
+{
+	// Transformations cannot be sent over the network, so a worker process offers a fixed set of them by name.
+	struct transformation_registry
+	{
+		void add(Si::noexcept_string name, typed_transformation transformation);
+		typed_transformation const *find(Si::noexcept_string const &name) const;
+
+		std::map<Si::noexcept_string, typed_transformation> const &entries() const
+		{
+			return m_entries;
+		}
+
+	private:
+		std::map<Si::noexcept_string, typed_transformation> m_entries;
+	};
+
+	// The protocol between a coordinator and its workers, version 2. Every message is a frame:
+	//
+	//   u32 size of the rest, u32 message type, message
+	//
+	// hello (worker to coordinator, once):   u32 version, u32 secret size, secret, u32 capacity > 0, u32 name count,
+	//                                        names as u32 size and bytes
+	// invoke (coordinator to worker):        u64 request, u32 name size, name, padding to 8, input document
+	// result (worker to coordinator):        u64 request, u32 0, padding to 8, output document
+	// failure (worker to coordinator):       u64 request, u32 message size, message
+	//
+	// Integers are little endian and the documents use graph_serialization. The padding keeps a document aligned to
+	// eight bytes within the frame. A worker runs up to capacity invocations at the same time and answers them in
+	// the order they finish, so the coordinator matches the answers by request number.
+	//
+	// The coordinator trusts the results of its workers, so a worker has to know the secret of the coordinator. Until
+	// a connection has sent a valid hello, its frames may not be larger than max_hello_size, which keeps strangers
+	// from making the coordinator allocate much memory. The secret is sent in plain text, so the network between the
+	// coordinator and its workers has to be trusted.
+	std::uint32_t const remote_protocol_version = 2;
+	std::uint32_t const max_hello_size = 16 * 1024;
+
+	// Accepts connections of workers and sends invocations to the ones that have a free slot. Invocations block the
+	// calling thread, which makes them usable as transformations in a dag.
+	struct remote_executor : private boost::noncopyable
+	{
+		// Connections whose hello does not contain the secret are closed. Throws std::invalid_argument if the secret is
+		// empty.
+		remote_executor(boost::asio::ip::tcp::endpoint listen_on, Si::noexcept_string secret);
+		~remote_executor();
+
+		// useful when listening on port 0
+		boost::asio::ip::tcp::endpoint local_endpoint() const;
+
+		std::size_t worker_count() const;
+		void wait_for_workers(std::size_t count);
+
+		// Runs the named transformation on a worker that offers it, waiting for a free slot if necessary. Throws
+		// std::invalid_argument if no connected worker offers the name and std::runtime_error if the transformation
+		// failed or the worker disconnected before it answered.
+		value invoke(Si::noexcept_string const &name, value const &input);
+
+	private:
+		struct state;
+
+		std::unique_ptr<state> m_state;
+	};
+
+	// The result of the worker is checked against the output type, and std::runtime_error is thrown if it is not
+	// compatible. The input is not checked because it comes from the dag of this process.
+	typed_transformation remote_transformation(remote_executor &executor, Si::noexcept_string name, type input,
+	                                           type output);
+
+	// Connects to a coordinator and runs the invocations it receives on up to capacity threads. Returns when the
+	// coordinator closes the connection, which it also does when the secret is wrong. Throws std::invalid_argument if
+	// capacity is zero.
+	void run_worker(boost::asio::ip::tcp::endpoint const &coordinator, Si::noexcept_string const &secret,
+	                transformation_registry const &offered, std::size_t capacity);
+}
+
+#endif
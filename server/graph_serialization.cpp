@@ -0,0 +1,425 @@
+#include "graph_serialization.hpp"
+#include <silicium/to_shared.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace graph
+{
+	namespace
+	{
+		char const magic[4] = {'B', 'S', 'G', 'V'};
+		std::size_t const header_size = 8;
+		std::size_t const max_depth = 256;
+
+		void append_integer(std::vector<char> &out, std::uint64_t integer, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				out.push_back(static_cast<char>(integer >> (8 * i)));
+			}
+		}
+
+		void store_integer(char *destination, std::uint64_t integer, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				destination[i] = static_cast<char>(integer >> (8 * i));
+			}
+		}
+
+		std::uint64_t load_integer(char const *source, std::size_t size)
+		{
+			std::uint64_t result = 0;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				result |= std::uint64_t(static_cast<unsigned char>(source[i])) << (8 * i);
+			}
+			return result;
+		}
+
+		std::uint64_t align(std::uint64_t offset)
+		{
+			return (offset + 7) & ~std::uint64_t(7);
+		}
+
+		// the document does not necessarily start at the beginning of the buffer
+		struct document_writer
+		{
+			std::vector<char> &out;
+			std::size_t begin;
+
+			std::uint64_t offset() const
+			{
+				return out.size() - begin;
+			}
+
+			void pad()
+			{
+				out.resize(static_cast<std::size_t>(begin + align(offset())), '\0');
+			}
+		};
+
+		void append_value_header(document_writer &writer, value_kind kind, std::uint32_t small)
+		{
+			writer.pad();
+			std::vector<char> &out = writer.out;
+			append_integer(out, static_cast<std::uint32_t>(kind), 4);
+			append_integer(out, small, 4);
+		}
+
+		void append_bytes(document_writer &writer, value_kind kind, char const *begin, std::size_t size)
+		{
+			append_value_header(writer, kind, 0);
+			append_integer(writer.out, size, 8);
+			writer.out.insert(writer.out.end(), begin, begin + size);
+		}
+
+		template <class String>
+		void append_string(document_writer &writer, value_kind kind, String const &content)
+		{
+			append_bytes(writer, kind, content.data(), content.size());
+		}
+
+		void append_value(document_writer &writer, value const &serialized)
+		{
+			std::vector<char> &out = writer.out;
+			Si::visit<void>(serialized,
+			                [&writer](blob const &content)
+			                {
+				                append_bytes(writer, value_kind::blob, content.begin(), content.size());
+				            },
+			                [&writer, &out](std::shared_ptr<listing> const &content)
+			                {
+				                if (!content)
+				                {
+					                throw std::invalid_argument("cannot serialize a null listing");
+				                }
+				                if (content->entries.size() > (std::numeric_limits<std::uint32_t>::max)())
+				                {
+					                throw std::invalid_argument("too many entries in a listing");
+				                }
+				                append_value_header(writer, value_kind::listing,
+				                                    static_cast<std::uint32_t>(content->entries.size()));
+				                std::size_t table = out.size();
+				                out.resize(table + content->entries.size() * 8);
+				                for (auto const &entry : content->entries)
+				                {
+					                writer.pad();
+					                store_integer(out.data() + table, writer.offset(), 8);
+					                table += 8;
+					                Si::noexcept_string const &key = entry.first.name();
+					                append_integer(out, key.size(), 8);
+					                out.insert(out.end(), key.begin(), key.end());
+					                append_value(writer, entry.second);
+				                }
+				            },
+			                [&writer](uri const &content)
+			                {
+				                append_string(writer, value_kind::uri, content.value);
+				            },
+			                [&writer](filesystem_directory_ownership const &content)
+			                {
+				                append_string(writer, value_kind::filesystem_directory_ownership,
+				                              content.owned.to_boost_path().string());
+				            },
+			                [&writer](ventura::absolute_path const &content)
+			                {
+				                append_string(writer, value_kind::absolute_path, content.to_boost_path().string());
+				            },
+			                [&writer](ventura::path_segment const &content)
+			                {
+				                append_string(writer, value_kind::path_segment, content.to_boost_path().string());
+				            },
+			                [&writer](std::uint32_t content)
+			                {
+				                append_value_header(writer, value_kind::uint32, content);
+				            },
+			                [](std::shared_ptr<byte_stream> const &)
+			                {
+				                throw std::invalid_argument("cannot serialize a stream");
+				            });
+		}
+
+		bool is_less(Si::memory_range left, Si::memory_range right)
+		{
+			// the same order as the keys of a listing
+			return std::lexicographical_compare(left.begin(), left.end(), right.begin(), right.end(),
+			                                    [](char l, char r)
+			                                    {
+				                                    return static_cast<unsigned char>(l) <
+				                                           static_cast<unsigned char>(r);
+				                                });
+		}
+
+		void require(bool condition)
+		{
+			if (!condition)
+			{
+				throw std::invalid_argument("malformed serialized graph value");
+			}
+		}
+
+		// returns the end of the value so that the caller can make sure that values do not overlap
+		std::uint64_t validate_value(Si::memory_range document, std::uint64_t offset, std::size_t depth)
+		{
+			std::uint64_t const size = static_cast<std::uint64_t>(document.size());
+			require(depth < max_depth);
+			require((offset % 8) == 0);
+			require(offset <= size && (size - offset) >= 8);
+			char const *const header = document.begin() + offset;
+			std::uint64_t const kind = load_integer(header, 4);
+			switch (static_cast<value_kind>(kind))
+			{
+			case value_kind::uint32:
+				return offset + 8;
+
+			case value_kind::blob:
+			case value_kind::uri:
+			case value_kind::filesystem_directory_ownership:
+			case value_kind::absolute_path:
+			case value_kind::path_segment:
+			{
+				require((size - offset) >= 16);
+				std::uint64_t const length = load_integer(header + 8, 8);
+				require(length <= (size - offset - 16));
+				return offset + 16 + length;
+			}
+
+			case value_kind::listing:
+			{
+				std::uint64_t const count = load_integer(header + 4, 4);
+				require((count * 8) <= (size - offset - 8));
+				std::uint64_t end = offset + 8 + count * 8;
+				Si::memory_range previous_key;
+				for (std::uint64_t i = 0; i < count; ++i)
+				{
+					std::uint64_t const entry = load_integer(header + 8 + i * 8, 8);
+					require(entry >= end);
+					require((entry % 8) == 0);
+					require(entry <= size && (size - entry) >= 8);
+					std::uint64_t const key_length = load_integer(document.begin() + entry, 8);
+					require(key_length <= (size - entry - 8));
+					Si::memory_range const key(document.begin() + entry + 8, document.begin() + entry + 8 + key_length);
+					require((i == 0) || is_less(previous_key, key));
+					previous_key = key;
+					end = validate_value(document, align(entry + 8 + key_length), depth + 1);
+				}
+				return end;
+			}
+			}
+			throw std::invalid_argument("unknown kind of serialized graph value");
+		}
+
+		template <class Path>
+		Path parse_path(Si::memory_range bytes)
+		{
+			auto parsed = Path::create(boost::filesystem::path(bytes.begin(), bytes.end()));
+			if (!parsed)
+			{
+				throw std::invalid_argument("invalid path in a serialized graph value");
+			}
+			return std::move(*parsed);
+		}
+	}
+
+	void serialize(value const &serialized, std::vector<char> &out)
+	{
+		document_writer writer{out, out.size()};
+		out.insert(out.end(), magic, magic + sizeof(magic));
+		append_integer(out, serialization_version, 4);
+		append_value(writer, serialized);
+	}
+
+	value_view::value_view()
+	    : m_document(nullptr)
+	    , m_offset(0)
+	{
+	}
+
+	value_view::value_view(char const *document, std::uint64_t offset)
+	    : m_document(document)
+	    , m_offset(offset)
+	{
+	}
+
+	value_kind value_view::kind() const
+	{
+		return static_cast<value_kind>(load_integer(m_document + m_offset, 4));
+	}
+
+	std::uint32_t value_view::get_uint32() const
+	{
+		if (kind() != value_kind::uint32)
+		{
+			throw std::invalid_argument("the serialized graph value is not a uint32");
+		}
+		return static_cast<std::uint32_t>(load_integer(m_document + m_offset + 4, 4));
+	}
+
+	Si::memory_range value_view::get_bytes() const
+	{
+		switch (kind())
+		{
+		case value_kind::listing:
+		case value_kind::uint32:
+			throw std::invalid_argument("the serialized graph value does not consist of bytes");
+
+		default:
+			break;
+		}
+		std::uint64_t const length = load_integer(m_document + m_offset + 8, 8);
+		char const *const begin = m_document + m_offset + 16;
+		return Si::memory_range(begin, begin + length);
+	}
+
+	std::size_t value_view::listing_size() const
+	{
+		if (kind() != value_kind::listing)
+		{
+			throw std::invalid_argument("the serialized graph value is not a listing");
+		}
+		return static_cast<std::size_t>(load_integer(m_document + m_offset + 4, 4));
+	}
+
+	Si::memory_range value_view::listing_key(std::size_t index) const
+	{
+		std::uint64_t const entry = entry_offset(index);
+		std::uint64_t const key_length = load_integer(m_document + entry, 8);
+		char const *const begin = m_document + entry + 8;
+		return Si::memory_range(begin, begin + key_length);
+	}
+
+	value_view value_view::listing_value(std::size_t index) const
+	{
+		std::uint64_t const entry = entry_offset(index);
+		std::uint64_t const key_length = load_integer(m_document + entry, 8);
+		return value_view(m_document, align(entry + 8 + key_length));
+	}
+
+	Si::optional<value_view> value_view::find(Si::memory_range key) const
+	{
+		std::size_t low = 0;
+		std::size_t high = listing_size();
+		while (low < high)
+		{
+			std::size_t const middle = low + (high - low) / 2;
+			Si::memory_range const middle_key = listing_key(middle);
+			if (is_less(middle_key, key))
+			{
+				low = middle + 1;
+			}
+			else if (is_less(key, middle_key))
+			{
+				high = middle;
+			}
+			else
+			{
+				return listing_value(middle);
+			}
+		}
+		return Si::none;
+	}
+
+	std::uint64_t value_view::entry_offset(std::size_t index) const
+	{
+		if (index >= listing_size())
+		{
+			throw std::out_of_range("listing entry index out of range");
+		}
+		return load_integer(m_document + m_offset + 8 + index * 8, 8);
+	}
+
+	value_view open_serialized(Si::memory_range document)
+	{
+		require(static_cast<std::size_t>(document.size()) >= header_size);
+		require(std::equal(magic, magic + sizeof(magic), document.begin()));
+		if (load_integer(document.begin() + 4, 4) != serialization_version)
+		{
+			throw std::invalid_argument("unsupported version of serialized graph value");
+		}
+		validate_value(document, header_size, 0);
+		return value_view(document.begin(), header_size);
+	}
+
+	namespace
+	{
+		value materialize_impl(value_view const &viewed, std::shared_ptr<void const> const *document_owner,
+		                       bool intern_keys)
+		{
+			switch (viewed.kind())
+			{
+			case value_kind::blob:
+			{
+				Si::memory_range const bytes = viewed.get_bytes();
+				if (document_owner)
+				{
+					return blob(*document_owner, bytes);
+				}
+				return blob(std::vector<char>(bytes.begin(), bytes.end()));
+			}
+
+			case value_kind::listing:
+			{
+				listing result;
+				std::size_t const size = viewed.listing_size();
+				result.entries.reserve(size);
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					Si::memory_range const key = viewed.listing_key(i);
+					if (intern_keys)
+					{
+						result.entries.insert(
+						    std::make_pair(Si::noexcept_string(key.begin(), key.end()),
+						                   materialize_impl(viewed.listing_value(i), document_owner, intern_keys)));
+						continue;
+					}
+					Si::optional<symbol> const existing = symbol::find_existing(key);
+					if (!existing)
+					{
+						continue;
+					}
+					result.entries.insert(std::make_pair(
+					    *existing, materialize_impl(viewed.listing_value(i), document_owner, intern_keys)));
+				}
+				return Si::to_shared(std::move(result));
+			}
+
+			case value_kind::uri:
+			{
+				Si::memory_range const bytes = viewed.get_bytes();
+				return uri{Si::noexcept_string(bytes.begin(), bytes.end())};
+			}
+
+			case value_kind::filesystem_directory_ownership:
+				return filesystem_directory_ownership{parse_path<ventura::absolute_path>(viewed.get_bytes())};
+
+			case value_kind::absolute_path:
+				return parse_path<ventura::absolute_path>(viewed.get_bytes());
+
+			case value_kind::path_segment:
+				return parse_path<ventura::path_segment>(viewed.get_bytes());
+
+			case value_kind::uint32:
+				return viewed.get_uint32();
+			}
+			throw std::invalid_argument("unknown kind of serialized graph value");
+		}
+	}
+
+	value materialize(value_view const &viewed)
+	{
+		return materialize_impl(viewed, nullptr, true);
+	}
+
+	value materialize(value_view const &viewed, blob const &document)
+	{
+		return materialize_impl(viewed, &document.owner(), true);
+	}
+
+	value materialize_known_keys(value_view const &viewed, blob const &document)
+	{
+		return materialize_impl(viewed, &document.owner(), false);
+	}
+}
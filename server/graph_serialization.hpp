@@ -0,0 +1,80 @@
+#ifndef BUILDSERVER_GRAPH_SERIALIZATION_HPP
+#define BUILDSERVER_GRAPH_SERIALIZATION_HPP
+
+#include "graph.hpp"
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+
+namespace graph
+{
+	// Binary encoding of a value, version 1. All integers are little endian and every value starts at a multiple
+	// of eight bytes from the beginning of the document, so a document can be used directly from a memory mapped file.
+	//
+	//   document: "BSGV" u32 version, value
+	//   value:    u32 kind, u32 small, payload
+	//     uint32:                small is the number, there is no payload
+	//     blob, uri and paths:   u64 size, the bytes
+	//     listing:               small is the number of entries, u64 offset of every entry (sorted by key)
+	//   entry:    u64 key size, the key, value
+	//
+	// Offsets are counted from the beginning of the document and always point forward.
+	std::uint32_t const serialization_version = 1;
+
+	enum class value_kind : std::uint32_t
+	{
+		blob,
+		listing,
+		uri,
+		filesystem_directory_ownership,
+		absolute_path,
+		path_segment,
+		uint32
+	};
+
+	void serialize(value const &serialized, std::vector<char> &out);
+
+	// A value inside of a serialized document. Reading does not copy: blobs, strings and keys are returned as ranges
+	// into the document, which therefore has to outlive the view.
+	struct value_view
+	{
+		value_view();
+		value_view(char const *document, std::uint64_t offset);
+
+		value_kind kind() const;
+		std::uint32_t get_uint32() const;
+
+		// the content of a blob, uri, directory ownership, absolute path or path segment
+		Si::memory_range get_bytes() const;
+
+		std::size_t listing_size() const;
+		Si::memory_range listing_key(std::size_t index) const;
+		value_view listing_value(std::size_t index) const;
+
+		// binary search over the sorted keys
+		Si::optional<value_view> find(Si::memory_range key) const;
+
+	private:
+		char const *m_document;
+		std::uint64_t m_offset;
+
+		std::uint64_t entry_offset(std::size_t index) const;
+	};
+
+	// Checks the whole document once so that reading it through the views is safe afterwards. Throws
+	// std::invalid_argument if the document is truncated, of an unknown version or otherwise malformed.
+	value_view open_serialized(Si::memory_range document);
+
+	// copies the viewed value into the in-memory representation
+	value materialize(value_view const &viewed);
+
+	// Like the other overload, but the blobs in the result refer to the document instead of copying it. The view
+	// has to point into the content of the document blob, for example a file mapped with blob::map_file.
+	value materialize(value_view const &viewed, blob const &document);
+
+	// Like the overload above, but entries whose key has never been interned by this process are left out instead of
+	// interning the key, which would let the sender of a document grow the symbol table without bound. No type of
+	// this process mentions such a key, so the entries would be ignored anyway. Meant for documents from the network.
+	value materialize_known_keys(value_view const &viewed, blob const &document);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include "graph_stream.hpp"
+#include "trace.hpp"
+#include <boost/thread/lock_guard.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace graph
+{
+	byte_stream::reader::reader(reader &&other)
+	    : m_stream(std::move(other.m_stream))
+	    , m_id(other.m_id)
+	{
+	}
+
+	byte_stream::reader::~reader()
+	{
+		if (!m_stream)
+		{
+			return;
+		}
+		{
+			boost::lock_guard<boost::mutex> lock(m_stream->m_access);
+			m_stream->m_reader_positions.erase(m_id);
+			m_stream->drop_consumed();
+		}
+		// an abandoned reader must not keep the producer waiting
+		m_stream->m_changed.notify_all();
+	}
+
+	Si::optional<blob> byte_stream::reader::read()
+	{
+		byte_stream &stream = *m_stream;
+		boost::unique_lock<boost::mutex> lock(stream.m_access);
+		std::uint64_t &position = stream.m_reader_positions.find(m_id)->second;
+		if ((position == (stream.m_first_chunk + stream.m_chunks.size())) && !stream.m_closed && !stream.m_failure)
+		{
+			buildserver::trace_span const waiting("byte_stream read", "wait");
+			do
+			{
+				stream.m_changed.wait(lock);
+			} while ((position == (stream.m_first_chunk + stream.m_chunks.size())) && !stream.m_closed &&
+			         !stream.m_failure);
+		}
+		if (position < (stream.m_first_chunk + stream.m_chunks.size()))
+		{
+			blob chunk = stream.m_chunks[static_cast<std::size_t>(position - stream.m_first_chunk)];
+			++position;
+			stream.drop_consumed();
+			lock.unlock();
+			stream.m_changed.notify_all();
+			return std::move(chunk);
+		}
+		if (stream.m_failure)
+		{
+			std::rethrow_exception(stream.m_failure);
+		}
+		return Si::none;
+	}
+
+	byte_stream::reader::reader(std::shared_ptr<byte_stream> stream, std::size_t id)
+	    : m_stream(std::move(stream))
+	    , m_id(id)
+	{
+	}
+
+	byte_stream::byte_stream(std::size_t capacity, std::size_t expected_readers)
+	    : m_first_chunk(0)
+	    , m_buffered_bytes(0)
+	    , m_capacity(capacity)
+	    , m_next_reader_id(0)
+	    , m_expected_readers(expected_readers)
+	    , m_closed(false)
+	{
+	}
+
+	void byte_stream::write(blob chunk)
+	{
+		if (chunk.empty())
+		{
+			return;
+		}
+		{
+			boost::unique_lock<boost::mutex> lock(m_access);
+			if (m_closed || m_failure)
+			{
+				throw std::logic_error("cannot write to a finished byte_stream");
+			}
+			if ((!m_reader_positions.empty() || (m_expected_readers > 0)) && (m_buffered_bytes >= m_capacity))
+			{
+				buildserver::trace_span const waiting("byte_stream backpressure", "wait");
+				do
+				{
+					m_changed.wait(lock);
+				} while ((!m_reader_positions.empty() || (m_expected_readers > 0)) &&
+				         (m_buffered_bytes >= m_capacity));
+			}
+			m_buffered_bytes += chunk.size();
+			m_chunks.emplace_back(std::move(chunk));
+			if (m_reader_positions.empty() && (m_expected_readers == 0))
+			{
+				while ((m_buffered_bytes > m_capacity) && (m_chunks.size() > 1))
+				{
+					drop_front();
+				}
+			}
+		}
+		m_changed.notify_all();
+	}
+
+	void byte_stream::close()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_access);
+			m_closed = true;
+		}
+		m_changed.notify_all();
+	}
+
+	void byte_stream::fail(std::exception_ptr error)
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_access);
+			if (!m_failure)
+			{
+				m_failure = std::move(error);
+			}
+		}
+		m_changed.notify_all();
+	}
+
+	byte_stream::reader byte_stream::open_reader(std::shared_ptr<byte_stream> const &stream)
+	{
+		boost::lock_guard<boost::mutex> lock(stream->m_access);
+		std::size_t const id = stream->m_next_reader_id++;
+		if (stream->m_expected_readers > 0)
+		{
+			// nothing has been dropped yet, so this reader starts at the first chunk
+			--stream->m_expected_readers;
+		}
+		stream->m_reader_positions.insert(std::make_pair(id, stream->m_first_chunk));
+		return reader(stream, id);
+	}
+
+	void byte_stream::drop_front()
+	{
+		m_buffered_bytes -= m_chunks.front().size();
+		m_chunks.pop_front();
+		++m_first_chunk;
+	}
+
+	void byte_stream::drop_consumed()
+	{
+		if (m_reader_positions.empty() || (m_expected_readers > 0))
+		{
+			return;
+		}
+		std::uint64_t slowest = m_reader_positions.begin()->second;
+		for (auto const &reader_position : m_reader_positions)
+		{
+			slowest = (std::min)(slowest, reader_position.second);
+		}
+		while (m_first_chunk < slowest)
+		{
+			drop_front();
+		}
+	}
+
+	byte_stream_sink::byte_stream_sink(std::shared_ptr<byte_stream> destination, std::size_t chunk_size)
+	    : m_destination(std::move(destination))
+	    , m_chunk_size(chunk_size)
+	{
+	}
+
+	byte_stream_sink::error_type byte_stream_sink::append(Si::iterator_range<char const *> data)
+	{
+		m_pending.insert(m_pending.end(), data.begin(), data.end());
+		if (m_pending.size() >= m_chunk_size)
+		{
+			flush();
+		}
+		return {};
+	}
+
+	void byte_stream_sink::flush()
+	{
+		if (m_pending.empty())
+		{
+			return;
+		}
+		std::vector<char> chunk;
+		chunk.reserve(m_chunk_size);
+		chunk.swap(m_pending);
+		m_destination->write(blob(std::move(chunk)));
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef BUILDSERVER_GRAPH_STREAM_HPP
+#define BUILDSERVER_GRAPH_STREAM_HPP
+
+#include "graph_blob.hpp"
+#include <silicium/iterator_range.hpp>
+#include <silicium/optional.hpp>
+#include <silicium/success.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <exception>
+#include <map>
+
+namespace graph
+{
+	// A sequence of chunks that one producer writes while any number of readers consume it, for example the output
+	// of a build that is indexed, searched for warnings and shown live at the same time.
+	//
+	// Backpressure: the producer blocks as long as the slowest open reader lags behind by capacity bytes or more.
+	// Readers that are known in advance are registered with expected_readers: nothing is dropped before they have
+	// opened, and the producer waits for them as if they were open already, so they see the whole stream no matter
+	// when they start. While neither an open nor an expected reader is left, the producer never blocks and only the
+	// newest capacity bytes are kept for readers that open later.
+	//
+	// Reading and writing block the calling thread. When producer and readers are nodes of one dag, the
+	// work_stealing_pool needs a thread for each of them or a reader can wait for a producer that never starts.
+	struct byte_stream : private boost::noncopyable
+	{
+		struct reader : private boost::noncopyable
+		{
+			reader(reader &&other);
+			~reader();
+
+			// Blocks until the next chunk has been written. Returns none at the end of the stream. If the producer
+			// failed, the exception is rethrown after the chunks written before the failure have been read.
+			Si::optional<blob> read();
+
+		private:
+			friend struct byte_stream;
+
+			std::shared_ptr<byte_stream> m_stream;
+			std::size_t m_id;
+
+			reader(std::shared_ptr<byte_stream> stream, std::size_t id);
+		};
+
+		explicit byte_stream(std::size_t capacity, std::size_t expected_readers = 0);
+
+		void write(blob chunk);
+		void close();
+		void fail(std::exception_ptr error);
+
+		// Starts at the oldest chunk that is still kept, which is the first chunk for an expected reader. Every reader
+		// that is opened counts as one of the expected readers until all of them have opened.
+		static reader open_reader(std::shared_ptr<byte_stream> const &stream);
+
+	private:
+		boost::mutex m_access;
+		boost::condition_variable m_changed;
+		std::deque<blob> m_chunks;
+		std::uint64_t m_first_chunk;
+		std::size_t m_buffered_bytes;
+		std::size_t m_capacity;
+		std::map<std::size_t, std::uint64_t> m_reader_positions;
+		std::size_t m_next_reader_id;
+		std::size_t m_expected_readers;
+		bool m_closed;
+		std::exception_ptr m_failure;
+
+		void drop_front();
+		void drop_consumed();
+	};
+
+	// A character sink for buildserver::cmake and the process helpers that writes into a stream in chunks of at least
+	// chunk_size bytes. flush() has to be called after the last append.
+	struct byte_stream_sink
+	{
+		typedef char element_type;
+		typedef Si::success error_type;
+
+		byte_stream_sink(std::shared_ptr<byte_stream> destination, std::size_t chunk_size);
+
+		error_type append(Si::iterator_range<char const *> data);
+		void flush();
+
+	private:
+		std::shared_ptr<byte_stream> m_destination;
+		std::size_t m_chunk_size;
+		std::vector<char> m_pending;
+	};
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "graph_symbol.hpp"
+#include <boost/functional/hash.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+
+namespace graph
+{
+	namespace
+	{
+		// hashes strings and memory ranges the same way so that the table can be searched without a string
+		struct name_hash
+		{
+			std::size_t operator()(Si::memory_range name) const
+			{
+				return boost::hash_range(name.begin(), name.end());
+			}
+
+			std::size_t operator()(Si::noexcept_string const &name) const
+			{
+				return boost::hash_range(name.begin(), name.end());
+			}
+		};
+
+		struct name_equal
+		{
+			bool operator()(Si::memory_range left, Si::noexcept_string const &right) const
+			{
+				return std::equal(left.begin(), left.end(), right.begin(), right.end());
+			}
+
+			bool operator()(Si::noexcept_string const &left, Si::memory_range right) const
+			{
+				return (*this)(right, left);
+			}
+		};
+
+		struct symbol_table
+		{
+			boost::mutex access;
+
+			// the elements of a node based set never move, so the symbols can point to them
+			boost::unordered_set<Si::noexcept_string, name_hash> names;
+		};
+
+		symbol_table &get_symbol_table()
+		{
+			static symbol_table instance;
+			return instance;
+		}
+
+		Si::noexcept_string const &intern(Si::memory_range name)
+		{
+			symbol_table &table = get_symbol_table();
+			boost::lock_guard<boost::mutex> lock(table.access);
+			auto const existing = table.names.find(name, name_hash(), name_equal());
+			if (existing != table.names.end())
+			{
+				return *existing;
+			}
+			return *table.names.insert(Si::noexcept_string(name.begin(), name.end())).first;
+		}
+	}
+
+	symbol::symbol(char const *name)
+	    : m_name(&intern(Si::make_c_str_range(name)))
+	{
+	}
+
+	symbol::symbol(Si::noexcept_string const &name)
+	    : m_name(&intern(Si::make_memory_range(name)))
+	{
+	}
+
+	Si::optional<symbol> symbol::find_existing(Si::memory_range name)
+	{
+		symbol_table &table = get_symbol_table();
+		boost::lock_guard<boost::mutex> lock(table.access);
+		auto const existing = table.names.find(name, name_hash(), name_equal());
+		if (existing == table.names.end())
+		{
+			return Si::none;
+		}
+		return symbol(&*existing);
+	}
+}
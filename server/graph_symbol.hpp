@@ -0,0 +1,551 @@
+#ifndef BUILDSERVER_GRAPH_SYMBOL_HPP
+#define BUILDSERVER_GRAPH_SYMBOL_HPP
+
+#include <silicium/noexcept_string.hpp>
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace graph
+{
+	// An interned string: there is exactly one copy of every name for the whole process, so two symbols are equal
+	// if and only if they point to the same copy. Interning takes a lock, so keys that are looked up repeatedly should
+	// be kept in symbol variables instead of being converted from strings every time. Looking a string up in a
+	// symbol_map or a persistent_symbol_map compares names and does not touch the table. Interned names live until
+	// the process exits.
+	struct symbol
+	{
+		symbol(char const *name);
+		symbol(Si::noexcept_string const &name);
+
+		// does not intern anything, so looking up an unknown name does not grow the table
+		static Si::optional<symbol> find_existing(Si::memory_range name);
+
+		Si::noexcept_string const &name() const
+		{
+			return *m_name;
+		}
+
+		friend bool operator==(symbol left, symbol right)
+		{
+			return left.m_name == right.m_name;
+		}
+
+		friend bool operator!=(symbol left, symbol right)
+		{
+			return left.m_name != right.m_name;
+		}
+
+	private:
+		Si::noexcept_string const *m_name;
+
+		explicit symbol(Si::noexcept_string const *name)
+		    : m_name(name)
+		{
+		}
+	};
+
+	// orders like operator< of the names, negative if the name of the symbol comes first
+	inline int compare_name(symbol left, Si::memory_range right)
+	{
+		return left.name().compare(0, left.name().size(), right.begin(), static_cast<std::size_t>(right.size()));
+	}
+
+	// A sorted vector replacing std::map<Si::noexcept_string, T> for the few entries of a listing. The entries are
+	// ordered by name like in the map, but a lookup with a symbol only compares pointers.
+	template <class T>
+	struct symbol_map
+	{
+		typedef std::pair<symbol, T> value_type;
+		typedef typename std::vector<value_type>::iterator iterator;
+		typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+		template <class Key, class Mapped>
+		std::pair<iterator, bool> insert(std::pair<Key, Mapped> entry)
+		{
+			symbol const key(entry.first);
+			iterator const position = lower_bound(m_entries.begin(), m_entries.end(), key.name());
+			if ((position != m_entries.end()) && (position->first == key))
+			{
+				return std::make_pair(position, false);
+			}
+			return std::make_pair(m_entries.insert(position, value_type(key, std::move(entry.second))), true);
+		}
+
+		iterator find(symbol key)
+		{
+			return find_impl(m_entries.begin(), m_entries.end(), key);
+		}
+
+		const_iterator find(symbol key) const
+		{
+			return find_impl(m_entries.begin(), m_entries.end(), key);
+		}
+
+		iterator find(char const *key)
+		{
+			return find(Si::make_c_str_range(key));
+		}
+
+		const_iterator find(char const *key) const
+		{
+			return find(Si::make_c_str_range(key));
+		}
+
+		iterator find(Si::noexcept_string const &key)
+		{
+			return find(Si::make_memory_range(key));
+		}
+
+		const_iterator find(Si::noexcept_string const &key) const
+		{
+			return find(Si::make_memory_range(key));
+		}
+
+		iterator find(Si::memory_range key)
+		{
+			return find_name(m_entries.begin(), m_entries.end(), key);
+		}
+
+		const_iterator find(Si::memory_range key) const
+		{
+			return find_name(m_entries.begin(), m_entries.end(), key);
+		}
+
+		iterator begin()
+		{
+			return m_entries.begin();
+		}
+
+		iterator end()
+		{
+			return m_entries.end();
+		}
+
+		const_iterator begin() const
+		{
+			return m_entries.begin();
+		}
+
+		const_iterator end() const
+		{
+			return m_entries.end();
+		}
+
+		std::size_t size() const
+		{
+			return m_entries.size();
+		}
+
+		bool empty() const
+		{
+			return m_entries.empty();
+		}
+
+		void reserve(std::size_t capacity)
+		{
+			m_entries.reserve(capacity);
+		}
+
+	private:
+		// below this size comparing every pointer is faster than a binary search over the names
+		static std::size_t const linear_search_limit = 16;
+
+		std::vector<value_type> m_entries;
+
+		template <class Iterator>
+		static Iterator lower_bound(Iterator begin, Iterator end, Si::noexcept_string const &name)
+		{
+			return std::lower_bound(begin, end, name, [](value_type const &entry, Si::noexcept_string const &key)
+			                        {
+				                        return entry.first.name() < key;
+				                    });
+		}
+
+		template <class Iterator>
+		static Iterator find_impl(Iterator begin, Iterator end, symbol key)
+		{
+			if (static_cast<std::size_t>(end - begin) <= linear_search_limit)
+			{
+				return std::find_if(begin, end, [key](value_type const &entry)
+				                    {
+					                    return entry.first == key;
+					                });
+			}
+			Iterator const position = lower_bound(begin, end, key.name());
+			if ((position != end) && (position->first == key))
+			{
+				return position;
+			}
+			return end;
+		}
+
+		// a string that was never interned cannot be in the map, but asking the symbol table would take its lock
+		template <class Iterator>
+		static Iterator find_name(Iterator begin, Iterator end, Si::memory_range key)
+		{
+			if (static_cast<std::size_t>(end - begin) <= linear_search_limit)
+			{
+				return std::find_if(begin, end, [key](value_type const &entry)
+				                    {
+					                    return compare_name(entry.first, key) == 0;
+					                });
+			}
+			Iterator const position =
+			    std::lower_bound(begin, end, key, [](value_type const &entry, Si::memory_range name)
+			                     {
+				                     return compare_name(entry.first, name) < 0;
+				                 });
+			if ((position != end) && (compare_name(position->first, key) == 0))
+			{
+				return position;
+			}
+			return end;
+		}
+	};
+
+	// A symbol_map whose copies share their entries, so that a listing can be derived from another one by copying it
+	// and inserting a few entries. A copy costs a reference count plus the entries that were inserted since the
+	// shared part was last rebuilt, and inserting into a copy never copies the shared entries, so deriving costs
+	// O(changes) instead of O(size). An entry cannot be changed after it has been inserted because other copies may
+	// see it.
+	template <class T>
+	struct persistent_symbol_map
+	{
+		typedef std::pair<symbol, T> value_type;
+
+		// iterates the shared and the added entries merged by name like a symbol_map
+		struct const_iterator
+		{
+			typedef std::forward_iterator_tag iterator_category;
+			typedef std::pair<symbol, T> value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef value_type const *pointer;
+			typedef value_type const &reference;
+
+			const_iterator()
+			    : m_on_shared(false)
+			{
+			}
+
+			reference operator*() const
+			{
+				return m_on_shared ? *m_shared : *m_added;
+			}
+
+			pointer operator->() const
+			{
+				return &**this;
+			}
+
+			const_iterator &operator++()
+			{
+				if (m_on_shared)
+				{
+					++m_shared;
+				}
+				else
+				{
+					++m_added;
+				}
+				m_on_shared = is_on_shared();
+				return *this;
+			}
+
+			const_iterator operator++(int)
+			{
+				const_iterator old = *this;
+				++*this;
+				return old;
+			}
+
+			friend bool operator==(const_iterator const &left, const_iterator const &right)
+			{
+				return (left.m_shared == right.m_shared) && (left.m_added == right.m_added);
+			}
+
+			friend bool operator!=(const_iterator const &left, const_iterator const &right)
+			{
+				return !(left == right);
+			}
+
+		private:
+			friend struct persistent_symbol_map;
+
+			typedef typename std::vector<value_type>::const_iterator part_iterator;
+
+			part_iterator m_shared;
+			part_iterator m_shared_end;
+			part_iterator m_added;
+			part_iterator m_added_end;
+
+			// the names in the two parts are distinct, so the smaller one is the current entry
+			bool m_on_shared;
+
+			const_iterator(part_iterator shared, part_iterator shared_end, part_iterator added, part_iterator added_end)
+			    : m_shared(shared)
+			    , m_shared_end(shared_end)
+			    , m_added(added)
+			    , m_added_end(added_end)
+			    , m_on_shared(is_on_shared())
+			{
+			}
+
+			bool is_on_shared() const
+			{
+				if (m_shared == m_shared_end)
+				{
+					return false;
+				}
+				return (m_added == m_added_end) || (m_shared->first.name() < m_added->first.name());
+			}
+		};
+
+		typedef const_iterator iterator;
+
+		template <class Key, class Mapped>
+		std::pair<iterator, bool> insert(std::pair<Key, Mapped> entry)
+		{
+			symbol const key(entry.first);
+			// nobody else can see the shared part while this is its only reference, so it can be changed like the
+			// vector of a symbol_map
+			if (m_added.empty() && (!m_shared || (m_shared.use_count() == 1)))
+			{
+				if (!m_shared)
+				{
+					m_shared = std::make_shared<std::vector<value_type>>();
+				}
+				typename std::vector<value_type>::iterator const position =
+				    std::lower_bound(m_shared->begin(), m_shared->end(), key, &name_less);
+				if ((position != m_shared->end()) && (position->first == key))
+				{
+					return std::make_pair(at_shared(position), false);
+				}
+				return std::make_pair(at_shared(m_shared->insert(position, value_type(key, std::move(entry.second)))),
+				                      true);
+			}
+			iterator const existing = find(key);
+			if (existing != end())
+			{
+				return std::make_pair(existing, false);
+			}
+			typename std::vector<value_type>::iterator const position =
+			    std::lower_bound(m_added.begin(), m_added.end(), key, &name_less);
+			std::size_t const index = static_cast<std::size_t>(position - m_added.begin());
+			m_added.insert(position, value_type(key, std::move(entry.second)));
+			if (m_added.size() > merge_limit)
+			{
+				merge();
+				return std::make_pair(find(key), true);
+			}
+			return std::make_pair(at_added(m_added.begin() + static_cast<std::ptrdiff_t>(index)), true);
+		}
+
+		const_iterator find(symbol key) const
+		{
+			return at_entry(find_entry(key));
+		}
+
+		// Like find(), but without the iterator over both parts, which makes it the faster way to look up a single
+		// entry. Returns nullptr if there is no entry with that name.
+		T const *find_value(symbol key) const
+		{
+			value_type const *const found = find_entry(key);
+			return found ? &found->second : nullptr;
+		}
+
+		T const *find_value(char const *key) const
+		{
+			return find_value(Si::make_c_str_range(key));
+		}
+
+		T const *find_value(Si::noexcept_string const &key) const
+		{
+			return find_value(Si::make_memory_range(key));
+		}
+
+		T const *find_value(Si::memory_range key) const
+		{
+			value_type const *const found = find_entry(key);
+			return found ? &found->second : nullptr;
+		}
+
+		const_iterator find(char const *key) const
+		{
+			return find(Si::make_c_str_range(key));
+		}
+
+		const_iterator find(Si::noexcept_string const &key) const
+		{
+			return find(Si::make_memory_range(key));
+		}
+
+		const_iterator find(Si::memory_range key) const
+		{
+			return at_entry(find_entry(key));
+		}
+
+		const_iterator begin() const
+		{
+			return m_shared ? const_iterator(m_shared->cbegin(), m_shared->cend(), m_added.begin(), m_added.end())
+			                : const_iterator(empty_part().cbegin(), empty_part().cend(), m_added.begin(),
+			                                 m_added.end());
+		}
+
+		const_iterator end() const
+		{
+			return m_shared ? const_iterator(m_shared->cend(), m_shared->cend(), m_added.end(), m_added.end())
+			                : const_iterator(empty_part().cend(), empty_part().cend(), m_added.end(), m_added.end());
+		}
+
+		std::size_t size() const
+		{
+			return (m_shared ? m_shared->size() : 0) + m_added.size();
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		// only useful before the map is copied for the first time
+		void reserve(std::size_t capacity)
+		{
+			if (!m_shared)
+			{
+				m_shared = std::make_shared<std::vector<value_type>>();
+			}
+			if (m_shared.use_count() == 1)
+			{
+				m_shared->reserve(capacity);
+			}
+		}
+
+	private:
+		// When more entries have been added to a copy, they are merged with the shared ones into a new shared part
+		// that later copies share in turn. Until then the added entries are searched linearly.
+		static std::size_t const merge_limit = 16;
+
+		std::shared_ptr<std::vector<value_type>> m_shared;
+		std::vector<value_type> m_added;
+
+		static bool name_less(value_type const &entry, symbol key)
+		{
+			return entry.first.name() < key.name();
+		}
+
+		value_type const *find_entry(symbol key) const
+		{
+			// the added entries are few, so comparing their pointers is faster than searching by name
+			for (value_type const &entry : m_added)
+			{
+				if (entry.first == key)
+				{
+					return &entry;
+				}
+			}
+			if (!m_shared)
+			{
+				return nullptr;
+			}
+			if (m_shared->size() <= merge_limit)
+			{
+				for (value_type const &entry : *m_shared)
+				{
+					if (entry.first == key)
+					{
+						return &entry;
+					}
+				}
+				return nullptr;
+			}
+			auto const position = std::lower_bound(m_shared->cbegin(), m_shared->cend(), key, &name_less);
+			if ((position != m_shared->cend()) && (position->first == key))
+			{
+				return &*position;
+			}
+			return nullptr;
+		}
+
+		// compares names instead of interning the key, which would take the lock of the symbol table
+		value_type const *find_entry(Si::memory_range key) const
+		{
+			for (value_type const &entry : m_added)
+			{
+				if (compare_name(entry.first, key) == 0)
+				{
+					return &entry;
+				}
+			}
+			if (!m_shared)
+			{
+				return nullptr;
+			}
+			auto const position = std::lower_bound(m_shared->cbegin(), m_shared->cend(), key,
+			                                       [](value_type const &entry, Si::memory_range name)
+			                                       {
+				                                       return compare_name(entry.first, name) < 0;
+				                                   });
+			if ((position != m_shared->cend()) && (compare_name(position->first, key) == 0))
+			{
+				return &*position;
+			}
+			return nullptr;
+		}
+
+		const_iterator at_entry(value_type const *found) const
+		{
+			if (!found)
+			{
+				return end();
+			}
+			if (!m_added.empty() && (found >= m_added.data()) && (found < (m_added.data() + m_added.size())))
+			{
+				return at_added(m_added.begin() + (found - m_added.data()));
+			}
+			return at_shared(m_shared->cbegin() + (found - m_shared->data()));
+		}
+
+		static std::vector<value_type> const &empty_part()
+		{
+			static std::vector<value_type> const empty;
+			return empty;
+		}
+
+		const_iterator at_shared(typename std::vector<value_type>::const_iterator position) const
+		{
+			return const_iterator(position, m_shared->cend(),
+			                      std::lower_bound(m_added.begin(), m_added.end(), position->first, &name_less),
+			                      m_added.end());
+		}
+
+		const_iterator at_added(typename std::vector<value_type>::const_iterator position) const
+		{
+			if (!m_shared)
+			{
+				return const_iterator(empty_part().cend(), empty_part().cend(), position, m_added.end());
+			}
+			return const_iterator(std::lower_bound(m_shared->cbegin(), m_shared->cend(), position->first, &name_less),
+			                      m_shared->cend(), position, m_added.end());
+		}
+
+		void merge()
+		{
+			auto merged = std::make_shared<std::vector<value_type>>();
+			merged->reserve(size());
+			for (value_type const &entry : *this)
+			{
+				merged->emplace_back(entry);
+			}
+			m_shared = std::move(merged);
+			m_added.clear();
+		}
+	};
+}
+
+#endif
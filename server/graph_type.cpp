@@ -0,0 +1,294 @@
+#include "graph_type.hpp"
+#include <silicium/to_shared.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+
+namespace graph
+{
+	struct interned_type::node
+	{
+		bool listing;
+
+		// only for atomic types
+		atomic_type atomic;
+
+		// only for listings, in the order of a symbol_map
+		std::vector<std::pair<symbol, node const *>> entries;
+
+		type structure;
+	};
+
+	namespace
+	{
+		typedef std::vector<std::pair<symbol, interned_type::node const *>> entry_list;
+
+		// the children are interned already, so hashing their addresses is enough
+		struct entry_list_hash
+		{
+			std::size_t operator()(entry_list const &entries) const
+			{
+				std::size_t result = 0;
+				for (auto const &entry : entries)
+				{
+					boost::hash_combine(result, &entry.first.name());
+					boost::hash_combine(result, entry.second);
+				}
+				return result;
+			}
+		};
+
+		typedef std::pair<interned_type::node const *, interned_type::node const *> node_pair;
+
+		struct type_table
+		{
+			boost::mutex access;
+
+			// the nodes are allocated separately, so they do not move when the table grows
+			boost::unordered_map<entry_list, std::unique_ptr<interned_type::node>, entry_list_hash> listings;
+
+			// produced and expected type to the result of is_compatible
+			boost::unordered_map<node_pair, bool, boost::hash<node_pair>> compatible;
+		};
+
+		type_table &get_type_table()
+		{
+			static type_table instance;
+			return instance;
+		}
+
+		std::size_t const atomic_type_count = static_cast<std::size_t>(atomic_type::stream) + 1;
+
+		std::array<interned_type::node, atomic_type_count> make_atomic_nodes()
+		{
+			std::array<interned_type::node, atomic_type_count> result;
+			for (std::size_t i = 0; i < result.size(); ++i)
+			{
+				result[i].listing = false;
+				result[i].atomic = static_cast<atomic_type>(i);
+				result[i].structure = result[i].atomic;
+			}
+			return result;
+		}
+
+		// the atomic types are not in the table, so they can be interned without a lock
+		interned_type::node const &get_atomic_node(atomic_type atomic)
+		{
+			static std::array<interned_type::node, atomic_type_count> const nodes = make_atomic_nodes();
+			std::size_t const index = static_cast<std::size_t>(atomic);
+			if (index >= nodes.size())
+			{
+				throw std::invalid_argument("unknown atomic type");
+			}
+			return nodes[index];
+		}
+	}
+
+	interned_type::interned_type(atomic_type atomic)
+	    : m_node(&get_atomic_node(atomic))
+	{
+	}
+
+	interned_type::interned_type(type const &structure)
+	    : m_node(Si::visit<interned_type>(structure,
+	                                      [](atomic_type atomic)
+	                                      {
+		                                      return interned_type(atomic);
+		                                  },
+	                                      [](std::shared_ptr<listing_type> const &listing_) -> interned_type
+	                                      {
+		                                      if (!listing_)
+		                                      {
+			                                      throw std::invalid_argument("a listing type must not be null");
+		                                      }
+		                                      symbol_map<interned_type> entries;
+		                                      entries.reserve(listing_->entries.size());
+		                                      for (auto const &entry : listing_->entries)
+		                                      {
+			                                      entries.insert(
+			                                          std::make_pair(entry.first, interned_type(entry.second)));
+		                                      }
+		                                      return interned_type(entries);
+		                                  })
+	                 .m_node)
+	{
+	}
+
+	interned_type::interned_type(symbol_map<interned_type> const &entries)
+	{
+		entry_list key;
+		key.reserve(entries.size());
+		for (auto const &entry : entries)
+		{
+			key.emplace_back(entry.first, entry.second.m_node);
+		}
+		type_table &table = get_type_table();
+		boost::lock_guard<boost::mutex> lock(table.access);
+		auto const existing = table.listings.find(key);
+		if (existing != table.listings.end())
+		{
+			m_node = existing->second.get();
+			return;
+		}
+		std::unique_ptr<node> created(new node);
+		created->listing = true;
+		created->atomic = atomic_type::blob;
+		listing_type structure;
+		structure.entries.reserve(key.size());
+		for (auto const &entry : key)
+		{
+			structure.entries.insert(std::make_pair(entry.first, entry.second->structure));
+		}
+		created->structure = Si::to_shared(std::move(structure));
+		created->entries = key;
+		m_node = created.get();
+		table.listings.insert(std::make_pair(std::move(key), std::move(created)));
+	}
+
+	bool interned_type::is_listing() const
+	{
+		return m_node->listing;
+	}
+
+	Si::optional<interned_type> interned_type::find_entry(symbol key) const
+	{
+		for (auto const &entry : m_node->entries)
+		{
+			if (entry.first == key)
+			{
+				return interned_type(entry.second);
+			}
+		}
+		return Si::none;
+	}
+
+	type const &interned_type::structure() const
+	{
+		return m_node->structure;
+	}
+
+	bool is_compatible(interned_type produced, interned_type expected)
+	{
+		if (produced == expected)
+		{
+			return true;
+		}
+		if (!produced.is_listing() || !expected.is_listing())
+		{
+			return false;
+		}
+		node_pair const key(produced.m_node, expected.m_node);
+		type_table &table = get_type_table();
+		{
+			boost::lock_guard<boost::mutex> lock(table.access);
+			auto const known = table.compatible.find(key);
+			if (known != table.compatible.end())
+			{
+				return known->second;
+			}
+		}
+		// the entries are compared without the lock because the check recurses into this function
+		bool const result = std::all_of(expected.m_node->entries.begin(), expected.m_node->entries.end(),
+		                                [&produced](std::pair<symbol, interned_type::node const *> const &required)
+		                                {
+			                                Si::optional<interned_type> const found =
+			                                    produced.find_entry(required.first);
+			                                return found && is_compatible(*found, interned_type(required.second));
+			                            });
+		boost::lock_guard<boost::mutex> lock(table.access);
+		table.compatible.insert(std::make_pair(key, result));
+		return result;
+	}
+
+	type make_listing_type(std::initializer_list<std::pair<char const *, type>> entries)
+	{
+		listing_type result;
+		for (auto const &entry : entries)
+		{
+			result.entries.insert(std::make_pair(entry.first, entry.second));
+		}
+		return Si::to_shared(std::move(result));
+	}
+
+	namespace
+	{
+		bool has_structure(value const &checked, type const &expected)
+		{
+			auto const *const checked_listing = Si::try_get_ptr<std::shared_ptr<listing>>(checked);
+			if (atomic_type const *const atomic = Si::try_get_ptr<atomic_type>(expected))
+			{
+				// atomic types are interned without a lock
+				return !checked_listing && (type_of(checked) == interned_type(*atomic));
+			}
+			if (!checked_listing || !*checked_listing)
+			{
+				return false;
+			}
+			listing_type const &expected_listing = **Si::try_get_ptr<std::shared_ptr<listing_type>>(expected);
+			return std::all_of(expected_listing.entries.begin(), expected_listing.entries.end(),
+			                   [checked_listing](std::pair<symbol, type> const &required)
+			                   {
+				                   auto const found = (*checked_listing)->entries.find(required.first);
+				                   return (found != (*checked_listing)->entries.end()) &&
+				                          has_structure(found->second, required.second);
+				               });
+		}
+	}
+
+	bool has_type(value const &checked, interned_type expected)
+	{
+		return has_structure(checked, expected.structure());
+	}
+
+	interned_type type_of(value const &typed)
+	{
+		return Si::visit<interned_type>(typed,
+		                                [](blob const &)
+		                                {
+			                                return interned_type(atomic_type::blob);
+			                            },
+		                                [](std::shared_ptr<listing> const &content) -> interned_type
+		                                {
+			                                if (!content)
+			                                {
+				                                throw std::invalid_argument("a null listing has no type");
+			                                }
+			                                symbol_map<interned_type> entries;
+			                                entries.reserve(content->entries.size());
+			                                for (auto const &entry : content->entries)
+			                                {
+				                                entries.insert(std::make_pair(entry.first, type_of(entry.second)));
+			                                }
+			                                return interned_type(entries);
+			                            },
+		                                [](uri const &)
+		                                {
+			                                return interned_type(atomic_type::uri);
+			                            },
+		                                [](filesystem_directory_ownership const &)
+		                                {
+			                                return interned_type(atomic_type::filesystem_directory_ownership);
+			                            },
+		                                [](ventura::absolute_path const &)
+		                                {
+			                                return interned_type(atomic_type::absolute_path);
+			                            },
+		                                [](ventura::path_segment const &)
+		                                {
+			                                return interned_type(atomic_type::path_segment);
+			                            },
+		                                [](std::uint32_t)
+		                                {
+			                                return interned_type(atomic_type::uint32);
+			                            },
+		                                [](std::shared_ptr<byte_stream> const &)
+		                                {
+			                                return interned_type(atomic_type::stream);
+			                            });
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef BUILDSERVER_GRAPH_TYPE_HPP
+#define BUILDSERVER_GRAPH_TYPE_HPP
+
+#include "graph.hpp"
+#include <silicium/optional.hpp>
+#include <initializer_list>
+
+namespace graph
+{
+	// A hash-consed type: structurally equal types share one immutable node for the whole process, so two interned
+	// types are equal if and only if they point to the same node. Interning a listing takes a lock like interning a
+	// symbol does, so it belongs into the construction of a graph and not into the processing of values. Interned
+	// types live until the process exits.
+	struct interned_type
+	{
+		explicit interned_type(atomic_type atomic);
+		explicit interned_type(type const &structure);
+
+		// a listing with these entries
+		explicit interned_type(symbol_map<interned_type> const &entries);
+
+		bool is_listing() const;
+
+		// the type of the entry if this is a listing that has it
+		Si::optional<interned_type> find_entry(symbol key) const;
+
+		// Equal for equal types, so the listing_type can be compared by pointer, too. Does not allocate.
+		type const &structure() const;
+
+		friend bool operator==(interned_type left, interned_type right)
+		{
+			return left.m_node == right.m_node;
+		}
+
+		friend bool operator!=(interned_type left, interned_type right)
+		{
+			return left.m_node != right.m_node;
+		}
+
+		struct node;
+
+	private:
+		node const *m_node;
+
+		explicit interned_type(node const *existing)
+		    : m_node(existing)
+		{
+		}
+
+		friend bool is_compatible(interned_type produced, interned_type expected);
+	};
+
+	// True if a value of the produced type can be passed where the expected type is required: the types are equal,
+	// or both are listings and the produced one has every entry of the expected one with a compatible type. Additional
+	// entries do not hurt because transformations look up the entries they need by name. Equal types are recognized
+	// without a lock and the results for listings are remembered, so checking a pair again is a table lookup.
+	bool is_compatible(interned_type produced, interned_type expected);
+
+	// the type of a constant, for example
+	interned_type type_of(value const &typed);
+
+	// for writing the types of transformations in place
+	type make_listing_type(std::initializer_list<std::pair<char const *, type>> entries);
+
+	// The same as is_compatible(type_of(checked), expected) without interning the type of the value. Only the entries
+	// that the expected type names are visited and no lock is taken, so this is cheap enough for checking every value
+	// that comes from code which cannot be checked when a dag is built.
+	bool has_type(value const &checked, interned_type expected);
+}
+
+#endif
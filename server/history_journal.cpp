@@ -0,0 +1,663 @@
+#include "history_journal.hpp"
+#include <boost/crc.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/range/algorithm/equal.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace buildserver
+{
+	namespace
+	{
+		std::uint32_t const journal_magic = 0x4a484253;
+		std::uint32_t const record_magic = 0x52484253;
+		std::uint32_t const index_magic = 0x49484253;
+		std::uint32_t const format_version = 1;
+
+		struct journal_header
+		{
+			std::uint32_t magic;
+			std::uint32_t version;
+			std::uint64_t id;
+		};
+
+		struct record_header
+		{
+			std::uint32_t magic;
+			std::uint32_t step_length;
+			std::uint32_t value_length;
+
+			// CRC-32 of the lengths, the step and the value
+			std::uint32_t checksum;
+		};
+
+		struct index_header
+		{
+			std::uint32_t magic;
+			std::uint32_t version;
+			std::uint64_t journal_id;
+
+			// a power of two
+			std::uint64_t capacity;
+
+			std::uint64_t count;
+
+			// the journal up to this offset is in the index
+			std::uint64_t indexed_length;
+
+			// the size of the records that the index refers to
+			std::uint64_t live_bytes;
+		};
+
+		struct index_slot
+		{
+			std::uint64_t hash;
+
+			// zero for an empty slot, which is never the offset of a record because the journal header is there
+			std::uint64_t offset;
+
+			std::uint64_t size;
+		};
+
+		std::uint64_t const first_record = sizeof(journal_header);
+		std::uint64_t const minimum_capacity = 64;
+
+		boost::filesystem::path journal_path(boost::filesystem::path const &directory)
+		{
+			return directory / "journal";
+		}
+
+		boost::filesystem::path index_path(boost::filesystem::path const &directory)
+		{
+			return directory / "index";
+		}
+
+		// FNV-1a, because the hashes are stored and have to be the same in every build
+		std::uint64_t hash_step(Si::memory_range step)
+		{
+			std::uint64_t result = 14695981039346656037u;
+			for (char c : step)
+			{
+				result ^= static_cast<unsigned char>(c);
+				result *= 1099511628211u;
+			}
+			return result;
+		}
+
+		std::uint32_t checksum_record(record_header const &header, Si::memory_range step, Si::memory_range value)
+		{
+			boost::crc_32_type crc;
+			crc.process_bytes(&header.step_length, sizeof(header.step_length));
+			crc.process_bytes(&header.value_length, sizeof(header.value_length));
+			crc.process_bytes(step.begin(), static_cast<std::size_t>(step.size()));
+			crc.process_bytes(value.begin(), static_cast<std::size_t>(value.size()));
+			return crc.checksum();
+		}
+
+		std::uint64_t make_journal_id()
+		{
+			std::random_device random;
+			return (static_cast<std::uint64_t>(random()) << 32) ^ random();
+		}
+
+		struct record
+		{
+			std::uint64_t size;
+			std::vector<char> step;
+			std::vector<char> value;
+		};
+
+		bool read_bytes(std::istream &in, std::vector<char> &bytes, std::uint32_t length)
+		{
+			bytes.resize(length);
+			return !!in.read(bytes.data(), static_cast<std::streamsize>(length));
+		}
+
+		// Reads the record that starts at the offset and ends before end. Returns false if it is torn or corrupt.
+		bool read_record(std::istream &journal, std::uint64_t offset, std::uint64_t end, record &result)
+		{
+			record_header header;
+			if ((offset > end) || ((end - offset) < sizeof(header)))
+			{
+				return false;
+			}
+			journal.clear();
+			journal.seekg(static_cast<std::streamoff>(offset));
+			if (!journal.read(reinterpret_cast<char *>(&header), sizeof(header)) || (header.magic != record_magic))
+			{
+				return false;
+			}
+			std::uint64_t const size = sizeof(header) + std::uint64_t(header.step_length) + header.value_length;
+			if (size > (end - offset))
+			{
+				return false;
+			}
+			if (!read_bytes(journal, result.step, header.step_length) ||
+			    !read_bytes(journal, result.value, header.value_length) ||
+			    (checksum_record(header, Si::make_memory_range(result.step), Si::make_memory_range(result.value)) !=
+			     header.checksum))
+			{
+				return false;
+			}
+			result.size = size;
+			return true;
+		}
+
+		// Compares only the step of a record that has been checked before.
+		bool has_step(std::istream &journal, std::uint64_t offset, Si::memory_range step)
+		{
+			record_header header;
+			journal.clear();
+			journal.seekg(static_cast<std::streamoff>(offset));
+			if (!journal.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+			    (header.step_length != static_cast<std::uint64_t>(step.size())))
+			{
+				return false;
+			}
+			std::vector<char> stored;
+			return read_bytes(journal, stored, header.step_length) && boost::range::equal(stored, step);
+		}
+
+		// returns the size of the record
+		std::uint64_t write_record(std::ostream &journal, Si::memory_range step, Si::memory_range value)
+		{
+			record_header header;
+			header.magic = record_magic;
+			header.step_length = static_cast<std::uint32_t>(step.size());
+			header.value_length = static_cast<std::uint32_t>(value.size());
+			header.checksum = checksum_record(header, step, value);
+			journal.write(reinterpret_cast<char const *>(&header), sizeof(header));
+			journal.write(step.begin(), static_cast<std::streamsize>(step.size()));
+			journal.write(value.begin(), static_cast<std::streamsize>(value.size()));
+			return sizeof(header) + std::uint64_t(header.step_length) + header.value_length;
+		}
+
+		void create_journal(boost::filesystem::path const &file, std::uint64_t id)
+		{
+			journal_header const header = {journal_magic, format_version, id};
+			std::ofstream out(file.string(), std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+			if (!out.flush())
+			{
+				throw std::runtime_error("could not create " + file.string());
+			}
+		}
+
+		std::uint64_t read_journal_id(boost::filesystem::path const &file)
+		{
+			journal_header header;
+			std::ifstream in(file.string(), std::ios::binary);
+			if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) || (header.magic != journal_magic) ||
+			    (header.version != format_version))
+			{
+				throw std::runtime_error(file.string() + " is not a history journal");
+			}
+			return header.id;
+		}
+	}
+
+	struct history_index
+	{
+		boost::filesystem::path file;
+		boost::interprocess::file_mapping mapping;
+		boost::interprocess::mapped_region region;
+
+		explicit history_index(boost::filesystem::path file_)
+		    : file(std::move(file_))
+		    , mapping(file.string().c_str(), boost::interprocess::read_write)
+		    , region(mapping, boost::interprocess::read_write)
+		{
+		}
+
+		index_header &header()
+		{
+			return *static_cast<index_header *>(region.get_address());
+		}
+
+		index_slot *slots()
+		{
+			return reinterpret_cast<index_slot *>(static_cast<char *>(region.get_address()) + sizeof(index_header));
+		}
+
+		bool belongs_to(std::uint64_t journal_id, std::uint64_t journal_size)
+		{
+			if (region.get_size() < sizeof(index_header))
+			{
+				return false;
+			}
+			index_header const &h = header();
+			return (h.magic == index_magic) && (h.version == format_version) && (h.journal_id == journal_id) &&
+			       (h.capacity >= minimum_capacity) && ((h.capacity & (h.capacity - 1)) == 0) &&
+			       (region.get_size() == (sizeof(index_header) + h.capacity * sizeof(index_slot))) &&
+			       (h.indexed_length >= first_record) && (h.indexed_length <= journal_size);
+		}
+	};
+
+	namespace
+	{
+		// Writes an empty index under a temporary name and renames it, so that a crash cannot leave a partial index
+		// under the final name.
+		std::unique_ptr<history_index> create_index(boost::filesystem::path const &file, std::uint64_t journal_id,
+		                                            std::uint64_t capacity)
+		{
+			boost::filesystem::path const temporary = file.string() + ".creating";
+			{
+				index_header const header = {index_magic, format_version, journal_id, capacity, 0, first_record, 0};
+				std::ofstream out(temporary.string(), std::ios::binary | std::ios::trunc);
+				out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+				index_slot const empty = {0, 0, 0};
+				for (std::uint64_t i = 0; i < capacity; ++i)
+				{
+					out.write(reinterpret_cast<char const *>(&empty), sizeof(empty));
+				}
+				if (!out.flush())
+				{
+					throw std::runtime_error("could not create " + temporary.string());
+				}
+			}
+			boost::filesystem::rename(temporary, file);
+			return std::unique_ptr<history_index>(new history_index(file));
+		}
+
+		void insert_new(history_index &index, index_slot const &inserted)
+		{
+			std::uint64_t const mask = index.header().capacity - 1;
+			index_slot *const slots = index.slots();
+			for (std::uint64_t i = inserted.hash & mask;; i = (i + 1) & mask)
+			{
+				if (slots[i].offset == 0)
+				{
+					slots[i] = inserted;
+					index.header().count += 1;
+					index.header().live_bytes += inserted.size;
+					return;
+				}
+			}
+		}
+
+		void grow(std::unique_ptr<history_index> &index)
+		{
+			index_header const old = index->header();
+			boost::filesystem::path const file = index->file;
+			boost::filesystem::path const grown_file = file.string() + ".growing";
+			{
+				std::unique_ptr<history_index> grown = create_index(grown_file, old.journal_id, old.capacity * 2);
+				for (std::uint64_t i = 0; i < old.capacity; ++i)
+				{
+					if (index->slots()[i].offset != 0)
+					{
+						insert_new(*grown, index->slots()[i]);
+					}
+				}
+				grown->header().indexed_length = old.indexed_length;
+			}
+			// unmapped before the rename, which some systems do not allow for mapped files
+			index.reset();
+			boost::filesystem::rename(grown_file, file);
+			index.reset(new history_index(file));
+		}
+
+		// Makes the record the latest one of its step. journal is used to tell steps with equal hashes apart.
+		void put(std::unique_ptr<history_index> &index, std::istream &journal, Si::memory_range step,
+		         index_slot const &latest)
+		{
+			if (((index->header().count + 1) * 2) > index->header().capacity)
+			{
+				grow(index);
+			}
+			index_header &header = index->header();
+			std::uint64_t const mask = header.capacity - 1;
+			index_slot *const slots = index->slots();
+			for (std::uint64_t i = latest.hash & mask;; i = (i + 1) & mask)
+			{
+				index_slot &slot = slots[i];
+				if (slot.offset == 0)
+				{
+					slot = latest;
+					header.count += 1;
+					header.live_bytes += latest.size;
+					return;
+				}
+				if ((slot.hash == latest.hash) && has_step(journal, slot.offset, step))
+				{
+					header.live_bytes -= slot.size;
+					slot = latest;
+					header.live_bytes += latest.size;
+					return;
+				}
+			}
+		}
+
+		std::unique_ptr<history_index> try_map_index(boost::filesystem::path const &file, std::uint64_t journal_id,
+		                                             std::uint64_t journal_size)
+		{
+			if (!boost::filesystem::exists(file))
+			{
+				return nullptr;
+			}
+			try
+			{
+				std::unique_ptr<history_index> existing(new history_index(file));
+				if (existing->belongs_to(journal_id, journal_size))
+				{
+					return existing;
+				}
+			}
+			catch (boost::interprocess::interprocess_exception const &)
+			{
+			}
+			return nullptr;
+		}
+	}
+
+	history_journal::history_journal(boost::filesystem::path directory, std::uint64_t compaction_threshold)
+	    : m_directory(std::move(directory))
+	    , m_compaction_threshold(compaction_threshold)
+	    , m_journal_id(0)
+	    , m_journal_size(0)
+	    , m_recovered_records(0)
+	    , m_compacting(false)
+	{
+		open();
+	}
+
+	history_journal::~history_journal()
+	{
+		wait_for_compaction();
+		if (m_compaction.joinable())
+		{
+			m_compaction.join();
+		}
+	}
+
+	void history_journal::append(Si::memory_range step, Si::memory_range value)
+	{
+		if ((static_cast<std::uint64_t>(step.size()) > (std::numeric_limits<std::uint32_t>::max)()) ||
+		    (static_cast<std::uint64_t>(value.size()) > (std::numeric_limits<std::uint32_t>::max)()))
+		{
+			throw std::invalid_argument("a history record is limited to 4 GiB");
+		}
+		bool start_compaction = false;
+		{
+			boost::lock_guard<boost::mutex> lock(m_access);
+			check_usable();
+			std::uint64_t const offset = m_journal_size;
+			std::uint64_t const size = write_record(m_writer, step, value);
+			if (!m_writer.flush())
+			{
+				throw std::runtime_error("could not append to the history journal");
+			}
+			m_journal_size += size;
+			index_slot const latest = {hash_step(step), offset, size};
+			put(m_index, m_reader, step, latest);
+			index_header &header = m_index->header();
+			header.indexed_length = m_journal_size;
+			start_compaction = !m_compacting && (m_journal_size > ((2 * header.live_bytes) + m_compaction_threshold));
+		}
+		if (start_compaction)
+		{
+			compact_in_background();
+		}
+	}
+
+	Si::optional<std::vector<char>> history_journal::latest(Si::memory_range step) const
+	{
+		std::uint64_t const hash = hash_step(step);
+		boost::lock_guard<boost::mutex> lock(m_access);
+		check_usable();
+		std::uint64_t const mask = m_index->header().capacity - 1;
+		index_slot const *const slots = m_index->slots();
+		for (std::uint64_t i = hash & mask; slots[i].offset != 0; i = (i + 1) & mask)
+		{
+			if (slots[i].hash != hash)
+			{
+				continue;
+			}
+			record found;
+			if (!read_record(m_reader, slots[i].offset, m_journal_size, found))
+			{
+				throw std::runtime_error("the history journal in " + m_directory.string() + " is corrupt");
+			}
+			if (boost::range::equal(found.step, step))
+			{
+				return std::move(found.value);
+			}
+		}
+		return Si::none;
+	}
+
+	void history_journal::compact_in_background()
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		if (m_compacting || !m_failure.empty())
+		{
+			return;
+		}
+		m_compacting = true;
+		// the previous compaction has finished, so the thread only has to exit
+		if (m_compaction.joinable())
+		{
+			m_compaction.join();
+		}
+		m_compaction = boost::thread([this]()
+		                             {
+			                             compact();
+			                         });
+	}
+
+	void history_journal::wait_for_compaction()
+	{
+		boost::unique_lock<boost::mutex> lock(m_access);
+		while (m_compacting)
+		{
+			m_compaction_finished.wait(lock);
+		}
+	}
+
+	std::uint64_t history_journal::journal_size() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		return m_journal_size;
+	}
+
+	std::size_t history_journal::step_count() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		check_usable();
+		return static_cast<std::size_t>(m_index->header().count);
+	}
+
+	bool history_journal::failed() const
+	{
+		boost::lock_guard<boost::mutex> lock(m_access);
+		return !m_failure.empty();
+	}
+
+	void history_journal::open()
+	{
+		boost::filesystem::create_directories(m_directory);
+		boost::filesystem::path const journal = journal_path(m_directory);
+		boost::filesystem::path const index = index_path(m_directory);
+		// left over by a compaction or a growth of the index that did not finish
+		for (char const *unfinished : {"journal.compacting", "index.compacting", "index.creating", "index.growing",
+		                               "index.compacting.creating", "index.growing.creating"})
+		{
+			boost::filesystem::remove(m_directory / unfinished);
+		}
+		if (!boost::filesystem::exists(journal))
+		{
+			create_journal(journal, make_journal_id());
+		}
+		m_journal_id = read_journal_id(journal);
+		m_journal_size = boost::filesystem::file_size(journal);
+		m_index = try_map_index(index, m_journal_id, m_journal_size);
+		if (!m_index)
+		{
+			m_index = create_index(index, m_journal_id, minimum_capacity);
+		}
+		m_reader.open(journal.string(), std::ios::binary);
+		std::uint64_t valid_end = m_index->header().indexed_length;
+		record found;
+		while (read_record(m_reader, valid_end, m_journal_size, found))
+		{
+			index_slot const latest = {hash_step(Si::make_memory_range(found.step)), valid_end, found.size};
+			put(m_index, m_reader, Si::make_memory_range(found.step), latest);
+			valid_end += found.size;
+			++m_recovered_records;
+		}
+		if (valid_end < m_journal_size)
+		{
+			// a torn record of an append that did not finish
+			m_reader.close();
+			boost::filesystem::resize_file(journal, valid_end);
+			m_journal_size = valid_end;
+			m_reader.open(journal.string(), std::ios::binary);
+		}
+		m_index->header().indexed_length = m_journal_size;
+		m_writer.open(journal.string(), std::ios::binary | std::ios::app);
+		if (!m_reader || !m_writer)
+		{
+			throw std::runtime_error("could not open " + journal.string());
+		}
+	}
+
+	void history_journal::compact()
+	{
+		boost::filesystem::path const compacted_journal = m_directory / "journal.compacting";
+		boost::filesystem::path const compacted_index = m_directory / "index.compacting";
+		try
+		{
+			std::vector<index_slot> live;
+			std::uint64_t copied_until = 0;
+			{
+				boost::lock_guard<boost::mutex> lock(m_access);
+				index_slot const *const slots = m_index->slots();
+				std::copy_if(slots, slots + m_index->header().capacity, std::back_inserter(live),
+				             [](index_slot const &slot)
+				             {
+					             return slot.offset != 0;
+				             });
+				copied_until = m_journal_size;
+			}
+
+			// The journal is only appended to, so the records before copied_until can be read without the lock. They
+			// are copied in the order of the journal, which keeps the reads sequential.
+			std::sort(live.begin(), live.end(), [](index_slot const &left, index_slot const &right)
+			          {
+				          return left.offset < right.offset;
+				      });
+			std::uint64_t const id = make_journal_id();
+			create_journal(compacted_journal, id);
+			std::uint64_t capacity = minimum_capacity;
+			while (capacity < (live.size() * 4))
+			{
+				capacity *= 2;
+			}
+			std::unique_ptr<history_index> index = create_index(compacted_index, id, capacity);
+			std::ifstream old(journal_path(m_directory).string(), std::ios::binary);
+			std::ofstream out(compacted_journal.string(), std::ios::binary | std::ios::app);
+			std::uint64_t size = first_record;
+			record copied;
+			for (index_slot const &slot : live)
+			{
+				if (!read_record(old, slot.offset, copied_until, copied))
+				{
+					throw std::runtime_error("the history journal is corrupt");
+				}
+				write_record(out, Si::make_memory_range(copied.step), Si::make_memory_range(copied.value));
+				index_slot const moved = {slot.hash, size, copied.size};
+				insert_new(*index, moved);
+				size += copied.size;
+			}
+			if (!out.flush())
+			{
+				throw std::runtime_error("could not write " + compacted_journal.string());
+			}
+
+			boost::lock_guard<boost::mutex> lock(m_access);
+			// the records that were appended during the copy
+			std::ifstream compacted(compacted_journal.string(), std::ios::binary);
+			for (std::uint64_t offset = copied_until; offset < m_journal_size; offset += copied.size)
+			{
+				if (!read_record(m_reader, offset, m_journal_size, copied))
+				{
+					throw std::runtime_error("the history journal is corrupt");
+				}
+				write_record(out, Si::make_memory_range(copied.step), Si::make_memory_range(copied.value));
+				if (!out.flush())
+				{
+					throw std::runtime_error("could not write " + compacted_journal.string());
+				}
+				index_slot const latest = {hash_step(Si::make_memory_range(copied.step)), size, copied.size};
+				put(index, compacted, Si::make_memory_range(copied.step), latest);
+				size += copied.size;
+			}
+			index->header().indexed_length = size;
+			out.close();
+			old.close();
+			compacted.close();
+			index.reset();
+			m_writer.close();
+			m_reader.close();
+			m_index.reset();
+
+			// A crash between the renames leaves an index of another journal, which is rebuilt when the journal is
+			// opened again.
+			boost::filesystem::rename(compacted_journal, journal_path(m_directory));
+			boost::filesystem::rename(compacted_index, index_path(m_directory));
+			m_index.reset(new history_index(index_path(m_directory)));
+			m_journal_id = id;
+			m_journal_size = size;
+			m_reader.open(journal_path(m_directory).string(), std::ios::binary);
+			m_writer.open(journal_path(m_directory).string(), std::ios::binary | std::ios::app);
+			m_compacting = false;
+			m_compaction_finished.notify_all();
+		}
+		catch (std::exception const &)
+		{
+			// the old journal is still complete, so it is kept as it is
+			boost::system::error_code ignored;
+			boost::filesystem::remove(compacted_journal, ignored);
+			boost::filesystem::remove(compacted_index, ignored);
+			boost::lock_guard<boost::mutex> lock(m_access);
+			if (!m_index)
+			{
+				// the files were being swapped, so whichever journal is complete on the disk is opened again
+				m_writer.close();
+				m_reader.close();
+				try
+				{
+					open();
+				}
+				catch (std::exception const &ex)
+				{
+					// nothing may escape the thread, so the callers learn about it from the next call
+					m_writer.close();
+					m_reader.close();
+					m_index.reset();
+					m_failure = ex.what();
+					if (m_failure.empty())
+					{
+						m_failure = "unknown error";
+					}
+				}
+			}
+			m_compacting = false;
+			m_compaction_finished.notify_all();
+		}
+	}
+
+	void history_journal::check_usable() const
+	{
+		if (!m_failure.empty())
+		{
+			throw std::runtime_error("the history journal in " + m_directory.string() +
+			                         " could not be opened again after a compaction: " + m_failure);
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef BUILDSERVER_HISTORY_JOURNAL_HPP
+#define BUILDSERVER_HISTORY_JOURNAL_HPP
+
+#include <silicium/memory_range.hpp>
+#include <silicium/optional.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace buildserver
+{
+	struct history_index;
+
+	// Remembers the latest value of every pipeline step across restarts, for example the last commit message that a
+	// persistent filter has let through. Two files in the directory hold the state:
+	//
+	//   journal   a header with a random id, then the appended records: step id and value with a CRC-32
+	//   index     a hash table of step id to the latest record, mapped into memory, that names the id of its journal
+	//             and how much of the journal it covers
+	//
+	// Looking up the latest value costs one probe of the index and one read of the record. Opening the journal only
+	// checks the records that the index does not cover yet, and cuts a torn record at the end off. A missing index or
+	// one that belongs to another journal is rebuilt from the whole journal.
+	//
+	// Values that have been replaced are removed by a compaction that copies the latest records into a new journal on
+	// a background thread. Appends and lookups continue meanwhile and only wait while the records that were appended
+	// during the copy are moved over and the files are swapped. All member functions may be called from any thread.
+	//
+	// A compaction that fails before the files are swapped keeps the old journal. If it fails while they are swapped
+	// and the journal cannot be opened again, the history_journal is failed: append, latest and step_count throw
+	// std::runtime_error with the reason from then on.
+	struct history_journal : private boost::noncopyable
+	{
+		// A compaction starts by itself when the journal has grown by the threshold beyond twice the size of the latest
+		// records. Throws std::runtime_error if the journal exists but cannot be read.
+		explicit history_journal(boost::filesystem::path directory, std::uint64_t compaction_threshold = 1u << 20);
+
+		// waits for a running compaction
+		~history_journal();
+
+		// The record is written to the journal before this returns, but it is not synced to the disk.
+		void append(Si::memory_range step, Si::memory_range value);
+
+		Si::optional<std::vector<char>> latest(Si::memory_range step) const;
+
+		// does nothing if a compaction is running already
+		void compact_in_background();
+
+		void wait_for_compaction();
+
+		// bytes, including the replaced records that a compaction would remove
+		std::uint64_t journal_size() const;
+
+		std::size_t step_count() const;
+
+		bool failed() const;
+
+		// the records that the index did not cover when the journal was opened
+		std::uint64_t recovered_records() const
+		{
+			return m_recovered_records;
+		}
+
+	private:
+		boost::filesystem::path m_directory;
+		std::uint64_t m_compaction_threshold;
+		mutable boost::mutex m_access;
+		std::uint64_t m_journal_id;
+		std::uint64_t m_journal_size;
+		std::ofstream m_writer;
+		mutable std::ifstream m_reader;
+		std::unique_ptr<history_index> m_index;
+		std::uint64_t m_recovered_records;
+		bool m_compacting;
+
+		// why the journal could not be opened again after a compaction, empty while it works
+		std::string m_failure;
+		boost::condition_variable m_compaction_finished;
+		boost::thread m_compaction;
+
+		void open();
+		void compact();
+
+		// throws if the journal has failed, must be called with m_access locked
+		void check_usable() const;
+	};
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "json_writer.hpp"
+#include <cassert>
+
+namespace buildserver
+{
+	namespace
+	{
+		// The length of the well-formed UTF-8 sequence at begin (RFC 3629), or 0 if the bytes there are not one.
+		// Overlong forms, surrogates and code points beyond U+10FFFF are not well-formed.
+		std::size_t utf8_sequence_length(unsigned char const *begin, unsigned char const *end)
+		{
+			unsigned char const lead = *begin;
+			std::size_t length = 0;
+			unsigned char second_min = 0x80;
+			unsigned char second_max = 0xbf;
+			if ((lead >= 0xc2) && (lead <= 0xdf))
+			{
+				length = 2;
+			}
+			else if ((lead >= 0xe0) && (lead <= 0xef))
+			{
+				length = 3;
+				if (lead == 0xe0)
+				{
+					second_min = 0xa0;
+				}
+				else if (lead == 0xed)
+				{
+					second_max = 0x9f;
+				}
+			}
+			else if ((lead >= 0xf0) && (lead <= 0xf4))
+			{
+				length = 4;
+				if (lead == 0xf0)
+				{
+					second_min = 0x90;
+				}
+				else if (lead == 0xf4)
+				{
+					second_max = 0x8f;
+				}
+			}
+			else
+			{
+				return 0;
+			}
+			if (static_cast<std::size_t>(end - begin) < length)
+			{
+				return 0;
+			}
+			if ((begin[1] < second_min) || (begin[1] > second_max))
+			{
+				return 0;
+			}
+			for (std::size_t i = 2; i < length; ++i)
+			{
+				if ((begin[i] & 0xc0) != 0x80)
+				{
+					return 0;
+				}
+			}
+			return length;
+		}
+	}
+
+	json_writer::json_writer(std::vector<char> &out)
+	    : m_out(out)
+	    , m_first_element(0)
+	    , m_depth(0)
+	    , m_after_key(false)
+	{
+	}
+
+	void json_writer::begin_object()
+	{
+		push_container('{');
+	}
+
+	void json_writer::end_object()
+	{
+		pop_container('}');
+	}
+
+	void json_writer::begin_array()
+	{
+		push_container('[');
+	}
+
+	void json_writer::end_array()
+	{
+		pop_container(']');
+	}
+
+	void json_writer::key(Si::memory_range name)
+	{
+		assert(!m_after_key);
+		string(name);
+		append(':');
+		m_after_key = true;
+	}
+
+	void json_writer::string(Si::memory_range value)
+	{
+		before_value();
+		append('"');
+		static char const hex[] = "0123456789abcdef";
+		char const *unescaped_begin = value.begin();
+		for (char const *i = value.begin(); i != value.end(); ++i)
+		{
+			unsigned char const c = static_cast<unsigned char>(*i);
+			if (c >= 0x80)
+			{
+				std::size_t const length = utf8_sequence_length(reinterpret_cast<unsigned char const *>(i),
+				                                                reinterpret_cast<unsigned char const *>(value.end()));
+				if (length > 0)
+				{
+					i += length - 1;
+					continue;
+				}
+				// a JSON text has to be UTF-8, so every byte that does not belong to a well-formed sequence becomes
+				// U+FFFD REPLACEMENT CHARACTER
+				append(unescaped_begin, i);
+				unescaped_begin = i + 1;
+				static char const replacement[] = "\xef\xbf\xbd";
+				append(replacement, replacement + 3);
+				continue;
+			}
+			if ((c >= 0x20) && (c != '"') && (c != '\\'))
+			{
+				continue;
+			}
+			append(unescaped_begin, i);
+			unescaped_begin = i + 1;
+			switch (c)
+			{
+			case '"':
+				append("\\\"", "\\\"" + 2);
+				break;
+			case '\\':
+				append("\\\\", "\\\\" + 2);
+				break;
+			case '\n':
+				append("\\n", "\\n" + 2);
+				break;
+			case '\r':
+				append("\\r", "\\r" + 2);
+				break;
+			case '\t':
+				append("\\t", "\\t" + 2);
+				break;
+			default:
+			{
+				char const escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+				append(escaped, escaped + sizeof(escaped));
+				break;
+			}
+			}
+		}
+		append(unescaped_begin, value.end());
+		append('"');
+	}
+
+	void json_writer::number(std::uint64_t value)
+	{
+		before_value();
+		char digits[20];
+		char *const end = digits + sizeof(digits);
+		char *begin = end;
+		do
+		{
+			*--begin = static_cast<char>('0' + (value % 10));
+			value /= 10;
+		} while (value != 0);
+		append(begin, end);
+	}
+
+	void json_writer::boolean(bool value)
+	{
+		before_value();
+		static char const true_[] = "true";
+		static char const false_[] = "false";
+		if (value)
+		{
+			append(true_, true_ + 4);
+		}
+		else
+		{
+			append(false_, false_ + 5);
+		}
+	}
+
+	void json_writer::null()
+	{
+		before_value();
+		static char const null_[] = "null";
+		append(null_, null_ + 4);
+	}
+
+	void json_writer::before_value()
+	{
+		if (m_after_key)
+		{
+			m_after_key = false;
+			return;
+		}
+		if (m_depth == 0)
+		{
+			return;
+		}
+		std::uint64_t const bit = std::uint64_t(1) << (m_depth - 1);
+		if (m_first_element & bit)
+		{
+			m_first_element &= ~bit;
+		}
+		else
+		{
+			append(',');
+		}
+	}
+
+	void json_writer::push_container(char opening)
+	{
+		before_value();
+		append(opening);
+		assert(m_depth < 64);
+		++m_depth;
+		m_first_element |= std::uint64_t(1) << (m_depth - 1);
+	}
+
+	void json_writer::pop_container(char closing)
+	{
+		assert(m_depth > 0);
+		assert(!m_after_key);
+		--m_depth;
+		append(closing);
+	}
+
+	void json_writer::append(char c)
+	{
+		m_out.push_back(c);
+	}
+
+	void json_writer::append(char const *begin, char const *end)
+	{
+		m_out.insert(m_out.end(), begin, end);
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef BUILDSERVER_JSON_WRITER_HPP
+#define BUILDSERVER_JSON_WRITER_HPP
+
+#include <silicium/memory_range.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace buildserver
+{
+	// Appends compact JSON to a caller-owned buffer. The writer itself never allocates, so serializing into a buffer
+	// that is reused between requests is allocation-free once the buffer has grown to its working size.
+	struct json_writer
+	{
+		explicit json_writer(std::vector<char> &out);
+
+		void begin_object();
+		void end_object();
+		void begin_array();
+		void end_array();
+		void key(Si::memory_range name);
+		// bytes that are not well-formed UTF-8 are replaced with U+FFFD
+		void string(Si::memory_range value);
+		void number(std::uint64_t value);
+		void boolean(bool value);
+		void null();
+
+	private:
+		std::vector<char> &m_out;
+
+		// one bit per nesting level: set while the current container has no element yet
+		std::uint64_t m_first_element;
+		unsigned m_depth;
+		bool m_after_key;
+
+		void before_value();
+		void push_container(char opening);
+		void pop_container(char closing);
+		void append(char c);
+		void append(char const *begin, char const *end);
+	};
+}
+
+#endif
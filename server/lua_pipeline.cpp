@@ -0,0 +1,291 @@
+#include "lua_pipeline.hpp"
+#include "file_io.hpp"
+#include "sha256.hpp"
+#include <silicium/optional.hpp>
+#include <luacpp/register_any_function.hpp>
+#include <luacpp/load.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace buildserver
+{
+	namespace
+	{
+		int append_chunk(lua_State *, void const *chunk, std::size_t size, void *bytecode)
+		{
+			char const *const begin = static_cast<char const *>(chunk);
+			static_cast<std::vector<char> *>(bytecode)->insert(static_cast<std::vector<char> *>(bytecode)->end(), begin,
+			                                                   begin + size);
+			return 0;
+		}
+
+		std::vector<char> compile(lua_State &compiler, std::vector<char> const &source, std::string const &name)
+		{
+			int const stack_size = lua_gettop(&compiler);
+			if (luaL_loadbuffer(&compiler, source.data(), source.size(), name.c_str()) != 0)
+			{
+				throw_lua_error(compiler, stack_size);
+			}
+			std::vector<char> bytecode;
+			int const dumped = lua_dump(&compiler, &append_chunk, &bytecode);
+			lua_settop(&compiler, stack_size);
+			if (dumped != 0)
+			{
+				throw std::runtime_error("could not dump the bytecode of " + name);
+			}
+			return bytecode;
+		}
+
+		// Returns none if the digest does not match the bytecode or if Lua cannot load it as a binary chunk.
+		Si::optional<std::vector<char>> load_stored(lua_State &compiler, boost::filesystem::path const &file)
+		{
+			std::vector<char> const stored = read_file(file);
+			std::size_t const digest_size = sha256_digest().size();
+			if (stored.size() < digest_size)
+			{
+				return Si::none;
+			}
+			Si::memory_range const bytecode(stored.data() + digest_size, stored.data() + stored.size());
+			sha256_digest const digest = hash_sha256(bytecode);
+			if (!std::equal(digest.begin(), digest.end(), reinterpret_cast<std::uint8_t const *>(stored.data())))
+			{
+				return Si::none;
+			}
+			// luaL_loadbuffer would accept source code, too
+			Si::memory_range const signature = Si::make_c_str_range(LUA_SIGNATURE);
+			if ((bytecode.size() < signature.size()) ||
+			    !std::equal(signature.begin(), signature.end(), bytecode.begin()))
+			{
+				return Si::none;
+			}
+			int const stack_size = lua_gettop(&compiler);
+			std::size_t const size = static_cast<std::size_t>(bytecode.size());
+			bool const loadable = (luaL_loadbuffer(&compiler, bytecode.begin(), size, file.string().c_str()) == 0);
+			lua_settop(&compiler, stack_size);
+			if (!loadable)
+			{
+				return Si::none;
+			}
+			return std::vector<char>(bytecode.begin(), bytecode.end());
+		}
+
+		// require(name, version) returns the module or nil
+		int require_module(lua_State *state)
+		{
+			luaL_checkstring(state, 1);
+			luaL_checkstring(state, 2);
+			lua_pushvalue(state, 1);
+			lua_pushliteral(state, "/");
+			lua_pushvalue(state, 2);
+			lua_concat(state, 3);
+			lua_gettable(state, lua_upvalueindex(1));
+			return 1;
+		}
+
+		// steps.export(name, function) makes the function available to lua_pipeline_host::push_step
+		int export_step(lua_State *state)
+		{
+			luaL_checkstring(state, 1);
+			luaL_checktype(state, 2, LUA_TFUNCTION);
+			lua_settop(state, 2);
+			lua_settable(state, lua_upvalueindex(1));
+			return 0;
+		}
+	}
+
+	void throw_lua_error(lua_State &state, int stack_size)
+	{
+		std::size_t length = 0;
+		char const *const message = lua_tolstring(&state, -1, &length);
+		std::string error = message ? std::string(message, length) : std::string("unknown Lua error");
+		lua_settop(&state, stack_size);
+		throw std::runtime_error(std::move(error));
+	}
+
+	lua_bytecode_cache::lua_bytecode_cache(boost::filesystem::path directory)
+	    : m_directory(std::move(directory))
+	    , m_hits(0)
+	    , m_misses(0)
+	{
+		create_private_directory(m_directory);
+	}
+
+	std::vector<char> const &lua_bytecode_cache::get(lua_State &compiler, boost::filesystem::path const &script)
+	{
+		std::vector<char> const source = read_file(script);
+		sha256 hash;
+		hash.update(Si::make_c_str_range(LUA_RELEASE));
+		hash.update(Si::make_memory_range(source));
+		std::string const key = format_hex(hash.finish());
+		auto const loaded = m_loaded.find(key);
+		if (loaded != m_loaded.end())
+		{
+			++m_hits;
+			return loaded->second;
+		}
+		boost::filesystem::path const cached = m_directory / (key + ".luac");
+		if (boost::filesystem::exists(cached))
+		{
+			Si::optional<std::vector<char>> stored = load_stored(compiler, cached);
+			if (stored)
+			{
+				++m_hits;
+				return m_loaded.insert(std::make_pair(key, std::move(*stored))).first->second;
+			}
+			boost::filesystem::remove(cached);
+		}
+		++m_misses;
+		std::vector<char> bytecode = compile(compiler, source, script.string());
+		sha256_digest const digest = hash_sha256(Si::make_memory_range(bytecode));
+		std::vector<char> stored(digest.begin(), digest.end());
+		stored.insert(stored.end(), bytecode.begin(), bytecode.end());
+		write_file_atomically(cached, Si::make_memory_range(stored));
+		return m_loaded.insert(std::make_pair(key, std::move(bytecode))).first->second;
+	}
+
+	lua_pipeline_host::lua_pipeline_host(lua_State &state)
+	    : m_state(state)
+	{
+		lua_newtable(&m_state);
+		m_exported = luaL_ref(&m_state, LUA_REGISTRYINDEX);
+
+		// "name/version" to module
+		lua_newtable(&m_state);
+		{
+			lua::stack s(m_state);
+			lua::stack_value steps = lua::create_table(m_state);
+			steps.set("map", lua::register_any_function(s, [](lua::any_local)
+			                                            {
+				                                        }));
+			steps.set("sequence", lua::register_any_function(s, [](lua::any_local)
+			                                                 {
+				                                             }));
+			steps.release();
+		}
+		lua_rawgeti(&m_state, LUA_REGISTRYINDEX, m_exported);
+		lua_pushcclosure(&m_state, &export_step, 1);
+		lua_setfield(&m_state, -2, "export");
+		lua_setfield(&m_state, -2, "steps/1.0");
+		lua_pushcclosure(&m_state, &require_module, 1);
+		m_require = luaL_ref(&m_state, LUA_REGISTRYINDEX);
+	}
+
+	lua_pipeline_host::~lua_pipeline_host()
+	{
+		luaL_unref(&m_state, LUA_REGISTRYINDEX, m_require);
+		luaL_unref(&m_state, LUA_REGISTRYINDEX, m_exported);
+	}
+
+	void lua_pipeline_host::run(std::vector<char> const &bytecode, std::string const &name)
+	{
+		int const stack_size = lua_gettop(&m_state);
+		if (luaL_loadbuffer(&m_state, bytecode.data(), bytecode.size(), name.c_str()) != 0)
+		{
+			throw_lua_error(m_state, stack_size);
+		}
+		lua_newtable(&m_state);
+		lua_newtable(&m_state);
+		lua_pushvalue(&m_state, LUA_GLOBALSINDEX);
+		lua_setfield(&m_state, -2, "__index");
+		lua_setmetatable(&m_state, -2);
+		lua_setfenv(&m_state, -2);
+		if (lua_pcall(&m_state, 0, 1, 0) != 0)
+		{
+			throw_lua_error(m_state, stack_size);
+		}
+		if (lua_isfunction(&m_state, -1))
+		{
+			lua_rawgeti(&m_state, LUA_REGISTRYINDEX, m_require);
+			if (lua_pcall(&m_state, 1, 0, 0) != 0)
+			{
+				throw_lua_error(m_state, stack_size);
+			}
+		}
+		lua_settop(&m_state, stack_size);
+	}
+
+	bool lua_pipeline_host::push_step(std::string const &name)
+	{
+		lua_rawgeti(&m_state, LUA_REGISTRYINDEX, m_exported);
+		lua_getfield(&m_state, -1, name.c_str());
+		lua_remove(&m_state, -2);
+		if (lua_isfunction(&m_state, -1))
+		{
+			return true;
+		}
+		lua_pop(&m_state, 1);
+		return false;
+	}
+
+	lua_worker_pool::lua_worker_pool(std::size_t worker_count, std::function<void(lua_pipeline_host &)> prepare)
+	    : m_next_worker(0)
+	{
+		if (worker_count == 0)
+		{
+			throw std::invalid_argument("a lua_worker_pool needs at least one worker");
+		}
+		for (std::size_t i = 0; i < worker_count; ++i)
+		{
+			m_workers.emplace_back(new worker);
+		}
+		for (std::unique_ptr<worker> const &each : m_workers)
+		{
+			worker &current = *each;
+			current.thread = boost::thread([&current, prepare]()
+			                               {
+				                               auto owner = lua::create_lua();
+				                               lua_pipeline_host host(*owner);
+				                               prepare(host);
+				                               current.host = &host;
+				                               current.jobs.run();
+				                               current.host = nullptr;
+				                           });
+		}
+	}
+
+	lua_worker_pool::~lua_worker_pool()
+	{
+		for (std::unique_ptr<worker> const &each : m_workers)
+		{
+			each->keep_running.reset();
+		}
+		for (std::unique_ptr<worker> const &each : m_workers)
+		{
+			each->thread.join();
+		}
+	}
+
+	void lua_worker_pool::post(std::function<void(lua_pipeline_host &)> job)
+	{
+		worker &chosen = *m_workers[m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_workers.size()];
+		chosen.jobs.post([&chosen, job]()
+		                 {
+			                 job(*chosen.host);
+			             });
+	}
+
+	void push_result(lua_State &state, process_result const &result)
+	{
+		memory_blob const *const blob = Si::try_get_ptr<memory_blob>(result);
+		if (!blob)
+		{
+			lua_pushnil(&state);
+			return;
+		}
+		lua_pushlstring(&state, blob->content.data(), blob->content.size());
+	}
+
+	shared_result pop_result(lua_State &state)
+	{
+		std::size_t length = 0;
+		char const *const content =
+		    (lua_type(&state, -1) == LUA_TSTRING) ? lua_tolstring(&state, -1, &length) : nullptr;
+		shared_result result =
+		    content ? std::make_shared<process_result const>(memory_blob{std::vector<char>(content, content + length)})
+		            : std::make_shared<process_result const>(
+		                  failure_description{"a Lua step has to return a string"});
+		lua_pop(&state, 1);
+		return result;
+	}
+}
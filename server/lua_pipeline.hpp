@@ -0,0 +1,138 @@
+#ifndef BUILDSERVER_LUA_PIPELINE_HPP
+#define BUILDSERVER_LUA_PIPELINE_HPP
+
+#include "dag_runner.hpp"
+#include <boost/asio/io_service.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <lua.hpp>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace buildserver
+{
+	// Pops the error message of a failed Lua call and throws it as a std::runtime_error.
+	void throw_lua_error(lua_State &state, int stack_size);
+
+	// Compiles pipeline scripts to bytecode once. The bytecode is kept in memory and in a directory that can be shared
+	// by the processes of the current user:
+	//
+	//   directory/<sha256>.luac   the SHA-256 of the bytecode, followed by the bytecode
+	//
+	// The file name is the SHA-256 of the Lua release and the source, so an edited script is compiled again and a
+	// bytecode file is never loaded by an interpreter that cannot read it. Files are written under a temporary name and
+	// renamed, so a concurrent reader never sees a partial file. A file whose digest does not match or that Lua cannot
+	// load is deleted and compiled again.
+	//
+	// The digest only detects damaged files. Lua does not verify bytecode, so loading bytecode that someone else has
+	// written would let them run arbitrary code in the server. That is why the directory has to be private to the
+	// current user (see create_private_directory).
+	struct lua_bytecode_cache : private boost::noncopyable
+	{
+		// Throws std::runtime_error if the directory belongs to another user or can be written by other users.
+		explicit lua_bytecode_cache(boost::filesystem::path directory);
+
+		// The script is read and hashed on every call, but compiled only if its content is new. Throws
+		// std::runtime_error if the script cannot be read or compiled.
+		std::vector<char> const &get(lua_State &compiler, boost::filesystem::path const &script);
+
+		std::size_t hits() const
+		{
+			return m_hits;
+		}
+
+		std::size_t misses() const
+		{
+			return m_misses;
+		}
+
+	private:
+		boost::filesystem::path m_directory;
+		std::unordered_map<std::string, std::vector<char>> m_loaded;
+		std::size_t m_hits;
+		std::size_t m_misses;
+	};
+
+	// Runs precompiled pipeline scripts in one Lua state that is set up once. The native modules are created in the
+	// constructor, so running a script only loads its bytecode. Every script gets its own table of globals that falls
+	// back to the shared one, so the scripts of different projects cannot see each other's globals. Scripts make
+	// functions available to the server with steps.export(name, function) of the module "steps" version "1.0".
+	struct lua_pipeline_host : private boost::noncopyable
+	{
+		explicit lua_pipeline_host(lua_State &state);
+		~lua_pipeline_host();
+
+		// Executes the chunk and calls the function that it returns with the require function of the host. Throws
+		// std::runtime_error if the bytecode cannot be loaded or the script fails.
+		void run(std::vector<char> const &bytecode, std::string const &name);
+
+		// Pushes the function that a script has exported under the name. Returns false and pushes nothing if there is
+		// none.
+		bool push_step(std::string const &name);
+
+		lua_State &state() const
+		{
+			return m_state;
+		}
+
+	private:
+		lua_State &m_state;
+		int m_require;
+		int m_exported;
+	};
+
+	// A fixed set of threads that own one Lua state each, so Lua steps can run on all cores although a lua_State must
+	// not be used by two threads at once. A state is created, prepared and used only on the thread of its worker.
+	//
+	// Lua values never leave the state that created them. Data is passed between workers, and between a worker and
+	// the thread of the dag_runner, only as a shared_result: a process_result is never changed after it has been
+	// produced, so all threads can read the same instance without a lock or a copy. A job converts its input into
+	// values of its own state and converts its output into a new process_result (see push_result and pop_result).
+	struct lua_worker_pool : private boost::noncopyable
+	{
+		// Prepare is called once for every worker on its thread with the host of the new state, for example to run the
+		// cached bytecode of the scripts that export the steps. It must not throw.
+		lua_worker_pool(std::size_t worker_count, std::function<void(lua_pipeline_host &)> prepare);
+
+		// finishes the jobs that were posted already
+		~lua_worker_pool();
+
+		// Runs the job on one of the workers with the host of that worker. The jobs are distributed round-robin. Jobs
+		// must not throw.
+		void post(std::function<void(lua_pipeline_host &)> job);
+
+		std::size_t worker_count() const
+		{
+			return m_workers.size();
+		}
+
+	private:
+		struct worker
+		{
+			boost::asio::io_service jobs;
+			std::unique_ptr<boost::asio::io_service::work> keep_running;
+			lua_pipeline_host *host;
+			boost::thread thread;
+
+			worker()
+			    : keep_running(new boost::asio::io_service::work(jobs))
+			    , host(nullptr)
+			{
+			}
+		};
+
+		std::vector<std::unique_ptr<worker>> m_workers;
+		std::atomic<std::size_t> m_next_worker;
+	};
+
+	// Pushes the content of a memory_blob as a string and anything else as nil.
+	void push_result(lua_State &state, process_result const &result);
+
+	// Pops a string as a memory_blob. Any other value is a failure.
+	shared_result pop_result(lua_State &state);
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include "metrics.hpp"
+#include "thread_local.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace buildserver
+{
+	namespace metrics
+	{
+		namespace
+		{
+			struct registry
+			{
+				boost::mutex access;
+				std::vector<counter const *> counters;
+				std::vector<gauge const *> gauges;
+				std::vector<histogram const *> histograms;
+			};
+
+			// metrics are usually static objects in different translation units, so the registry has to be
+			// constructed on first use
+			registry &get_registry()
+			{
+				static registry instance;
+				return instance;
+			}
+
+			std::atomic<std::size_t> next_shard(0);
+
+			std::size_t highest_bit(std::uint64_t value)
+			{
+				assert(value != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+				unsigned long index;
+				_BitScanReverse64(&index, value);
+				return index;
+#elif defined(__GNUC__)
+				return static_cast<std::size_t>(63 - __builtin_clzll(value));
+#else
+				std::size_t index = 0;
+				while (value >>= 1)
+				{
+					++index;
+				}
+				return index;
+#endif
+			}
+
+			void append(std::vector<char> &out, char const *text)
+			{
+				out.insert(out.end(), text, text + std::strlen(text));
+			}
+
+			template <class... Arguments>
+			void append_format(std::vector<char> &out, char const *format, Arguments... arguments)
+			{
+				char buffer[64];
+				int const length = std::snprintf(buffer, sizeof(buffer), format, arguments...);
+				assert(length >= 0);
+				out.insert(out.end(), buffer,
+				           buffer + (std::min)(static_cast<std::size_t>(length), sizeof(buffer) - 1));
+			}
+
+			void append_header(std::vector<char> &out, char const *name, char const *help, char const *type)
+			{
+				append(out, "# HELP ");
+				append(out, name);
+				append(out, " ");
+				append(out, help);
+				append(out, "\n# TYPE ");
+				append(out, name);
+				append(out, " ");
+				append(out, type);
+				append(out, "\n");
+			}
+
+			template <class Metric>
+			void unregister(std::vector<Metric const *> &metrics, Metric const &removed)
+			{
+				metrics.erase(std::remove(metrics.begin(), metrics.end(), &removed), metrics.end());
+			}
+
+			double nanoseconds_to_seconds(std::uint64_t nanoseconds)
+			{
+				return static_cast<double>(nanoseconds) / 1e9;
+			}
+		}
+
+		std::size_t current_shard()
+		{
+			// 0 means "not assigned yet" so that the thread local can be zero-initialized
+			static BUILDSERVER_THREAD_LOCAL std::size_t shard_plus_one = 0;
+			if (shard_plus_one == 0)
+			{
+				shard_plus_one = (next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count) + 1;
+			}
+			return shard_plus_one - 1;
+		}
+
+		counter::counter(char const *name, char const *help)
+		    : m_name(name)
+		    , m_help(help)
+		{
+			for (shard &s : m_shards)
+			{
+				s.value.store(0, std::memory_order_relaxed);
+			}
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			r.counters.emplace_back(this);
+		}
+
+		counter::~counter()
+		{
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			unregister(r.counters, *this);
+		}
+
+		std::uint64_t counter::read() const
+		{
+			std::uint64_t sum = 0;
+			for (shard const &s : m_shards)
+			{
+				sum += s.value.load(std::memory_order_relaxed);
+			}
+			return sum;
+		}
+
+		gauge::gauge(char const *name, char const *help)
+		    : m_name(name)
+		    , m_help(help)
+		    , m_value(0)
+		{
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			r.gauges.emplace_back(this);
+		}
+
+		gauge::~gauge()
+		{
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			unregister(r.gauges, *this);
+		}
+
+		std::size_t get_bucket_index(std::uint64_t value)
+		{
+			if (value < sub_bucket_count)
+			{
+				return static_cast<std::size_t>(value);
+			}
+			std::size_t const magnitude = highest_bit(value);
+			std::size_t const shift = magnitude - sub_bucket_bits;
+			std::size_t const sub_bucket = static_cast<std::size_t>(value >> shift) & (sub_bucket_count - 1);
+			return (magnitude - sub_bucket_bits + 1) * sub_bucket_count + sub_bucket;
+		}
+
+		std::uint64_t get_bucket_upper_bound(std::size_t bucket)
+		{
+			assert(bucket < histogram_bucket_count);
+			if (bucket < sub_bucket_count)
+			{
+				return bucket;
+			}
+			std::size_t const shift = (bucket / sub_bucket_count) - 1;
+			std::uint64_t const sub_bucket = bucket % sub_bucket_count;
+			std::uint64_t const lower_bound = (sub_bucket_count + sub_bucket) << shift;
+			return lower_bound + ((std::uint64_t(1) << shift) - 1);
+		}
+
+		histogram::histogram(char const *name, char const *help)
+		    : m_name(name)
+		    , m_help(help)
+		{
+			for (shard &s : m_shards)
+			{
+				for (std::atomic<std::uint64_t> &bucket : s.buckets)
+				{
+					bucket.store(0, std::memory_order_relaxed);
+				}
+				s.sum.store(0, std::memory_order_relaxed);
+			}
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			r.histograms.emplace_back(this);
+		}
+
+		histogram::~histogram()
+		{
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			unregister(r.histograms, *this);
+		}
+
+		histogram_snapshot histogram::read() const
+		{
+			histogram_snapshot result;
+			result.buckets.fill(0);
+			result.count = 0;
+			result.sum = 0;
+			for (shard const &s : m_shards)
+			{
+				for (std::size_t i = 0; i < histogram_bucket_count; ++i)
+				{
+					std::uint64_t const in_bucket = s.buckets[i].load(std::memory_order_relaxed);
+					result.buckets[i] += in_bucket;
+					result.count += in_bucket;
+				}
+				result.sum += s.sum.load(std::memory_order_relaxed);
+			}
+			return result;
+		}
+
+		void render_prometheus(std::vector<char> &out)
+		{
+			registry &r = get_registry();
+			boost::lock_guard<boost::mutex> lock(r.access);
+			for (counter const *c : r.counters)
+			{
+				append_header(out, c->name(), c->help(), "counter");
+				append(out, c->name());
+				append_format(out, " %llu\n", static_cast<unsigned long long>(c->read()));
+			}
+			for (gauge const *g : r.gauges)
+			{
+				append_header(out, g->name(), g->help(), "gauge");
+				append(out, g->name());
+				append_format(out, " %lld\n", static_cast<long long>(g->read()));
+			}
+			for (histogram const *h : r.histograms)
+			{
+				histogram_snapshot const snapshot = h->read();
+				append_header(out, h->name(), h->help(), "histogram");
+				std::uint64_t cumulative = 0;
+				// Every bucket is written even if it is empty, because Prometheus computes rates and quantiles per
+				// bucket series, and a series that only exists while its bucket is not empty breaks both.
+				for (std::size_t i = 0; i < histogram_bucket_count; ++i)
+				{
+					cumulative += snapshot.buckets[i];
+					append(out, h->name());
+					append_format(out, "_bucket{le=\"%.9g\"} %llu\n",
+					              nanoseconds_to_seconds(get_bucket_upper_bound(i)),
+					              static_cast<unsigned long long>(cumulative));
+				}
+				append(out, h->name());
+				append_format(out, "_bucket{le=\"+Inf\"} %llu\n", static_cast<unsigned long long>(snapshot.count));
+				append(out, h->name());
+				append_format(out, "_sum %.9g\n", nanoseconds_to_seconds(snapshot.sum));
+				append(out, h->name());
+				append_format(out, "_count %llu\n", static_cast<unsigned long long>(snapshot.count));
+			}
+		}
+
+		counter &processes_spawned()
+		{
+			static counter instance("buildserver_processes_spawned_total", "Child processes started");
+			return instance;
+		}
+	}
+}
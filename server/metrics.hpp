@@ -0,0 +1,185 @@
+#ifndef BUILDSERVER_METRICS_HPP
+#define BUILDSERVER_METRICS_HPP
+
+#include <boost/noncopyable.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace buildserver
+{
+	namespace metrics
+	{
+		// Every thread writes to one of these shards, so concurrent recording does not fight over one cache line.
+		std::size_t const shard_count = 16;
+
+		// The shards are padded by hand instead of with alignas, which some of the compilers we build with do not
+		// support. The padding keeps the values of neighbouring shards at least a cache line apart.
+		std::size_t const cache_line_size = 64;
+
+		std::size_t current_shard();
+
+		struct counter : private boost::noncopyable
+		{
+			// the name and the help text have to outlive the counter, string literals are the intended use
+			counter(char const *name, char const *help);
+			~counter();
+
+			void add(std::uint64_t amount = 1)
+			{
+				m_shards[current_shard()].value.fetch_add(amount, std::memory_order_relaxed);
+			}
+
+			std::uint64_t read() const;
+
+			char const *name() const
+			{
+				return m_name;
+			}
+
+			char const *help() const
+			{
+				return m_help;
+			}
+
+		private:
+			struct shard
+			{
+				std::atomic<std::uint64_t> value;
+				char padding[cache_line_size - sizeof(std::atomic<std::uint64_t>)];
+			};
+
+			char const *m_name;
+			char const *m_help;
+			std::array<shard, shard_count> m_shards;
+		};
+
+		// A value that goes up and down, like the length of a queue. Gauges are set rarely enough to share one atomic.
+		struct gauge : private boost::noncopyable
+		{
+			gauge(char const *name, char const *help);
+			~gauge();
+
+			void set(std::int64_t value)
+			{
+				m_value.store(value, std::memory_order_relaxed);
+			}
+
+			void add(std::int64_t difference)
+			{
+				m_value.fetch_add(difference, std::memory_order_relaxed);
+			}
+
+			std::int64_t read() const
+			{
+				return m_value.load(std::memory_order_relaxed);
+			}
+
+			char const *name() const
+			{
+				return m_name;
+			}
+
+			char const *help() const
+			{
+				return m_help;
+			}
+
+		private:
+			char const *m_name;
+			char const *m_help;
+			std::atomic<std::int64_t> m_value;
+		};
+
+		// Durations are recorded in nanoseconds into log-linear buckets: every power of two is split into
+		// sub_bucket_count linear buckets, so a bucket is never wider than a quarter of its lower bound.
+		std::size_t const sub_bucket_bits = 2;
+		std::size_t const sub_bucket_count = std::size_t(1) << sub_bucket_bits;
+		std::size_t const histogram_bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+		std::size_t get_bucket_index(std::uint64_t value);
+
+		// the largest value that falls into the bucket
+		std::uint64_t get_bucket_upper_bound(std::size_t bucket);
+
+		struct histogram_snapshot
+		{
+			std::array<std::uint64_t, histogram_bucket_count> buckets;
+			std::uint64_t count;
+			std::uint64_t sum;
+		};
+
+		struct histogram : private boost::noncopyable
+		{
+			histogram(char const *name, char const *help);
+			~histogram();
+
+			void record(std::uint64_t nanoseconds)
+			{
+				shard &mine = m_shards[current_shard()];
+				mine.buckets[get_bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+				mine.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+			}
+
+			template <class Rep, class Period>
+			void record(std::chrono::duration<Rep, Period> elapsed)
+			{
+				record(
+				    static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+			}
+
+			histogram_snapshot read() const;
+
+			char const *name() const
+			{
+				return m_name;
+			}
+
+			char const *help() const
+			{
+				return m_help;
+			}
+
+		private:
+			struct shard
+			{
+				std::array<std::atomic<std::uint64_t>, histogram_bucket_count> buckets;
+				std::atomic<std::uint64_t> sum;
+				char padding[cache_line_size];
+			};
+
+			char const *m_name;
+			char const *m_help;
+			std::array<shard, shard_count> m_shards;
+		};
+
+		// records the lifetime of the object into a histogram
+		struct scoped_duration : private boost::noncopyable
+		{
+			explicit scoped_duration(histogram &destination)
+			    : m_destination(destination)
+			    , m_started(std::chrono::steady_clock::now())
+			{
+			}
+
+			~scoped_duration()
+			{
+				m_destination.record(std::chrono::steady_clock::now() - m_started);
+			}
+
+		private:
+			histogram &m_destination;
+			std::chrono::steady_clock::time_point m_started;
+		};
+
+		// appends all metrics that exist in this process in the Prometheus text exposition format
+		void render_prometheus(std::vector<char> &out);
+
+		// counts every child process started by the build server, no matter which part of it started the process
+		counter &processes_spawned();
+	}
+}
+
+#endif
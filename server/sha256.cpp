@@ -0,0 +1,161 @@
+#include "sha256.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace buildserver
+{
+	namespace
+	{
+		std::uint32_t const round_constants[64] = {
+		    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+		std::uint32_t rotate_right(std::uint32_t value, unsigned bits)
+		{
+			return (value >> bits) | (value << (32 - bits));
+		}
+
+		std::uint32_t load_big_endian(std::uint8_t const *bytes)
+		{
+			return (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) | (std::uint32_t(bytes[2]) << 8) |
+			       std::uint32_t(bytes[3]);
+		}
+	}
+
+	sha256::sha256()
+	    : m_state{{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}}
+	    , m_block_used(0)
+	    , m_total_length(0)
+	{
+	}
+
+	void sha256::update(Si::memory_range data)
+	{
+		std::uint8_t const *input = reinterpret_cast<std::uint8_t const *>(data.begin());
+		std::size_t remaining = static_cast<std::size_t>(data.size());
+		m_total_length += remaining;
+		if (m_block_used > 0)
+		{
+			std::size_t const copied = (std::min)(remaining, m_block.size() - m_block_used);
+			std::memcpy(m_block.data() + m_block_used, input, copied);
+			m_block_used += copied;
+			input += copied;
+			remaining -= copied;
+			if (m_block_used < m_block.size())
+			{
+				return;
+			}
+			process_block(m_block.data());
+			m_block_used = 0;
+		}
+		// full blocks are hashed directly from the input without copying them first
+		while (remaining >= m_block.size())
+		{
+			process_block(input);
+			input += m_block.size();
+			remaining -= m_block.size();
+		}
+		if (remaining > 0)
+		{
+			std::memcpy(m_block.data(), input, remaining);
+			m_block_used = remaining;
+		}
+	}
+
+	sha256_digest sha256::finish()
+	{
+		std::uint64_t const length_in_bits = m_total_length * 8;
+		m_block[m_block_used++] = 0x80;
+		if (m_block_used > 56)
+		{
+			std::fill(m_block.begin() + static_cast<std::ptrdiff_t>(m_block_used), m_block.end(), std::uint8_t(0));
+			process_block(m_block.data());
+			m_block_used = 0;
+		}
+		std::fill(m_block.begin() + static_cast<std::ptrdiff_t>(m_block_used), m_block.begin() + 56, std::uint8_t(0));
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			m_block[56 + i] = static_cast<std::uint8_t>(length_in_bits >> (56 - 8 * i));
+		}
+		process_block(m_block.data());
+		sha256_digest result;
+		for (std::size_t i = 0; i < m_state.size(); ++i)
+		{
+			result[4 * i] = static_cast<std::uint8_t>(m_state[i] >> 24);
+			result[4 * i + 1] = static_cast<std::uint8_t>(m_state[i] >> 16);
+			result[4 * i + 2] = static_cast<std::uint8_t>(m_state[i] >> 8);
+			result[4 * i + 3] = static_cast<std::uint8_t>(m_state[i]);
+		}
+		return result;
+	}
+
+	void sha256::process_block(std::uint8_t const *block)
+	{
+		std::uint32_t schedule[64];
+		for (std::size_t i = 0; i < 16; ++i)
+		{
+			schedule[i] = load_big_endian(block + 4 * i);
+		}
+		for (std::size_t i = 16; i < 64; ++i)
+		{
+			std::uint32_t const s0 =
+			    rotate_right(schedule[i - 15], 7) ^ rotate_right(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+			std::uint32_t const s1 =
+			    rotate_right(schedule[i - 2], 17) ^ rotate_right(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+			schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+		}
+		std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		std::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+		for (std::size_t i = 0; i < 64; ++i)
+		{
+			std::uint32_t const s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+			std::uint32_t const choice = (e & f) ^ (~e & g);
+			std::uint32_t const temp1 = h + s1 + choice + round_constants[i] + schedule[i];
+			std::uint32_t const s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+			std::uint32_t const majority = (a & b) ^ (a & c) ^ (b & c);
+			std::uint32_t const temp2 = s0 + majority;
+			h = g;
+			g = f;
+			f = e;
+			e = d + temp1;
+			d = c;
+			c = b;
+			b = a;
+			a = temp1 + temp2;
+		}
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+		m_state[4] += e;
+		m_state[5] += f;
+		m_state[6] += g;
+		m_state[7] += h;
+	}
+
+	sha256_digest hash_sha256(Si::memory_range data)
+	{
+		sha256 hasher;
+		hasher.update(data);
+		return hasher.finish();
+	}
+
+	std::string format_hex(sha256_digest const &digest)
+	{
+		static char const hex[] = "0123456789abcdef";
+		std::string result;
+		result.reserve(digest.size() * 2);
+		for (std::uint8_t byte : digest)
+		{
+			result.push_back(hex[byte >> 4]);
+			result.push_back(hex[byte & 0xf]);
+		}
+		return result;
+	}
+}
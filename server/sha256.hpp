@@ -0,0 +1,35 @@
+#ifndef BUILDSERVER_SHA256_HPP
+#define BUILDSERVER_SHA256_HPP
+
+#include <silicium/memory_range.hpp>
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace buildserver
+{
+	typedef std::array<std::uint8_t, 32> sha256_digest;
+
+	// incremental SHA-256 as specified in FIPS 180-4
+	struct sha256
+	{
+		sha256();
+		void update(Si::memory_range data);
+		sha256_digest finish();
+
+	private:
+		std::array<std::uint32_t, 8> m_state;
+		std::array<std::uint8_t, 64> m_block;
+		std::size_t m_block_used;
+		std::uint64_t m_total_length;
+
+		void process_block(std::uint8_t const *block);
+	};
+
+	sha256_digest hash_sha256(Si::memory_range data);
+
+	// lower case, 64 characters
+	std::string format_hex(sha256_digest const &digest);
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef BUILDSERVER_THREAD_LOCAL_HPP
+#define BUILDSERVER_THREAD_LOCAL_HPP
+
+// thread_local is not supported by every compiler we build with, but these extensions are (for trivial types)
+#ifdef _MSC_VER
+#define BUILDSERVER_THREAD_LOCAL __declspec(thread)
+#else
+#define BUILDSERVER_THREAD_LOCAL __thread
+#endif
+
+#endif
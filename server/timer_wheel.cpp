@@ -0,0 +1,292 @@
+#include "timer_wheel.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace buildserver
+{
+	namespace
+	{
+		unsigned const slot_bits = 6;
+		std::uint32_t const slots_per_level = 1u << slot_bits;
+		std::size_t const level_count = 4;
+
+		// the ticks that the levels cover together
+		std::uint64_t const wheel_range = std::uint64_t(1) << (slot_bits * level_count);
+
+		std::uint32_t const no_entry = (std::numeric_limits<std::uint32_t>::max)();
+		std::uint32_t const expiring_slot = static_cast<std::uint32_t>(slots_per_level * level_count);
+
+		std::uint32_t slot_of(std::size_t level, std::uint64_t tick)
+		{
+			return static_cast<std::uint32_t>(level * slots_per_level +
+			                                  ((tick >> (slot_bits * level)) & (slots_per_level - 1)));
+		}
+
+		timer_wheel::handle make_handle(std::uint32_t index, std::uint32_t generation)
+		{
+			return (static_cast<std::uint64_t>(generation) << 32) | index;
+		}
+	}
+
+	timer_wheel::timer_wheel()
+	    : m_free(no_entry)
+	    , m_armed(0)
+	    , m_slots(expiring_slot + 1, no_entry)
+	    , m_next_tick(0)
+	{
+	}
+
+	timer_wheel::handle timer_wheel::arm(std::uint64_t expiry, std::function<void()> callback)
+	{
+		std::uint32_t index = m_free;
+		if (index == no_entry)
+		{
+			if (m_entries.size() >= no_entry)
+			{
+				throw std::length_error("too many timers");
+			}
+			index = static_cast<std::uint32_t>(m_entries.size());
+			m_entries.emplace_back();
+			m_entries.back().generation = 1;
+		}
+		else
+		{
+			m_free = m_entries[index].next;
+		}
+		entry &armed = m_entries[index];
+		armed.expiry = (std::max)(expiry, m_next_tick);
+		armed.callback = std::move(callback);
+		insert(index);
+		++m_armed;
+		return make_handle(index, armed.generation);
+	}
+
+	bool timer_wheel::cancel(handle timer)
+	{
+		std::uint32_t const index = static_cast<std::uint32_t>(timer);
+		if ((index >= m_entries.size()) || (m_entries[index].generation != static_cast<std::uint32_t>(timer >> 32)) ||
+		    (m_entries[index].slot == no_entry))
+		{
+			return false;
+		}
+		unlink(index);
+		release(index);
+		return true;
+	}
+
+	void timer_wheel::advance(std::uint64_t last)
+	{
+		while (m_next_tick <= last)
+		{
+			if (m_armed == 0)
+			{
+				// nothing can expire, so the empty slots do not have to be visited
+				m_next_tick = last + 1;
+				return;
+			}
+			std::uint64_t const tick = m_next_tick;
+			for (std::size_t level = 1; level < level_count; ++level)
+			{
+				if ((tick & ((std::uint64_t(1) << (slot_bits * level)) - 1)) != 0)
+				{
+					break;
+				}
+				cascade(level);
+			}
+			move_slot(slot_of(0, tick), expiring_slot);
+			++m_next_tick;
+			while (m_slots[expiring_slot] != no_entry)
+			{
+				std::uint32_t const index = m_slots[expiring_slot];
+				std::function<void()> callback = std::move(m_entries[index].callback);
+				unlink(index);
+				release(index);
+				callback();
+			}
+		}
+	}
+
+	std::uint64_t timer_wheel::next_event() const
+	{
+		std::uint64_t next = (std::numeric_limits<std::uint64_t>::max)();
+		if (m_armed == 0)
+		{
+			return next;
+		}
+		for (std::size_t level = 0; level < level_count; ++level)
+		{
+			// a level is only visited at the ticks that are multiples of the range of one of its slots
+			unsigned const shift = static_cast<unsigned>(slot_bits * level);
+			std::uint64_t const step = std::uint64_t(1) << shift;
+			std::uint64_t tick = ((m_next_tick + step - 1) >> shift) << shift;
+			for (std::uint32_t i = 0; (i < slots_per_level) && (tick < next); ++i, tick += step)
+			{
+				if (m_slots[slot_of(level, tick)] != no_entry)
+				{
+					next = tick;
+				}
+			}
+		}
+		return next;
+	}
+
+	void timer_wheel::insert(std::uint32_t index)
+	{
+		std::uint64_t const expiry = m_entries[index].expiry;
+		assert(expiry >= m_next_tick);
+		std::uint64_t const delay = expiry - m_next_tick;
+		if (delay >= wheel_range)
+		{
+			// parked in the top level until the remaining delay fits
+			link(index, slot_of(level_count - 1, m_next_tick + wheel_range - 1));
+			return;
+		}
+		std::size_t level = 0;
+		while (delay >= (std::uint64_t(1) << (slot_bits * (level + 1))))
+		{
+			++level;
+		}
+		link(index, slot_of(level, expiry));
+	}
+
+	void timer_wheel::link(std::uint32_t index, std::uint32_t slot)
+	{
+		entry &linked = m_entries[index];
+		linked.slot = slot;
+		linked.previous = no_entry;
+		linked.next = m_slots[slot];
+		if (linked.next != no_entry)
+		{
+			m_entries[linked.next].previous = index;
+		}
+		m_slots[slot] = index;
+	}
+
+	void timer_wheel::unlink(std::uint32_t index)
+	{
+		entry &unlinked = m_entries[index];
+		if (unlinked.previous == no_entry)
+		{
+			m_slots[unlinked.slot] = unlinked.next;
+		}
+		else
+		{
+			m_entries[unlinked.previous].next = unlinked.next;
+		}
+		if (unlinked.next != no_entry)
+		{
+			m_entries[unlinked.next].previous = unlinked.previous;
+		}
+		unlinked.slot = no_entry;
+	}
+
+	void timer_wheel::release(std::uint32_t index)
+	{
+		entry &released = m_entries[index];
+		released.callback = nullptr;
+		// zero is left out, so that no handle is zero
+		if (++released.generation == 0)
+		{
+			released.generation = 1;
+		}
+		released.next = m_free;
+		m_free = index;
+		--m_armed;
+	}
+
+	void timer_wheel::move_slot(std::uint32_t from, std::uint32_t to)
+	{
+		assert(m_slots[to] == no_entry);
+		m_slots[to] = m_slots[from];
+		m_slots[from] = no_entry;
+		for (std::uint32_t i = m_slots[to]; i != no_entry; i = m_entries[i].next)
+		{
+			m_entries[i].slot = to;
+		}
+	}
+
+	void timer_wheel::cascade(std::size_t level)
+	{
+		std::uint32_t const slot = slot_of(level, m_next_tick);
+		std::uint32_t index = m_slots[slot];
+		m_slots[slot] = no_entry;
+		while (index != no_entry)
+		{
+			std::uint32_t const next = m_entries[index].next;
+			insert(index);
+			index = next;
+		}
+	}
+
+	steady_timer_wheel::steady_timer_wheel(boost::asio::io_service &io, clock::duration resolution)
+	    : m_ticker(io)
+	    , m_resolution(resolution)
+	    , m_start(clock::now())
+	    , m_ticking(false)
+	    , m_wake_up(0)
+	    , m_wait_generation(0)
+	    , m_alive(std::make_shared<bool>(true))
+	{
+		if (resolution <= clock::duration::zero())
+		{
+			throw std::invalid_argument("the resolution of a timer wheel has to be positive");
+		}
+	}
+
+	steady_timer_wheel::~steady_timer_wheel()
+	{
+		*m_alive = false;
+		boost::system::error_code ignored;
+		m_ticker.cancel(ignored);
+	}
+
+	timer_wheel::handle steady_timer_wheel::expires_from_now(clock::duration delay, std::function<void()> callback)
+	{
+		clock::time_point const now = clock::now();
+		if (!m_ticking)
+		{
+			// no timer is armed, so this only skips the ticks that passed while the wheel was idle
+			m_wheel.advance(tick_at(now));
+		}
+		// rounded up, so that the timer cannot expire early
+		clock::duration const until_expiry = (now - m_start) + (std::max)(delay, clock::duration::zero());
+		std::uint64_t const expiry =
+		    static_cast<std::uint64_t>((until_expiry + m_resolution - clock::duration(1)) / m_resolution);
+		timer_wheel::handle const armed = m_wheel.arm(expiry, std::move(callback));
+		if (!m_ticking || (expiry < m_wake_up))
+		{
+			schedule_tick();
+		}
+		return armed;
+	}
+
+	std::uint64_t steady_timer_wheel::tick_at(clock::time_point time) const
+	{
+		return static_cast<std::uint64_t>((time - m_start) / m_resolution);
+	}
+
+	void steady_timer_wheel::schedule_tick()
+	{
+		m_ticking = true;
+		m_wake_up = m_wheel.next_event();
+		m_ticker.expires_at(m_start + m_resolution * static_cast<clock::rep>(m_wake_up));
+		std::shared_ptr<bool> alive = m_alive;
+		std::uint64_t const generation = ++m_wait_generation;
+		m_ticker.async_wait([this, alive, generation](boost::system::error_code ec)
+		                    {
+			                    if (!*alive || !!ec || (generation != m_wait_generation))
+			                    {
+				                    return;
+			                    }
+			                    m_wheel.advance(tick_at(clock::now()));
+			                    if (m_wheel.armed() == 0)
+			                    {
+				                    m_ticking = false;
+				                    return;
+			                    }
+			                    schedule_tick();
+			                });
+	}
+}
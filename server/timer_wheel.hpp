@@ -0,0 +1,129 @@
+#ifndef BUILDSERVER_TIMER_WHEEL_HPP
+#define BUILDSERVER_TIMER_WHEEL_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace buildserver
+{
+	// A hierarchical timing wheel that counts time in abstract ticks. Arming and cancelling a timer are O(1), and
+	// advancing by one tick costs O(1) plus the timers that expire or move to a finer level, no matter how many timers
+	// are armed. Level 0 has one slot per tick, every further level covers 64 times the range of the previous one,
+	// and a timer moves down a level whenever the finer level wraps around. Timers beyond the range of the top level
+	// move down later than they could, but they do not expire early.
+	struct timer_wheel : private boost::noncopyable
+	{
+		// Identifies an armed timer. A handle of a timer that expired or was cancelled is not valid again until the
+		// generation counter of its entry wraps around after 2^32 reuses. Zero is never a valid handle.
+		typedef std::uint64_t handle;
+
+		timer_wheel();
+
+		// The callback is called by advance() when it processes the tick expiry, or the next tick if expiry has been
+		// processed already.
+		handle arm(std::uint64_t expiry, std::function<void()> callback);
+
+		// Returns false if the timer has expired or has been cancelled already.
+		bool cancel(handle timer);
+
+		// Processes every tick up to and including last. Callbacks may arm and cancel timers, but they must not throw.
+		// A timer that a callback arms for a tick that has been processed expires at the following tick.
+		void advance(std::uint64_t last);
+
+		// the first tick that has not been processed yet
+		std::uint64_t next_tick() const
+		{
+			return m_next_tick;
+		}
+
+		// The first tick at which advance() has to do more than skip empty slots, because a timer expires or moves to a
+		// finer level. The maximum of std::uint64_t if no timer is armed. Costs one look at up to 64 slots per level.
+		std::uint64_t next_event() const;
+
+		std::size_t armed() const
+		{
+			return m_armed;
+		}
+
+	private:
+		struct entry
+		{
+			std::uint64_t expiry;
+			std::function<void()> callback;
+			std::uint32_t generation;
+			std::uint32_t slot;
+			std::uint32_t previous;
+			std::uint32_t next;
+		};
+
+		std::vector<entry> m_entries;
+		std::uint32_t m_free;
+		std::size_t m_armed;
+
+		// the first entry of the list of every slot of every level, followed by the list of expiring timers
+		std::vector<std::uint32_t> m_slots;
+
+		std::uint64_t m_next_tick;
+
+		void insert(std::uint32_t index);
+		void link(std::uint32_t index, std::uint32_t slot);
+		void unlink(std::uint32_t index);
+		void release(std::uint32_t index);
+		void move_slot(std::uint32_t from, std::uint32_t to);
+		void cascade(std::size_t level);
+	};
+
+	// Drives a timer_wheel from an io_service with a fixed resolution. One steady_timer wakes up only at the ticks at
+	// which a timer expires or moves to a finer level, and not at all while no timer is armed, so thousands of timeouts
+	// cost as much polling as one. Timers expire at least the requested duration after they are armed and up to one
+	// resolution later. Must only be used on the thread that runs the io_service.
+	struct steady_timer_wheel : private boost::noncopyable
+	{
+		typedef std::chrono::steady_clock clock;
+
+		steady_timer_wheel(boost::asio::io_service &io, clock::duration resolution);
+		~steady_timer_wheel();
+
+		// the callback is called by a handler of the io_service together with the other timers of the same tick
+		timer_wheel::handle expires_from_now(clock::duration delay, std::function<void()> callback);
+
+		bool cancel(timer_wheel::handle timer)
+		{
+			return m_wheel.cancel(timer);
+		}
+
+		std::size_t armed() const
+		{
+			return m_wheel.armed();
+		}
+
+	private:
+		boost::asio::steady_timer m_ticker;
+		clock::duration m_resolution;
+		clock::time_point m_start;
+		timer_wheel m_wheel;
+		bool m_ticking;
+
+		// the tick that the pending wait ends at
+		std::uint64_t m_wake_up;
+
+		// identifies the pending wait, because a replaced wait may have completed already when it is replaced
+		std::uint64_t m_wait_generation;
+
+		// false after destruction, for a tick handler that could not be cancelled anymore
+		std::shared_ptr<bool> m_alive;
+
+		// the last tick that has begun at the given time
+		std::uint64_t tick_at(clock::time_point time) const;
+
+		void schedule_tick();
+	};
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include "trace.hpp"
+#include "json_writer.hpp"
+#include "thread_local.hpp"
+#include <algorithm>
+
+namespace buildserver
+{
+	namespace
+	{
+		BUILDSERVER_THREAD_LOCAL trace_recorder *installed_trace = nullptr;
+
+		std::atomic<std::uint32_t> next_thread(0);
+
+		std::uint32_t current_thread()
+		{
+			// 0 means "not assigned yet" so that the thread local can be zero-initialized
+			static BUILDSERVER_THREAD_LOCAL std::uint32_t thread_plus_one = 0;
+			if (thread_plus_one == 0)
+			{
+				thread_plus_one = next_thread.fetch_add(1, std::memory_order_relaxed) + 1;
+			}
+			return thread_plus_one - 1;
+		}
+
+		std::uint64_t nanoseconds_between(std::chrono::steady_clock::time_point from,
+		                                  std::chrono::steady_clock::time_point to)
+		{
+			if (to < from)
+			{
+				return 0;
+			}
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+		}
+	}
+
+	trace_recorder::trace_recorder(std::size_t capacity)
+	    : m_started(std::chrono::steady_clock::now())
+	    , m_slots(new slot[capacity])
+	    , m_capacity(capacity)
+	    , m_used(0)
+	{
+		for (std::size_t i = 0; i < capacity; ++i)
+		{
+			m_slots[i].complete.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void trace_recorder::record(char const *name, char const *category, std::chrono::steady_clock::time_point begin,
+	                            std::chrono::steady_clock::time_point end)
+	{
+		std::size_t const index = m_used.fetch_add(1, std::memory_order_relaxed);
+		if (index >= m_capacity)
+		{
+			return;
+		}
+		slot &reserved = m_slots[index];
+		reserved.event.name = name;
+		reserved.event.category = category;
+		reserved.event.begin = nanoseconds_between(m_started, begin);
+		reserved.event.duration = nanoseconds_between(begin, end);
+		reserved.event.thread = current_thread();
+		reserved.complete.store(true, std::memory_order_release);
+	}
+
+	std::vector<trace_event> trace_recorder::events() const
+	{
+		std::size_t const used = (std::min)(m_used.load(std::memory_order_relaxed), m_capacity);
+		std::vector<trace_event> result;
+		result.reserve(used);
+		for (std::size_t i = 0; i < used; ++i)
+		{
+			// a slot can be reserved by a span that is still being written
+			if (m_slots[i].complete.load(std::memory_order_acquire))
+			{
+				result.emplace_back(m_slots[i].event);
+			}
+		}
+		return result;
+	}
+
+	std::uint64_t trace_recorder::dropped() const
+	{
+		std::size_t const used = m_used.load(std::memory_order_relaxed);
+		return (used > m_capacity) ? (used - m_capacity) : 0;
+	}
+
+	void trace_recorder::write_chrome_trace(std::vector<char> &out) const
+	{
+		json_writer json(out);
+		json.begin_object();
+		json.key(Si::make_c_str_range("traceEvents"));
+		json.begin_array();
+		for (trace_event const &event : events())
+		{
+			// The format counts in microseconds. Both ends are rounded down the same way so that spans which are
+			// nested in nanoseconds stay nested.
+			std::uint64_t const begin = event.begin / 1000;
+			std::uint64_t const end = (event.begin + event.duration) / 1000;
+			json.begin_object();
+			json.key(Si::make_c_str_range("name"));
+			json.string(Si::make_c_str_range(event.name));
+			json.key(Si::make_c_str_range("cat"));
+			json.string(Si::make_c_str_range(event.category));
+			json.key(Si::make_c_str_range("ph"));
+			json.string(Si::make_c_str_range("X"));
+			json.key(Si::make_c_str_range("ts"));
+			json.number(begin);
+			json.key(Si::make_c_str_range("dur"));
+			json.number(end - begin);
+			json.key(Si::make_c_str_range("pid"));
+			json.number(1);
+			json.key(Si::make_c_str_range("tid"));
+			json.number(event.thread);
+			json.end_object();
+		}
+		json.end_array();
+		json.key(Si::make_c_str_range("droppedEvents"));
+		json.number(dropped());
+		json.end_object();
+	}
+
+	trace_recorder *current_trace()
+	{
+		return installed_trace;
+	}
+
+	trace_scope::trace_scope(trace_recorder *recorder)
+	    : m_previous(installed_trace)
+	{
+		installed_trace = recorder;
+	}
+
+	trace_scope::~trace_scope()
+	{
+		installed_trace = m_previous;
+	}
+}
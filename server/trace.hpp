@@ -0,0 +1,100 @@
+#ifndef BUILDSERVER_TRACE_HPP
+#define BUILDSERVER_TRACE_HPP
+
+#include <boost/noncopyable.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace buildserver
+{
+	struct trace_event
+	{
+		// the strings have to outlive the recorder, string literals and graph::symbol names are the intended use
+		char const *name;
+		char const *category;
+
+		// nanoseconds since the recorder was created
+		std::uint64_t begin;
+		std::uint64_t duration;
+
+		// a small number that identifies the recording thread within this process
+		std::uint32_t thread;
+	};
+
+	// Collects the spans of one build. Recording reserves a slot in a buffer allocated in advance with a single
+	// atomic increment, so it neither locks nor allocates. Spans that do not fit anymore are counted and dropped.
+	struct trace_recorder : private boost::noncopyable
+	{
+		explicit trace_recorder(std::size_t capacity);
+
+		void record(char const *name, char const *category, std::chrono::steady_clock::time_point begin,
+		            std::chrono::steady_clock::time_point end);
+
+		// the spans that are complete, in no particular order
+		std::vector<trace_event> events() const;
+
+		std::uint64_t dropped() const;
+
+		// Appends the spans in the trace event format of chrome://tracing and Perfetto.
+		void write_chrome_trace(std::vector<char> &out) const;
+
+	private:
+		struct slot
+		{
+			trace_event event;
+			std::atomic<bool> complete;
+		};
+
+		std::chrono::steady_clock::time_point m_started;
+		std::unique_ptr<slot[]> m_slots;
+		std::size_t m_capacity;
+		std::atomic<std::size_t> m_used;
+	};
+
+	// the recorder installed on the calling thread by trace_scope, or nullptr
+	trace_recorder *current_trace();
+
+	// Installs a recorder for the calling thread for the lifetime of the object. Scopes can be nested.
+	struct trace_scope : private boost::noncopyable
+	{
+		explicit trace_scope(trace_recorder *recorder);
+		~trace_scope();
+
+	private:
+		trace_recorder *m_previous;
+	};
+
+	// Records its lifetime into the recorder of the current thread. Without a recorder it only costs a null check.
+	struct trace_span : private boost::noncopyable
+	{
+		trace_span(char const *name, char const *category)
+		    : m_recorder(current_trace())
+		    , m_name(name)
+		    , m_category(category)
+		{
+			if (m_recorder)
+			{
+				m_started = std::chrono::steady_clock::now();
+			}
+		}
+
+		~trace_span()
+		{
+			if (m_recorder)
+			{
+				m_recorder->record(m_name, m_category, m_started, std::chrono::steady_clock::now());
+			}
+		}
+
+	private:
+		trace_recorder *m_recorder;
+		char const *m_name;
+		char const *m_category;
+		std::chrono::steady_clock::time_point m_started;
+	};
+}
+
+#endif
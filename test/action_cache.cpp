@@ -0,0 +1,161 @@
+#include <boost/test/unit_test.hpp>
+#include "server/action_cache.hpp"
+#include "test/temporary_directory.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+
+namespace
+{
+	void write_text(boost::filesystem::path const &file, std::string const &content)
+	{
+		boost::filesystem::create_directories(file.parent_path());
+		std::ofstream(file.string(), std::ios::binary) << content;
+	}
+
+	std::string read_text(boost::filesystem::path const &file)
+	{
+		std::ifstream in(file.string(), std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(action_cache_tree_hash)
+{
+	buildserver::test::temporary_directory first;
+	write_text(first.path / "CMakeLists.txt", "project(x)");
+	write_text(first.path / "src" / "main.cpp", "int main() {}");
+	write_text(first.path / ".git" / "HEAD", "ref: refs/heads/master");
+
+	// created in a different order and with a different repository state
+	buildserver::test::temporary_directory second;
+	write_text(second.path / "src" / "main.cpp", "int main() {}");
+	write_text(second.path / ".git" / "HEAD", "ref: refs/heads/feature");
+	write_text(second.path / "CMakeLists.txt", "project(x)");
+
+	std::vector<Si::noexcept_string> const excluded{".git"};
+	buildserver::sha256_digest const original = buildserver::hash_directory_tree(first.path, excluded);
+	BOOST_CHECK(original == buildserver::hash_directory_tree(second.path, excluded));
+	BOOST_CHECK(original != buildserver::hash_directory_tree(second.path, {}));
+
+	write_text(second.path / "src" / "main.cpp", "int main() { return 1; }");
+	BOOST_CHECK(original != buildserver::hash_directory_tree(second.path, excluded));
+
+	// moving content between files changes the hash, too
+	buildserver::test::temporary_directory third;
+	write_text(third.path / "CMakeLists.txt", "project(x)int main() {}");
+	boost::filesystem::create_directories(third.path / "src");
+	write_text(third.path / "src" / "main.cpp", "");
+	BOOST_CHECK(original != buildserver::hash_directory_tree(third.path, excluded));
+}
+
+BOOST_AUTO_TEST_CASE(action_cache_action_hash)
+{
+	buildserver::action_description generate;
+	generate.tool = "cmake_generate";
+	generate.inputs["source"] = "0123";
+	generate.inputs["definition:CMAKE_BUILD_TYPE"] = "Release";
+	buildserver::action_description reordered;
+	reordered.tool = "cmake_generate";
+	reordered.inputs["definition:CMAKE_BUILD_TYPE"] = "Release";
+	reordered.inputs["source"] = "0123";
+	BOOST_CHECK(buildserver::hash_action(generate) == buildserver::hash_action(reordered));
+	reordered.inputs["definition:CMAKE_BUILD_TYPE"] = "Debug";
+	BOOST_CHECK(buildserver::hash_action(generate) != buildserver::hash_action(reordered));
+	reordered = generate;
+	reordered.tool = "cmake_build";
+	BOOST_CHECK(buildserver::hash_action(generate) != buildserver::hash_action(reordered));
+}
+
+BOOST_AUTO_TEST_CASE(action_cache_store_and_restore)
+{
+	buildserver::test::temporary_directory store;
+	buildserver::test::temporary_directory build;
+	write_text(build.path / "CMakeCache.txt", "CMAKE_BUILD_TYPE:STRING=Release");
+	write_text(build.path / "bin" / "tool", "#!/bin/sh");
+	write_text(build.path / "bin" / "copy", "#!/bin/sh");
+	boost::filesystem::create_directories(build.path / "empty");
+	boost::filesystem::permissions(build.path / "bin" / "tool",
+	                               boost::filesystem::add_perms | boost::filesystem::owner_exe);
+
+	buildserver::action_description description;
+	description.tool = "cmake_build";
+	buildserver::sha256_digest const action = buildserver::hash_action(description);
+
+	buildserver::action_cache cache(store.path);
+	buildserver::test::temporary_directory restored;
+	write_text(restored.path / "stale", "removed by a restore");
+	BOOST_CHECK(!cache.restore(action, restored.path));
+	BOOST_CHECK(boost::filesystem::exists(restored.path / "stale"));
+	BOOST_CHECK_EQUAL(1u, cache.misses());
+
+	cache.store(action, build.path, Si::make_c_str_range("[100%] Built target tool\n"));
+	Si::optional<std::vector<char>> const log = cache.restore(action, restored.path);
+	BOOST_REQUIRE(log);
+	BOOST_CHECK_EQUAL("[100%] Built target tool\n", std::string(log->begin(), log->end()));
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+	BOOST_CHECK(!boost::filesystem::exists(restored.path / "stale"));
+	BOOST_CHECK(boost::filesystem::is_directory(restored.path / "empty"));
+	BOOST_CHECK_EQUAL("CMAKE_BUILD_TYPE:STRING=Release", read_text(restored.path / "CMakeCache.txt"));
+	BOOST_CHECK_EQUAL("#!/bin/sh", read_text(restored.path / "bin" / "copy"));
+	BOOST_CHECK(buildserver::hash_directory_tree(build.path, {}) ==
+	            buildserver::hash_directory_tree(restored.path, {}));
+
+	// another cache on the same directory sees the stored action
+	buildserver::action_cache shared(store.path);
+	buildserver::test::temporary_directory again;
+	BOOST_CHECK(shared.restore(action, again.path));
+
+	// equal files are stored once: the two scripts and the cache file plus the manifest and the log
+	std::size_t objects = 0;
+	for (auto i = boost::filesystem::recursive_directory_iterator(store.path / "objects");
+	     i != boost::filesystem::recursive_directory_iterator(); ++i)
+	{
+		objects += boost::filesystem::is_regular_file(i->path());
+	}
+	BOOST_CHECK_EQUAL(4u, objects);
+}
+
+BOOST_AUTO_TEST_CASE(action_cache_restore_does_not_follow_symlinks)
+{
+	buildserver::test::temporary_directory store;
+	buildserver::test::temporary_directory outside;
+	buildserver::action_cache cache(store.path);
+
+	// a damaged manifest: the symlink a to another directory, then the file a/y
+	std::string const content = "escaped";
+	buildserver::sha256_digest const content_digest = buildserver::hash_sha256(Si::make_memory_range(content));
+	std::string manifest;
+	auto const append_string = [&manifest](std::string const &appended)
+	{
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			manifest.push_back(static_cast<char>(static_cast<std::uint64_t>(appended.size()) >> (8 * i)));
+		}
+		manifest += appended;
+	};
+	manifest += "l";
+	manifest.push_back('\0');
+	append_string("a");
+	append_string(outside.path.string());
+	manifest += "f";
+	manifest.push_back('\0');
+	append_string("a/y");
+	manifest.append(content_digest.begin(), content_digest.end());
+
+	auto const put_object = [&store](std::string const &object)
+	{
+		std::string const name = buildserver::format_hex(buildserver::hash_sha256(Si::make_memory_range(object)));
+		write_text(store.path / "objects" / name.substr(0, 2) / name.substr(2), object);
+		return name;
+	};
+	put_object(content);
+	std::string const record = put_object(manifest) + put_object("");
+	buildserver::action_description description;
+	description.tool = "damaged";
+	buildserver::sha256_digest const action = buildserver::hash_action(description);
+	write_text(store.path / "actions" / buildserver::format_hex(action), record);
+
+	buildserver::test::temporary_directory restored;
+	BOOST_CHECK_THROW(cache.restore(action, restored.path), std::invalid_argument);
+	BOOST_CHECK(!boost::filesystem::exists(outside.path / "y"));
+}
@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+#include <string>
+#include "server/build_queue.hpp"
+
+namespace
+{
+	buildserver::build_key make_key(Si::noexcept_string branch)
+	{
+		return buildserver::build_key{Si::to_os_string("repo"), std::move(branch)};
+	}
+
+	struct collecting_observer
+	{
+		std::vector<buildserver::build_request> *received;
+
+		void got_element(buildserver::build_request element)
+		{
+			received->emplace_back(std::move(element));
+		}
+
+		void ended()
+		{
+			BOOST_FAIL("the build queue never ends");
+		}
+	};
+}
+
+BOOST_AUTO_TEST_CASE(pending_builds_latest_commit_wins)
+{
+	buildserver::pending_builds pending;
+	for (unsigned push = 0; push < 50; ++push)
+	{
+		pending.push(make_key("branch" + Si::to_noexcept_string(std::to_string(push % 10))),
+		             Si::to_noexcept_string(std::to_string(push)));
+	}
+	BOOST_CHECK_EQUAL(10u, pending.size());
+	for (unsigned branch = 0; branch < 10; ++branch)
+	{
+		Si::optional<buildserver::build_request> request = pending.pop();
+		BOOST_REQUIRE(request);
+		BOOST_CHECK_EQUAL("branch" + Si::to_noexcept_string(std::to_string(branch)), request->key.branch);
+		BOOST_CHECK_EQUAL(Si::to_noexcept_string(std::to_string(40 + branch)), request->commit);
+	}
+	BOOST_CHECK(!pending.pop());
+	BOOST_CHECK_EQUAL(10u, pending.in_flight());
+}
+
+BOOST_AUTO_TEST_CASE(pending_builds_in_flight_key_waits)
+{
+	buildserver::pending_builds pending;
+	BOOST_CHECK(pending.push(make_key("master"), "a"));
+	BOOST_CHECK(!pending.push(make_key("master"), "b"));
+	Si::optional<buildserver::build_request> first = pending.pop();
+	BOOST_REQUIRE(first);
+	BOOST_CHECK_EQUAL("b", first->commit);
+
+	BOOST_CHECK(pending.push(make_key("master"), "c"));
+	BOOST_CHECK(pending.push(make_key("develop"), "d"));
+	Si::optional<buildserver::build_request> second = pending.pop();
+	BOOST_REQUIRE(second);
+	BOOST_CHECK_EQUAL("develop", second->key.branch);
+	BOOST_CHECK(!pending.pop());
+
+	pending.finish(make_key("master"));
+	Si::optional<buildserver::build_request> third = pending.pop();
+	BOOST_REQUIRE(third);
+	BOOST_CHECK_EQUAL("c", third->commit);
+}
+
+BOOST_AUTO_TEST_CASE(build_queue_serves_several_consumers)
+{
+	buildserver::build_queue<collecting_observer> queue;
+	std::vector<buildserver::build_request> received;
+	queue.async_get_one(collecting_observer{&received});
+	queue.async_get_one(collecting_observer{&received});
+	BOOST_CHECK(received.empty());
+
+	queue.push(make_key("master"), "a");
+	queue.push(make_key("master"), "b");
+	BOOST_REQUIRE_EQUAL(1u, received.size());
+	BOOST_CHECK_EQUAL("a", received[0].commit);
+
+	queue.push(make_key("develop"), "c");
+	BOOST_REQUIRE_EQUAL(2u, received.size());
+	BOOST_CHECK_EQUAL("c", received[1].commit);
+
+	queue.finish(make_key("master"));
+	queue.async_get_one(collecting_observer{&received});
+	BOOST_REQUIRE_EQUAL(3u, received.size());
+	BOOST_CHECK_EQUAL("b", received[2].commit);
+}
+
+BOOST_AUTO_TEST_CASE(build_queue_valid_branch_names)
+{
+	for (char const *name : {"master", "feature/x", "release-1.0", "a.b", "v1@2"})
+	{
+		BOOST_CHECK_MESSAGE(buildserver::is_valid_branch_name(Si::make_c_str_range(name)), name);
+	}
+	for (char const *name : {"", "-f", "--upload-pack=x", "a..b", "a b", "a\tb", "a~1", "a^", "a:b", "a?", "a*",
+	                         "a[b", "a\\b", "a@{1}", "/a", "a/", "a//b", "a/.b", ".a", "a.", "a.lock"})
+	{
+		BOOST_CHECK_MESSAGE(!buildserver::is_valid_branch_name(Si::make_c_str_range(name)), name);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(build_queue_valid_commits)
+{
+	BOOST_CHECK(buildserver::is_valid_commit(Si::make_c_str_range("abcd")));
+	BOOST_CHECK(buildserver::is_valid_commit(Si::make_c_str_range("0123456789ABCDEFabcdef0123456789abcdef01")));
+	BOOST_CHECK(!buildserver::is_valid_commit(Si::make_c_str_range("abc")));
+	BOOST_CHECK(!buildserver::is_valid_commit(Si::make_c_str_range("-abcd")));
+	BOOST_CHECK(!buildserver::is_valid_commit(Si::make_c_str_range("HEAD~1")));
+	BOOST_CHECK(!buildserver::is_valid_commit(Si::make_c_str_range("abcdg")));
+}
@@ -0,0 +1,186 @@
+#include <boost/test/unit_test.hpp>
+#include "server/dag_runner.hpp"
+#include <silicium/make_unique.hpp>
+#include <boost/asio/io_service.hpp>
+
+namespace
+{
+	// delivers its input during async_get_result
+	struct synchronous_process : buildserver::process
+	{
+		buildserver::shared_result input;
+
+		explicit synchronous_process(buildserver::shared_result input)
+		    : input(std::move(input))
+		{
+		}
+
+		virtual void async_get_result(std::function<void(buildserver::shared_result)> result_handler) SILICIUM_OVERRIDE
+		{
+			result_handler(input);
+		}
+	};
+
+	struct posted_process : buildserver::process
+	{
+		boost::asio::io_service &io;
+		buildserver::shared_result input;
+
+		explicit posted_process(boost::asio::io_service &io, buildserver::shared_result input)
+		    : io(io)
+		    , input(std::move(input))
+		{
+		}
+
+		virtual void async_get_result(std::function<void(buildserver::shared_result)> result_handler) SILICIUM_OVERRIDE
+		{
+			buildserver::shared_result output = input;
+			io.post([result_handler, output]()
+			        {
+				        result_handler(output);
+				    });
+		}
+	};
+
+	buildserver::step make_counting_step(std::vector<buildserver::shared_result> &inputs)
+	{
+		return [&inputs](buildserver::shared_result const &input,
+		                 std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+		{
+			inputs.emplace_back(input);
+			return Si::make_unique<synchronous_process>(input);
+		};
+	}
+
+	buildserver::shared_result make_input(char content)
+	{
+		return std::make_shared<buildserver::process_result const>(
+		    buildserver::memory_blob{std::vector<char>(1, content)});
+	}
+}
+
+BOOST_AUTO_TEST_CASE(dag_runner_deep_chain)
+{
+	std::size_t const depth = 200000;
+	std::vector<buildserver::shared_result> inputs;
+	buildserver::dag_node root(make_counting_step(inputs));
+	buildserver::dag_node *last = &root;
+	for (std::size_t i = 1; i < depth; ++i)
+	{
+		last->edges.emplace_back(Si::make_unique<buildserver::dag_node>(make_counting_step(inputs)));
+		last = last->edges.back().get();
+	}
+	buildserver::dag_runner runner(root);
+	buildserver::shared_result const input = make_input('a');
+	runner.start(input);
+	BOOST_REQUIRE_EQUAL(depth, inputs.size());
+	BOOST_CHECK(inputs.front() == input);
+	BOOST_CHECK(inputs.back() == input);
+	BOOST_CHECK_EQUAL(0u, runner.running());
+}
+
+BOOST_AUTO_TEST_CASE(dag_runner_wide_fan_out)
+{
+	std::size_t const width = 200000;
+	std::vector<buildserver::shared_result> inputs;
+	buildserver::dag_node root(make_counting_step(inputs));
+	for (std::size_t i = 0; i < width; ++i)
+	{
+		root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(make_counting_step(inputs)));
+	}
+	buildserver::dag_runner runner(root);
+	buildserver::shared_result const input = make_input('a');
+	runner.start(input);
+	BOOST_REQUIRE_EQUAL(width + 1, inputs.size());
+	for (buildserver::shared_result const &received : inputs)
+	{
+		// the successors share the result instead of getting copies
+		BOOST_REQUIRE(received == input);
+	}
+	BOOST_CHECK_EQUAL(0u, runner.running());
+}
+
+BOOST_AUTO_TEST_CASE(dag_runner_reuses_synchronously_finished_processes)
+{
+	std::size_t created = 0;
+	std::size_t reused = 0;
+	std::vector<buildserver::shared_result> outputs;
+	buildserver::dag_node root([&created, &reused](buildserver::shared_result const &input,
+	                                               std::unique_ptr<buildserver::process> finished)
+	                               -> std::unique_ptr<buildserver::process>
+	                           {
+		                           if (finished)
+		                           {
+			                           ++reused;
+			                           static_cast<synchronous_process &>(*finished).input = input;
+			                           return finished;
+		                           }
+		                           ++created;
+		                           return Si::make_unique<synchronous_process>(input);
+		                       });
+	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(make_counting_step(outputs)));
+	buildserver::dag_runner runner(root);
+	buildserver::shared_result const first = make_input('a');
+	buildserver::shared_result const second = make_input('b');
+	runner.start(first);
+	runner.start(second);
+	runner.start(first);
+	BOOST_CHECK_EQUAL(1u, created);
+	BOOST_CHECK_EQUAL(2u, reused);
+	BOOST_REQUIRE_EQUAL(3u, outputs.size());
+	BOOST_CHECK(outputs[0] == first);
+	BOOST_CHECK(outputs[1] == second);
+	BOOST_CHECK(outputs[2] == first);
+	BOOST_CHECK_EQUAL(0u, runner.running());
+}
+
+BOOST_AUTO_TEST_CASE(dag_runner_asynchronous_processes)
+{
+	boost::asio::io_service io;
+	std::vector<buildserver::shared_result> outputs;
+	std::size_t ignored = 0;
+	buildserver::dag_node root([&io](buildserver::shared_result const &input,
+	                                 std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+	                           {
+		                           return Si::make_unique<posted_process>(io, input);
+		                       });
+	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(make_counting_step(outputs)));
+	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(
+	    [&ignored](buildserver::shared_result const &,
+	               std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+	    {
+		    ++ignored;
+		    return nullptr;
+		}));
+	buildserver::dag_runner runner(root);
+	runner.start(make_input('a'));
+	runner.start(make_input('b'));
+	BOOST_CHECK_EQUAL(2u, runner.running());
+	BOOST_CHECK(outputs.empty());
+	io.run();
+	BOOST_CHECK_EQUAL(0u, runner.running());
+	BOOST_CHECK_EQUAL(2u, outputs.size());
+	BOOST_CHECK_EQUAL(2u, ignored);
+}
+
+BOOST_AUTO_TEST_CASE(dag_runner_null_result_ends_the_branch)
+{
+	std::vector<buildserver::shared_result> outputs;
+	buildserver::dag_node root([](buildserver::shared_result const &input,
+	                              std::unique_ptr<buildserver::process>) -> std::unique_ptr<buildserver::process>
+	                           {
+		                           // passes on only the inputs that contain an 'a'
+		                           buildserver::memory_blob const *const blob =
+		                               Si::try_get_ptr<buildserver::memory_blob>(*input);
+		                           bool const passed = blob && (blob->content == std::vector<char>(1, 'a'));
+		                           return Si::make_unique<synchronous_process>(passed ? input : nullptr);
+		                       });
+	root.edges.emplace_back(Si::make_unique<buildserver::dag_node>(make_counting_step(outputs)));
+	buildserver::dag_runner runner(root);
+	buildserver::shared_result const passed = make_input('a');
+	runner.start(passed);
+	runner.start(make_input('b'));
+	BOOST_REQUIRE_EQUAL(1u, outputs.size());
+	BOOST_CHECK(outputs[0] == passed);
+	BOOST_CHECK_EQUAL(0u, runner.running());
+}
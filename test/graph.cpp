@@ -66,6 +66,5 @@ BOOST_AUTO_TEST_CASE(graph_typed_transformation)
 	std::vector<char> const expected{28, 2, 0, 0};
 	auto const *const blob_result = Si::try_get_ptr<graph::blob>(result);
 	BOOST_REQUIRE(blob_result);
-	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), blob_result->content.begin(),
-	                              blob_result->content.end());
+	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), blob_result->begin(), blob_result->end());
 }
@@ -0,0 +1,56 @@
+#include <boost/test/unit_test.hpp>
+#include <silicium/to_shared.hpp>
+#include "server/graph_serialization.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <fstream>
+
+BOOST_AUTO_TEST_CASE(graph_blob_copies_and_slices_share_storage)
+{
+	graph::blob const original(std::vector<char>{'h', 'e', 'l', 'l', 'o'});
+	graph::value const copied = original;
+	graph::blob const *const copied_blob = Si::try_get_ptr<graph::blob>(copied);
+	BOOST_REQUIRE(copied_blob);
+	BOOST_CHECK(original.begin() == copied_blob->begin());
+
+	graph::blob const middle = original.slice(1, 3);
+	BOOST_CHECK((original.begin() + 1) == middle.begin());
+	BOOST_CHECK_EQUAL("ell", std::string(middle.begin(), middle.end()));
+	BOOST_CHECK(middle.slice(3, 0).empty());
+	BOOST_CHECK_THROW(middle.slice(2, 2), std::out_of_range);
+	BOOST_CHECK(graph::blob().empty());
+}
+
+BOOST_AUTO_TEST_CASE(graph_blob_map_file)
+{
+	boost::filesystem::path const file =
+	    boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("graph_blob_%%%%-%%%%-%%%%");
+	graph::value const original = []() -> graph::value
+	{
+		graph::listing result;
+		result.entries.insert(std::make_pair("log", graph::blob(std::vector<char>(100000, 'L'))));
+		return Si::to_shared(std::move(result));
+	}();
+	{
+		std::vector<char> document;
+		graph::serialize(original, document);
+		std::ofstream out(file.string(), std::ios::binary);
+		out.write(document.data(), static_cast<std::streamsize>(document.size()));
+	}
+	{
+		graph::blob const mapped = graph::blob::map_file(file);
+		graph::value const loaded = graph::materialize(graph::open_serialized(mapped.content()), mapped);
+		auto const *const loaded_listing = Si::try_get_ptr<std::shared_ptr<graph::listing>>(loaded);
+		BOOST_REQUIRE(loaded_listing);
+		graph::blob const *const log = graph::find_entry_of_type<graph::blob>(**loaded_listing, "log");
+		BOOST_REQUIRE(log);
+		BOOST_CHECK_EQUAL(100000u, log->size());
+		BOOST_CHECK_EQUAL(100000, std::count(log->begin(), log->end(), 'L'));
+
+		// the blob in the result is part of the mapping
+		BOOST_CHECK(log->begin() > mapped.begin());
+		BOOST_CHECK(log->end() <= mapped.end());
+		BOOST_CHECK(log->owner() == mapped.owner());
+	}
+	boost::filesystem::remove(file);
+}
@@ -0,0 +1,300 @@
+#include <boost/test/unit_test.hpp>
+#include <silicium/to_shared.hpp>
+#include "server/graph_executor.hpp"
+#include "server/graph_hash.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	// The transformations run on the threads of the pool where the Boost.Test assertions must not be used.
+
+	graph::value uint32_add(graph::value v)
+	{
+		auto const *const arguments = Si::try_get_ptr<std::shared_ptr<graph::listing>>(v);
+		if (!arguments)
+		{
+			throw std::invalid_argument("expected a listing");
+		}
+		auto const *first = graph::find_entry_of_type<std::uint32_t>(**arguments, "first");
+		auto const *second = graph::find_entry_of_type<std::uint32_t>(**arguments, "second");
+		if (!first || !second)
+		{
+			throw std::invalid_argument("expected two numbers");
+		}
+		return static_cast<std::uint32_t>(*first + *second);
+	}
+
+	graph::value uint32_double(graph::value v)
+	{
+		auto const *const i32 = Si::try_get_ptr<std::uint32_t>(v);
+		if (!i32)
+		{
+			throw std::invalid_argument("expected a number");
+		}
+		return static_cast<std::uint32_t>(*i32 * 2);
+	}
+
+	graph::type make_pair_type()
+	{
+		graph::listing_type result;
+		result.entries.insert(std::make_pair("first", graph::atomic_type::uint32));
+		result.entries.insert(std::make_pair("second", graph::atomic_type::uint32));
+		return Si::to_shared(std::move(result));
+	}
+
+	std::uint32_t get_uint32(graph::value const &v)
+	{
+		auto const *const i32 = Si::try_get_ptr<std::uint32_t>(v);
+		BOOST_REQUIRE(i32);
+		return *i32;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_diamond)
+{
+	graph::typed_transformation const tf_double{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                            &uint32_double};
+	graph::typed_transformation const tf_add{make_pair_type(), graph::atomic_type::uint32, &uint32_add};
+	graph::dag g;
+	graph::node_id const root = g.add_node(tf_double, graph::constant{std::uint32_t(5)});
+	graph::node_id const left = g.add_node(tf_double, graph::dependency{root, ""});
+	graph::node_id const right = g.add_node(tf_add, {{"first", graph::dependency{root, ""}},
+	                                                 {"second", graph::constant{std::uint32_t(1)}}});
+	graph::node_id const joined =
+	    g.add_node(tf_add, {{"first", graph::dependency{left, ""}}, {"second", graph::dependency{right, ""}}});
+	graph::work_stealing_pool pool(4);
+	std::vector<graph::value> const results = graph::execute(g, pool);
+	BOOST_REQUIRE_EQUAL(4u, results.size());
+	BOOST_CHECK_EQUAL(10u, get_uint32(results[root.index]));
+	BOOST_CHECK_EQUAL(20u, get_uint32(results[left.index]));
+	BOOST_CHECK_EQUAL(11u, get_uint32(results[right.index]));
+	BOOST_CHECK_EQUAL(31u, get_uint32(results[joined.index]));
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_runs_independent_nodes_concurrently)
+{
+	// both nodes wait until the other one has started, which can only happen if they overlap
+	std::atomic<std::size_t> started(0);
+	std::atomic<std::size_t> met(0);
+	auto const rendezvous = [&started, &met](graph::value v) -> graph::value
+	{
+		++started;
+		auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while ((started.load() < 2) && (std::chrono::steady_clock::now() < deadline))
+		{
+			std::this_thread::yield();
+		}
+		if (started.load() == 2)
+		{
+			++met;
+		}
+		return v;
+	};
+	graph::typed_transformation const tf_rendezvous{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                                rendezvous};
+	graph::dag g;
+	g.add_node(tf_rendezvous, graph::constant{std::uint32_t(1)});
+	g.add_node(tf_rendezvous, graph::constant{std::uint32_t(2)});
+	graph::work_stealing_pool pool(2);
+	std::vector<graph::value> const results = graph::execute(g, pool);
+	BOOST_CHECK_EQUAL(2u, met.load());
+	BOOST_CHECK_EQUAL(1u, get_uint32(results[0]));
+	BOOST_CHECK_EQUAL(2u, get_uint32(results[1]));
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_nested_graphs_on_the_same_pool)
+{
+	graph::typed_transformation const tf_double{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                            &uint32_double};
+	for (std::size_t threads : {1u, 2u})
+	{
+		graph::work_stealing_pool pool(threads);
+		// every outer node waits for an inner graph, so with more outer nodes than threads all workers wait at the
+		// same time while the inner nodes are still queued
+		auto const run_inner = [&pool, &tf_double](graph::value v) -> graph::value
+		{
+			graph::dag inner;
+			graph::node_id last = inner.add_node(tf_double, graph::argument(graph::constant{std::move(v)}));
+			for (int i = 0; i < 3; ++i)
+			{
+				last = inner.add_node(tf_double, graph::dependency{last, ""});
+			}
+			return graph::evaluate(inner, {last}, pool).front();
+		};
+		graph::typed_transformation const tf_nested{graph::atomic_type::uint32, graph::atomic_type::uint32,
+		                                            run_inner};
+		graph::dag outer;
+		for (std::uint32_t i = 0; i < 6; ++i)
+		{
+			outer.add_node(tf_nested, graph::constant{i});
+		}
+		std::vector<graph::value> const results = graph::execute(outer, pool);
+		BOOST_REQUIRE_EQUAL(6u, results.size());
+		for (std::uint32_t i = 0; i < 6; ++i)
+		{
+			BOOST_CHECK_EQUAL(i * 16, get_uint32(results[i]));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_listing_entry_and_failure)
+{
+	graph::typed_transformation const tf_add{make_pair_type(), graph::atomic_type::uint32, &uint32_add};
+	graph::typed_transformation const tf_make_pair{
+	    graph::atomic_type::uint32, make_pair_type(), [](graph::value v) -> graph::value
+	    {
+		    graph::listing result;
+		    result.entries.insert(std::make_pair("first", v));
+		    result.entries.insert(std::make_pair("second", std::uint32_t(3)));
+		    return Si::to_shared(std::move(result));
+		}};
+	graph::typed_transformation const tf_throw{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                           [](graph::value) -> graph::value
+	                                           {
+		                                           throw std::runtime_error("expected failure");
+		                                       }};
+	graph::work_stealing_pool pool(3);
+	{
+		graph::dag g;
+		graph::node_id const pair = g.add_node(tf_make_pair, graph::constant{std::uint32_t(4)});
+		graph::node_id const sum = g.add_node(
+		    tf_add, {{"first", graph::dependency{pair, "second"}}, {"second", graph::dependency{pair, "first"}}});
+		BOOST_CHECK_EQUAL(7u, get_uint32(graph::execute(g, pool)[sum.index]));
+	}
+	{
+		graph::dag g;
+		graph::node_id const failing = g.add_node(tf_throw, graph::constant{std::uint32_t(4)});
+		g.add_node(tf_add, {{"first", graph::dependency{failing, ""}}, {"second", graph::dependency{failing, ""}}});
+		BOOST_CHECK_THROW(graph::execute(g, pool), std::runtime_error);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_checks_the_outputs)
+{
+	std::atomic<bool> consumed(false);
+	// promises a pair, but the second number is missing
+	graph::typed_transformation const tf_broken{graph::atomic_type::uint32, make_pair_type(),
+	                                            [](graph::value v) -> graph::value
+	                                            {
+		                                            graph::listing result;
+		                                            result.entries.insert(std::make_pair("first", v));
+		                                            return Si::to_shared(std::move(result));
+		                                        }};
+	graph::typed_transformation const tf_consume{make_pair_type(), graph::atomic_type::uint32,
+	                                             [&consumed](graph::value v) -> graph::value
+	                                             {
+		                                             consumed = true;
+		                                             return uint32_add(std::move(v));
+		                                         }};
+	graph::work_stealing_pool pool(2);
+	graph::dag g;
+	graph::node_id const broken = g.add_node(tf_broken, graph::constant{std::uint32_t(4)});
+	g.add_node(tf_consume, graph::dependency{broken, ""});
+	BOOST_CHECK_THROW(graph::execute(g, pool), std::runtime_error);
+	BOOST_CHECK(!consumed);
+}
+
+BOOST_AUTO_TEST_CASE(graph_dag_rejects_unknown_dependencies)
+{
+	graph::typed_transformation const tf_double{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                            &uint32_double};
+	graph::dag g;
+	BOOST_CHECK_THROW(g.add_node(tf_double, graph::dependency{graph::node_id{0}, ""}), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graph_evaluate_runs_only_the_dependencies)
+{
+	std::atomic<std::size_t> calls(0);
+	graph::typed_transformation const tf_counted_double{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                                    [&calls](graph::value v)
+	                                                    {
+		                                                    ++calls;
+		                                                    return uint32_double(std::move(v));
+		                                                }};
+	graph::dag g;
+	graph::node_id const root = g.add_node(tf_counted_double, graph::constant{std::uint32_t(1)});
+	graph::node_id const wanted = g.add_node(tf_counted_double, graph::dependency{root, ""});
+	g.add_node(tf_counted_double, graph::dependency{root, ""});
+	g.add_node(tf_counted_double, graph::constant{std::uint32_t(7)});
+	graph::work_stealing_pool pool(2);
+	std::vector<graph::value> const results = graph::evaluate(g, {wanted, root}, pool);
+	BOOST_REQUIRE_EQUAL(2u, results.size());
+	BOOST_CHECK_EQUAL(4u, get_uint32(results[0]));
+	BOOST_CHECK_EQUAL(2u, get_uint32(results[1]));
+	BOOST_CHECK_EQUAL(2u, calls.load());
+	BOOST_CHECK(graph::evaluate(g, {}, pool).empty());
+	BOOST_CHECK_EQUAL(2u, calls.load());
+	BOOST_CHECK_THROW(graph::evaluate(g, {graph::node_id{4}}, pool), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graph_evaluate_reuses_memoized_results)
+{
+	std::atomic<std::size_t> calls(0);
+	graph::typed_transformation const tf_counted_double{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                                    [&calls](graph::value v)
+	                                                    {
+		                                                    ++calls;
+		                                                    return uint32_double(std::move(v));
+		                                                }};
+	graph::memo_cache cache(16);
+	graph::typed_transformation const tf_double = graph::memoize("double", tf_counted_double, cache);
+	graph::typed_transformation const tf_add = graph::memoize(
+	    "add", graph::typed_transformation{make_pair_type(), graph::atomic_type::uint32, &uint32_add}, cache);
+	graph::dag g;
+	graph::node_id const root = g.add_node(tf_double, graph::constant{std::uint32_t(3)});
+	graph::node_id const left = g.add_node(tf_double, graph::dependency{root, ""});
+	graph::node_id const joined =
+	    g.add_node(tf_add, {{"first", graph::dependency{left, ""}}, {"second", graph::dependency{root, ""}}});
+	graph::work_stealing_pool pool(2);
+	BOOST_CHECK_EQUAL(12u, get_uint32(graph::evaluate(g, {left}, pool).front()));
+	BOOST_CHECK_EQUAL(2u, calls.load());
+
+	// the sum is new, but the doubling steps below it are answered from the cache
+	BOOST_CHECK_EQUAL(18u, get_uint32(graph::evaluate(g, {joined}, pool).front()));
+	BOOST_CHECK_EQUAL(2u, calls.load());
+	BOOST_CHECK_EQUAL(2u, cache.hits());
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_starts_the_critical_path_first)
+{
+	boost::mutex order_access;
+	std::vector<std::uint32_t> order;
+	graph::typed_transformation const tf_log{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                         [&order_access, &order](graph::value v)
+	                                         {
+		                                         boost::lock_guard<boost::mutex> lock(order_access);
+		                                         order.emplace_back(*Si::try_get_ptr<std::uint32_t>(v));
+		                                         return v;
+		                                     }};
+	graph::dag g;
+	g.add_node(tf_log, graph::constant{std::uint32_t(1)}, "short");
+	g.add_node(tf_log, graph::constant{std::uint32_t(2)}, "short");
+	graph::node_id const slow = g.add_node(tf_log, graph::constant{std::uint32_t(3)}, "slow");
+	g.add_node(tf_log, graph::dependency{slow, ""}, "short");
+
+	// with one thread the nodes run in the order of the priorities
+	graph::work_stealing_pool pool(1);
+	graph::duration_history durations(std::chrono::milliseconds(1));
+	durations.record("slow", std::chrono::seconds(1));
+	durations.record("short", std::chrono::microseconds(1));
+	graph::execute(g, pool, &durations);
+	std::vector<std::uint32_t> const expected{3, 1, 2, 3};
+	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), order.begin(), order.end());
+
+	// without a history the longest chain counted in nodes goes first
+	order.clear();
+	graph::execute(g, pool);
+	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), order.begin(), order.end());
+}
+
+BOOST_AUTO_TEST_CASE(graph_duration_history_averages)
+{
+	graph::duration_history durations(std::chrono::milliseconds(5));
+	BOOST_CHECK(std::chrono::milliseconds(5) == durations.estimate("never recorded"));
+	durations.record("step", std::chrono::milliseconds(100));
+	BOOST_CHECK(std::chrono::milliseconds(100) == durations.estimate("step"));
+	durations.record("step", std::chrono::milliseconds(20));
+	BOOST_CHECK(std::chrono::milliseconds(80) == durations.estimate("step"));
+}
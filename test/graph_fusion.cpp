@@ -0,0 +1,80 @@
+#include <boost/test/unit_test.hpp>
+#include "server/graph_fusion.hpp"
+#include "server/graph_type.hpp"
+#include <silicium/to_shared.hpp>
+
+namespace
+{
+	graph::pipeline_stage add_entry(graph::type input, graph::type output, graph::symbol key, std::uint32_t entry,
+	                                std::vector<graph::listing const *> &seen)
+	{
+		return graph::make_in_place_stage(std::move(input), std::move(output), [key, entry, &seen](graph::value &v)
+		                                  {
+			                                  graph::listing &changed = graph::mutable_listing(v);
+			                                  seen.emplace_back(&changed);
+			                                  changed.entries.insert(std::make_pair(key, entry));
+			                              });
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_fusion_chain)
+{
+	graph::typed_transformation const sum{
+	    graph::make_listing_type({{"first", graph::atomic_type::uint32}, {"second", graph::atomic_type::uint32}}),
+	    graph::atomic_type::uint32, [](graph::value v) -> graph::value
+	    {
+		    graph::listing const &arguments = **Si::try_get_ptr<std::shared_ptr<graph::listing>>(v);
+		    return *graph::find_entry_of_type<std::uint32_t const>(arguments, "first") +
+		           *graph::find_entry_of_type<std::uint32_t const>(arguments, "second");
+		}};
+	graph::typed_transformation const fused = graph::fuse(
+	    {graph::make_identity_stage(sum.input), graph::make_stage(sum),
+	     graph::make_in_place_stage(graph::atomic_type::uint32, graph::atomic_type::uint32, [](graph::value &v)
+	                                {
+		                                *Si::try_get_ptr<std::uint32_t>(v) *= 2;
+		                            }),
+	     graph::make_identity_stage(graph::atomic_type::uint32)});
+	BOOST_CHECK(graph::interned_type(fused.input) == graph::interned_type(sum.input));
+	BOOST_CHECK(graph::interned_type(fused.output) == graph::interned_type(graph::atomic_type::uint32));
+	graph::listing arguments;
+	arguments.entries.insert(std::make_pair("first", std::uint32_t(40)));
+	arguments.entries.insert(std::make_pair("second", std::uint32_t(2)));
+	graph::value const result = fused.transform(Si::to_shared(std::move(arguments)));
+	BOOST_CHECK_EQUAL(84u, *Si::try_get_ptr<std::uint32_t>(result));
+
+	// only identities
+	graph::typed_transformation const passing = graph::fuse({graph::make_identity_stage(graph::atomic_type::uri)});
+	BOOST_CHECK_EQUAL("x", Si::try_get_ptr<graph::uri>(passing.transform(graph::uri{"x"}))->value);
+
+	BOOST_CHECK_THROW(graph::fuse({}), std::invalid_argument);
+	BOOST_CHECK_THROW(graph::fuse({graph::make_stage(sum), graph::make_stage(sum)}), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graph_fusion_reuses_the_listing)
+{
+	graph::type const empty = graph::make_listing_type({});
+	graph::type const one = graph::make_listing_type({{"a", graph::atomic_type::uint32}});
+	graph::type const two =
+	    graph::make_listing_type({{"a", graph::atomic_type::uint32}, {"b", graph::atomic_type::uint32}});
+	std::vector<graph::listing const *> seen;
+	graph::typed_transformation const fused =
+	    graph::fuse({add_entry(empty, one, "a", 1, seen), add_entry(one, two, "b", 2, seen)});
+
+	// the pipeline owns the only reference to the input, so both stages change the same listing
+	graph::value const result = fused.transform(std::make_shared<graph::listing>());
+	auto const &output = *Si::try_get_ptr<std::shared_ptr<graph::listing>>(result);
+	BOOST_REQUIRE_EQUAL(2u, seen.size());
+	BOOST_CHECK_EQUAL(seen[0], seen[1]);
+	BOOST_CHECK_EQUAL(seen[1], output.get());
+	BOOST_CHECK_EQUAL(2u, output->entries.size());
+
+	// an input that the caller keeps is copied once and stays unchanged
+	seen.clear();
+	auto const kept = std::make_shared<graph::listing>();
+	graph::value const derived = fused.transform(kept);
+	BOOST_CHECK(kept->entries.empty());
+	BOOST_REQUIRE_EQUAL(2u, seen.size());
+	BOOST_CHECK_NE(seen[0], kept.get());
+	BOOST_CHECK_EQUAL(seen[0], seen[1]);
+	BOOST_CHECK_EQUAL(2u, (*Si::try_get_ptr<std::shared_ptr<graph::listing>>(derived))->entries.size());
+}
@@ -0,0 +1,75 @@
+#include <boost/test/unit_test.hpp>
+#include <silicium/to_shared.hpp>
+#include "server/graph_hash.hpp"
+
+BOOST_AUTO_TEST_CASE(sha256_known_digests)
+{
+	BOOST_CHECK_EQUAL("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+	                  buildserver::format_hex(buildserver::hash_sha256(Si::make_c_str_range(""))));
+	BOOST_CHECK_EQUAL("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+	                  buildserver::format_hex(buildserver::hash_sha256(Si::make_c_str_range("abc"))));
+	BOOST_CHECK_EQUAL("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+	                  buildserver::format_hex(buildserver::hash_sha256(
+	                      Si::make_c_str_range("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"))));
+
+	// the same input split into pieces that do not line up with the blocks
+	std::string const million(1000000, 'a');
+	buildserver::sha256 incremental;
+	for (std::size_t i = 0; i < million.size(); i += 999)
+	{
+		std::size_t const piece = (std::min<std::size_t>)(999, million.size() - i);
+		incremental.update(Si::memory_range(million.data() + i, million.data() + i + piece));
+	}
+	BOOST_CHECK_EQUAL("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+	                  buildserver::format_hex(incremental.finish()));
+}
+
+BOOST_AUTO_TEST_CASE(graph_hash_value_is_structural)
+{
+	auto const make_listing = [](char const *key, graph::value entry) -> graph::value
+	{
+		graph::listing result;
+		result.entries.insert(std::make_pair(key, std::move(entry)));
+		return Si::to_shared(std::move(result));
+	};
+	BOOST_CHECK(graph::hash_value(make_listing("a", std::uint32_t(1))) ==
+	            graph::hash_value(make_listing("a", std::uint32_t(1))));
+	BOOST_CHECK(graph::hash_value(make_listing("a", std::uint32_t(1))) !=
+	            graph::hash_value(make_listing("b", std::uint32_t(1))));
+	BOOST_CHECK(graph::hash_value(make_listing("a", std::uint32_t(1))) !=
+	            graph::hash_value(make_listing("a", std::uint32_t(2))));
+
+	// the same bytes with a different type
+	BOOST_CHECK(graph::hash_value(graph::blob{{1, 0, 0, 0}}) != graph::hash_value(std::uint32_t(1)));
+	BOOST_CHECK(graph::hash_value(graph::uri{"x"}) != graph::hash_value(graph::blob{{'x'}}));
+}
+
+BOOST_AUTO_TEST_CASE(graph_memoize_skips_equal_inputs)
+{
+	std::size_t calls = 0;
+	graph::typed_transformation const increment{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                            [&calls](graph::value v) -> graph::value
+	                                            {
+		                                            ++calls;
+		                                            return *Si::try_get_ptr<std::uint32_t>(v) + 1;
+		                                        }};
+	graph::memo_cache cache(2);
+	graph::typed_transformation const memoized = graph::memoize("increment", increment, cache);
+	graph::typed_transformation const other = graph::memoize("increment.v2", increment, cache);
+
+	BOOST_CHECK_EQUAL(2u, *Si::try_get_ptr<std::uint32_t>(memoized.transform(std::uint32_t(1))));
+	BOOST_CHECK_EQUAL(2u, *Si::try_get_ptr<std::uint32_t>(memoized.transform(std::uint32_t(1))));
+	BOOST_CHECK_EQUAL(1u, calls);
+
+	// the name is part of the key
+	BOOST_CHECK_EQUAL(2u, *Si::try_get_ptr<std::uint32_t>(other.transform(std::uint32_t(1))));
+	BOOST_CHECK_EQUAL(2u, calls);
+
+	// the capacity is two, so the first result is forgotten
+	memoized.transform(std::uint32_t(5));
+	BOOST_CHECK_EQUAL(3u, calls);
+	BOOST_CHECK_EQUAL(2u, cache.size());
+	memoized.transform(std::uint32_t(1));
+	BOOST_CHECK_EQUAL(4u, calls);
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+}
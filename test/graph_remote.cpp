@@ -0,0 +1,210 @@
+#include <boost/test/unit_test.hpp>
+#include "server/graph_remote.hpp"
+#include "server/graph_executor.hpp"
+#include <silicium/to_shared.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/thread/thread.hpp>
+#include <array>
+
+namespace
+{
+	// The transformations run on the threads of the workers where the Boost.Test assertions must not be used.
+
+	graph::value uint32_double(graph::value v)
+	{
+		auto const *const i32 = Si::try_get_ptr<std::uint32_t>(v);
+		if (!i32)
+		{
+			throw std::invalid_argument("expected a number");
+		}
+		return static_cast<std::uint32_t>(*i32 * 2);
+	}
+
+	graph::transformation_registry make_registry(std::uint32_t worker)
+	{
+		graph::transformation_registry registry;
+		registry.add("double", graph::typed_transformation{graph::atomic_type::uint32, graph::atomic_type::uint32,
+		                                                   &uint32_double});
+		registry.add("which", graph::typed_transformation{graph::atomic_type::uint32, graph::atomic_type::uint32,
+		                                                  [worker](graph::value) -> graph::value
+		                                                  {
+			                                                  // long enough for the other invocations to overlap
+			                                                  boost::this_thread::sleep_for(
+			                                                      boost::chrono::milliseconds(200));
+			                                                  return worker;
+			                                              }});
+		registry.add("fail", graph::typed_transformation{graph::atomic_type::uint32, graph::atomic_type::uint32,
+		                                                 [](graph::value) -> graph::value
+		                                                 {
+			                                                 throw std::runtime_error("expected failure");
+			                                             }});
+		return registry;
+	}
+
+	Si::noexcept_string const farm_secret = "correct horse battery staple";
+
+	// runs a number of workers on localhost for the lifetime of the object
+	struct local_farm
+	{
+		std::unique_ptr<graph::remote_executor> coordinator;
+		std::vector<graph::transformation_registry> registries;
+		std::vector<boost::thread> workers;
+
+		explicit local_farm(std::vector<std::size_t> const &capacities)
+		    : coordinator(new graph::remote_executor(
+		          boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0), farm_secret))
+		{
+			for (std::size_t i = 0; i < capacities.size(); ++i)
+			{
+				registries.emplace_back(make_registry(static_cast<std::uint32_t>(i)));
+			}
+			for (std::size_t i = 0; i < capacities.size(); ++i)
+			{
+				graph::transformation_registry const &registry = registries[i];
+				boost::asio::ip::tcp::endpoint const endpoint = coordinator->local_endpoint();
+				std::size_t const capacity = capacities[i];
+				workers.emplace_back([&registry, endpoint, capacity]()
+				                     {
+					                     graph::run_worker(endpoint, farm_secret, registry, capacity);
+					                 });
+			}
+			coordinator->wait_for_workers(capacities.size());
+		}
+
+		~local_farm()
+		{
+			// the workers return when the coordinator closes the connections
+			coordinator.reset();
+			for (boost::thread &worker : workers)
+			{
+				worker.join();
+			}
+		}
+	};
+
+	std::uint32_t get_uint32(graph::value const &v)
+	{
+		auto const *const i32 = Si::try_get_ptr<std::uint32_t>(v);
+		BOOST_REQUIRE(i32);
+		return *i32;
+	}
+
+	// true if the coordinator closes the connection without having sent anything
+	bool is_closed_by_peer(boost::asio::ip::tcp::socket &socket)
+	{
+		char received = 0;
+		boost::system::error_code error;
+		boost::asio::read(socket, boost::asio::buffer(&received, 1), error);
+		return (error == boost::asio::error::eof) || (error == boost::asio::error::connection_reset);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_invoke)
+{
+	local_farm farm({1, 2});
+	BOOST_CHECK_EQUAL(2u, farm.coordinator->worker_count());
+	BOOST_CHECK_EQUAL(14u, get_uint32(farm.coordinator->invoke("double", std::uint32_t(7))));
+
+	graph::listing structured;
+	structured.entries.insert(std::make_pair("number", std::uint32_t(3)));
+	BOOST_CHECK_THROW(farm.coordinator->invoke("double", Si::to_shared(std::move(structured))), std::runtime_error);
+	BOOST_CHECK_THROW(farm.coordinator->invoke("fail", std::uint32_t(1)), std::runtime_error);
+	// the worker checks the input before the transformation would ignore it
+	BOOST_CHECK_THROW(farm.coordinator->invoke("which", graph::blob()), std::runtime_error);
+	BOOST_CHECK_THROW(farm.coordinator->invoke("unknown", std::uint32_t(1)), std::invalid_argument);
+
+	// the connections are still usable after failures
+	BOOST_CHECK_EQUAL(2u, get_uint32(farm.coordinator->invoke("double", std::uint32_t(1))));
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_dag_uses_every_worker)
+{
+	local_farm farm({1, 1, 2});
+	graph::typed_transformation const tf_which = graph::remote_transformation(
+	    *farm.coordinator, "which", graph::atomic_type::uint32, graph::atomic_type::uint32);
+	graph::typed_transformation const tf_double = graph::remote_transformation(
+	    *farm.coordinator, "double", graph::atomic_type::uint32, graph::atomic_type::uint32);
+	graph::dag g;
+	std::vector<graph::node_id> shards;
+	for (std::uint32_t i = 0; i < 4; ++i)
+	{
+		shards.emplace_back(g.add_node(tf_which, graph::constant{i}));
+	}
+	graph::node_id const doubled = g.add_node(tf_double, graph::dependency{shards.front(), ""});
+
+	// there are as many threads as slots, so all of the shards are in flight at the same time
+	graph::work_stealing_pool pool(4);
+	std::vector<graph::value> const results = graph::execute(g, pool);
+	std::vector<std::size_t> per_worker(3);
+	for (graph::node_id const shard : shards)
+	{
+		std::uint32_t const worker = get_uint32(results[shard.index]);
+		BOOST_REQUIRE_LT(worker, per_worker.size());
+		++per_worker[worker];
+	}
+	BOOST_CHECK_EQUAL(1u, per_worker[0]);
+	BOOST_CHECK_EQUAL(1u, per_worker[1]);
+	BOOST_CHECK_EQUAL(2u, per_worker[2]);
+	BOOST_CHECK_EQUAL(get_uint32(results[shards.front().index]) * 2, get_uint32(results[doubled.index]));
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_checks_the_result_type)
+{
+	local_farm farm({1});
+	graph::typed_transformation const wrong_output = graph::remote_transformation(
+	    *farm.coordinator, "double", graph::atomic_type::uint32, graph::atomic_type::blob);
+	BOOST_CHECK_THROW(wrong_output.transform(std::uint32_t(1)), std::runtime_error);
+	graph::typed_transformation const right_output = graph::remote_transformation(
+	    *farm.coordinator, "double", graph::atomic_type::uint32, graph::atomic_type::uint32);
+	BOOST_CHECK_EQUAL(2u, get_uint32(right_output.transform(std::uint32_t(1))));
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_rejects_workers_without_slots)
+{
+	graph::remote_executor coordinator(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+	                                   "s");
+	BOOST_CHECK_THROW(graph::run_worker(coordinator.local_endpoint(), "s", graph::transformation_registry(), 0),
+	                  std::invalid_argument);
+
+	// a hello of another implementation: size, message type, version, secret, capacity, name count
+	boost::asio::io_service io;
+	boost::asio::ip::tcp::socket socket(io);
+	socket.connect(coordinator.local_endpoint());
+	std::array<char, 25> hello = {{21, 0, 0, 0, 1, 0, 0, 0, static_cast<char>(graph::remote_protocol_version), 0, 0,
+	                               0, 1, 0, 0, 0, 's', 0, 0, 0, 0, 0, 0, 0, 0}};
+	boost::asio::write(socket, boost::asio::buffer(hello));
+	BOOST_CHECK(is_closed_by_peer(socket));
+	BOOST_CHECK_EQUAL(0u, coordinator.worker_count());
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_rejects_workers_without_the_secret)
+{
+	BOOST_CHECK_THROW(graph::remote_executor(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+	                                         ""),
+	                  std::invalid_argument);
+	graph::remote_executor coordinator(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+	                                   farm_secret);
+	graph::transformation_registry const registry = make_registry(0);
+	// the worker returns because the coordinator closes the connection
+	graph::run_worker(coordinator.local_endpoint(), "wrong horse battery staple", registry, 1);
+	graph::run_worker(coordinator.local_endpoint(), "correct", registry, 1);
+	BOOST_CHECK_EQUAL(0u, coordinator.worker_count());
+}
+
+BOOST_AUTO_TEST_CASE(graph_remote_limits_frames_before_the_hello)
+{
+	graph::remote_executor coordinator(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+	                                   farm_secret);
+	boost::asio::io_service io;
+	boost::asio::ip::tcp::socket socket(io);
+	socket.connect(coordinator.local_endpoint());
+	// announces a frame of one byte more than a hello may have, which is rejected before it arrives
+	std::uint32_t const size = graph::max_hello_size + 1;
+	std::array<char, 4> const announced = {{static_cast<char>(size), static_cast<char>(size >> 8),
+	                                        static_cast<char>(size >> 16), static_cast<char>(size >> 24)}};
+	boost::asio::write(socket, boost::asio::buffer(announced));
+	BOOST_CHECK(is_closed_by_peer(socket));
+	BOOST_CHECK_EQUAL(0u, coordinator.worker_count());
+}
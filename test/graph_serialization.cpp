@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+#include <silicium/to_shared.hpp>
+#include <algorithm>
+#include "server/graph_serialization.hpp"
+#include "server/graph_hash.hpp"
+
+namespace
+{
+	graph::value make_example()
+	{
+		graph::listing inner;
+		inner.entries.insert(std::make_pair("number", std::uint32_t(123456)));
+		inner.entries.insert(std::make_pair("name", graph::uri{"https://example.com/repo.git"}));
+		graph::listing outer;
+		outer.entries.insert(std::make_pair("output", graph::blob{std::vector<char>(1000, 'x')}));
+		outer.entries.insert(std::make_pair("inner", Si::to_shared(std::move(inner))));
+		outer.entries.insert(std::make_pair("empty", Si::to_shared(graph::listing())));
+		outer.entries.insert(std::make_pair("odd", graph::blob{{1, 2, 3}}));
+		return Si::to_shared(std::move(outer));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_serialization_round_trip)
+{
+	graph::value const original = make_example();
+	std::vector<char> document;
+	graph::serialize(original, document);
+	graph::value_view const root = graph::open_serialized(Si::make_memory_range(document));
+	BOOST_CHECK(graph::hash_value(original) == graph::hash_value(graph::materialize(root)));
+
+	// a document can follow other data in the same buffer
+	std::vector<char> appended(3, 'a');
+	graph::serialize(original, appended);
+	BOOST_CHECK(graph::hash_value(original) ==
+	            graph::hash_value(graph::materialize(graph::open_serialized(
+	                Si::memory_range(appended.data() + 3, appended.data() + appended.size())))));
+}
+
+BOOST_AUTO_TEST_CASE(graph_serialization_views_do_not_copy)
+{
+	std::vector<char> document;
+	graph::serialize(make_example(), document);
+	graph::value_view const root = graph::open_serialized(Si::make_memory_range(document));
+	BOOST_REQUIRE(graph::value_kind::listing == root.kind());
+	BOOST_CHECK_EQUAL(4u, root.listing_size());
+
+	Si::optional<graph::value_view> const output = root.find(Si::make_c_str_range("output"));
+	BOOST_REQUIRE(output);
+	Si::memory_range const bytes = output->get_bytes();
+	BOOST_CHECK_EQUAL(1000, bytes.size());
+	BOOST_CHECK(bytes.begin() > document.data());
+	BOOST_CHECK(bytes.end() <= (document.data() + document.size()));
+
+	Si::optional<graph::value_view> const inner = root.find(Si::make_c_str_range("inner"));
+	BOOST_REQUIRE(inner);
+	Si::optional<graph::value_view> const number = inner->find(Si::make_c_str_range("number"));
+	BOOST_REQUIRE(number);
+	BOOST_CHECK_EQUAL(123456u, number->get_uint32());
+	BOOST_CHECK(!inner->find(Si::make_c_str_range("missing")));
+	BOOST_CHECK_THROW(number->get_bytes(), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graph_serialization_rejects_malformed_documents)
+{
+	std::vector<char> document;
+	graph::serialize(make_example(), document);
+	for (std::size_t truncated = 0; truncated < document.size(); truncated += 7)
+	{
+		BOOST_CHECK_THROW(graph::open_serialized(Si::memory_range(document.data(), document.data() + truncated)),
+		                  std::invalid_argument);
+	}
+
+	std::vector<char> wrong_version = document;
+	wrong_version[4] = 2;
+	BOOST_CHECK_THROW(graph::open_serialized(Si::make_memory_range(wrong_version)), std::invalid_argument);
+
+	// the offset of the first entry of the root listing points back at the root itself
+	std::vector<char> cyclic = document;
+	std::fill(cyclic.begin() + 16, cyclic.begin() + 24, '\0');
+	cyclic[16] = 8;
+	BOOST_CHECK_THROW(graph::open_serialized(Si::make_memory_range(cyclic)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(graph_serialization_known_keys_only)
+{
+	graph::listing sent;
+	sent.entries.insert(std::make_pair("number", std::uint32_t(1)));
+	sent.entries.insert(std::make_pair("placeholder_key", std::uint32_t(2)));
+	std::vector<char> document;
+	graph::serialize(Si::to_shared(std::move(sent)), document);
+
+	// a peer could send any key, so one is renamed to a name that nothing has interned
+	std::string const placeholder = "placeholder_key";
+	std::string const unknown = "unknown_key_x42";
+	auto const found = std::search(document.begin(), document.end(), placeholder.begin(), placeholder.end());
+	BOOST_REQUIRE(found != document.end());
+	std::copy(unknown.begin(), unknown.end(), found);
+	BOOST_REQUIRE(!graph::symbol::find_existing(Si::make_memory_range(unknown)));
+
+	graph::blob const received{std::move(document)};
+	graph::value const materialized =
+	    graph::materialize_known_keys(graph::open_serialized(received.content()), received);
+	BOOST_CHECK(!graph::symbol::find_existing(Si::make_memory_range(unknown)));
+	auto const *const entries = Si::try_get_ptr<std::shared_ptr<graph::listing>>(materialized);
+	BOOST_REQUIRE(entries);
+	BOOST_CHECK_EQUAL(1u, (*entries)->entries.size());
+	std::uint32_t const *const number = graph::find_entry_of_type<std::uint32_t>(**entries, "number");
+	BOOST_REQUIRE(number);
+	BOOST_CHECK_EQUAL(1u, *number);
+}
@@ -0,0 +1,142 @@
+#include <boost/test/unit_test.hpp>
+#include "server/graph.hpp"
+#include <boost/thread/thread.hpp>
+#include <atomic>
+
+namespace
+{
+	graph::blob make_chunk(std::string const &content)
+	{
+		return graph::blob(std::vector<char>(content.begin(), content.end()));
+	}
+
+	std::string read_all(graph::byte_stream::reader &from)
+	{
+		std::string result;
+		for (;;)
+		{
+			Si::optional<graph::blob> chunk = from.read();
+			if (!chunk)
+			{
+				return result;
+			}
+			result.append(chunk->begin(), chunk->end());
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_every_reader_gets_everything)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(16);
+	graph::byte_stream::reader first = graph::byte_stream::open_reader(stream);
+	graph::byte_stream::reader second = graph::byte_stream::open_reader(stream);
+	std::string expected;
+	for (int i = 0; i < 100; ++i)
+	{
+		expected += std::to_string(i);
+	}
+	boost::thread producer([stream]()
+	                       {
+		                       for (int i = 0; i < 100; ++i)
+		                       {
+			                       stream->write(make_chunk(std::to_string(i)));
+		                       }
+		                       stream->close();
+		                   });
+	std::string first_result;
+	boost::thread first_consumer([&first, &first_result]()
+	                             {
+		                             first_result = read_all(first);
+		                         });
+	std::string const second_result = read_all(second);
+	first_consumer.join();
+	producer.join();
+	BOOST_CHECK_EQUAL(expected, first_result);
+	BOOST_CHECK_EQUAL(expected, second_result);
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_backpressure)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(10);
+	graph::byte_stream::reader slow = graph::byte_stream::open_reader(stream);
+	std::atomic<int> written(0);
+	boost::thread producer([stream, &written]()
+	                       {
+		                       for (int i = 0; i < 5; ++i)
+		                       {
+			                       stream->write(make_chunk("0123456789"));
+			                       ++written;
+		                       }
+		                       stream->close();
+		                   });
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+	// the second chunk cannot be written before the first one has been read
+	BOOST_CHECK_LE(written.load(), 1);
+	BOOST_CHECK_EQUAL(50u, read_all(slow).size());
+	producer.join();
+	BOOST_CHECK_EQUAL(5, written.load());
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_without_readers_keeps_the_newest_bytes)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(10);
+	stream->write(make_chunk("aaaaaa"));
+	stream->write(make_chunk("bbbbbb"));
+	stream->write(make_chunk("cccccc"));
+	stream->close();
+	graph::byte_stream::reader late = graph::byte_stream::open_reader(stream);
+	BOOST_CHECK_EQUAL("cccccc", read_all(late));
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_expected_reader_gets_everything)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(10, 1);
+	std::atomic<int> written(0);
+	boost::thread producer([stream, &written]()
+	                       {
+		                       for (int i = 0; i < 5; ++i)
+		                       {
+			                       stream->write(make_chunk("0123456789"));
+			                       ++written;
+		                       }
+		                       stream->close();
+		                   });
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+	// the producer waits for the reader that has not opened yet instead of dropping the first chunk
+	BOOST_CHECK_EQUAL(1, written.load());
+	graph::byte_stream::reader late = graph::byte_stream::open_reader(stream);
+	BOOST_CHECK_EQUAL(50u, read_all(late).size());
+	producer.join();
+
+	// once the expected reader has opened, later readers only get what is still kept
+	graph::byte_stream::reader unexpected = graph::byte_stream::open_reader(stream);
+	BOOST_CHECK_EQUAL("", read_all(unexpected));
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_failure_after_the_data)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(10);
+	graph::byte_stream::reader reader = graph::byte_stream::open_reader(stream);
+	stream->write(make_chunk("a"));
+	stream->fail(std::make_exception_ptr(std::runtime_error("build failed")));
+	Si::optional<graph::blob> const chunk = reader.read();
+	BOOST_REQUIRE(chunk);
+	BOOST_CHECK_EQUAL("a", std::string(chunk->begin(), chunk->end()));
+	BOOST_CHECK_THROW(reader.read(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(graph_stream_sink_chunks)
+{
+	auto const stream = std::make_shared<graph::byte_stream>(1000);
+	graph::byte_stream::reader reader = graph::byte_stream::open_reader(stream);
+	graph::byte_stream_sink sink(stream, 4);
+	sink.append(Si::make_c_str_range("ab"));
+	sink.append(Si::make_c_str_range("cde"));
+	sink.append(Si::make_c_str_range("f"));
+	sink.flush();
+	stream->close();
+	Si::optional<graph::blob> const first = reader.read();
+	BOOST_REQUIRE(first);
+	BOOST_CHECK_EQUAL("abcde", std::string(first->begin(), first->end()));
+	BOOST_CHECK_EQUAL("f", read_all(reader));
+}
@@ -0,0 +1,149 @@
+#include <boost/test/unit_test.hpp>
+#include "server/graph.hpp"
+#include <algorithm>
+
+BOOST_AUTO_TEST_CASE(graph_symbol_interning)
+{
+	graph::symbol const first("graph_symbol_interning");
+	graph::symbol const second(Si::noexcept_string("graph_symbol_interning"));
+	BOOST_CHECK(first == second);
+	BOOST_CHECK_EQUAL(&first.name(), &second.name());
+	BOOST_CHECK(first != graph::symbol("graph_symbol_interning2"));
+
+	BOOST_CHECK(!graph::symbol::find_existing(Si::make_c_str_range("graph_symbol_never_interned")));
+	Si::optional<graph::symbol> const existing =
+	    graph::symbol::find_existing(Si::make_c_str_range("graph_symbol_interning"));
+	BOOST_REQUIRE(existing);
+	BOOST_CHECK(*existing == first);
+}
+
+BOOST_AUTO_TEST_CASE(graph_symbol_map_lookup)
+{
+	// more entries than the linear search handles, inserted out of order
+	graph::listing list;
+	for (std::uint32_t i = 0; i < 40; ++i)
+	{
+		std::uint32_t const key = (i * 7) % 40;
+		BOOST_CHECK(list.entries.insert(std::make_pair(Si::to_noexcept_string(std::to_string(100 + key)), key)).second);
+	}
+	BOOST_CHECK(!list.entries.insert(std::make_pair("105", std::uint32_t(0))).second);
+	BOOST_REQUIRE_EQUAL(40u, list.entries.size());
+
+	// iterated by name like the std::map this replaced
+	std::uint32_t expected = 0;
+	for (auto const &entry : list.entries)
+	{
+		Si::noexcept_string const &name = entry.first.name();
+		BOOST_CHECK_EQUAL(std::to_string(100 + expected), std::string(name.begin(), name.end()));
+		++expected;
+	}
+
+	for (std::uint32_t i = 0; i < 40; ++i)
+	{
+		Si::noexcept_string const name = Si::to_noexcept_string(std::to_string(100 + i));
+		std::uint32_t const *const by_string = graph::find_entry_of_type<std::uint32_t>(list, name);
+		BOOST_REQUIRE(by_string);
+		BOOST_CHECK_EQUAL(i, *by_string);
+		BOOST_CHECK_EQUAL(by_string, graph::find_entry_of_type<std::uint32_t>(list, graph::symbol(name)));
+	}
+	BOOST_CHECK(!graph::find_entry_of_type<std::uint32_t>(list, "graph_symbol_missing"));
+	BOOST_CHECK(!graph::symbol::find_existing(Si::make_c_str_range("graph_symbol_missing")));
+	BOOST_CHECK(!graph::find_entry_of_type<graph::blob>(list, "105"));
+}
+
+BOOST_AUTO_TEST_CASE(graph_listing_derived_copies_share_entries)
+{
+	graph::listing environment;
+	for (std::uint32_t i = 0; i < 40; ++i)
+	{
+		environment.entries.insert(std::make_pair(Si::to_noexcept_string(std::to_string(200 + 2 * i)), i));
+	}
+
+	graph::listing derived = environment;
+	BOOST_CHECK(derived.entries.insert(std::make_pair("201", std::uint32_t(1000))).second);
+	BOOST_CHECK(derived.entries.insert(std::make_pair("299", std::uint32_t(1001))).second);
+	BOOST_CHECK(!derived.entries.insert(std::make_pair("202", std::uint32_t(0))).second);
+	BOOST_CHECK_EQUAL(40u, environment.entries.size());
+	BOOST_CHECK_EQUAL(42u, derived.entries.size());
+	BOOST_CHECK(!graph::find_entry_of_type<std::uint32_t>(environment, "201"));
+	BOOST_CHECK_EQUAL(1000u, *graph::find_entry_of_type<std::uint32_t>(derived, "201"));
+
+	// the entries of the parent are not copied
+	BOOST_CHECK_EQUAL(graph::find_entry_of_type<std::uint32_t>(environment, "250"),
+	                  graph::find_entry_of_type<std::uint32_t>(derived, "250"));
+
+	// the inserted entries are iterated in order with the shared ones
+	std::vector<std::string> names;
+	for (auto const &entry : derived.entries)
+	{
+		names.emplace_back(entry.first.name().begin(), entry.first.name().end());
+	}
+	BOOST_REQUIRE_EQUAL(42u, names.size());
+	BOOST_CHECK(std::is_sorted(names.begin(), names.end()));
+	BOOST_CHECK_EQUAL("200", names[0]);
+	BOOST_CHECK_EQUAL("201", names[1]);
+	BOOST_CHECK_EQUAL("299", names[41]);
+	auto const found = derived.entries.find("201");
+	BOOST_REQUIRE(found != derived.entries.end());
+	auto next = found;
+	++next;
+	BOOST_CHECK_EQUAL("202", next->first.name());
+
+	// many insertions into a copy are merged into a new shared part without changing the result
+	graph::listing grown = derived;
+	for (std::uint32_t i = 0; i < 40; ++i)
+	{
+		grown.entries.insert(std::make_pair(Si::to_noexcept_string(std::to_string(301 + 2 * i)), i));
+	}
+	BOOST_CHECK_EQUAL(82u, grown.entries.size());
+	BOOST_CHECK_EQUAL(42u, derived.entries.size());
+	BOOST_CHECK_EQUAL(82, std::distance(grown.entries.begin(), grown.entries.end()));
+	for (std::uint32_t i = 0; i < 40; ++i)
+	{
+		BOOST_CHECK_EQUAL(i, *graph::find_entry_of_type<std::uint32_t>(grown, std::to_string(301 + 2 * i).c_str()));
+		BOOST_CHECK_EQUAL(i, *graph::find_entry_of_type<std::uint32_t>(grown, std::to_string(200 + 2 * i).c_str()));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_symbol_map_lookup_by_name)
+{
+	// prefixes of each other and bytes above 0x7f, which have to be ordered like the names are sorted
+	std::vector<std::string> const names = {"a", "ab", "abc", "b", "\xc3\xa4", "\xc3\xa4x", "z"};
+	for (std::size_t filler : {0u, 20u})
+	{
+		graph::symbol_map<std::size_t> map;
+		graph::persistent_symbol_map<std::size_t> persistent;
+		for (std::size_t i = 0; i < filler; ++i)
+		{
+			Si::noexcept_string const name = Si::to_noexcept_string("filler" + std::to_string(i));
+			map.insert(std::make_pair(name, i));
+			persistent.insert(std::make_pair(name, i));
+		}
+		graph::persistent_symbol_map<std::size_t> derived = persistent;
+		for (std::size_t i = 0; i < names.size(); ++i)
+		{
+			Si::noexcept_string const name = Si::to_noexcept_string(names[i]);
+			map.insert(std::make_pair(name, 1000 + i));
+			persistent.insert(std::make_pair(name, 1000 + i));
+			derived.insert(std::make_pair(name, 1000 + i));
+		}
+		for (std::size_t i = 0; i < names.size(); ++i)
+		{
+			Si::memory_range const name = Si::make_memory_range(names[i]);
+			BOOST_REQUIRE(map.find(name) != map.end());
+			BOOST_CHECK_EQUAL(1000 + i, map.find(name)->second);
+			BOOST_REQUIRE(persistent.find_value(name));
+			BOOST_CHECK_EQUAL(1000 + i, *persistent.find_value(name));
+			BOOST_REQUIRE(derived.find(name) != derived.end());
+			BOOST_CHECK_EQUAL(1000 + i, derived.find(name)->second);
+		}
+		for (char const *missing : {"", "aa", "abcd", "\xc3", "graph_symbol_missing_by_name"})
+		{
+			BOOST_CHECK(map.find(missing) == map.end());
+			BOOST_CHECK(!persistent.find_value(missing));
+			BOOST_CHECK(derived.find(missing) == derived.end());
+		}
+	}
+	// the lookups of names that were never interned did not intern them
+	BOOST_CHECK(!graph::symbol::find_existing(Si::make_c_str_range("graph_symbol_missing_by_name")));
+}
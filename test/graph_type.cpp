@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+#include "server/graph_executor.hpp"
+#include <silicium/to_shared.hpp>
+
+namespace
+{
+	graph::value identity(graph::value v)
+	{
+		return v;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(graph_type_interning)
+{
+	graph::type const first = graph::make_listing_type(
+	    {{"a", graph::atomic_type::uint32}, {"b", graph::make_listing_type({{"c", graph::atomic_type::blob}})}});
+	graph::type const second = graph::make_listing_type(
+	    {{"b", graph::make_listing_type({{"c", graph::atomic_type::blob}})}, {"a", graph::atomic_type::uint32}});
+	graph::type const different = graph::make_listing_type(
+	    {{"a", graph::atomic_type::uint32}, {"b", graph::make_listing_type({{"c", graph::atomic_type::uri}})}});
+	BOOST_CHECK(graph::interned_type(first) == graph::interned_type(second));
+	BOOST_CHECK(graph::interned_type(first) != graph::interned_type(different));
+	BOOST_CHECK(graph::interned_type(graph::atomic_type::uint32) == graph::interned_type(graph::atomic_type::uint32));
+	BOOST_CHECK(graph::interned_type(graph::atomic_type::uint32) != graph::interned_type(graph::atomic_type::blob));
+
+	// the canonical structure is shared between equal types
+	auto const *const first_structure =
+	    Si::try_get_ptr<std::shared_ptr<graph::listing_type>>(graph::interned_type(first).structure());
+	auto const *const second_structure =
+	    Si::try_get_ptr<std::shared_ptr<graph::listing_type>>(graph::interned_type(second).structure());
+	BOOST_REQUIRE(first_structure && second_structure);
+	BOOST_CHECK_EQUAL(first_structure->get(), second_structure->get());
+
+	Si::optional<graph::interned_type> const entry = graph::interned_type(first).find_entry("a");
+	BOOST_REQUIRE(entry);
+	BOOST_CHECK(*entry == graph::interned_type(graph::atomic_type::uint32));
+	BOOST_CHECK(!graph::interned_type(first).find_entry("c"));
+}
+
+BOOST_AUTO_TEST_CASE(graph_type_compatibility)
+{
+	graph::interned_type const wide(graph::make_listing_type(
+	    {{"a", graph::atomic_type::uint32},
+	     {"b", graph::make_listing_type({{"c", graph::atomic_type::blob}, {"d", graph::atomic_type::uri}})}}));
+	graph::interned_type const narrow(
+	    graph::make_listing_type({{"b", graph::make_listing_type({{"c", graph::atomic_type::blob}})}}));
+	BOOST_CHECK(graph::is_compatible(wide, wide));
+	BOOST_CHECK(graph::is_compatible(wide, narrow));
+	BOOST_CHECK(!graph::is_compatible(narrow, wide));
+	// answered from the memo this time
+	BOOST_CHECK(graph::is_compatible(wide, narrow));
+	BOOST_CHECK(!graph::is_compatible(narrow, wide));
+	BOOST_CHECK(!graph::is_compatible(wide, graph::interned_type(graph::atomic_type::uint32)));
+	BOOST_CHECK(!graph::is_compatible(graph::interned_type(graph::atomic_type::uint32), narrow));
+
+	graph::listing value;
+	value.entries.insert(std::make_pair("a", std::uint32_t(1)));
+	value.entries.insert(std::make_pair("b", graph::uri{"x"}));
+	BOOST_CHECK(graph::type_of(Si::to_shared(std::move(value))) ==
+	            graph::interned_type(
+	                graph::make_listing_type({{"a", graph::atomic_type::uint32}, {"b", graph::atomic_type::uri}})));
+}
+
+BOOST_AUTO_TEST_CASE(graph_type_has_type)
+{
+	graph::interned_type const narrow(graph::make_listing_type(
+	    {{"a", graph::atomic_type::uint32}, {"b", graph::make_listing_type({{"c", graph::atomic_type::blob}})}}));
+	graph::listing inner;
+	inner.entries.insert(std::make_pair("c", graph::blob()));
+	inner.entries.insert(std::make_pair("d", graph::uri{"x"}));
+	graph::listing wide;
+	wide.entries.insert(std::make_pair("a", std::uint32_t(1)));
+	wide.entries.insert(std::make_pair("b", Si::to_shared(std::move(inner))));
+	graph::value const checked = Si::to_shared(std::move(wide));
+	BOOST_CHECK(graph::has_type(checked, narrow));
+	BOOST_CHECK(graph::has_type(std::uint32_t(1), graph::interned_type(graph::atomic_type::uint32)));
+	BOOST_CHECK(!graph::has_type(std::uint32_t(1), graph::interned_type(graph::atomic_type::blob)));
+	BOOST_CHECK(!graph::has_type(std::uint32_t(1), narrow));
+	BOOST_CHECK(!graph::has_type(checked, graph::interned_type(graph::atomic_type::uint32)));
+
+	graph::listing missing;
+	missing.entries.insert(std::make_pair("a", std::uint32_t(1)));
+	BOOST_CHECK(!graph::has_type(Si::to_shared(std::move(missing)), narrow));
+	graph::listing wrong_entry;
+	wrong_entry.entries.insert(std::make_pair("a", graph::blob()));
+	wrong_entry.entries.insert(std::make_pair("b", Si::to_shared(graph::listing())));
+	BOOST_CHECK(!graph::has_type(Si::to_shared(std::move(wrong_entry)), narrow));
+}
+
+BOOST_AUTO_TEST_CASE(graph_dag_checks_types_when_nodes_are_added)
+{
+	graph::typed_transformation const tf_uint32{graph::atomic_type::uint32, graph::atomic_type::uint32, &identity};
+	graph::typed_transformation const tf_pair{
+	    graph::make_listing_type({{"first", graph::atomic_type::uint32}, {"second", graph::atomic_type::uint32}}),
+	    graph::make_listing_type({{"first", graph::atomic_type::uint32}, {"second", graph::atomic_type::uint32}}),
+	    &identity};
+	graph::typed_transformation const tf_first{graph::make_listing_type({{"first", graph::atomic_type::uint32}}),
+	                                           graph::atomic_type::uint32, &identity};
+	graph::dag g;
+	graph::node_id const number = g.add_node(tf_uint32, graph::constant{std::uint32_t(1)});
+	BOOST_CHECK_THROW(g.add_node(tf_uint32, graph::constant{graph::blob()}), std::invalid_argument);
+	graph::node_id const pair =
+	    g.add_node(tf_pair, {{"first", graph::dependency{number, ""}}, {"second", graph::constant{std::uint32_t(2)}}});
+	BOOST_CHECK_THROW(g.add_node(tf_pair, {{"first", graph::dependency{number, ""}}}), std::invalid_argument);
+	BOOST_CHECK_THROW(g.add_node(tf_uint32, graph::dependency{pair, ""}), std::invalid_argument);
+	BOOST_CHECK_THROW(g.add_node(tf_uint32, graph::dependency{pair, "third"}), std::invalid_argument);
+	BOOST_CHECK_THROW(g.add_node(tf_uint32, graph::dependency{number, "first"}), std::invalid_argument);
+	BOOST_CHECK_THROW(g.add_node(tf_uint32, graph::dependency{graph::node_id{10}, ""}), std::invalid_argument);
+
+	// additional entries are fine
+	g.add_node(tf_uint32, graph::dependency{pair, "second"});
+	g.add_node(tf_first, graph::dependency{pair, ""});
+	BOOST_CHECK_EQUAL(4u, g.nodes().size());
+}
@@ -0,0 +1,121 @@
+#include <boost/test/unit_test.hpp>
+#include "server/history_journal.hpp"
+#include "test/temporary_directory.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <string>
+
+namespace
+{
+	Si::memory_range text(std::string const &content)
+	{
+		return Si::memory_range(content.data(), content.data() + content.size());
+	}
+
+	std::string latest_text(buildserver::history_journal const &journal, std::string const &step)
+	{
+		Si::optional<std::vector<char>> const found = journal.latest(text(step));
+		BOOST_REQUIRE(found);
+		return std::string(found->begin(), found->end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(history_journal_survives_reopening)
+{
+	buildserver::test::temporary_directory directory;
+	{
+		buildserver::history_journal journal(directory.path);
+		BOOST_CHECK(!journal.latest(text("400")));
+		journal.append(text("400"), text("first message"));
+		journal.append(text("300"), text(""));
+		journal.append(text("400"), text("second message"));
+		BOOST_CHECK_EQUAL("second message", latest_text(journal, "400"));
+		BOOST_CHECK_EQUAL("", latest_text(journal, "300"));
+		BOOST_CHECK_EQUAL(2u, journal.step_count());
+	}
+	buildserver::history_journal reopened(directory.path);
+	// the index covered the whole journal, so nothing had to be read again
+	BOOST_CHECK_EQUAL(0u, reopened.recovered_records());
+	BOOST_CHECK_EQUAL("second message", latest_text(reopened, "400"));
+	BOOST_CHECK_EQUAL(2u, reopened.step_count());
+	BOOST_CHECK(!reopened.latest(text("40")));
+}
+
+BOOST_AUTO_TEST_CASE(history_journal_recovery)
+{
+	buildserver::test::temporary_directory directory;
+	std::uint64_t complete_size = 0;
+	{
+		buildserver::history_journal journal(directory.path);
+		for (int i = 0; i < 100; ++i)
+		{
+			journal.append(text(std::to_string(i)), text("value " + std::to_string(i)));
+		}
+		journal.append(text("7"), text("changed"));
+		complete_size = journal.journal_size();
+	}
+	{
+		// an append that was interrupted in the middle of the record
+		std::ofstream torn((directory.path / "journal").string(), std::ios::binary | std::ios::app);
+		// the magic number of a record, the lengths and the rest are missing
+		torn << "SBHR";
+	}
+	{
+		buildserver::history_journal journal(directory.path);
+		BOOST_CHECK_EQUAL(0u, journal.recovered_records());
+		BOOST_CHECK_EQUAL(complete_size, journal.journal_size());
+		BOOST_CHECK_EQUAL("changed", latest_text(journal, "7"));
+	}
+	boost::filesystem::remove(directory.path / "index");
+	buildserver::history_journal rebuilt(directory.path);
+	BOOST_CHECK_EQUAL(101u, rebuilt.recovered_records());
+	BOOST_CHECK_EQUAL(100u, rebuilt.step_count());
+	BOOST_CHECK_EQUAL("changed", latest_text(rebuilt, "7"));
+	BOOST_CHECK_EQUAL("value 99", latest_text(rebuilt, "99"));
+}
+
+BOOST_AUTO_TEST_CASE(history_journal_compaction)
+{
+	buildserver::test::temporary_directory directory;
+	{
+		buildserver::history_journal journal(directory.path, 4096);
+		for (int i = 0; i < 2000; ++i)
+		{
+			journal.append(text(std::to_string(i % 3)), text(std::string(100, 'a') + std::to_string(i)));
+			if ((i % 100) == 0)
+			{
+				BOOST_CHECK_EQUAL(std::string(100, 'a') + std::to_string(i),
+				                  latest_text(journal, std::to_string(i % 3)));
+			}
+		}
+		journal.wait_for_compaction();
+		// three live records and whatever was appended after the last compaction
+		BOOST_CHECK_LT(journal.journal_size(), 3 * 4096u);
+		BOOST_CHECK_EQUAL(3u, journal.step_count());
+		BOOST_CHECK_EQUAL(std::string(100, 'a') + "1997", latest_text(journal, "2"));
+	}
+	buildserver::history_journal reopened(directory.path);
+	BOOST_CHECK_EQUAL(0u, reopened.recovered_records());
+	BOOST_CHECK_EQUAL(std::string(100, 'a') + "1998", latest_text(reopened, "0"));
+	BOOST_CHECK_EQUAL(std::string(100, 'a') + "1999", latest_text(reopened, "1"));
+}
+
+BOOST_AUTO_TEST_CASE(history_journal_fails_when_it_cannot_be_reopened)
+{
+	buildserver::test::temporary_directory directory;
+	buildserver::history_journal journal(directory.path);
+	journal.append(text("step"), text("value"));
+
+	// the renames of the compaction and the index of the reopened journal cannot replace a directory that is not empty
+	boost::filesystem::remove(directory.path / "index");
+	boost::filesystem::create_directories(directory.path / "index" / "blocker");
+	journal.compact_in_background();
+	journal.wait_for_compaction();
+	BOOST_CHECK(journal.failed());
+	BOOST_CHECK_THROW(journal.latest(text("step")), std::runtime_error);
+	BOOST_CHECK_THROW(journal.append(text("step"), text("other")), std::runtime_error);
+	BOOST_CHECK_THROW(journal.step_count(), std::runtime_error);
+
+	// a failed journal does not start compactions anymore
+	journal.compact_in_background();
+	journal.wait_for_compaction();
+}
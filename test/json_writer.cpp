@@ -0,0 +1,58 @@
+#include <boost/test/unit_test.hpp>
+#include "server/json_writer.hpp"
+#include <string>
+
+BOOST_AUTO_TEST_CASE(json_writer_nested)
+{
+	std::vector<char> buffer;
+	buildserver::json_writer writer(buffer);
+	writer.begin_object();
+	writer.key(Si::make_c_str_range("version"));
+	writer.number(42);
+	writer.key(Si::make_c_str_range("steps"));
+	writer.begin_array();
+	writer.boolean(true);
+	writer.null();
+	writer.begin_object();
+	writer.end_object();
+	writer.number(18446744073709551615ull);
+	writer.end_array();
+	writer.end_object();
+	BOOST_CHECK_EQUAL("{\"version\":42,\"steps\":[true,null,{},18446744073709551615]}",
+	                  std::string(buffer.begin(), buffer.end()));
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_escapes_strings)
+{
+	std::vector<char> buffer;
+	buildserver::json_writer writer(buffer);
+	writer.string(Si::make_c_str_range("a\"b\\c\nd\x01"));
+	BOOST_CHECK_EQUAL("\"a\\\"b\\\\c\\nd\\u0001\"", std::string(buffer.begin(), buffer.end()));
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_keeps_valid_utf8)
+{
+	std::vector<char> buffer;
+	buildserver::json_writer writer(buffer);
+	// 2, 3 and 4 byte sequences, including the highest code point
+	std::string const text = "\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80\xf4\x8f\xbf\xbf";
+	writer.string(Si::make_memory_range(text));
+	BOOST_CHECK_EQUAL("\"" + text + "\"", std::string(buffer.begin(), buffer.end()));
+}
+
+BOOST_AUTO_TEST_CASE(json_writer_replaces_invalid_utf8)
+{
+	std::string const replacement = "\xef\xbf\xbd";
+	// a lone continuation byte, an overlong '/', a surrogate, a code point beyond U+10FFFF and a truncated sequence
+	std::string const invalid[] = {"\x80", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xe2\x82"};
+	for (std::string const &bytes : invalid)
+	{
+		std::vector<char> buffer;
+		buildserver::json_writer writer(buffer);
+		writer.string(Si::make_memory_range("a" + bytes + "b"));
+		std::string const written(buffer.begin(), buffer.end());
+		BOOST_CHECK_EQUAL(std::string::npos, written.find_first_of(bytes));
+		BOOST_CHECK_EQUAL(written.find(replacement), 2u);
+		BOOST_CHECK_EQUAL('b', written[written.size() - 2]);
+	}
+}
@@ -0,0 +1,227 @@
+#include <boost/test/unit_test.hpp>
+#include "server/lua_pipeline.hpp"
+#include "server/sha256.hpp"
+#include "test/temporary_directory.hpp"
+#include <luacpp/load.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+namespace
+{
+	void write_text(boost::filesystem::path const &file, std::string const &content)
+	{
+		std::ofstream(file.string(), std::ios::binary) << content;
+	}
+
+	std::vector<boost::filesystem::path> list_files(boost::filesystem::path const &directory)
+	{
+		return std::vector<boost::filesystem::path>{boost::filesystem::directory_iterator(directory),
+		                                            boost::filesystem::directory_iterator()};
+	}
+
+	std::string const twice_script = "return function(require)\n"
+	                                 "\trequire(\"steps\", \"1.0\").export(\"twice\", function(content)\n"
+	                                 "\t\treturn content .. content\n"
+	                                 "\tend)\n"
+	                                 "end\n";
+
+	std::string digest_and_content(std::string const &content)
+	{
+		buildserver::sha256_digest const digest = buildserver::hash_sha256(Si::make_memory_range(content));
+		return std::string(digest.begin(), digest.end()) + content;
+	}
+
+	// Calls the exported step with a blob and returns the content of the result or what went wrong. Does not use the
+	// checks of Boost.Test because it runs on the workers, too.
+	std::string call_step(buildserver::lua_pipeline_host &host, std::string const &name, std::string const &input)
+	{
+		lua_State &state = host.state();
+		int const stack_size = lua_gettop(&state);
+		if (!host.push_step(name))
+		{
+			return "missing";
+		}
+		buildserver::push_result(state, buildserver::memory_blob{std::vector<char>(input.begin(), input.end())});
+		if (lua_pcall(&state, 1, 1, 0) != 0)
+		{
+			lua_settop(&state, stack_size);
+			return "failed";
+		}
+		buildserver::shared_result const output = buildserver::pop_result(state);
+		if (lua_gettop(&state) != stack_size)
+		{
+			return "unbalanced";
+		}
+		buildserver::memory_blob const *const blob = Si::try_get_ptr<buildserver::memory_blob>(*output);
+		if (!blob)
+		{
+			return "failed";
+		}
+		return std::string(blob->content.begin(), blob->content.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(lua_bytecode_cache_hit)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const script = directory.path / "pipeline.lua";
+	write_text(script, twice_script);
+	auto compiler = lua::create_lua();
+	std::vector<char> compiled;
+	{
+		buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+		compiled = cache.get(*compiler, script);
+		BOOST_CHECK(!compiled.empty());
+		BOOST_CHECK_EQUAL(0u, cache.hits());
+		BOOST_CHECK_EQUAL(1u, cache.misses());
+		BOOST_CHECK(compiled == cache.get(*compiler, script));
+		BOOST_CHECK_EQUAL(1u, cache.hits());
+		BOOST_CHECK_EQUAL(1u, cache.misses());
+	}
+
+	// a new process finds the bytecode in the directory
+	buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+	BOOST_CHECK(compiled == cache.get(*compiler, script));
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+	BOOST_CHECK_EQUAL(0u, cache.misses());
+	BOOST_CHECK_EQUAL(1u, list_files(directory.path / "bytecode").size());
+}
+
+BOOST_AUTO_TEST_CASE(lua_bytecode_cache_edited_script)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const script = directory.path / "pipeline.lua";
+	auto compiler = lua::create_lua();
+	buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+	write_text(script, "return 1");
+	std::vector<char> const original = cache.get(*compiler, script);
+	write_text(script, "return 2");
+	std::vector<char> const edited = cache.get(*compiler, script);
+	BOOST_CHECK(original != edited);
+	BOOST_CHECK_EQUAL(0u, cache.hits());
+	BOOST_CHECK_EQUAL(2u, cache.misses());
+	BOOST_CHECK_EQUAL(2u, list_files(directory.path / "bytecode").size());
+
+	// the original is still cached
+	write_text(script, "return 1");
+	BOOST_CHECK(original == cache.get(*compiler, script));
+	BOOST_CHECK_EQUAL(1u, cache.hits());
+}
+
+BOOST_AUTO_TEST_CASE(lua_bytecode_cache_replaces_damaged_files)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const script = directory.path / "pipeline.lua";
+	write_text(script, twice_script);
+	auto compiler = lua::create_lua();
+	std::vector<char> compiled;
+	{
+		buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+		compiled = cache.get(*compiler, script);
+	}
+	std::vector<boost::filesystem::path> const stored = list_files(directory.path / "bytecode");
+	BOOST_REQUIRE_EQUAL(1u, stored.size());
+	BOOST_CHECK_EQUAL(32u + compiled.size(), boost::filesystem::file_size(stored[0]));
+
+	std::vector<std::string> const damages = {
+	    // the bytecode does not match the digest
+	    std::string(32, 'x') + std::string(compiled.begin(), compiled.end()),
+	    // too short for a digest
+	    "x",
+	    // source code instead of bytecode
+	    digest_and_content("return 3")};
+	for (std::string const &damaged : damages)
+	{
+		write_text(stored[0], damaged);
+		buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+		BOOST_CHECK(compiled == cache.get(*compiler, script));
+		BOOST_CHECK_EQUAL(0u, cache.hits());
+		BOOST_CHECK_EQUAL(1u, cache.misses());
+		BOOST_CHECK_EQUAL(32u + compiled.size(), boost::filesystem::file_size(stored[0]));
+	}
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(lua_bytecode_cache_rejects_shared_directories)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const shared = directory.path / "shared";
+	boost::filesystem::create_directory(shared);
+	boost::filesystem::permissions(shared, boost::filesystem::all_all);
+	BOOST_CHECK_THROW(buildserver::lua_bytecode_cache rejected(shared), std::runtime_error);
+
+	boost::filesystem::permissions(shared, boost::filesystem::owner_all | boost::filesystem::group_write);
+	BOOST_CHECK_THROW(buildserver::lua_bytecode_cache rejected(shared), std::runtime_error);
+
+	// a new directory is only accessible by its owner
+	buildserver::lua_bytecode_cache created(directory.path / "private");
+	BOOST_CHECK(boost::filesystem::owner_all ==
+	            boost::filesystem::status(directory.path / "private").permissions());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(lua_pipeline_host_exports_steps)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const script = directory.path / "pipeline.lua";
+	write_text(script, twice_script);
+	auto state = lua::create_lua();
+	buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+	buildserver::lua_pipeline_host host(*state);
+	BOOST_CHECK_EQUAL("missing", call_step(host, "twice", "ab"));
+	host.run(cache.get(*state, script), script.string());
+	BOOST_CHECK_EQUAL("abab", call_step(host, "twice", "ab"));
+	BOOST_CHECK_EQUAL("missing", call_step(host, "thrice", "ab"));
+	BOOST_CHECK_EQUAL(0, lua_gettop(state.get()));
+}
+
+BOOST_AUTO_TEST_CASE(lua_worker_pool_runs_steps_concurrently)
+{
+	buildserver::test::temporary_directory directory;
+	boost::filesystem::path const script = directory.path / "pipeline.lua";
+	write_text(script, twice_script);
+	auto compiler = lua::create_lua();
+	buildserver::lua_bytecode_cache cache(directory.path / "bytecode");
+	std::vector<char> const &bytecode = cache.get(*compiler, script);
+
+	std::size_t const worker_count = 4;
+	std::atomic<std::size_t> arrived(0);
+	std::vector<std::string> outputs(worker_count);
+	std::vector<char> met_the_others(worker_count);
+	std::vector<lua_State *> states(worker_count);
+	{
+		buildserver::lua_worker_pool workers(worker_count, [&bytecode](buildserver::lua_pipeline_host &host)
+		                                     {
+			                                     host.run(bytecode, "pipeline.lua");
+			                                 });
+		for (std::size_t i = 0; i < worker_count; ++i)
+		{
+			workers.post([i, &arrived, &outputs, &met_the_others, &states](buildserver::lua_pipeline_host &host)
+			             {
+				             outputs[i] = call_step(host, "twice", std::to_string(i));
+				             states[i] = &host.state();
+
+				             // every job waits for the others, which can only arrive if they run at the same time
+				             ++arrived;
+				             auto const give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+				             while ((arrived.load() < worker_count) && (std::chrono::steady_clock::now() < give_up))
+				             {
+					             boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+				             }
+				             met_the_others[i] = (arrived.load() == worker_count);
+				         });
+		}
+	}
+	for (std::size_t i = 0; i < worker_count; ++i)
+	{
+		BOOST_CHECK_EQUAL(std::to_string(i) + std::to_string(i), outputs[i]);
+		BOOST_CHECK(met_the_others[i]);
+		for (std::size_t k = 0; k < i; ++k)
+		{
+			BOOST_CHECK(states[i] != states[k]);
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#include <boost/test/unit_test.hpp>
+#include "server/metrics.hpp"
+#include <boost/thread/thread.hpp>
+#include <string>
+
+BOOST_AUTO_TEST_CASE(metrics_bucket_bounds)
+{
+	std::uint64_t const values[] = {0, 1, 3, 4, 7, 8, 9, 15, 16, 1000, 123456789, ~std::uint64_t(0)};
+	for (std::uint64_t const value : values)
+	{
+		std::size_t const bucket = buildserver::metrics::get_bucket_index(value);
+		BOOST_REQUIRE_LT(bucket, buildserver::metrics::histogram_bucket_count);
+		BOOST_CHECK_LE(value, buildserver::metrics::get_bucket_upper_bound(bucket));
+		if (bucket > 0)
+		{
+			BOOST_CHECK_GT(value, buildserver::metrics::get_bucket_upper_bound(bucket - 1));
+		}
+	}
+	BOOST_CHECK_EQUAL(buildserver::metrics::histogram_bucket_count - 1,
+	                  buildserver::metrics::get_bucket_index(~std::uint64_t(0)));
+}
+
+BOOST_AUTO_TEST_CASE(metrics_concurrent_recording)
+{
+	buildserver::metrics::counter events("test_events_total", "events");
+	buildserver::metrics::histogram durations("test_durations_seconds", "durations");
+	boost::thread_group threads;
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.create_thread([&events, &durations]()
+		                      {
+			                      for (std::uint64_t j = 0; j < 1000; ++j)
+			                      {
+				                      events.add();
+				                      durations.record(j);
+			                      }
+			                  });
+	}
+	threads.join_all();
+	BOOST_CHECK_EQUAL(4000u, events.read());
+	buildserver::metrics::histogram_snapshot const snapshot = durations.read();
+	BOOST_CHECK_EQUAL(4000u, snapshot.count);
+	BOOST_CHECK_EQUAL(4u * (999u * 1000u / 2u), snapshot.sum);
+
+	std::vector<char> rendered;
+	buildserver::metrics::render_prometheus(rendered);
+	std::string const text(rendered.begin(), rendered.end());
+	BOOST_CHECK_NE(std::string::npos, text.find("test_events_total 4000\n"));
+	BOOST_CHECK_NE(std::string::npos, text.find("test_durations_seconds_count 4000\n"));
+}
+
+BOOST_AUTO_TEST_CASE(metrics_render_every_bucket)
+{
+	buildserver::metrics::histogram durations("test_sparse_durations_seconds", "durations");
+	durations.record(1000);
+	std::vector<char> rendered;
+	buildserver::metrics::render_prometheus(rendered);
+	std::string const text(rendered.begin(), rendered.end());
+	std::string const bucket_prefix = "test_sparse_durations_seconds_bucket{le=\"";
+	std::size_t buckets = 0;
+	double previous_bound = -1;
+	std::uint64_t previous_count = 0;
+	for (std::size_t found = text.find(bucket_prefix); found != std::string::npos;
+	     found = text.find(bucket_prefix, found + 1))
+	{
+		std::size_t const bound_begin = found + bucket_prefix.size();
+		std::size_t const bound_end = text.find('"', bound_begin);
+		std::string const bound = text.substr(bound_begin, bound_end - bound_begin);
+		std::uint64_t const count = std::stoull(text.substr(bound_end + 2));
+		++buckets;
+		BOOST_CHECK_GE(count, previous_count);
+		previous_count = count;
+		if (bound != "+Inf")
+		{
+			// the bounds have to be distinct after formatting
+			BOOST_CHECK_GT(std::stod(bound), previous_bound);
+			previous_bound = std::stod(bound);
+		}
+	}
+	BOOST_CHECK_EQUAL(buildserver::metrics::histogram_bucket_count + 1, buckets);
+	BOOST_CHECK_EQUAL(1u, previous_count);
+}
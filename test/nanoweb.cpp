@@ -0,0 +1,273 @@
+#include <boost/test/unit_test.hpp>
+#include "nanoweb/admission.hpp"
+#include "nanoweb/compression.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+#include <future>
+#include <string>
+#include <thread>
+
+namespace
+{
+	Si::optional<nanoweb::content_encoding> choose(char const *accept_encoding)
+	{
+		return nanoweb::choose_content_encoding(Si::make_c_str_range(accept_encoding), true, true);
+	}
+
+	std::string decompress(std::vector<char> const &compressed, nanoweb::content_encoding encoding)
+	{
+		z_stream stream = {};
+		BOOST_REQUIRE_EQUAL(Z_OK,
+		                    inflateInit2(&stream, (encoding == nanoweb::content_encoding::gzip) ? (15 + 16) : 15));
+		std::string decompressed(1 << 16, '\0');
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+		stream.avail_in = static_cast<uInt>(compressed.size());
+		stream.next_out = reinterpret_cast<Bytef *>(&decompressed[0]);
+		stream.avail_out = static_cast<uInt>(decompressed.size());
+		int const status = inflate(&stream, Z_FINISH);
+		decompressed.resize(stream.total_out);
+		inflateEnd(&stream);
+		BOOST_REQUIRE_EQUAL(Z_STREAM_END, status);
+		return decompressed;
+	}
+
+	// accepts loopback connections and hands them to an admission_control on a thread of its own
+	struct admission_server
+	{
+		explicit admission_server(nanoweb::admission_limits limits, nanoweb::request_handler handler)
+		    : m_acceptor(m_io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+		    , m_handler(std::move(handler))
+		    , m_admission(limits)
+		{
+			accept();
+			m_thread = std::thread([this]()
+			                       {
+				                       m_io.run();
+				                   });
+		}
+
+		~admission_server()
+		{
+			m_io.stop();
+			m_thread.join();
+		}
+
+		boost::asio::ip::tcp::endpoint endpoint() const
+		{
+			return m_acceptor.local_endpoint();
+		}
+
+		nanoweb::admission_counters counters()
+		{
+			std::promise<nanoweb::admission_counters> result;
+			m_io.post([this, &result]()
+			          {
+				          result.set_value(m_admission.counters());
+				      });
+			return result.get_future().get();
+		}
+
+	private:
+		boost::asio::io_service m_io;
+		boost::asio::ip::tcp::acceptor m_acceptor;
+		nanoweb::request_handler m_handler;
+		nanoweb::admission_control m_admission;
+		std::thread m_thread;
+
+		void accept()
+		{
+			auto client = std::make_shared<boost::asio::ip::tcp::socket>(m_io);
+			m_acceptor.async_accept(*client, [this, client](boost::system::error_code ec)
+			                        {
+				                        if (!!ec)
+				                        {
+					                        return;
+				                        }
+				                        m_admission.admit(client, m_handler,
+				                                          [](boost::asio::ip::tcp::socket &, boost::system::error_code)
+				                                          {
+					                                      });
+				                        accept();
+				                    });
+		}
+	};
+
+	nanoweb::request_handler make_hello_handler()
+	{
+		return [](boost::asio::ip::tcp::socket &client, Si::http::request const &,
+		          Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
+		{
+			nanoweb::quick_final_response(client, yield, "200", "OK", Si::make_c_str_range("hello"));
+			return nanoweb::request_handler_result::handled;
+		};
+	}
+
+	std::string const hello_request = "GET / HTTP/1.0\r\nHost: localhost\r\n\r\n";
+
+	// reads until the server closes the connection
+	std::string receive_all(boost::asio::ip::tcp::socket &socket)
+	{
+		std::string received;
+		char buffer[4096];
+		boost::system::error_code ec;
+		while (!ec)
+		{
+			std::size_t const size = socket.read_some(boost::asio::buffer(buffer), ec);
+			received.append(buffer, size);
+		}
+		return received;
+	}
+
+	bool starts_with(std::string const &text, std::string const &prefix)
+	{
+		return text.compare(0, prefix.size(), prefix) == 0;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_decode_query_value)
+{
+	BOOST_CHECK_EQUAL("feature/x y", *nanoweb::decode_query_value(Si::make_c_str_range("feature%2Fx+y")));
+	BOOST_CHECK_EQUAL("-", *nanoweb::decode_query_value(Si::make_c_str_range("%2d")));
+	BOOST_CHECK_EQUAL("", *nanoweb::decode_query_value(Si::make_c_str_range("")));
+	BOOST_CHECK(!nanoweb::decode_query_value(Si::make_c_str_range("a%2")));
+	BOOST_CHECK(!nanoweb::decode_query_value(Si::make_c_str_range("a%g0")));
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_choose_content_encoding)
+{
+	BOOST_CHECK(nanoweb::content_encoding::identity == *choose(""));
+	BOOST_CHECK(nanoweb::content_encoding::gzip == *choose("deflate, gzip"));
+	BOOST_CHECK(nanoweb::content_encoding::gzip == *choose("x-gzip"));
+	BOOST_CHECK(nanoweb::content_encoding::deflate == *choose("gzip;q=0.5, deflate"));
+	BOOST_CHECK(nanoweb::content_encoding::deflate == *choose("gzip;q=0, *"));
+	BOOST_CHECK(nanoweb::content_encoding::identity == *choose("br"));
+	BOOST_CHECK(nanoweb::content_encoding::identity == *choose("gzip;q=0, deflate;q=0"));
+	BOOST_CHECK(nanoweb::content_encoding::gzip == *choose("identity;q=0, gzip"));
+
+	// the available encodings are considered even if the client prefers another one
+	BOOST_CHECK(nanoweb::content_encoding::deflate ==
+	            *nanoweb::choose_content_encoding(Si::make_c_str_range("gzip, deflate;q=0.1"), false, true));
+	BOOST_CHECK(nanoweb::content_encoding::identity ==
+	            *nanoweb::choose_content_encoding(Si::make_c_str_range("gzip"), false, false));
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_choose_content_encoding_not_acceptable)
+{
+	BOOST_CHECK(!choose("identity;q=0"));
+	BOOST_CHECK(!choose("*;q=0"));
+	BOOST_CHECK(!choose("gzip;q=0, identity;q=0"));
+	BOOST_CHECK(!nanoweb::choose_content_encoding(Si::make_c_str_range("gzip, identity;q=0"), false, false));
+	BOOST_CHECK(nanoweb::content_encoding::identity == *choose("*;q=0, identity"));
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_compress_round_trip)
+{
+	std::string content;
+	for (int i = 0; i < 1000; ++i)
+	{
+		content += "line " + std::to_string(i % 10) + "\n";
+	}
+	for (nanoweb::content_encoding encoding : {nanoweb::content_encoding::gzip, nanoweb::content_encoding::deflate})
+	{
+		std::vector<char> const compressed = nanoweb::compress(Si::make_memory_range(content), encoding);
+		BOOST_CHECK_LT(compressed.size(), content.size());
+		BOOST_CHECK_EQUAL(content, decompress(compressed, encoding));
+	}
+	std::vector<char> const empty = nanoweb::compress(Si::make_c_str_range(""), nanoweb::content_encoding::gzip);
+	BOOST_CHECK_EQUAL("", decompress(empty, nanoweb::content_encoding::gzip));
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_precompress)
+{
+	std::string const repetitive(4096, 'a');
+	std::shared_ptr<nanoweb::precompressed_content const> const compressible =
+	    nanoweb::precompress("text/plain", std::vector<char>(repetitive.begin(), repetitive.end()));
+	BOOST_CHECK_EQUAL("text/plain", compressible->content_type);
+	BOOST_CHECK_EQUAL(repetitive, std::string(compressible->identity.begin(), compressible->identity.end()));
+	BOOST_REQUIRE(compressible->gzip);
+	BOOST_REQUIRE(compressible->deflate);
+	BOOST_CHECK_EQUAL(repetitive, decompress(*compressible->gzip, nanoweb::content_encoding::gzip));
+	BOOST_CHECK_EQUAL(repetitive, decompress(*compressible->deflate, nanoweb::content_encoding::deflate));
+
+	// the headers of the compressed formats make a tiny body larger
+	std::shared_ptr<nanoweb::precompressed_content const> const tiny =
+	    nanoweb::precompress("text/plain", std::vector<char>{'x'});
+	BOOST_CHECK(!tiny->gzip);
+	BOOST_CHECK(!tiny->deflate);
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_admission_requires_a_connection)
+{
+	BOOST_CHECK_THROW(nanoweb::admission_control(
+	                      nanoweb::admission_limits{0, std::chrono::seconds(1), std::chrono::seconds(1)}),
+	                  std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_admission_sheds_beyond_the_limit)
+{
+	admission_server server(nanoweb::admission_limits{1, std::chrono::seconds(10), std::chrono::seconds(10)},
+	                        make_hello_handler());
+	boost::asio::io_service io;
+
+	// occupies the only place without sending a request yet
+	boost::asio::ip::tcp::socket waiting(io);
+	waiting.connect(server.endpoint());
+
+	boost::asio::ip::tcp::socket shed(io);
+	shed.connect(server.endpoint());
+	BOOST_CHECK(starts_with(receive_all(shed), "HTTP/1.0 503"));
+
+	boost::asio::write(waiting, boost::asio::buffer(hello_request));
+	std::string const response = receive_all(waiting);
+	BOOST_CHECK(starts_with(response, "HTTP/1.0 200"));
+	BOOST_CHECK_EQUAL("hello", response.substr(response.size() - 5));
+
+	nanoweb::admission_counters const counters = server.counters();
+	BOOST_CHECK_EQUAL(1u, counters.accepted);
+	BOOST_CHECK_EQUAL(1u, counters.shed);
+	BOOST_CHECK_EQUAL(0u, counters.timed_out);
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_admission_read_timeout)
+{
+	admission_server server(nanoweb::admission_limits{4, std::chrono::milliseconds(50), std::chrono::seconds(10)},
+	                        make_hello_handler());
+	boost::asio::io_service io;
+
+	boost::asio::ip::tcp::socket silent(io);
+	silent.connect(server.endpoint());
+	BOOST_CHECK_EQUAL("", receive_all(silent));
+
+	// a client that sends its request in time is not affected
+	boost::asio::ip::tcp::socket quick(io);
+	quick.connect(server.endpoint());
+	boost::asio::write(quick, boost::asio::buffer(hello_request));
+	BOOST_CHECK(starts_with(receive_all(quick), "HTTP/1.0 200"));
+
+	nanoweb::admission_counters const counters = server.counters();
+	BOOST_CHECK_EQUAL(2u, counters.accepted);
+	BOOST_CHECK_EQUAL(1u, counters.timed_out);
+}
+
+BOOST_AUTO_TEST_CASE(nanoweb_admission_write_timeout)
+{
+	// far more than the socket buffers can hold, so that the response cannot be written while the client is not
+	// reading
+	std::size_t const body_size = 64 * 1024 * 1024;
+	admission_server server(
+	    nanoweb::admission_limits{4, std::chrono::seconds(10), std::chrono::milliseconds(100)},
+	    [body_size](boost::asio::ip::tcp::socket &client, Si::http::request const &,
+	                Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
+	    {
+		    std::vector<char> const body(body_size, 'x');
+		    nanoweb::quick_final_response(client, yield, "200", "OK", Si::make_memory_range(body));
+		    return nanoweb::request_handler_result::handled;
+		});
+	boost::asio::io_service io;
+	boost::asio::ip::tcp::socket slow(io);
+	slow.connect(server.endpoint());
+	boost::asio::write(slow, boost::asio::buffer(hello_request));
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	BOOST_CHECK_LT(receive_all(slow).size(), body_size);
+	BOOST_CHECK_EQUAL(1u, server.counters().timed_out);
+}
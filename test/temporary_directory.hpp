@@ -0,0 +1,30 @@
+#ifndef BUILDSERVER_TEST_TEMPORARY_DIRECTORY_HPP
+#define BUILDSERVER_TEST_TEMPORARY_DIRECTORY_HPP
+
+#include <boost/filesystem/operations.hpp>
+
+namespace buildserver
+{
+	namespace test
+	{
+		// a new empty directory that is removed with all of its content at the end of the test
+		struct temporary_directory
+		{
+			boost::filesystem::path path;
+
+			temporary_directory()
+			    : path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+			{
+				boost::filesystem::create_directories(path);
+			}
+
+			~temporary_directory()
+			{
+				boost::system::error_code ignored;
+				boost::filesystem::remove_all(path, ignored);
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include <boost/test/unit_test.hpp>
+#include "server/timer_wheel.hpp"
+#include <algorithm>
+#include <limits>
+#include <map>
+
+BOOST_AUTO_TEST_CASE(timer_wheel_expires_at_the_armed_tick)
+{
+	buildserver::timer_wheel wheel;
+	std::map<std::uint64_t, std::vector<std::uint64_t>> expired_at;
+	std::uint64_t now = 0;
+	std::vector<std::uint64_t> const expiries = {0, 1, 63, 64, 65, 4095, 4096, 4097, 300000, 20000000};
+	for (std::uint64_t expiry : expiries)
+	{
+		wheel.arm(expiry, [&expired_at, &now, expiry]()
+		          {
+			          expired_at[expiry].emplace_back(now);
+			      });
+	}
+	BOOST_CHECK_EQUAL(expiries.size(), wheel.armed());
+	// uneven steps, so that every tick is processed by differently sized advances
+	for (std::uint64_t step = 1; now < 20000010; step = (step * 7) % 1000 + 1)
+	{
+		now += step;
+		wheel.advance(now);
+	}
+	BOOST_CHECK_EQUAL(0u, wheel.armed());
+	BOOST_REQUIRE_EQUAL(expiries.size(), expired_at.size());
+	for (std::uint64_t expiry : expiries)
+	{
+		BOOST_REQUIRE_EQUAL(1u, expired_at[expiry].size());
+		std::uint64_t const processed_at = expired_at[expiry][0];
+		// the callback runs while the advance that covers the expiry processes it
+		BOOST_CHECK_GE(processed_at, expiry);
+		BOOST_CHECK_LT(processed_at, expiry + 1000);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(timer_wheel_cancel)
+{
+	buildserver::timer_wheel wheel;
+	std::size_t calls = 0;
+	auto const count = [&calls]()
+	{
+		++calls;
+	};
+	BOOST_CHECK(!wheel.cancel(0));
+	buildserver::timer_wheel::handle const kept = wheel.arm(10, count);
+	buildserver::timer_wheel::handle const cancelled = wheel.arm(10, count);
+	buildserver::timer_wheel::handle const far = wheel.arm(100000, count);
+	BOOST_CHECK(wheel.cancel(cancelled));
+	BOOST_CHECK(!wheel.cancel(cancelled));
+	wheel.advance(9);
+	BOOST_CHECK_EQUAL(0u, calls);
+	wheel.advance(10);
+	BOOST_CHECK_EQUAL(1u, calls);
+	BOOST_CHECK(!wheel.cancel(kept));
+
+	// the entry of the expired timer is reused, but its old handle stays invalid
+	buildserver::timer_wheel::handle const reused = wheel.arm(20, count);
+	BOOST_CHECK(!wheel.cancel(kept));
+	BOOST_CHECK(wheel.cancel(reused));
+	BOOST_CHECK(wheel.cancel(far));
+	BOOST_CHECK_EQUAL(0u, wheel.armed());
+	wheel.advance(200000);
+	BOOST_CHECK_EQUAL(1u, calls);
+}
+
+BOOST_AUTO_TEST_CASE(timer_wheel_rearm_from_callback)
+{
+	buildserver::timer_wheel wheel;
+	std::vector<std::uint64_t> ticks;
+	std::function<void()> repeat;
+	repeat = [&]()
+	{
+		ticks.emplace_back(wheel.next_tick() - 1);
+		if (ticks.size() < 3)
+		{
+			// already processed, so it expires at the following tick
+			wheel.arm(0, repeat);
+		}
+	};
+	wheel.arm(5, repeat);
+	wheel.advance(100);
+	std::vector<std::uint64_t> const expected = {5, 6, 7};
+	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), ticks.begin(), ticks.end());
+}
+
+BOOST_AUTO_TEST_CASE(timer_wheel_next_event)
+{
+	buildserver::timer_wheel wheel;
+	auto const nothing = []()
+	{
+	};
+	BOOST_CHECK_EQUAL((std::numeric_limits<std::uint64_t>::max)(), wheel.next_event());
+	buildserver::timer_wheel::handle const near = wheel.arm(5, nothing);
+	// in level 1 until tick 960
+	wheel.arm(1000, nothing);
+	BOOST_CHECK_EQUAL(5u, wheel.next_event());
+	BOOST_CHECK(wheel.cancel(near));
+	BOOST_CHECK_EQUAL(960u, wheel.next_event());
+	wheel.advance(959);
+	BOOST_CHECK_EQUAL(960u, wheel.next_event());
+	wheel.advance(960);
+	BOOST_CHECK_EQUAL(1000u, wheel.next_event());
+	wheel.advance(1000);
+	BOOST_CHECK_EQUAL(0u, wheel.armed());
+	BOOST_CHECK_EQUAL((std::numeric_limits<std::uint64_t>::max)(), wheel.next_event());
+
+	// moves down one level at a time
+	wheel.arm(300000, nothing);
+	std::vector<std::uint64_t> events;
+	while (wheel.armed() > 0)
+	{
+		events.emplace_back(wheel.next_event());
+		wheel.advance(events.back());
+	}
+	std::vector<std::uint64_t> const expected = {262144, 299008, 299968, 300000};
+	BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), events.begin(), events.end());
+}
+
+BOOST_AUTO_TEST_CASE(timer_wheel_next_event_skips_only_idle_ticks)
+{
+	buildserver::timer_wheel wheel;
+	std::map<std::uint64_t, std::uint64_t> expired_at;
+	std::uint64_t now = 0;
+	std::vector<std::uint64_t> const expiries = {0, 1, 63, 64, 65, 4095, 4096, 4097, 300000, 20000000};
+	for (std::uint64_t expiry : expiries)
+	{
+		wheel.arm(expiry, [&expired_at, &now, expiry]()
+		          {
+			          expired_at[expiry] = now;
+			      });
+	}
+	std::size_t advances = 0;
+	while (wheel.armed() > 0)
+	{
+		now = wheel.next_event();
+		wheel.advance(now);
+		++advances;
+	}
+	BOOST_REQUIRE_EQUAL(expiries.size(), expired_at.size());
+	for (std::uint64_t expiry : expiries)
+	{
+		BOOST_CHECK_EQUAL(expiry, expired_at[expiry]);
+	}
+	BOOST_CHECK_LT(advances, 40u);
+}
+
+BOOST_AUTO_TEST_CASE(steady_timer_wheel_waits_at_least_the_delay)
+{
+	boost::asio::io_service io;
+	buildserver::steady_timer_wheel wheel(io, std::chrono::milliseconds(1));
+	auto const started = buildserver::steady_timer_wheel::clock::now();
+	std::vector<std::chrono::milliseconds> elapsed;
+	for (int delay : {5, 0, 20})
+	{
+		wheel.expires_from_now(std::chrono::milliseconds(delay), [&elapsed, started, delay]()
+		                       {
+			                       auto const waited = buildserver::steady_timer_wheel::clock::now() - started;
+			                       BOOST_CHECK(waited >= std::chrono::milliseconds(delay));
+			                       elapsed.emplace_back(std::chrono::duration_cast<std::chrono::milliseconds>(waited));
+			                   });
+	}
+	buildserver::timer_wheel::handle const cancelled =
+	    wheel.expires_from_now(std::chrono::milliseconds(10), []()
+	                           {
+		                           BOOST_FAIL("a cancelled timer expired");
+		                       });
+	BOOST_CHECK(wheel.cancel(cancelled));
+	io.run();
+	BOOST_CHECK_EQUAL(3u, elapsed.size());
+	BOOST_CHECK(std::is_sorted(elapsed.begin(), elapsed.end()));
+	BOOST_CHECK_EQUAL(0u, wheel.armed());
+}
+
+BOOST_AUTO_TEST_CASE(steady_timer_wheel_sleeps_until_the_next_event)
+{
+	boost::asio::io_service io;
+	buildserver::steady_timer_wheel wheel(io, std::chrono::milliseconds(1));
+	bool expired = false;
+	wheel.expires_from_now(std::chrono::milliseconds(100), [&expired]()
+	                       {
+		                       expired = true;
+		                   });
+	std::size_t const handlers = io.run();
+	BOOST_CHECK(expired);
+	// one wake-up to move the timer to level 0 and one to expire it instead of one per tick
+	BOOST_CHECK_LE(handlers, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(steady_timer_wheel_wakes_up_earlier_for_a_new_timer)
+{
+	boost::asio::io_service io;
+	buildserver::steady_timer_wheel wheel(io, std::chrono::milliseconds(1));
+	auto const started = buildserver::steady_timer_wheel::clock::now();
+	std::vector<std::chrono::milliseconds> elapsed;
+	for (int delay : {1000, 5})
+	{
+		wheel.expires_from_now(std::chrono::milliseconds(delay), [&elapsed, started]()
+		                       {
+			                       elapsed.emplace_back(std::chrono::duration_cast<std::chrono::milliseconds>(
+			                           buildserver::steady_timer_wheel::clock::now() - started));
+			                   });
+	}
+	io.run();
+	BOOST_REQUIRE_EQUAL(2u, elapsed.size());
+	BOOST_CHECK(elapsed[0] < std::chrono::milliseconds(500));
+	BOOST_CHECK(elapsed[1] >= std::chrono::milliseconds(1000));
+}
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+#include "server/trace.hpp"
+#include "server/graph_executor.hpp"
+#include <algorithm>
+#include <string>
+
+namespace
+{
+	bool has_span(std::vector<buildserver::trace_event> const &events, std::string const &name)
+	{
+		return std::any_of(events.begin(), events.end(), [&name](buildserver::trace_event const &event)
+		                   {
+			                   return name == event.name;
+			               });
+	}
+}
+
+BOOST_AUTO_TEST_CASE(trace_span_without_recorder)
+{
+	BOOST_CHECK(!buildserver::current_trace());
+	buildserver::trace_span const span("ignored", "test");
+}
+
+BOOST_AUTO_TEST_CASE(trace_spans_are_nested_and_scoped)
+{
+	buildserver::trace_recorder outer(8);
+	buildserver::trace_recorder inner(8);
+	{
+		buildserver::trace_scope const outer_scope(&outer);
+		buildserver::trace_span const parent("parent", "test");
+		{
+			buildserver::trace_scope const inner_scope(&inner);
+			BOOST_CHECK_EQUAL(&inner, buildserver::current_trace());
+			buildserver::trace_span const elsewhere("elsewhere", "test");
+		}
+		BOOST_CHECK_EQUAL(&outer, buildserver::current_trace());
+		buildserver::trace_span const child("child", "test");
+	}
+	BOOST_CHECK(!buildserver::current_trace());
+
+	std::vector<buildserver::trace_event> const events = outer.events();
+	BOOST_REQUIRE_EQUAL(2u, events.size());
+	// spans are recorded when they end
+	BOOST_CHECK_EQUAL(std::string("child"), events[0].name);
+	BOOST_CHECK_EQUAL(std::string("parent"), events[1].name);
+	BOOST_CHECK_LE(events[1].begin, events[0].begin);
+	BOOST_CHECK_GE(events[1].begin + events[1].duration, events[0].begin + events[0].duration);
+	BOOST_CHECK_EQUAL(events[0].thread, events[1].thread);
+	BOOST_CHECK_EQUAL(1u, inner.events().size());
+}
+
+BOOST_AUTO_TEST_CASE(trace_drops_spans_beyond_capacity)
+{
+	buildserver::trace_recorder trace(2);
+	auto const now = std::chrono::steady_clock::now();
+	for (int i = 0; i < 5; ++i)
+	{
+		trace.record("span", "test", now, now);
+	}
+	BOOST_CHECK_EQUAL(2u, trace.events().size());
+	BOOST_CHECK_EQUAL(3u, trace.dropped());
+}
+
+BOOST_AUTO_TEST_CASE(trace_chrome_format)
+{
+	buildserver::trace_recorder trace(4);
+	auto const now = std::chrono::steady_clock::now();
+	trace.record("a \"quoted\" name", "step", now, now + std::chrono::milliseconds(3));
+	std::vector<char> json;
+	trace.write_chrome_trace(json);
+	std::string const written(json.begin(), json.end());
+	BOOST_CHECK_EQUAL(0u, written.find("{\"traceEvents\":[{\"name\":\"a \\\"quoted\\\" name\",\"cat\":\"step\","
+	                                   "\"ph\":\"X\",\"ts\":"));
+	BOOST_CHECK_NE(std::string::npos, written.find("\"dur\":3000,\"pid\":1,\"tid\":"));
+	BOOST_CHECK_NE(std::string::npos, written.find("],\"droppedEvents\":0}"));
+}
+
+BOOST_AUTO_TEST_CASE(trace_graph_nodes)
+{
+	graph::typed_transformation const tf_traced{graph::atomic_type::uint32, graph::atomic_type::uint32,
+	                                            [](graph::value v)
+	                                            {
+		                                            buildserver::trace_span const span("inside", "test");
+		                                            return v;
+		                                        }};
+	graph::dag g;
+	graph::node_id const first = g.add_node(tf_traced, graph::constant{std::uint32_t(1)}, "first");
+	g.add_node(tf_traced, graph::dependency{first, ""}, "second");
+	graph::work_stealing_pool pool(2);
+	buildserver::trace_recorder trace(16);
+	{
+		buildserver::trace_scope const tracing(&trace);
+		graph::execute(g, pool);
+	}
+	std::vector<buildserver::trace_event> const events = trace.events();
+	BOOST_CHECK_EQUAL(5u, events.size());
+	BOOST_CHECK(has_span(events, "first"));
+	BOOST_CHECK(has_span(events, "second"));
+	BOOST_CHECK(has_span(events, "inside"));
+	BOOST_CHECK(has_span(events, "wait for graph nodes"));
+}
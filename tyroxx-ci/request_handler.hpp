@@ -0,0 +1,429 @@
+#ifndef BUILDSERVER_TYROXX_CI_REQUEST_HANDLER_HPP
+#define BUILDSERVER_TYROXX_CI_REQUEST_HANDLER_HPP
+
+#include "nanoweb/nanoweb.hpp"
+#include "nanoweb/compression.hpp"
+#include "server/build_queue.hpp"
+#include "server/json_writer.hpp"
+#include "server/metrics.hpp"
+#include <silicium/html/generator.hpp>
+#include <silicium/function.hpp>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <memory>
+
+// The HTTP interface of tyroxx-ci: the overview page, logs, traces, status.json, metrics and push notifications.
+// The build workers are not part of it, so that it can be driven without them, for example by benchmark/http_load.
+namespace tyroxx
+{
+	struct push_notification
+	{
+		Si::noexcept_string branch;
+		Si::noexcept_string commit;
+	};
+
+	// The notify callback returns false if the notification has been refused because too many branches are known.
+	template <class YieldContext>
+	nanoweb::request_handler_result handle_notify_request(boost::asio::ip::tcp::socket &client, YieldContext &&yield,
+	                                                      Si::noexcept_string const &path,
+	                                                      Si::noexcept_string const &secret,
+	                                                      Si::function<bool(push_notification)> const &notify)
+	{
+		if (std::string::npos == path.find(secret))
+		{
+			nanoweb::quick_final_response(client, yield, "403", "Forbidden",
+			                              Si::make_c_str_range("the path does not contain the correct secret"));
+			return nanoweb::request_handler_result::handled;
+		}
+
+		push_notification notification;
+		notification.branch = "master";
+		Si::optional<Si::memory_range> const branch =
+		    nanoweb::find_query_parameter(Si::make_memory_range(path), Si::make_c_str_range("branch"));
+		if (branch && !branch->empty())
+		{
+			Si::optional<Si::noexcept_string> decoded = nanoweb::decode_query_value(*branch);
+			if (!decoded || !buildserver::is_valid_branch_name(Si::make_memory_range(*decoded)))
+			{
+				nanoweb::quick_final_response(client, yield, "400", "Bad Request",
+				                              Si::make_c_str_range("the branch is not a valid branch name"));
+				return nanoweb::request_handler_result::handled;
+			}
+			notification.branch = std::move(*decoded);
+		}
+		Si::optional<Si::memory_range> const commit =
+		    nanoweb::find_query_parameter(Si::make_memory_range(path), Si::make_c_str_range("commit"));
+		if (commit && !commit->empty())
+		{
+			if (!buildserver::is_valid_commit(*commit))
+			{
+				nanoweb::quick_final_response(client, yield, "400", "Bad Request",
+				                              Si::make_c_str_range("the commit is not a hexadecimal object name"));
+				return nanoweb::request_handler_result::handled;
+			}
+			notification.commit.assign(commit->begin(), commit->end());
+		}
+		if (!notify(std::move(notification)))
+		{
+			nanoweb::quick_final_response(client, yield, "503", "Service Unavailable",
+			                              Si::make_c_str_range("the server does not accept any more branches"));
+			return nanoweb::request_handler_result::handled;
+		}
+
+		nanoweb::quick_final_response(client, yield, "200", "OK",
+		                              Si::make_c_str_range("the server has been successfully notified"));
+		return nanoweb::request_handler_result::handled;
+	}
+
+	enum class build_result
+	{
+		success,
+		failure
+	};
+
+	struct step_history
+	{
+		bool is_building = false;
+		Si::optional<build_result> last_result;
+		std::shared_ptr<nanoweb::precompressed_content const> last_log;
+
+		// the spans of the last build in the Chrome trace event format
+		std::shared_ptr<nanoweb::precompressed_content const> last_trace;
+
+		// the registry version of the last change of this step
+		std::uint64_t changed_in_version = 0;
+	};
+
+	template <class CharSink, class StepRange>
+	void render_overview_page(CharSink &&rendered, StepRange &&steps)
+	{
+		auto doc = Si::html::make_generator(std::forward<CharSink>(rendered));
+		doc("html", [&]
+		    {
+			    doc("head", [&]
+			        {
+				        doc("title", [&]
+				            {
+					            doc.write("buildserver overview");
+					        });
+				    });
+			    doc("body", [&]
+			        {
+				        doc("h1", [&]
+				            {
+					            doc.write("Overview");
+					        });
+				        doc("table",
+				            [&]
+				            {
+					            doc.attribute("border", "1");
+					        },
+				            [&]
+				            {
+					            for (auto &&step : steps)
+					            {
+						            doc("tr", [&]
+						                {
+							                doc("td", [&]
+							                    {
+								                    doc.write(step.first);
+								                });
+							                step_history const &history = step.second;
+							                doc("td", [&]
+							                    {
+								                    doc.write(history.is_building ? "building.." : "idle");
+								                });
+							                doc("td", [&]
+							                    {
+								                    if (!history.last_result)
+								                    {
+									                    doc.write("not built");
+									                    return;
+								                    }
+								                    doc.write("last build ");
+								                    switch (*history.last_result)
+								                    {
+								                    case build_result::success:
+									                    doc.write("succeeded");
+									                    break;
+								                    case build_result::failure:
+									                    doc.write("failed");
+									                    break;
+								                    }
+								                });
+							            });
+					            }
+					        });
+				    });
+			});
+	}
+
+	struct step_history_registry
+	{
+		std::map<Si::noexcept_string, step_history> name_to_step;
+
+		// incremented on every change so that rendered pages can be cached until the next change and so that clients
+		// can ask for the changes since a version they already know
+		std::uint64_t version = 0;
+
+		// distinguishes the version numbers of this process from those of a previous run of the server
+		std::uint64_t instance =
+		    static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+
+		// the version that removed a step most recently, because the changes since an older version cannot express
+		// the removal
+		std::uint64_t removed_in_version = 0;
+
+		step_history &changed(Si::noexcept_string const &name)
+		{
+			step_history &step = name_to_step[name];
+			step.changed_in_version = ++version;
+			return step;
+		}
+
+		void forget(Si::noexcept_string const &name)
+		{
+			if (name_to_step.erase(name))
+			{
+				removed_in_version = ++version;
+			}
+		}
+	};
+
+	// A full snapshot if since is zero, otherwise only the steps that changed after version since.
+	inline void render_status_json(std::vector<char> &rendered, step_history_registry const &registry,
+	                               std::uint64_t since)
+	{
+		buildserver::json_writer json(rendered);
+		json.begin_object();
+		json.key(Si::make_c_str_range("instance"));
+		json.number(registry.instance);
+		json.key(Si::make_c_str_range("version"));
+		json.number(registry.version);
+		json.key(Si::make_c_str_range("since"));
+		json.number(since);
+		json.key(Si::make_c_str_range("steps"));
+		json.begin_object();
+		for (auto const &step : registry.name_to_step)
+		{
+			step_history const &history = step.second;
+			if (history.changed_in_version <= since)
+			{
+				continue;
+			}
+			json.key(Si::make_memory_range(step.first));
+			json.begin_object();
+			json.key(Si::make_c_str_range("changed"));
+			json.number(history.changed_in_version);
+			json.key(Si::make_c_str_range("building"));
+			json.boolean(history.is_building);
+			json.key(Si::make_c_str_range("last_result"));
+			if (history.last_result)
+			{
+				switch (*history.last_result)
+				{
+				case build_result::success:
+					json.string(Si::make_c_str_range("success"));
+					break;
+				case build_result::failure:
+					json.string(Si::make_c_str_range("failure"));
+					break;
+				}
+			}
+			else
+			{
+				json.null();
+			}
+			json.key(Si::make_c_str_range("has_log"));
+			json.boolean(!!history.last_log);
+			json.key(Si::make_c_str_range("has_trace"));
+			json.boolean(!!history.last_trace);
+			json.end_object();
+		}
+		json.end_object();
+		json.end_object();
+	}
+
+	// Keeps serialization buffers with their capacity between requests. A buffer cannot be shared directly because a
+	// coroutine writing a response can be suspended while another request is being answered.
+	struct buffer_pool
+	{
+		std::vector<char> take()
+		{
+			if (m_free.empty())
+			{
+				std::vector<char> fresh;
+				fresh.reserve(4096);
+				return fresh;
+			}
+			std::vector<char> reused = std::move(m_free.back());
+			m_free.pop_back();
+			return reused;
+		}
+
+		void give_back(std::vector<char> buffer)
+		{
+			buffer.clear();
+			m_free.emplace_back(std::move(buffer));
+		}
+
+	private:
+		std::vector<std::vector<char>> m_free;
+	};
+
+	// 0 if the parameter is missing, is not a decimal number or does not fit into 64 bits
+	inline std::uint64_t parse_query_number(Si::noexcept_string const &path, char const *name)
+	{
+		Si::optional<Si::memory_range> const value =
+		    nanoweb::find_query_parameter(Si::make_memory_range(path), Si::make_c_str_range(name));
+		if (!value)
+		{
+			return 0;
+		}
+		std::uint64_t result = 0;
+		for (char const digit : *value)
+		{
+			if (digit < '0' || digit > '9')
+			{
+				return 0;
+			}
+			std::uint64_t const digit_value = static_cast<std::uint64_t>(digit - '0');
+			if (result > ((std::numeric_limits<std::uint64_t>::max)() - digit_value) / 10)
+			{
+				return 0;
+			}
+			result = result * 10 + digit_value;
+		}
+		return result;
+	}
+
+	// branch names can contain slashes
+	inline Si::noexcept_string join_path(Si::iterator_range<Si::memory_range const *> segments)
+	{
+		Si::noexcept_string name;
+		for (Si::memory_range const &segment : segments)
+		{
+			if (!name.empty())
+			{
+				name += '/';
+			}
+			name.append(segment.begin(), segment.end());
+		}
+		return name;
+	}
+
+	inline nanoweb::request_handler make_root_request_handler(Si::noexcept_string const &secret,
+	                                                          Si::function<bool(push_notification)> const &notify_,
+	                                                          step_history_registry const &registry)
+	{
+		auto overview = std::make_shared<nanoweb::versioned_representation>();
+		auto full_status = std::make_shared<nanoweb::versioned_representation>();
+		auto status_buffers = std::make_shared<buffer_pool>();
+		auto handle_request = nanoweb::make_directory(
+		    {{Si::make_c_str_range(""),
+		      nanoweb::request_handler(
+		          [&registry, overview](boost::asio::ip::tcp::socket &client, Si::http::request const &request,
+		                                Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
+		          {
+			          std::shared_ptr<nanoweb::precompressed_content const> const page =
+			              overview->get(registry.version, [&registry]()
+			                            {
+				                            std::vector<char> content;
+				                            render_overview_page(Si::make_container_sink(content),
+				                                                 registry.name_to_step);
+				                            return nanoweb::precompress("text/html; charset=utf-8", std::move(content));
+				                        });
+			          nanoweb::quick_final_response(client, yield, "200", "OK", request, *page);
+			          return nanoweb::request_handler_result::handled;
+			      })},
+		     {Si::make_c_str_range("log"),
+		      nanoweb::request_handler(
+		          [&registry](boost::asio::ip::tcp::socket &client, Si::http::request const &request,
+		                      Si::iterator_range<Si::memory_range const *> remaining_path, Si::spawn_context yield)
+		          {
+			          auto const step = registry.name_to_step.find(join_path(remaining_path));
+			          if ((step == registry.name_to_step.end()) || !step->second.last_log)
+			          {
+				          return nanoweb::request_handler_result::not_found;
+			          }
+			          std::shared_ptr<nanoweb::precompressed_content const> const log = step->second.last_log;
+			          nanoweb::quick_final_response(client, yield, "200", "OK", request, *log);
+			          return nanoweb::request_handler_result::handled;
+			      })},
+		     {Si::make_c_str_range("trace"),
+		      nanoweb::request_handler(
+		          [&registry](boost::asio::ip::tcp::socket &client, Si::http::request const &request,
+		                      Si::iterator_range<Si::memory_range const *> remaining_path, Si::spawn_context yield)
+		          {
+			          // can be loaded into chrome://tracing or ui.perfetto.dev
+			          auto const step = registry.name_to_step.find(join_path(remaining_path));
+			          if ((step == registry.name_to_step.end()) || !step->second.last_trace)
+			          {
+				          return nanoweb::request_handler_result::not_found;
+			          }
+			          std::shared_ptr<nanoweb::precompressed_content const> const trace = step->second.last_trace;
+			          nanoweb::quick_final_response(client, yield, "200", "OK", request, *trace);
+			          return nanoweb::request_handler_result::handled;
+			      })},
+		     {Si::make_c_str_range("status.json"),
+		      nanoweb::request_handler(
+		          [&registry, full_status, status_buffers](boost::asio::ip::tcp::socket &client,
+		                                                   Si::http::request const &request,
+		                                                   Si::iterator_range<Si::memory_range const *>,
+		                                                   Si::spawn_context yield)
+		          {
+			          // /status.json?instance=I&since=N answers with the steps that changed after version N
+			          std::uint64_t since = parse_query_number(request.path, "since");
+			          if ((parse_query_number(request.path, "instance") != registry.instance) ||
+			              (since > registry.version) || (since < registry.removed_in_version))
+			          {
+				          since = 0;
+			          }
+			          if (since == 0)
+			          {
+				          std::shared_ptr<nanoweb::precompressed_content const> const snapshot =
+				              full_status->get(registry.version, [&registry]()
+				                               {
+					                               std::vector<char> content;
+					                               render_status_json(content, registry, 0);
+					                               return nanoweb::precompress("application/json", std::move(content));
+					                           });
+				          nanoweb::quick_final_response(client, yield, "200", "OK", request, *snapshot);
+				          return nanoweb::request_handler_result::handled;
+			          }
+			          std::vector<char> content = status_buffers->take();
+			          render_status_json(content, registry, since);
+			          nanoweb::quick_final_response(client, yield, "200", "OK",
+			                                        Si::make_c_str_range("application/json"),
+			                                        Si::make_memory_range(content));
+			          status_buffers->give_back(std::move(content));
+			          return nanoweb::request_handler_result::handled;
+			      })},
+		     {Si::make_c_str_range("metrics"),
+		      nanoweb::request_handler(
+		          [status_buffers](boost::asio::ip::tcp::socket &client, Si::http::request const &,
+		                           Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
+		          {
+			          std::vector<char> content = status_buffers->take();
+			          buildserver::metrics::render_prometheus(content);
+			          nanoweb::quick_final_response(client, yield, "200", "OK",
+			                                        Si::make_c_str_range("text/plain; version=0.0.4"),
+			                                        Si::make_memory_range(content));
+			          status_buffers->give_back(std::move(content));
+			          return nanoweb::request_handler_result::handled;
+			      })},
+		     {Si::make_c_str_range("notify"),
+		      nanoweb::request_handler(
+		          [&secret, notify_](boost::asio::ip::tcp::socket &client, Si::http::request const &request,
+		                             Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
+		          {
+			          return handle_notify_request(client, yield, request.path, secret, notify_);
+			      })}});
+		return handle_request;
+	}
+}
+
+#endif
@@ -1,8 +1,12 @@
-#include "nanoweb/nanoweb.hpp"
+#include "tyroxx-ci/request_handler.hpp"
+#include "nanoweb/admission.hpp"
 #include "server/find_cmake.hpp"
 #include "server/find_executable.hpp"
 #include "server/find_git.hpp"
 #include "server/cmake.hpp"
+#include "server/build_queue.hpp"
+#include "server/metrics.hpp"
+#include "server/trace.hpp"
 #include <silicium/asio/tcp_acceptor.hpp>
 #include <silicium/asio/writing_observable.hpp>
 #include <silicium/asio/posting_observable.hpp>
@@ -17,193 +21,35 @@
 #include <silicium/variant.hpp>
 #include <silicium/std_threading.hpp>
 #include <ventura/run_process.hpp>
-#include <silicium/html/generator.hpp>
 #include <ventura/async_process.hpp>
 #include <ventura/absolute_path.hpp>
 #include <ventura/path_segment.hpp>
 #include <ventura/file_operations.hpp>
 #include <boost/program_options.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 #include <boost/range/algorithm/equal.hpp>
 #include <boost/thread.hpp>
 #include <unordered_map>
 #include <functional>
+#include <chrono>
 #include <iostream>
 
 namespace
 {
-	struct notification
-	{
-	};
-
-	template <class Observer>
-	struct saturating_notifier
-	{
-		typedef notification element_type;
-
-		template <class ActualObserver>
-		void async_get_one(ActualObserver &&observer)
-		{
-			return Si::visit<void>(m_observer_or_notification,
-			                       [this, &observer](Observer &my_observer) mutable
-			                       {
-				                       assert(!my_observer.get());
-				                       my_observer = Observer(observer);
-				                   },
-			                       [this, &observer](notification)
-			                       {
-				                       m_observer_or_notification = Observer();
-				                       std::move(observer).got_element(notification());
-				                   });
-		}
-
-		void notify()
-		{
-			Si::visit<void>(m_observer_or_notification,
-			                [this](Observer &observer)
-			                {
-				                if (observer.get())
-				                {
-					                Si::exchange(observer, Observer()).got_element(notification());
-				                }
-				                else
-				                {
-					                m_observer_or_notification = notification();
-				                }
-				            },
-			                [](notification const &)
-			                {
-				            });
-		}
-
-	private:
-		Si::variant<Observer, notification> m_observer_or_notification;
-	};
-
-	template <class YieldContext>
-	nanoweb::request_handler_result handle_notify_request(boost::asio::ip::tcp::socket &client, YieldContext &&yield,
-	                                       Si::noexcept_string const &path, Si::noexcept_string const &secret,
-	                                       Si::function<void()> const &notify)
-	{
-		if (std::string::npos == path.find(secret))
-		{
-			nanoweb::quick_final_response(client, yield, "403", "Forbidden",
-			                              Si::make_c_str_range("the path does not contain the correct secret"));
-			return nanoweb::request_handler_result::handled;
-		}
-
-		notify();
-
-		nanoweb::quick_final_response(client, yield, "200", "OK",
-		                              Si::make_c_str_range("the server has been successfully notified"));
-		return nanoweb::request_handler_result::handled;
-	}
-
-	enum class build_result
-	{
-		success,
-		failure
-	};
-
-	struct step_history
-	{
-		bool is_building = false;
-		Si::optional<build_result> last_result;
-	};
-
-	template <class CharSink, class StepRange>
-	void render_overview_page(CharSink &&rendered, StepRange &&steps)
-	{
-		auto doc = Si::html::make_generator(std::forward<CharSink>(rendered));
-		doc("html", [&]
-		    {
-			    doc("head", [&]
-			        {
-				        doc("title", [&]
-				            {
-					            doc.write("buildserver overview");
-					        });
-				    });
-			    doc("body", [&]
-			        {
-				        doc("h1", [&]
-				            {
-					            doc.write("Overview");
-					        });
-				        doc("table",
-				            [&]
-				            {
-					            doc.attribute("border", "1");
-					        },
-				            [&]
-				            {
-					            for (auto &&step : steps)
-					            {
-						            doc("tr", [&]
-						                {
-							                doc("td", [&]
-							                    {
-								                    doc.write(step.first);
-								                });
-							                step_history const &history = step.second;
-							                doc("td", [&]
-							                    {
-								                    doc.write(history.is_building ? "building.." : "idle");
-								                });
-							                doc("td", [&]
-							                    {
-								                    if (!history.last_result)
-								                    {
-									                    doc.write("not built");
-									                    return;
-								                    }
-								                    doc.write("last build ");
-								                    switch (*history.last_result)
-								                    {
-								                    case build_result::success:
-									                    doc.write("succeeded");
-									                    break;
-								                    case build_result::failure:
-									                    doc.write("failed");
-									                    break;
-								                    }
-								                });
-							            });
-					            }
-					        });
-				    });
-			});
-	}
-
-	struct step_history_registry
-	{
-		std::map<Si::noexcept_string, step_history> name_to_step;
-	};
-
-	nanoweb::request_handler make_root_request_handler(Si::noexcept_string const &secret,
-	                                                   Si::function<void()> const &notify_,
-	                                                   step_history_registry const &registry)
-	{
-		auto handle_request = nanoweb::make_directory(
-		    {{Si::make_c_str_range(""),
-		      nanoweb::request_handler(
-		          [&registry](boost::asio::ip::tcp::socket &client, Si::http::request const &,
-		                      Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
-		          {
-			          std::vector<char> content;
-			          render_overview_page(Si::make_container_sink(content), registry.name_to_step);
-			          nanoweb::quick_final_response(client, yield, "200", "OK", Si::make_memory_range(content));
-			          return nanoweb::request_handler_result::handled;
-			      })},
-		     {Si::make_c_str_range("notify"),
-		      nanoweb::request_handler(
-		          [&secret, notify_](boost::asio::ip::tcp::socket &client, Si::http::request const &request,
-		                               Si::iterator_range<Si::memory_range const *>, Si::spawn_context yield)
-		          {
-			          return handle_notify_request(client, yield, request.path, secret, notify_);
-			      })}});
-		return handle_request;
-	}
+	using tyroxx::build_result;
+	using tyroxx::push_notification;
+	using tyroxx::step_history;
+	using tyroxx::step_history_registry;
+
+	buildserver::metrics::histogram process_duration("buildserver_process_duration_seconds",
+	                                                 "Lifetime of git and test processes");
+	buildserver::metrics::histogram test_duration("buildserver_test_duration_seconds", "Duration of unit test runs");
+	buildserver::metrics::histogram build_duration("buildserver_build_duration_seconds",
+	                                               "Duration of complete builds from clone to test");
+	buildserver::metrics::counter builds_failed("buildserver_builds_failed_total", "Builds that did not succeed");
+	buildserver::metrics::gauge build_queue_depth("buildserver_build_queue_depth",
+	                                              "Builds waiting for a worker, one per branch at most");
 
 	typedef Si::os_string git_repository_address;
 
@@ -213,12 +59,22 @@ namespace
 		boost::uint16_t port;
 		Si::noexcept_string secret;
 		ventura::absolute_path workspace;
+		unsigned build_workers;
+		std::size_t max_connections;
+		unsigned read_timeout;
+		unsigned write_timeout;
+		std::size_t max_branches;
 	};
 
 	boost::optional<options> parse_options(int argc, char **argv)
 	{
 		options result;
 		result.port = 8080;
+		result.build_workers = 1;
+		result.max_connections = 256;
+		result.read_timeout = 10;
+		result.write_timeout = 60;
+		result.max_branches = 100;
 
 		boost::program_options::options_description desc("Allowed options");
 		desc.add_options()("help", "produce help message")("repository,r", boost::program_options::
@@ -232,7 +88,18 @@ namespace
 		    "port,p", boost::program_options::value(&result.port), "port to listen on for POSTed push notifications")(
 		    "secret,s", boost::program_options::value(&result.secret),
 		    "a string that needs to be in the query for the notification to be accepted")(
-		    "workspace,w", boost::program_options::value(&result.workspace), "");
+		    "workspace,w", boost::program_options::value(&result.workspace), "")(
+		    "workers", boost::program_options::value(&result.build_workers),
+		    "how many branches can be built at the same time")(
+		    "max-connections", boost::program_options::value(&result.max_connections),
+		    "HTTP clients beyond this number get a 503 response immediately")(
+		    "read-timeout", boost::program_options::value(&result.read_timeout),
+		    "seconds an HTTP client has to send its request before it is disconnected")(
+		    "write-timeout", boost::program_options::value(&result.write_timeout),
+		    "seconds an HTTP client has to receive the response before it is disconnected")(
+		    "max-branches", boost::program_options::value(&result.max_branches),
+		    "notifications for further branches are refused, branches that do not exist are forgotten after the first "
+		    "attempt to build them");
 
 		boost::program_options::positional_options_description positional;
 		positional.add("repository", 1);
@@ -273,11 +140,27 @@ namespace
 			return boost::none;
 		}
 
+		if (result.max_connections == 0)
+		{
+			std::cerr << "At least one HTTP connection has to be allowed\n";
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
+		if (result.build_workers == 0)
+		{
+			std::cerr << "At least one build worker is required\n";
+			std::cerr << desc << "\n";
+			return boost::none;
+		}
+
 		return std::move(result);
 	}
 
 	int run_process(ventura::async_process_parameters const &parameters, Si::Sink<char, Si::success>::interface &output)
 	{
+		buildserver::metrics::processes_spawned().add();
+		buildserver::metrics::scoped_duration const timing(process_duration);
 		Si::pipe standard_output_and_error = Si::make_pipe().move_value();
 		Si::file_handle standard_input =
 		    ventura::open_reading(Si::native_path_string(SILICIUM_SYSTEM_LITERAL("/dev/null"))).move_value();
@@ -295,6 +178,7 @@ namespace
 		ventura::experimental::read_from_anonymous_pipe(io, Si::ref_sink(output),
 		                                                std::move(standard_output_and_error.read), stopped_polling);
 		standard_output_and_error.write.close();
+		buildserver::trace_span const waiting("wait for process", "wait");
 		io.run();
 		int exit_code = process.wait_for_exit().get();
 		return exit_code;
@@ -304,6 +188,7 @@ namespace
 	               ventura::path_segment const &clone_name, ventura::absolute_path const &git_exe,
 	               Si::Sink<char, Si::success>::interface &output)
 	{
+		buildserver::trace_span const span("git_clone", "step");
 		ventura::async_process_parameters parameters;
 		parameters.executable = git_exe;
 		parameters.current_path = destination;
@@ -317,8 +202,51 @@ namespace
 		}
 	}
 
+	struct unknown_revision : std::runtime_error
+	{
+		explicit unknown_revision(Si::noexcept_string const &revision)
+		    : std::runtime_error(("the repository does not contain the commit " + revision).c_str())
+		{
+		}
+	};
+
+	// The revision has been validated as a branch name or a commit already. Appending ^{commit} makes sure that git
+	// cannot interpret it as anything but a commit.
+	void git_checkout(ventura::absolute_path const &repository, Si::noexcept_string const &revision,
+	                  ventura::absolute_path const &git_exe, Si::Sink<char, Si::success>::interface &output)
+	{
+		buildserver::trace_span const span("git_checkout", "step");
+		Si::noexcept_string const commit = revision + "^{commit}";
+		{
+			ventura::async_process_parameters parameters;
+			parameters.executable = git_exe;
+			parameters.current_path = repository;
+			parameters.arguments.emplace_back(Si::to_os_string("rev-parse"));
+			parameters.arguments.emplace_back(Si::to_os_string("--verify"));
+			parameters.arguments.emplace_back(Si::to_os_string("--quiet"));
+			parameters.arguments.emplace_back(Si::to_os_string(commit));
+			if (run_process(parameters, output) != 0)
+			{
+				throw unknown_revision(revision);
+			}
+		}
+		ventura::async_process_parameters parameters;
+		parameters.executable = git_exe;
+		parameters.current_path = repository;
+		parameters.arguments.emplace_back(Si::to_os_string("checkout"));
+		parameters.arguments.emplace_back(Si::to_os_string("--detach"));
+		parameters.arguments.emplace_back(Si::to_os_string(commit));
+		int exit_code = run_process(parameters, output);
+		if (exit_code != 0)
+		{
+			throw std::runtime_error("git-checkout failed");
+		}
+	}
+
 	build_result run_test(ventura::absolute_path const &build_dir, Si::Sink<char, Si::success>::interface &output)
 	{
+		buildserver::metrics::scoped_duration const timing(test_duration);
+		buildserver::trace_span const span("run_test", "step");
 		ventura::absolute_path const test_dir = build_dir / "test";
 		ventura::absolute_path const test_exe = test_dir / "unit_test";
 		ventura::async_process_parameters parameters;
@@ -335,13 +263,33 @@ namespace
 		}
 	}
 
-	build_result build(git_repository_address const &repository, ventura::absolute_path const &workspace,
+	// writes the build output to the console and keeps a copy for the log page
+	struct build_log_sink
+	{
+		typedef char element_type;
+		typedef Si::success error_type;
+
+		std::vector<char> *log;
+
+		error_type append(Si::iterator_range<char const *> data)
+		{
+			log->insert(log->end(), data.begin(), data.end());
+			std::cerr.write(data.begin(), static_cast<std::streamsize>(data.size()));
+			return {};
+		}
+	};
+
+	build_result build(buildserver::build_request const &request, ventura::absolute_path const &workspace,
 	                   ventura::absolute_path const &git, ventura::absolute_path const &cmake,
 	                   Si::Sink<char, Si::success>::interface &output)
 	{
+		buildserver::metrics::scoped_duration const timing(build_duration);
+		buildserver::trace_span const span("build", "build");
 		ventura::path_segment const clone_name = *ventura::path_segment::create("source.git");
-		git_clone(repository, workspace, clone_name, git, output);
+		git_clone(request.key.repository, workspace, clone_name, git, output);
 		ventura::absolute_path const source = workspace / clone_name;
+		// the clone has a local branch for the default branch only
+		git_checkout(source, request.commit.empty() ? ("origin/" + request.key.branch) : request.commit, git, output);
 
 		ventura::absolute_path const build = workspace / "build";
 		ventura::create_directories(build, Si::throw_);
@@ -367,73 +315,151 @@ namespace
 	{
 		boost::asio::io_service io;
 
-		saturating_notifier<Si::erased_observer<notification>> notifier;
+		buildserver::build_queue<Si::erased_observer<buildserver::build_request>> queue;
 		step_history_registry registry;
 
-		nanoweb::request_handler root_request_handler =
-			make_root_request_handler(options.secret, [&notifier] { notifier.notify(); }, registry);
+		nanoweb::request_handler root_request_handler = make_root_request_handler(
+		    options.secret,
+		    [&queue, &registry, &options](push_notification notification)
+		    {
+			    // every new branch adds an entry to the registry that stays there
+			    if ((registry.name_to_step.size() >= options.max_branches) &&
+			        (registry.name_to_step.count(notification.branch) == 0))
+			    {
+				    std::cerr << "Refused a notification for a new branch because too many branches are known\n";
+				    return false;
+			    }
+			    // make the branch visible on the overview page before its first build starts
+			    registry.changed(notification.branch);
+			    if (!queue.push(buildserver::build_key{options.repository, std::move(notification.branch)},
+			                    std::move(notification.commit)))
+			    {
+				    std::cerr << "Coalesced a notification with an already pending build\n";
+			    }
+			    build_queue_depth.set(static_cast<std::int64_t>(queue.pending().size()));
+			    return true;
+			},
+		    registry);
+		nanoweb::admission_control admission(
+		    nanoweb::admission_limits{options.max_connections, std::chrono::seconds(options.read_timeout),
+		                              std::chrono::seconds(options.write_timeout)});
 		Si::spawn_observable(Si::transform(
-			Si::asio::make_tcp_acceptor(boost::asio::ip::tcp::acceptor(
-				io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::any(), options.port))),
-			[&root_request_handler](Si::asio::tcp_acceptor_result maybe_client) -> Si::nothing
-		{
-			std::shared_ptr<boost::asio::ip::tcp::socket> client = maybe_client.get();
-			Si::spawn_coroutine([client, &root_request_handler](Si::spawn_context yield)
-			{
-				boost::system::error_code const error = nanoweb::serve_client(*client, yield, root_request_handler);
-				if (!!error)
-				{
-					std::cerr << client->remote_endpoint().address() << ": " << error << '\n';
-				}
-			});
-			return{};
-		}));
-
-		registry.name_to_step["silicium"] = step_history();
-
-		for (auto &step : registry.name_to_step)
+		    Si::asio::make_tcp_acceptor(boost::asio::ip::tcp::acceptor(
+		        io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::any(), options.port))),
+		    [&root_request_handler, &admission](Si::asio::tcp_acceptor_result maybe_client) -> Si::nothing
+		    {
+			    std::shared_ptr<boost::asio::ip::tcp::socket> client = maybe_client.get();
+			    admission.admit(std::move(client), root_request_handler,
+			                    [](boost::asio::ip::tcp::socket &client, boost::system::error_code error)
+			                    {
+				                    boost::system::error_code ignored;
+				                    std::cerr << client.remote_endpoint(ignored).address() << ": " << error << '\n';
+				                });
+			    return {};
+			}));
+
+		for (unsigned worker = 0; worker < options.build_workers; ++worker)
 		{
-			step_history &history = step.second;
-			Si::spawn_coroutine(
-				[&history, &notifier, &io, &options, &git, &cmake](Si::spawn_context yield)
-			{
-				Si::optional<notification> notification_ = yield.get_one(Si::ref(notifier));
-				assert(notification_);
-				std::cerr << "Received a notification\n";
-				try
-				{
-					history.is_building = true;
-					Si::optional<std::future<build_result>> maybe_result =
-						yield.get_one(Si::asio::make_posting_observable(
-							io, Si::make_thread_observable<Si::std_threading>(
-								[&]()
-					{
-						ventura::recreate_directories(options.workspace, Si::throw_);
-						auto output = Si::virtualize_sink(Si::ostream_ref_sink(std::cerr));
-						return build(options.repository, options.workspace, git,
-							cmake, output);
-					})));
-					assert(maybe_result);
-					auto const result = maybe_result->get();
-					switch (result)
-					{
-					case build_result::success:
-						std::cerr << "Build success\n";
-						break;
-
-					case build_result::failure:
-						std::cerr << "Build failure\n";
-						break;
-					}
-					history.last_result = result;
-				}
-				catch (std::exception const &ex)
-				{
-					std::cerr << "Exception: " << ex.what() << '\n';
-					history.last_result = build_result::failure;
-				}
-				history.is_building = false;
-			});
+			// every worker has its own workspace so that different branches can be built at the same time
+			ventura::absolute_path const workspace =
+			    options.workspace / *ventura::path_segment::create("worker" + boost::lexical_cast<std::string>(worker));
+			Si::spawn_coroutine([&queue, &registry, &io, &git, &cmake, workspace](Si::spawn_context yield)
+			                    {
+				                    for (;;)
+				                    {
+					                    Si::optional<buildserver::build_request> request = yield.get_one(Si::ref(queue));
+					                    assert(request);
+					                    build_queue_depth.set(static_cast<std::int64_t>(queue.pending().size()));
+					                    std::cerr << "Building branch " << request->key.branch << '\n';
+					                    Si::noexcept_string const &branch = request->key.branch;
+					                    step_history &history = registry.name_to_step[branch];
+					                    bool const never_built = !history.last_result;
+					                    bool revision_unknown = false;
+					                    try
+					                    {
+						                    history.is_building = true;
+						                    registry.changed(branch);
+						                    std::shared_ptr<nanoweb::precompressed_content const> compressed_log;
+						                    std::shared_ptr<nanoweb::precompressed_content const> compressed_trace;
+						                    Si::optional<std::future<build_result>> maybe_result =
+						                        yield.get_one(Si::asio::make_posting_observable(
+						                            io, Si::make_thread_observable<Si::std_threading>(
+						                                    [&]() -> build_result
+						                                    {
+							                                    std::vector<char> log;
+							                                    auto output = Si::virtualize_sink(build_log_sink{&log});
+							                                    build_result result = build_result::failure;
+							                                    buildserver::trace_recorder trace(16 * 1024);
+							                                    try
+							                                    {
+								                                    ventura::recreate_directories(workspace,
+								                                                                  Si::throw_);
+								                                    buildserver::trace_scope const tracing(&trace);
+								                                    result =
+								                                        build(*request, workspace, git, cmake, output);
+							                                    }
+							                                    catch (unknown_revision const &ex)
+							                                    {
+								                                    revision_unknown = true;
+								                                    std::string const message =
+								                                        std::string(ex.what()) + '\n';
+								                                    output.append(Si::make_memory_range(message));
+							                                    }
+							                                    catch (std::exception const &ex)
+							                                    {
+								                                    std::string const message =
+								                                        std::string("Exception: ") + ex.what() + '\n';
+								                                    output.append(Si::make_memory_range(message));
+							                                    }
+							                                    // a finished log never changes, so it is compressed
+							                                    // once here instead of for every request
+							                                    compressed_log = nanoweb::precompress(
+							                                        "text/plain; charset=utf-8", std::move(log),
+							                                        Z_BEST_COMPRESSION);
+							                                    std::vector<char> trace_json;
+							                                    trace.write_chrome_trace(trace_json);
+							                                    compressed_trace = nanoweb::precompress(
+							                                        "application/json", std::move(trace_json));
+							                                    return result;
+							                                })));
+						                    assert(maybe_result);
+						                    auto const result = maybe_result->get();
+						                    switch (result)
+						                    {
+						                    case build_result::success:
+							                    std::cerr << "Build success\n";
+							                    break;
+
+						                    case build_result::failure:
+							                    std::cerr << "Build failure\n";
+							                    break;
+						                    }
+						                    history.last_result = result;
+						                    history.last_log = std::move(compressed_log);
+						                    history.last_trace = std::move(compressed_trace);
+					                    }
+					                    catch (std::exception const &ex)
+					                    {
+						                    std::cerr << "Exception: " << ex.what() << '\n';
+						                    history.last_result = build_result::failure;
+					                    }
+					                    if (!history.last_result || (*history.last_result != build_result::success))
+					                    {
+						                    builds_failed.add();
+					                    }
+					                    if (revision_unknown && never_built)
+					                    {
+						                    // most likely a mistyped branch, which would take one of the places of
+						                    // --max-branches forever
+						                    registry.forget(branch);
+						                    queue.finish(request->key);
+						                    continue;
+					                    }
+					                    history.is_building = false;
+					                    registry.changed(branch);
+					                    queue.finish(request->key);
+				                    }
+				                });
 		}
 
 		io.run();